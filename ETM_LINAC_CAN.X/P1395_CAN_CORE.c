@@ -0,0 +1,644 @@
+#include "P1395_CAN_CORE.h"
+
+/*
+  Core CAN routines that are written in C.
+  
+  The latency timing, the bit timing solver and the transmit scheduler are always built.
+
+  The buffer routines are the C version of P1395_CAN_CORE.s.  They are only built when __P1395_CAN_CORE_C is defined (it
+  must be defined for both the compiler and the assembler so that P1395_CAN_CORE.s is left out).  The buffer layout and
+  the results are identical to the assembly version, so either one can be linked with P1395_CAN_MASTER.c /
+  P1395_CAN_SLAVE.c.  ETM_LINAC_CAN_SIM/P1395_CAN_CORE_CHECK.c (make core_check) runs the two side by side.
+
+  Buffer ownership
+  Every ETMCanBuffer has exactly one producer and one consumer. (ISR -> main loop for RX buffers, main loop ->
+  ISR for the TX buffer)
+   - The producer is the only writer of message_write_index, message_write_count, message_overwrite_count and
+     message_high_water.  The other side asks for the high water mark to be cleared with message_high_water_clear.
+   - The consumer is the only writer of message_read_index
+   - The producer fills the row before it stores the new message_write_index.
+   - The consumer copies the row out before it stores the new message_read_index.
+  The indexes are single words, so each store is atomic and neither side needs to disable the CAN interrupt.
+  All index and row accesses go through volatile pointers so the compiler can not move the row copy across the index
+  update.
+*/
+
+void ETMCanTimingInitialize(ETMCanTiming* timing_ptr, volatile unsigned int* timer_address, ETMCanTimerFlag timer_flag, unsigned int timer_period, unsigned long fcy) {
+  unsigned long counts_per_ms;
+  unsigned long count_ns;
+
+  timing_ptr->timer = timer_address;
+  timing_ptr->timer_flag = timer_flag;
+  timing_ptr->time_base = 0;
+  timing_ptr->time_base_next = timer_period + 1;
+
+  // Convert the bin limits to timer counts (the timer counts at Fcy/256)
+  counts_per_ms = (fcy >> 8) / 1000;
+  timing_ptr->bin_limit[0] = (counts_per_ms * ETM_CAN_LATENCY_BIN_0_US) / 1000;
+  timing_ptr->bin_limit[1] = (counts_per_ms * ETM_CAN_LATENCY_BIN_1_US) / 1000;
+  timing_ptr->bin_limit[2] = (counts_per_ms * ETM_CAN_LATENCY_BIN_2_US) / 1000;
+
+  ETMCanTimingClear(timing_ptr);
+
+  count_ns = 0xFFFF;
+  if (fcy >= 1000) {
+    count_ns = 256000000 / (fcy / 1000);
+  }
+  if (count_ns > 0xFFFF) {
+    count_ns = 0xFFFF;
+  }
+  timing_ptr->data.timer_count_ns = count_ns;
+  timing_ptr->data.timer_period = timer_period;
+}
+
+
+void ETMCanTimingClear(ETMCanTiming* timing_ptr) {
+  unsigned int n;
+  unsigned int bin;
+
+  for (n = 0; n < ETM_CAN_TX_CLASSES; n++) {
+    for (bin = 0; bin < ETM_CAN_LATENCY_BINS; bin++) {
+      timing_ptr->data.tx_histogram[n][bin] = 0;
+    }
+    timing_ptr->data.tx_max[n] = 0;
+    timing_ptr->data.tx_buffer_max[n] = 0;
+  }
+  for (bin = 0; bin < ETM_CAN_LATENCY_BINS; bin++) {
+    timing_ptr->data.rx_histogram[bin] = 0;
+  }
+  timing_ptr->data.rx_max = 0;
+  timing_ptr->data.rx_isr_max = 0;
+}
+
+
+unsigned int ETMCanTimingRollover(ETMCanTiming* timing_ptr) {
+  if (!timing_ptr->timer_flag(0)) {
+    return 0;
+  }
+
+  /*
+    ETMCanTimingNow() uses time_base_next while TxIF is set and time_base once it is clear.  Moving time_base before TxIF
+    is cleared and time_base_next after means that every step gives the right time if the CAN interrupt runs in between.
+  */
+  timing_ptr->time_base = timing_ptr->time_base_next;
+  timing_ptr->timer_flag(1);
+  timing_ptr->time_base_next = timing_ptr->time_base + timing_ptr->data.timer_period + 1;
+  return 1;
+}
+
+
+unsigned int ETMCanTimingNow(ETMCanTiming* timing_ptr) {
+  unsigned int count;
+
+  if (timing_ptr->timer_flag(0)) {
+    // The timer has been reset, the main loop has not moved the time base yet
+    return (timing_ptr->time_base_next + *timing_ptr->timer);
+  }
+  count = *timing_ptr->timer;
+  if (timing_ptr->timer_flag(0)) {
+    // The timer was reset after TxIF was read, count may be from before the reset
+    return (timing_ptr->time_base_next + *timing_ptr->timer);
+  }
+  return (timing_ptr->time_base + count);
+}
+
+
+static unsigned int ETMCanTimingElapsed(ETMCanTiming* timing_ptr, unsigned int time_stamp) {
+  unsigned int elapsed;
+
+  elapsed = (ETMCanTimingNow(timing_ptr) - time_stamp) & 0xFFFF;
+  if (elapsed & 0x8000) {
+    // Too long to measure, or the time went backwards because the main loop missed a timer period
+    elapsed = 0xFFFF;
+  }
+  return elapsed;
+}
+
+
+static void ETMCanTimingRecord(ETMCanTiming* timing_ptr, unsigned int* histogram_ptr, unsigned int* max_ptr, unsigned int latency) {
+  unsigned int bin;
+
+  bin = 0;
+  while ((bin < (ETM_CAN_LATENCY_BINS - 1)) && (latency > timing_ptr->bin_limit[bin])) {
+    bin++;
+  }
+  histogram_ptr[bin]++;
+  if (latency > *max_ptr) {
+    *max_ptr = latency;
+  }
+}
+
+
+void ETMCanTimeStampNextMessage(ETMCanTiming* timing_ptr, ETMCanBuffer* buffer_ptr) {
+  // The row at message_write_index is not visible to the consumer until the producer stores the next write index
+  buffer_ptr->message_time_stamp[buffer_ptr->message_write_index] = ETMCanTimingNow(timing_ptr);
+}
+
+
+void ETMCanTimingRecordRX(ETMCanTiming* timing_ptr, ETMCanBuffer* buffer_ptr, ETMCanMessage* message_ptr) {
+  ETMCanTimingRecord(timing_ptr, timing_ptr->data.rx_histogram, &timing_ptr->data.rx_max,
+		     ETMCanTimingElapsed(timing_ptr, buffer_ptr->message_time_stamp[message_ptr - buffer_ptr->message_data]));
+}
+
+
+void ETMCanTimingRecordISR(ETMCanTiming* timing_ptr, unsigned int isr_time) {
+  unsigned int latency;
+
+  // The RX histogram belongs to the main loop, only the maximum is kept for these frames
+  latency = ETMCanTimingElapsed(timing_ptr, isr_time);
+  if (latency > timing_ptr->data.rx_isr_max) {
+    timing_ptr->data.rx_isr_max = latency;
+  }
+}
+
+
+static unsigned int ETMCanBitTimingPhase2(unsigned int tq, unsigned int sample_point) {
+  unsigned int phase2;
+
+  // Place the sample point, Phase 2 must be 2-8 TQ and no longer than Propagation + Phase 1 which is 16 TQ at most
+  phase2 = tq - ((tq * (unsigned long)sample_point + 500) / 1000);
+  if ((phase2 < 2) || (phase2 > tq)) {
+    phase2 = 2;
+  }
+  if (phase2 > 8) {
+    phase2 = 8;
+  }
+  if ((tq - 1 - phase2) > 16) {
+    phase2 = tq - 17;
+  }
+  if (phase2 > ((tq - 1) >> 1)) {
+    phase2 = (tq - 1) >> 1;
+  }
+  return phase2;
+}
+
+
+static unsigned int ETMCanBitTimingSamplePoint(unsigned int tq, unsigned int phase2) {
+  return ((unsigned long)(tq - phase2) * 1000 + (tq >> 1)) / tq;
+}
+
+
+unsigned int ETMCanBitTimingSolve(ETMCanBitTiming* timing_ptr, unsigned long fcy, unsigned long bit_rate, unsigned int sample_point) {
+  unsigned long tq_rate;
+  unsigned long actual_rate;
+  unsigned long error;
+  unsigned long best_error;
+  unsigned long best_rate;
+  unsigned int brp;
+  unsigned int best_brp;
+  unsigned int tq;
+  unsigned int best_tq;
+  unsigned int sample_error;
+  unsigned int best_sample_error;
+  unsigned int tq_distance;
+  unsigned int best_tq_distance;
+  unsigned int tseg1;
+  unsigned int phase1;
+  unsigned int phase2;
+  unsigned int sjw;
+
+  best_tq = 0;
+  best_brp = 0;
+  best_rate = 0;
+  best_error = 0;
+  best_sample_error = 0;
+  best_tq_distance = 0;
+  if (bit_rate) {
+    for (brp = 0; brp <= ETM_CAN_BRP_MAX; brp++) {
+      // TQ = 2 x (BRP + 1) / Fcan with Fcan = 4 x Fcy
+      tq_rate = (fcy << 1) / (brp + 1);
+      tq = (tq_rate + (bit_rate >> 1)) / bit_rate;
+      if (tq > ETM_CAN_TQ_PER_BIT_MAX) {
+	continue;
+      }
+      if (tq < ETM_CAN_TQ_PER_BIT_MIN) {
+	// Every larger prescaler has even fewer TQ per bit
+	break;
+      }
+      actual_rate = tq_rate / tq;
+      if (actual_rate > bit_rate) {
+	error = actual_rate - bit_rate;
+      } else {
+	error = bit_rate - actual_rate;
+      }
+      sample_error = ETMCanBitTimingSamplePoint(tq, ETMCanBitTimingPhase2(tq, sample_point));
+      if (sample_error > sample_point) {
+	sample_error -= sample_point;
+      } else {
+	sample_error = sample_point - sample_error;
+      }
+      if (tq > ETM_CAN_TQ_PER_BIT_PREFERRED) {
+	tq_distance = tq - ETM_CAN_TQ_PER_BIT_PREFERRED;
+      } else {
+	tq_distance = ETM_CAN_TQ_PER_BIT_PREFERRED - tq;
+      }
+      // Smallest bit rate error first, then the closest sample point, then the closest to ETM_CAN_TQ_PER_BIT_PREFERRED
+      if ((best_tq == 0) || (error < best_error) ||
+	  ((error == best_error) && (sample_error < best_sample_error)) ||
+	  ((error == best_error) && (sample_error == best_sample_error) && (tq_distance < best_tq_distance))) {
+	best_error = error;
+	best_sample_error = sample_error;
+	best_tq_distance = tq_distance;
+	best_brp = brp;
+	best_tq = tq;
+	best_rate = actual_rate;
+      }
+    }
+  }
+
+  if ((best_tq == 0) || ((best_error * 1000) > (bit_rate * ETM_CAN_BIT_RATE_TOLERANCE))) {
+    // There is no setting for this bit rate at this Fcy
+    timing_ptr->cfg1 = 0;
+    timing_ptr->cfg2 = 0;
+    timing_ptr->tq_per_bit = 0;
+    timing_ptr->sample_point = 0;
+    timing_ptr->bit_rate = 0;
+    return 1;
+  }
+
+  phase2 = ETMCanBitTimingPhase2(best_tq, sample_point);
+  tseg1 = best_tq - 1 - phase2;
+  // Phase 1 gets the extra TQ when the split is odd (the fixed 12 TQ timing used Propagation 3, Phase 1 4)
+  phase1 = tseg1 - (tseg1 >> 1);
+
+  sjw = ETM_CAN_SYNC_JUMP_WIDTH;
+  if (sjw > phase2) {
+    sjw = phase2;
+  }
+  if (sjw > 4) {
+    sjw = 4;
+  }
+  if (sjw == 0) {
+    sjw = 1;
+  }
+
+  timing_ptr->cfg1 = ((sjw - 1) << 6) | best_brp;
+  // SEG2PH, SEG2PHTS = 1 (Phase 2 is programmable), SAM = 0 (single sample), SEG1PH, PRSEG
+  timing_ptr->cfg2 = ((phase2 - 1) << 8) | 0x0080 | ((phase1 - 1) << 3) | (tseg1 - phase1 - 1);
+  timing_ptr->tq_per_bit = best_tq;
+  timing_ptr->sample_point = ETMCanBitTimingSamplePoint(best_tq, phase2);
+  timing_ptr->bit_rate = best_rate;
+  return 0;
+}
+
+
+void ETMCanTXSchedulerInitialize(ETMCanTXScheduler* scheduler_ptr, volatile unsigned int* tx0_con_address, volatile unsigned int* tx1_con_address,
+				 volatile unsigned int* tx2_con_address, unsigned int* load_count_ptr, ETMCanTiming* timing_ptr) {
+  unsigned int n;
+
+  scheduler_ptr->mailbox[0] = tx0_con_address;
+  scheduler_ptr->mailbox[1] = tx1_con_address;
+  scheduler_ptr->mailbox[2] = tx2_con_address;
+  for (n = 0; n < ETM_CAN_TX_MAILBOXES; n++) {
+    scheduler_ptr->mailbox_class[n] = ETM_CAN_TX_CLASSES;
+  }
+
+  scheduler_ptr->mailbox_load_count = load_count_ptr;
+  scheduler_ptr->timing = timing_ptr;
+}
+
+
+void ETMCanTXSchedulerAddMessage(ETMCanTXScheduler* scheduler_ptr, unsigned int tx_class, ETMCanMessage* message_ptr) {
+  ETMCanTimeStampNextMessage(scheduler_ptr->timing, scheduler_ptr->queue[tx_class]);
+  ETMCanAddMessageToBuffer(scheduler_ptr->queue[tx_class], message_ptr);
+}
+
+
+void ETMCanTXSchedulerService(ETMCanTXScheduler* scheduler_ptr) {
+  unsigned int mailbox;
+  unsigned int tx_class;
+  unsigned int last_class;
+  unsigned int classes_loaded;
+  unsigned int latency;
+  ETMCanBuffer* queue_ptr;
+  ETMCanTiming* timing_ptr;
+
+  timing_ptr = scheduler_ptr->timing;
+
+  // Find the classes that are still waiting to transmit, these can not be loaded again until they are sent
+  // Record the latency of every TX buffer that has been sent since the last call
+  classes_loaded = 0;
+  for (mailbox = 0; mailbox < ETM_CAN_TX_MAILBOXES; mailbox++) {
+    tx_class = scheduler_ptr->mailbox_class[mailbox];
+    if (*scheduler_ptr->mailbox[mailbox] & TX_REQ_BIT) {
+      classes_loaded |= (1 << tx_class);
+    } else if (tx_class < ETM_CAN_TX_CLASSES) {
+      ETMCanTimingRecord(timing_ptr, timing_ptr->data.tx_histogram[tx_class], &timing_ptr->data.tx_max[tx_class],
+			 ETMCanTimingElapsed(timing_ptr, scheduler_ptr->mailbox_queue_time[mailbox]));
+      latency = ETMCanTimingElapsed(timing_ptr, scheduler_ptr->mailbox_load_time[mailbox]);
+      if (latency > timing_ptr->data.tx_buffer_max[tx_class]) {
+	timing_ptr->data.tx_buffer_max[tx_class] = latency;
+      }
+      scheduler_ptr->mailbox_class[mailbox] = ETM_CAN_TX_CLASSES;
+    }
+  }
+  
+  // Start with TX2 so that high priority messages go to the reserved TX buffer first
+  mailbox = ETM_CAN_TX_MAILBOXES;
+  while (mailbox) {
+    mailbox--;
+    if (*scheduler_ptr->mailbox[mailbox] & TX_REQ_BIT) {
+      // This TX buffer is waiting to transmit, leave it alone
+      continue;
+    }
+
+    last_class = ETM_CAN_TX_CLASS_LOG;
+    if (mailbox == ETM_CAN_TX_MAILBOX_RESERVED) {
+      last_class = ETM_CAN_TX_CLASS_STATUS_SYNC;
+    }
+
+    for (tx_class = 0; tx_class <= last_class; tx_class++) {
+      queue_ptr = scheduler_ptr->queue[tx_class];
+      if ((queue_ptr == 0) || (classes_loaded & (1 << tx_class)) || !ETMCanBufferNotEmpty(queue_ptr)) {
+	continue;
+      }
+      // Set the TX buffer priority from the class (TXPRI = 3 for pulse level -> 0 for logging) and load the message
+      scheduler_ptr->mailbox_queue_time[mailbox] = queue_ptr->message_time_stamp[queue_ptr->message_read_index];
+      scheduler_ptr->mailbox_load_time[mailbox] = ETMCanTimingNow(timing_ptr);
+      *scheduler_ptr->mailbox[mailbox] = (*scheduler_ptr->mailbox[mailbox] & 0xFFFC) | (ETM_CAN_TX_CLASS_LOG - tx_class);
+      ETMCanTXMessageBuffer(queue_ptr, scheduler_ptr->mailbox[mailbox]);
+      scheduler_ptr->mailbox_class[mailbox] = tx_class;
+      classes_loaded |= (1 << tx_class);
+      scheduler_ptr->mailbox_load_count[mailbox]++;
+      break;
+    }
+  }
+}
+
+
+void ETMCanBufferClearHighWater(ETMCanBuffer* buffer_ptr) {
+  volatile ETMCanBuffer* volatile_ptr = buffer_ptr;
+  volatile_ptr->message_high_water_clear = 1;
+}
+
+
+#ifdef __P1395_CAN_CORE_C
+
+#define ETM_CAN_ERROR_IDENTIFIER     0b0001011111111000      // Returned when there is no data, same as error_identifier in P1395_CAN_CORE.s
+
+// Offsets (in words) of the CAN SFRs from the CxTXxCON / CxRXxCON register
+#define ETM_CAN_CON_TO_SID           7
+#define ETM_CAN_SID_TO_DATA          3
+
+
+unsigned int ETMCanBufferRowsAvailable(ETMCanBuffer* buffer_ptr) {
+  volatile ETMCanBuffer* volatile_ptr = buffer_ptr;
+  return ((volatile_ptr->message_read_index - volatile_ptr->message_write_index - 1) & volatile_ptr->message_index_mask);
+}
+
+
+unsigned int ETMCanBufferNotEmpty(ETMCanBuffer* buffer_ptr) {
+  volatile ETMCanBuffer* volatile_ptr = buffer_ptr;
+  return ((volatile_ptr->message_write_index - volatile_ptr->message_read_index) & volatile_ptr->message_index_mask);
+}
+
+
+void ETMCanRXMessageBuffer(ETMCanBuffer* buffer_ptr, volatile unsigned int* rx_data_address) {
+  volatile ETMCanBuffer* volatile_ptr = buffer_ptr;
+  volatile ETMCanMessage* row_ptr;
+  volatile unsigned int* sfr_ptr;
+  unsigned int write_index;
+  unsigned int read_index;
+  unsigned int index_mask;
+  unsigned int rows_in_use;
+
+  if (!(*rx_data_address & BUFFER_FULL_BIT)) {
+    // The RX buffer is empty
+    return;
+  }
+
+  volatile_ptr->message_write_count++;
+  index_mask = volatile_ptr->message_index_mask;
+  write_index = volatile_ptr->message_write_index;
+  read_index = volatile_ptr->message_read_index;
+  if (((write_index + 1) & index_mask) == read_index) {
+    // The message buffer is full, the message is discarded
+    volatile_ptr->message_overwrite_count++;
+  } else {
+    sfr_ptr = rx_data_address - ETM_CAN_CON_TO_SID;
+    row_ptr = volatile_ptr->message_data + write_index;
+    row_ptr->identifier = *sfr_ptr;
+    sfr_ptr += ETM_CAN_SID_TO_DATA;
+    row_ptr->word0 = *sfr_ptr++;
+    row_ptr->word1 = *sfr_ptr++;
+    row_ptr->word2 = *sfr_ptr++;
+    row_ptr->word3 = *sfr_ptr;
+    volatile_ptr->message_write_index = (write_index + 1) & index_mask;
+
+    rows_in_use = (write_index + 1 - read_index) & index_mask;
+    if (volatile_ptr->message_high_water_clear) {
+      volatile_ptr->message_high_water = rows_in_use;
+      volatile_ptr->message_high_water_clear = 0;
+    } else if (rows_in_use > volatile_ptr->message_high_water) {
+      volatile_ptr->message_high_water = rows_in_use;
+    }
+  }
+
+  // Clear the RX Buffer full status bit
+  *rx_data_address &= ~BUFFER_FULL_BIT;
+}
+
+
+void ETMCanRXMessage(ETMCanMessage* message_ptr, volatile unsigned int* rx_register_address) {
+  volatile unsigned int* sfr_ptr;
+
+  if (!(*rx_register_address & BUFFER_FULL_BIT)) {
+    // The RX buffer is empty, return the error identifier and zero data
+    message_ptr->identifier = ETM_CAN_ERROR_IDENTIFIER;
+    message_ptr->word0 = 0;
+    message_ptr->word1 = 0;
+    message_ptr->word2 = 0;
+    message_ptr->word3 = 0;
+    return;
+  }
+
+  sfr_ptr = rx_register_address - ETM_CAN_CON_TO_SID;
+  message_ptr->identifier = *sfr_ptr;
+  sfr_ptr += ETM_CAN_SID_TO_DATA;
+  message_ptr->word0 = *sfr_ptr++;
+  message_ptr->word1 = *sfr_ptr++;
+  message_ptr->word2 = *sfr_ptr++;
+  message_ptr->word3 = *sfr_ptr;
+
+  // Clear the RX Buffer full status bit
+  *rx_register_address &= ~BUFFER_FULL_BIT;
+}
+
+
+void ETMCanAddMessageToBuffer(ETMCanBuffer* buffer_ptr, ETMCanMessage* message_ptr) {
+  volatile ETMCanBuffer* volatile_ptr = buffer_ptr;
+  volatile ETMCanMessage* row_ptr;
+  unsigned int write_index;
+  unsigned int read_index;
+  unsigned int index_mask;
+  unsigned int rows_in_use;
+
+  volatile_ptr->message_write_count++;
+  index_mask = volatile_ptr->message_index_mask;
+  write_index = volatile_ptr->message_write_index;
+  read_index = volatile_ptr->message_read_index;
+  if (((write_index + 1) & index_mask) == read_index) {
+    // The message buffer is full, the message is discarded
+    volatile_ptr->message_overwrite_count++;
+    return;
+  }
+
+  row_ptr = volatile_ptr->message_data + write_index;
+  row_ptr->identifier = message_ptr->identifier;
+  row_ptr->word0 = message_ptr->word0;
+  row_ptr->word1 = message_ptr->word1;
+  row_ptr->word2 = message_ptr->word2;
+  row_ptr->word3 = message_ptr->word3;
+  volatile_ptr->message_write_index = (write_index + 1) & index_mask;
+
+  rows_in_use = (write_index + 1 - read_index) & index_mask;
+  if (volatile_ptr->message_high_water_clear) {
+    volatile_ptr->message_high_water = rows_in_use;
+    volatile_ptr->message_high_water_clear = 0;
+  } else if (rows_in_use > volatile_ptr->message_high_water) {
+    volatile_ptr->message_high_water = rows_in_use;
+  }
+}
+
+
+void ETMCanReadMessageFromBuffer(ETMCanBuffer* buffer_ptr, ETMCanMessage* message_ptr) {
+  volatile ETMCanBuffer* volatile_ptr = buffer_ptr;
+  volatile ETMCanMessage* row_ptr;
+  unsigned int read_index;
+
+  read_index = volatile_ptr->message_read_index;
+  if (read_index == volatile_ptr->message_write_index) {
+    // The message buffer is empty, return the error identifier and zero data
+    message_ptr->identifier = ETM_CAN_ERROR_IDENTIFIER;
+    message_ptr->word0 = 0;
+    message_ptr->word1 = 0;
+    message_ptr->word2 = 0;
+    message_ptr->word3 = 0;
+    return;
+  }
+
+  row_ptr = volatile_ptr->message_data + read_index;
+  message_ptr->identifier = row_ptr->identifier;
+  message_ptr->word0 = row_ptr->word0;
+  message_ptr->word1 = row_ptr->word1;
+  message_ptr->word2 = row_ptr->word2;
+  message_ptr->word3 = row_ptr->word3;
+  volatile_ptr->message_read_index = (read_index + 1) & volatile_ptr->message_index_mask;
+}
+
+
+unsigned int ETMCanReadMessagesFromBuffer(ETMCanBuffer* buffer_ptr, ETMCanMessage* message_ptr, unsigned int max_messages) {
+  volatile ETMCanBuffer* volatile_ptr = buffer_ptr;
+  volatile ETMCanMessage* row_ptr;
+  unsigned int read_index;
+  unsigned int write_index;
+  unsigned int index_mask;
+  unsigned int messages;
+
+  index_mask = volatile_ptr->message_index_mask;
+  read_index = volatile_ptr->message_read_index;
+  write_index = volatile_ptr->message_write_index;
+  messages = 0;
+  
+  while ((messages < max_messages) && (read_index != write_index)) {
+    row_ptr = volatile_ptr->message_data + read_index;
+    message_ptr->identifier = row_ptr->identifier;
+    message_ptr->word0 = row_ptr->word0;
+    message_ptr->word1 = row_ptr->word1;
+    message_ptr->word2 = row_ptr->word2;
+    message_ptr->word3 = row_ptr->word3;
+    message_ptr++;
+    read_index = (read_index + 1) & index_mask;
+    messages++;
+  }
+
+  volatile_ptr->message_read_index = read_index;
+  return messages;
+}
+
+
+unsigned int ETMCanBufferPeek(ETMCanBuffer* buffer_ptr, ETMCanMessage** message_ptr) {
+  volatile ETMCanBuffer* volatile_ptr = buffer_ptr;
+  unsigned int read_index;
+  unsigned int write_index;
+
+  read_index = volatile_ptr->message_read_index;
+  write_index = volatile_ptr->message_write_index;
+  *message_ptr = volatile_ptr->message_data + read_index;
+
+  if (write_index >= read_index) {
+    return (write_index - read_index);
+  }
+  // The stored messages wrap around the end of the buffer, return the messages up to the end
+  return (volatile_ptr->message_index_mask + 1 - read_index);
+}
+
+
+void ETMCanBufferCommit(ETMCanBuffer* buffer_ptr, unsigned int messages) {
+  volatile ETMCanBuffer* volatile_ptr = buffer_ptr;
+  volatile_ptr->message_read_index = (volatile_ptr->message_read_index + messages) & volatile_ptr->message_index_mask;
+}
+
+
+void ETMCanTXMessageBuffer(ETMCanBuffer* buffer_ptr, volatile unsigned int* tx_register_address) {
+  volatile ETMCanBuffer* volatile_ptr = buffer_ptr;
+  volatile ETMCanMessage* row_ptr;
+  volatile unsigned int* sfr_ptr;
+  unsigned int read_index;
+
+  if (*tx_register_address & TX_REQ_BIT) {
+    // The TX buffer is still waiting to transmit
+    return;
+  }
+
+  read_index = volatile_ptr->message_read_index;
+  if (read_index == volatile_ptr->message_write_index) {
+    // The message buffer is empty
+    return;
+  }
+
+  row_ptr = volatile_ptr->message_data + read_index;
+  sfr_ptr = tx_register_address - ETM_CAN_CON_TO_SID;
+  *sfr_ptr = row_ptr->identifier;
+  sfr_ptr += ETM_CAN_SID_TO_DATA;
+  *sfr_ptr++ = row_ptr->word0;
+  *sfr_ptr++ = row_ptr->word1;
+  *sfr_ptr++ = row_ptr->word2;
+  *sfr_ptr = row_ptr->word3;
+
+  // Queue Transmission
+  *tx_register_address |= TX_REQ_BIT;
+
+  volatile_ptr->message_read_index = (read_index + 1) & volatile_ptr->message_index_mask;
+}
+
+
+void ETMCanTXMessage(ETMCanMessage* message_ptr, volatile unsigned int* tx_register_address) {
+  volatile unsigned int* sfr_ptr;
+
+  // Clear the transmit bit before we modify transmit data, this will abort ongoing transmissions
+  *tx_register_address &= ~TX_REQ_BIT;
+
+  sfr_ptr = tx_register_address - ETM_CAN_CON_TO_SID;
+  *sfr_ptr = message_ptr->identifier;
+  sfr_ptr += ETM_CAN_SID_TO_DATA;
+  *sfr_ptr++ = message_ptr->word0;
+  *sfr_ptr++ = message_ptr->word1;
+  *sfr_ptr++ = message_ptr->word2;
+  *sfr_ptr = message_ptr->word3;
+
+  // Queue Transmission
+  *tx_register_address |= TX_REQ_BIT;
+}
+
+
+void ETMCanBufferInitialize(ETMCanBuffer* buffer_ptr) {
+  volatile ETMCanBuffer* volatile_ptr = buffer_ptr;
+  volatile_ptr->message_write_index = 0;
+  volatile_ptr->message_read_index = 0;
+  volatile_ptr->message_write_count = 0;
+  volatile_ptr->message_overwrite_count = 0;
+  volatile_ptr->message_high_water = 0;
+}
+
+#endif
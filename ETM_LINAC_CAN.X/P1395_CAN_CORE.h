@@ -120,7 +120,7 @@ typedef struct {
   unsigned st_spare_3:1;
   unsigned st_spare_2:1;
   unsigned st_spare_1:1;
-  unsigned st_spare_0:1;
+  unsigned st_can_bit_timing:1;  // Set if ETMCanBitTimingSolve() failed, the CAN module was left in configuration mode
 } ETMCanSelfTestRegister;
 
 
@@ -174,7 +174,7 @@ typedef struct {
   unsigned int reset_count;     // This counts the number of processor resets since cleared by the user
   unsigned int RCON_value;      // The current value of RCON
   unsigned int reserved_1;
-  unsigned int reserved_0;
+  unsigned int can_buf_high_water; // high byte - tx log buffer (tx message buffer on the ECB), low byte - rx message buffer (rx data log buffer on the ECB)
 
   // Board Debug Data - 0x25
   // DPARKER are there better things we could be storing?
@@ -204,7 +204,7 @@ typedef struct {
   unsigned sync_B_pulse_sync_standby_led_on:1;
   unsigned sync_C_pulse_sync_ready_led_on:1;
   unsigned sync_D_pulse_sync_fault_led_on:1;
-  unsigned sync_E_unused:1;
+  unsigned sync_E_debug_boards_selected:1;
   unsigned sync_F_clear_debug_data:1;
 } ETMCanSyncControlWord;
 
@@ -212,9 +212,15 @@ typedef struct {
 typedef struct {
   ETMCanSyncControlWord sync_0_control_word;
   unsigned int sync_1_ecb_state_for_fault_logic;
-  unsigned int sync_2;
+  unsigned int sync_2_debug_boards;           // One bit per board address, boards that send their debugging registers
   unsigned int sync_3;
 } ETMCanSyncMessage;
+/*
+  Debugging registers (DEFAULT_DEBUG_x, DEFAULT_CAN_ERROR_x, DEFAULT_SYSTEM_ERROR_x and DEFAULT_CAN_TIMING_x) are only
+  sent by a slave while its bit is set in sync_2_debug_boards.  The ECB sets the bits of the boards it is mirroring.
+  This only applies while sync_E_debug_boards_selected is set in the sync control word.  An ECB that does not set it
+  (older ECB firmware) does not fill in sync_2_debug_boards, and every slave sends its debugging registers as before.
+*/
 
 
 // Public Variables
@@ -232,13 +238,39 @@ typedef struct {
 } ETMCanMessage;
 
 
+/*
+  The buffer routines are implemented in P1395_CAN_CORE.s
+  Define __P1395_CAN_CORE_C (for both the C compiler and the assembler) to use the portable version in P1395_CAN_CORE.c
+  instead.  Both use this structure and behave the same way.
+
+  Each buffer has one producer and one consumer (the CAN ISR and the main loop).
+  Only the producer writes message_write_index, message_write_count, message_overwrite_count and message_high_water.
+  Only the consumer writes message_read_index.
+  The high water mark is cleared with ETMCanBufferClearHighWater, this sets message_high_water_clear and the producer
+  restarts message_high_water from the rows in use the next time it stores a message.
+
+  A buffer must be declared with ETM_CAN_MESSAGE_BUFFER(name, depth), this sets the depth and the storage at compile time.
+  The depth must be a power of 2 (4 -> 256).  One row is always left empty, so a buffer holds (depth - 1) messages.
+  (This type was ETMCanMessageBuffer when the buffer was declared directly, the name was changed so that a direct
+  declaration, which would have no storage, does not compile)
+*/
 typedef struct {
   unsigned int message_write_index;
   unsigned int message_read_index;
   unsigned int message_write_count;
   unsigned int message_overwrite_count;
-  ETMCanMessage message_data[16];
-} ETMCanMessageBuffer;
+  unsigned int message_high_water;        // The most rows that have been in use at once
+  unsigned int message_index_mask;        // depth - 1, this is fixed when the buffer is declared
+  ETMCanMessage* message_data;            // Points to the (depth) rows of message storage
+  volatile unsigned int* message_time_stamp; // Points to the (depth) time stamps, one for each row (see Latency Timing)
+  unsigned int message_high_water_clear;  // Set by the consumer to ask the producer to clear message_high_water
+} ETMCanBuffer;
+
+#define ETM_CAN_MESSAGE_BUFFER(name, depth)				\
+  typedef char name##_depth_must_be_a_power_of_2[(((depth) >= 4) && ((depth) <= 256) && (((depth) & ((depth) - 1)) == 0)) ? 1 : -1]; \
+  ETMCanMessage name##_data[depth];					\
+  unsigned int name##_time_stamp[depth];				\
+  ETMCanBuffer name = {0, 0, 0, 0, 0, ((depth) - 1), name##_data, name##_time_stamp, 0}
 
 
 void ETMCanRXMessage(ETMCanMessage* message_ptr, volatile unsigned int* rx_register_address);
@@ -250,7 +282,7 @@ void ETMCanRXMessage(ETMCanMessage* message_ptr, volatile unsigned int* rx_regis
 */
 
 
-void ETMCanRXMessageBuffer(ETMCanMessageBuffer* buffer_ptr, volatile unsigned int* rx_data_address);
+void ETMCanRXMessageBuffer(ETMCanBuffer* buffer_ptr, volatile unsigned int* rx_data_address);
 /*
   This stores the data selected by rx_data_address (C1RX0CON,C1RX1CON,C2RX0CON,C2RX1CON) into the next available slot in the selected buffer.
   If the message buffer is full the data in the RX buffer is discarded.
@@ -265,11 +297,12 @@ void ETMCanTXMessage(ETMCanMessage* message_ptr, volatile unsigned int* tx_regis
   This moves the message data to the TX register indicated by tx_register_address (C1TX0CON, C1TX1CON, C1TX2CON)
   If the TX register is not empty, the data will be overwritten.
   Also sets the transmit bit to queue transmission
+  This must not be used on a TX buffer that is owned by the transmit scheduler
   see ETM_CAN_UTILITY.s
 */
 
 
-void ETMCanTXMessageBuffer(ETMCanMessageBuffer* buffer_ptr, volatile unsigned int* tx_register_address);
+void ETMCanTXMessageBuffer(ETMCanBuffer* buffer_ptr, volatile unsigned int* tx_register_address);
 /*
   This moves the oldest message in the buffer to to the TX register indicated by tx_register_address (C1TX0CON, C1TX1CON, C1TX2CON)
   If the TX register is not empty, no data will be transfered and the message buffer state will remain unchanged
@@ -279,7 +312,7 @@ void ETMCanTXMessageBuffer(ETMCanMessageBuffer* buffer_ptr, volatile unsigned in
 */
 
 
-void ETMCanAddMessageToBuffer(ETMCanMessageBuffer* buffer_ptr, ETMCanMessage* message_ptr);
+void ETMCanAddMessageToBuffer(ETMCanBuffer* buffer_ptr, ETMCanMessage* message_ptr);
 /*
   This adds a message to the buffer
   If the buffer is full the data is discarded.
@@ -287,7 +320,7 @@ void ETMCanAddMessageToBuffer(ETMCanMessageBuffer* buffer_ptr, ETMCanMessage* me
 */
 
 
-void ETMCanReadMessageFromBuffer(ETMCanMessageBuffer* buffer_ptr, ETMCanMessage* message_ptr);
+void ETMCanReadMessageFromBuffer(ETMCanBuffer* buffer_ptr, ETMCanMessage* message_ptr);
 /*
   This moves the oldest message in the buffer to the message_ptr
   If the buffer is empty it returns the error identifier (0b0000111000000000) and fills the data with Zeros.
@@ -295,21 +328,56 @@ void ETMCanReadMessageFromBuffer(ETMCanMessageBuffer* buffer_ptr, ETMCanMessage*
 */
 
 
-void ETMCanBufferInitialize(ETMCanMessageBuffer* buffer_ptr);
+unsigned int ETMCanReadMessagesFromBuffer(ETMCanBuffer* buffer_ptr, ETMCanMessage* message_ptr, unsigned int max_messages);
+/*
+  This moves up to max_messages of the oldest messages in the buffer to the array at message_ptr
+  Returns the number of messages that were moved (0 if the buffer is empty)
+  The read index is only updated once, after all of the messages have been copied
+  see ETM_CAN_UTILITY.s
+*/
+
+
+unsigned int ETMCanBufferPeek(ETMCanBuffer* buffer_ptr, ETMCanMessage** message_ptr);
+/*
+  This gives the consumer direct access to the oldest messages in the buffer without copying them
+  *message_ptr is set to the oldest message.  Returns the number of messages that are stored in order from there (0 if
+  the buffer is empty).  This stops at the end of the buffer storage, call again after ETMCanBufferCommit to get the rest.
+  The messages stay in the buffer (and can not be overwritten by the producer) until they are released with ETMCanBufferCommit
+  see ETM_CAN_UTILITY.s
+*/
+
+
+void ETMCanBufferCommit(ETMCanBuffer* buffer_ptr, unsigned int messages);
+/*
+  This releases the oldest (messages) messages in the buffer after they have been processed in place
+  messages must not be greater than the value returned by ETMCanBufferPeek
+  see ETM_CAN_UTILITY.s
+*/
+
+
+void ETMCanBufferInitialize(ETMCanBuffer* buffer_ptr);
 /*
   This initializes a can message buffer.
+  The indexes, counters and the high water mark are cleared.  The depth set by ETM_CAN_MESSAGE_BUFFER is not changed.
   see ETM_CAN_UTILITY.s
 */
 
 
-unsigned int ETMCanBufferRowsAvailable(ETMCanMessageBuffer* buffer_ptr);
+void ETMCanBufferClearHighWater(ETMCanBuffer* buffer_ptr);
+/*
+  This asks the producer to clear the high water mark, it can be called from either side of the buffer.
+  message_high_water restarts from the number of rows in use when the producer next stores a message.
+*/
+
+
+unsigned int ETMCanBufferRowsAvailable(ETMCanBuffer* buffer_ptr);
 /*
   This returns 0 if the buffer is full, otherwise returns the number of available rows
   see ETM_CAN_UTILITY.s
 */
 
 
-unsigned int ETMCanBufferNotEmpty(ETMCanMessageBuffer* buffer_ptr);
+unsigned int ETMCanBufferNotEmpty(ETMCanBuffer* buffer_ptr);
 /*
   Returns 0 if the buffer is Empty, otherwise returns the number messages in the buffer
   see ETM_CAN_UTILITY.s
@@ -317,6 +385,241 @@ unsigned int ETMCanBufferNotEmpty(ETMCanMessageBuffer* buffer_ptr);
 
 
 
+// ---------------- Latency Timing -------------------- //
+/*
+  Every frame is time stamped from the timer that clocks the timed transmissions (TMR4 on the ECB and the slave boards).
+  The timer counts at Fcy/256 and is reset at PRx (every 25mS on the ECB, 100mS on a slave), so it is extended to a
+  free running 16 bit time: time_base + TMRx.  The main loop adds (PRx + 1) to time_base when it sees TxIF
+  (ETMCanTimingRollover replaces clearing TxIF), and a time that is read while TxIF is still set uses the next time base.
+  A latency is measured correctly up to 32767 timer counts (0.8S at 10MHz), as long as the main loop handles every timer
+  period.  A longer latency, or one across a timer period that the main loop missed, is recorded as 0xFFFF counts.
+
+   - TX: when the message is added to its transmit queue (ETMCanTXSchedulerAddMessage), when it is loaded into a TX
+     buffer and when the scheduler sees that the TX buffer has been sent (the TX interrupt that follows the transmission)
+   - RX: when the CAN interrupt moves the frame out of the RX buffer into a message buffer (ETMCanTimeStampNextMessage)
+     The latency is recorded when the main loop processes the message (ETMCanTimingRecordRX).  Frames that are handled
+     inside the CAN interrupt (next pulse level and sync) are not buffered, they are timed from when the interrupt finds
+     them in the RX buffer to the point where they have been handled (ETMCanTimingRecordISR).
+
+  The time stamp for each buffered message is kept in message_time_stamp[] at the same index as the message row.  The
+  producer stores it in the free row before the message is added, so it follows the same ownership rules as the row.
+
+  The latency is counted in four bins, the upper limits of the first three are set in microseconds below and converted
+  to timer counts by ETMCanTimingInitialize().  The data is sent as the ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_x
+  registers, one register for every 4 words of ETMCanLatencyData.
+*/
+
+#ifndef ETM_CAN_LATENCY_BIN_0_US
+#define ETM_CAN_LATENCY_BIN_0_US            250     // Bin 0 is 0 -> 250uS
+#endif
+#ifndef ETM_CAN_LATENCY_BIN_1_US
+#define ETM_CAN_LATENCY_BIN_1_US            1000    // Bin 1 is 250uS -> 1mS
+#endif
+#ifndef ETM_CAN_LATENCY_BIN_2_US
+#define ETM_CAN_LATENCY_BIN_2_US            10000   // Bin 2 is 1mS -> 10mS, bin 3 is everything longer
+#endif
+
+#define ETM_CAN_LATENCY_BINS                4
+
+typedef struct {
+  // Can timing - 0x24 -> 0x27 (one register per transmit class, pulse level -> logging)
+  unsigned int tx_histogram[4][ETM_CAN_LATENCY_BINS];   // queued -> transmitted latency
+  
+  // Can timing - 0x2A
+  unsigned int tx_max[4];                               // longest queued -> transmitted latency (timer counts) for each class
+
+  // Can timing - 0x2B
+  unsigned int tx_buffer_max[4];                        // longest loaded -> transmitted time (timer counts) for each class, this is arbitration plus the frame
+
+  // Can timing - 0x2C
+  unsigned int rx_histogram[ETM_CAN_LATENCY_BINS];      // RX interrupt -> processed by the main loop latency
+
+  // Can timing - 0x2D
+  unsigned int rx_max;                                  // longest RX interrupt -> processed latency (timer counts)
+  unsigned int timer_count_ns;                          // length of one timer count in nS (0xFFFF if longer)
+  unsigned int timer_period;                            // PRx of the time stamp timer
+  unsigned int rx_isr_max;                              // longest RX -> handled latency of the frames handled in the interrupt (timer counts)
+} ETMCanLatencyData;
+
+typedef unsigned int (*ETMCanTimerFlag)(unsigned int clear);
+/*
+  Returns the state of TxIF for the time stamp timer (non zero once the timer has been reset at PRx)
+  If clear is non zero TxIF is cleared after it has been read.
+*/
+
+typedef struct {
+  volatile unsigned int*   timer;                                 // TMRx
+  ETMCanTimerFlag          timer_flag;                            // Reads and clears TxIF
+  volatile unsigned int    time_base;                             // The time (in timer counts) when TMRx was last reset
+  volatile unsigned int    time_base_next;                        // time_base + PRx + 1
+  unsigned int             bin_limit[ETM_CAN_LATENCY_BINS - 1];   // The bin limits in timer counts
+  ETMCanLatencyData        data;
+} ETMCanTiming;
+
+
+void ETMCanTimingInitialize(ETMCanTiming* timing_ptr, volatile unsigned int* timer_address, ETMCanTimerFlag timer_flag, unsigned int timer_period, unsigned long fcy);
+/*
+  This sets the timer used for time stamps and the bin limits and clears the latency data.
+  The timer must already be configured with a 1:256 prescale and PRx = timer_period.
+  see P1395_CAN_CORE.c
+*/
+
+
+unsigned int ETMCanTimingRollover(ETMCanTiming* timing_ptr);
+/*
+  Returns 0 if TxIF is clear.
+  Otherwise this moves the time base on by one timer period, clears TxIF and returns 1.
+  The main loop must use this instead of clearing TxIF directly.  It is safe if the CAN interrupt runs at any point.
+  see P1395_CAN_CORE.c
+*/
+
+
+unsigned int ETMCanTimingNow(ETMCanTiming* timing_ptr);
+/*
+  Returns the current time (time_base + TMRx) in timer counts.  This can be called from the main loop or the interrupt.
+  see P1395_CAN_CORE.c
+*/
+
+
+void ETMCanTimingClear(ETMCanTiming* timing_ptr);
+/*
+  This clears the histograms and the maximum latencies.
+  see P1395_CAN_CORE.c
+*/
+
+
+void ETMCanTimeStampNextMessage(ETMCanTiming* timing_ptr, ETMCanBuffer* buffer_ptr);
+/*
+  This stores the current time as the time stamp of the next message that will be added to the buffer.
+  Only the producer may call this, immediately before ETMCanRXMessageBuffer or ETMCanAddMessageToBuffer.
+  see P1395_CAN_CORE.c
+*/
+
+
+void ETMCanTimingRecordRX(ETMCanTiming* timing_ptr, ETMCanBuffer* buffer_ptr, ETMCanMessage* message_ptr);
+/*
+  This records the RX latency of a message that is being processed in place (message_ptr is from ETMCanBufferPeek).
+  It must be called before the message is released with ETMCanBufferCommit.
+  see P1395_CAN_CORE.c
+*/
+
+
+void ETMCanTimingRecordISR(ETMCanTiming* timing_ptr, unsigned int isr_time);
+/*
+  This records the RX latency of a frame that was handled inside the CAN interrupt.
+  isr_time is ETMCanTimingNow() when the interrupt found the frame.  Only the maximum (rx_isr_max) is kept.
+  see P1395_CAN_CORE.c
+*/
+
+
+// ---------------- Transmit Scheduler -------------------- //
+/*
+  The transmit scheduler owns all three TX buffers (TX0, TX1, TX2).
+  Messages are never written directly to a TX buffer.  They are added to the software queue (an ETMCanBuffer) for
+  their class and then MacroETMCanCheckTXBuffer() is called.  The CAN interrupt calls ETMCanTXSchedulerService() which
+  loads every empty TX buffer from the highest priority queue that has data.
+
+   - A TX buffer is only loaded when TXREQ is clear, a frame that is waiting for (or on) the bus is never overwritten
+   - Each class has at most one frame in the TX buffers at a time, so messages in the same class go out in order
+   - The TX buffer priority (TXPRI) is set from the class so the CAN module sends the highest class first
+   - TX2 is only used for next pulse level and status/sync messages so they never wait behind commands or logging
+
+  The queues have the same single producer (main loop) / single consumer (CAN interrupt) rules as the other buffers.
+*/
+
+#define ETM_CAN_TX_CLASS_PULSE_LEVEL        0       // Next pulse level message - highest priority
+#define ETM_CAN_TX_CLASS_STATUS_SYNC        1       // Sync message from the ECB, status messages from slave boards
+#define ETM_CAN_TX_CLASS_CMD                2       // Commands from the ECB, command returns from slave boards
+#define ETM_CAN_TX_CLASS_LOG                3       // Data logging - lowest priority
+#define ETM_CAN_TX_CLASSES                  4
+
+#define ETM_CAN_TX_MAILBOXES                3
+#define ETM_CAN_TX_MAILBOX_RESERVED         2       // TX2 is only loaded with pulse level and status/sync messages
+
+typedef struct {
+  ETMCanBuffer*     queue[ETM_CAN_TX_CLASSES];            // The software queue for each class, 0 if the class is not used
+  volatile unsigned int*   mailbox[ETM_CAN_TX_MAILBOXES];        // CxTX0CON, CxTX1CON, CxTX2CON
+  unsigned int             mailbox_class[ETM_CAN_TX_MAILBOXES];  // The class loaded into each TX buffer, ETM_CAN_TX_CLASSES once the transmission has been timed
+  unsigned int             mailbox_queue_time[ETM_CAN_TX_MAILBOXES]; // Time stamp from when the message in each TX buffer was queued
+  unsigned int             mailbox_load_time[ETM_CAN_TX_MAILBOXES];  // Time stamp from when each TX buffer was loaded
+  unsigned int*            mailbox_load_count;                   // Points to can_tx_0 in the debug data (can_tx_1, can_tx_2 follow)
+  ETMCanTiming*            timing;
+} ETMCanTXScheduler;
+
+
+void ETMCanTXSchedulerInitialize(ETMCanTXScheduler* scheduler_ptr, volatile unsigned int* tx0_con_address, volatile unsigned int* tx1_con_address,
+				 volatile unsigned int* tx2_con_address, unsigned int* load_count_ptr, ETMCanTiming* timing_ptr);
+/*
+  This initializes the scheduler for the TX buffers of one CAN port (CxTX0CON, CxTX1CON, CxTX2CON).
+  The queues are not changed, the caller sets scheduler_ptr->queue[] for each class that is used (and 0 for the others).
+  This must be called before the CAN interrupt is enabled.
+  The TX buffer priorities are set by the scheduler, CxTXxCON must already be configured.
+  The TX latency is recorded in timing_ptr, which must already be initialized.
+  see P1395_CAN_CORE.c
+*/
+
+
+void ETMCanTXSchedulerAddMessage(ETMCanTXScheduler* scheduler_ptr, unsigned int tx_class, ETMCanMessage* message_ptr);
+/*
+  This time stamps the message and adds it to the queue for tx_class.
+  Call MacroETMCanCheckTXBuffer() afterwards so that an empty TX buffer is loaded.
+  see P1395_CAN_CORE.c
+*/
+
+
+void ETMCanTXSchedulerService(ETMCanTXScheduler* scheduler_ptr);
+/*
+  This is called from the CAN interrupt (after clearing the TX interrupt flags).
+  The latency of every TX buffer that has been sent since the last call is recorded.
+  Every empty TX buffer is loaded with the oldest message of the highest priority class that is not already in a TX buffer.
+  see P1395_CAN_CORE.c
+*/
+
+
+
+// ---------- P1395 CAN Identifiers ---------------
+/*
+  Every P1395 message uses an 11 bit standard identifier 0bCCCCCCCAAAA.
+  The upper 7 bits are the message class (or the data log register) and the lower 4 bits are the board address.
+  The PIC does not map the identifier the same way in the TX and RX SID registers.
+    TRASMIT MODE   0bCCCCCXXXCCAAAA00
+    RECEIVE MODE   0bXXXCCCCCCCAAAAX0
+  All of the encoding/decoding is done with these macros so that it is written down in only one place.
+  When the arguments are constants everything folds to a constant at compile time.
+*/
+
+#define ETM_CAN_ID_LVL                           0x000  // When or'ed with address
+#define ETM_CAN_ID_SYNC                          0x040
+#define ETM_CAN_ID_RTN                           0x080  // When or'ed with slave address
+#define ETM_CAN_ID_STATUS                        0x090  // When or'ed with slave address
+#define ETM_CAN_ID_CMD                           0x300  // When or'ed with slave address
+#define ETM_CAN_ID_LOG                           0x400  // When or'ed with log register and slave address
+
+#define ETM_CAN_ID_MASK                          0x7FF
+#define ETM_CAN_ID_CLASS_MASK                    0x7F0
+#define ETM_CAN_ID_ADDRESS_MASK                  0x00F
+#define ETM_CAN_ID_LOG_REGISTER_MASK             0x3F0
+
+// Build an identifier from a class (or ETM_CAN_ID_LOG | log_register) and a board address
+#define ETM_CAN_ID(id_class, address)            ((id_class) | ((address) & ETM_CAN_ID_ADDRESS_MASK))
+
+// Pull the fields back out of an identifier
+#define ETM_CAN_ID_CLASS(id)                     ((id) & ETM_CAN_ID_CLASS_MASK)
+#define ETM_CAN_ID_ADDRESS(id)                   ((id) & ETM_CAN_ID_ADDRESS_MASK)
+#define ETM_CAN_ID_LOG_REGISTER(id)              ((id) & ETM_CAN_ID_LOG_REGISTER_MASK)
+
+// Convert between the identifier and the TX/RX SID register formats
+#define ETM_CAN_ID_TO_TX_SID(id)                 ((((id) & 0x07C0) << 5) | (((id) & 0x003F) << 2))
+#define ETM_CAN_TX_SID_TO_ID(sid)                ((((sid) >> 5) & 0x07C0) | (((sid) >> 2) & 0x003F))
+#define ETM_CAN_ID_TO_RX_SID(id)                 (((id) & ETM_CAN_ID_MASK) << 2)
+#define ETM_CAN_RX_SID_TO_ID(sid)                (((sid) >> 2) & ETM_CAN_ID_MASK)
+
+// Shortcuts for building a TX SID
+#define ETM_CAN_TX_SID(id_class, address)        ETM_CAN_ID_TO_TX_SID(ETM_CAN_ID(id_class, address))
+#define ETM_CAN_LOG_TX_SID(log_register, address) ETM_CAN_TX_SID((ETM_CAN_ID_LOG | (log_register)), address)
+
+
+
 // ---------- Define RX SID Masks and Filters ---------------
 
 
@@ -341,7 +644,7 @@ unsigned int ETMCanBufferNotEmpty(ETMCanMessageBuffer* buffer_ptr);
 // SLAVE FILTERS
 #define ETM_CAN_SLAVE_MSG_FILTER_RF0             0b0000000000000000  // This will accept the LVL broadcast
 #define ETM_CAN_SLAVE_MSG_FILTER_RF1             0b0000000100000000  // This will accept the SYNC broadcast
-#define ETM_CAN_SLAVE_MSG_FILTER_RF2             0b0000110000000000  // When or'ed with address this will accept CMD msg
+#define ETM_CAN_SLAVE_MSG_FILTER_RF2             0b0000110000000000  // When or'ed with ETM_CAN_ID_TO_RX_SID(address) this will accept CMD msg
 
 
 // ------- Define the bits for particular commands ---------------- 
@@ -350,18 +653,19 @@ unsigned int ETMCanBufferNotEmpty(ETMCanMessageBuffer* buffer_ptr);
 
 // MASTER receive Message Identifiers
 // RECEIVE MODE                                  0bXXXCCCCCCCAAAAX0
-#define ETM_CAN_MSG_RTN_RX                       0b0000001000000000  // When the address is removed this is a RTN message 
-#define ETM_CAN_MSG_STATUS_RX                    0b0000001001000000  // When the address is removed this is a STATUS message 
+#define ETM_CAN_MSG_RTN_RX                       ETM_CAN_ID_TO_RX_SID(ETM_CAN_ID_RTN)     // 0b0000001000000000 When the address is removed this is a RTN message 
+#define ETM_CAN_MSG_STATUS_RX                    ETM_CAN_ID_TO_RX_SID(ETM_CAN_ID_STATUS)  // 0b0000001001000000 When the address is removed this is a STATUS message 
+#define ETM_CAN_MASTER_MSG_TYPE_MASK             0b0001111111000000  // Removes the address so that RTN and STATUS can be told apart
 
 
 // Define TX SID VALUES
 // TRASMIT MODE                                  0bCCCCCXXXCCAAAA00
-#define ETM_CAN_MSG_LVL_TX                       0b0000000000000000 
-#define ETM_CAN_MSG_SYNC_TX                      0b0000100000000000
-#define ETM_CAN_MSG_RTN_TX                       0b0001000000000000 // When or'ed with slave address
-#define ETM_CAN_MSG_STATUS_TX                    0b0001000001000000 // When or'ed with slave address
-#define ETM_CAN_MSG_CMD_TX                       0b0110000000000000 // When or'ed with slave address 
-#define ETM_CAN_MSG_LOG_TX                       0b1000000000000000 // When or'ed with salve address and packet id
+#define ETM_CAN_MSG_LVL_TX                       ETM_CAN_ID_TO_TX_SID(ETM_CAN_ID_LVL)     // 0b0000000000000000
+#define ETM_CAN_MSG_SYNC_TX                      ETM_CAN_ID_TO_TX_SID(ETM_CAN_ID_SYNC)    // 0b0000100000000000
+#define ETM_CAN_MSG_RTN_TX                       ETM_CAN_ID_TO_TX_SID(ETM_CAN_ID_RTN)     // 0b0001000000000000 When or'ed with slave address
+#define ETM_CAN_MSG_STATUS_TX                    ETM_CAN_ID_TO_TX_SID(ETM_CAN_ID_STATUS)  // 0b0001000001000000 When or'ed with slave address
+#define ETM_CAN_MSG_CMD_TX                       ETM_CAN_ID_TO_TX_SID(ETM_CAN_ID_CMD)     // 0b0110000000000000 When or'ed with slave address 
+#define ETM_CAN_MSG_LOG_TX                       ETM_CAN_ID_TO_TX_SID(ETM_CAN_ID_LOG)     // 0b1000000000000000 When or'ed with salve address and packet id
 
 
 
@@ -404,6 +708,59 @@ unsigned int ETMCanBufferNotEmpty(ETMCanMessageBuffer* buffer_ptr);
 /*
   DPARKER -  In order to get the CAN network to work it was necessary to increase the time of each bit.
   With testing we may be able to get the values back down to 10xTQ which is 1Mbit
+
+  The bit timing is now calculated from Fcy, ETM_CAN_BIT_RATE and ETM_CAN_SAMPLE_POINT.  The defaults give the same
+  CXCFG1/CXCFG2 values as above at 10, 20 and 25MHz Fcy (12 TQ of 100nS, SJW 1 TQ), see make bit_timing in the simulator.
+*/
+
+
+
+// ---------- CAN Bit Timing ---------------
+/*
+  Every board on the network must use the same bit rate.
+  These can be overridden from the project (all boards must be built with the same values)
+  The defaults are the existing network timing (12 TQ of 100nS at 10MHz Fcy).  A network that is moved to 1Mbit must
+  build every board with ETM_CAN_BIT_RATE=1000000 (and ETM_CAN_SAMPLE_POINT=800 is recommended).
+*/
+#ifndef ETM_CAN_BIT_RATE
+#define ETM_CAN_BIT_RATE                         833333   // bits/second
+#endif
+
+#ifndef ETM_CAN_SAMPLE_POINT
+#define ETM_CAN_SAMPLE_POINT                     667      // Sample point in 0.1% of the bit time (667 = 66.7%)
+#endif
+
+#ifndef ETM_CAN_SYNC_JUMP_WIDTH
+#define ETM_CAN_SYNC_JUMP_WIDTH                  1        // TQ (1-4), it is limited to Phase Buffer Segment 2
+#endif
+
+#define ETM_CAN_BIT_RATE_TOLERANCE               5        // Largest bit rate error accepted by the solver in 0.1% (0.5%)
+
+#define ETM_CAN_TQ_PER_BIT_MIN                   8
+#define ETM_CAN_TQ_PER_BIT_MAX                   25
+#define ETM_CAN_TQ_PER_BIT_PREFERRED             12       // The existing network timing, SJW is set in TQ so more TQ per bit shortens it
+#define ETM_CAN_BRP_MAX                          63
+
+typedef struct {
+  unsigned int  cfg1;                 // CxCFG1 value
+  unsigned int  cfg2;                 // CxCFG2 value
+  unsigned int  tq_per_bit;           // Sync + Propagation + Phase 1 + Phase 2
+  unsigned int  sample_point;         // Actual sample point in 0.1% of the bit time
+  unsigned long bit_rate;             // Actual bit rate in bits/second
+} ETMCanBitTiming;
+
+
+unsigned int ETMCanBitTimingSolve(ETMCanBitTiming* timing_ptr, unsigned long fcy, unsigned long bit_rate, unsigned int sample_point);
+/*
+  Calculates CxCFG1 and CxCFG2 for a bit rate and sample point (in 0.1% of the bit time) with Fcan = 4xFcy
+  The baud rate prescaler with the smallest bit rate error is used.  When two are equal the one that gets closest to
+  the sample point is used, and then the one with TQ per bit closest to ETM_CAN_TQ_PER_BIT_PREFERRED.
+  The time before the sample point is split between the propagation and phase 1 segments, phase 1 gets the odd TQ.
+  Returns 0 if the timing was found.
+  Returns 1 if no setting is within ETM_CAN_BIT_RATE_TOLERANCE, the timing is zeroed and must not be used.
+  The master and slave then leave the CAN module in configuration mode (off the bus) and set st_can_bit_timing in the
+  self test register of their debug data.
+  see P1395_CAN_CORE.c
 */
 
 
@@ -436,6 +793,31 @@ unsigned int ETMCanBufferNotEmpty(ETMCanMessageBuffer* buffer_ptr);
 #define ETM_CAN_REGISTER_DEFAULT_CMD_RESET_ANALOG_CALIBRATION           0x003
 
 
+// Calibration Block Transfer
+/*
+  The calibration pairs (EEPROM registers 0x100 -> 0x1FF) can be moved one 16 word EEPROM page at a time.
+  A block is the 16 words of the page followed by a sequence number and ETMCRC16() of the first 17 words.
+  It is sent as ETM_CAN_CALIBRATION_BLOCK_FRAMES frames, frame f carries block words 3f, 3f+1, 3f+2 in word2, word1, word0.
+
+  Write - ECB sends CMD frames 0xZApf (p = calibration page 0 -> F, f = frame 0 -> 5) in order, frame 0 starts the block.
+          Once all the frames of a page have arrived the slave checks the CRC, writes the page with one ETMEEPromWritePage()
+          and returns 0xZApF: word2 = sequence, word1 = ETM_CAN_CALIBRATION_BLOCK_STATUS_xxx, word0 = CRC received
+  Read  - ECB sends CMD 0xZBp0 with word2 = sequence.  The slave returns the block as frames 0xZBpf
+*/
+#define ETM_CAN_REGISTER_CALIBRATION_BLOCK_WRITE                        0xA00
+#define ETM_CAN_REGISTER_CALIBRATION_BLOCK_READ                         0xB00
+#define ETM_CAN_CALIBRATION_BLOCK_ACK_FRAME                             0x00F
+#define ETM_CAN_CALIBRATION_BLOCK_FIRST_PAGE                            0x10    // EEPROM page of calibration page 0
+#define ETM_CAN_CALIBRATION_BLOCK_PAGES                                 16
+#define ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS                            16
+#define ETM_CAN_CALIBRATION_BLOCK_WORDS                                 18      // Page, sequence, CRC
+#define ETM_CAN_CALIBRATION_BLOCK_FRAMES                                6
+#define ETM_CAN_CALIBRATION_BLOCK_ALL_FRAMES                            0x003F  // One bit per frame
+
+#define ETM_CAN_CALIBRATION_BLOCK_STATUS_OK                             0
+#define ETM_CAN_CALIBRATION_BLOCK_STATUS_CRC_ERROR                      1
+
+
 // Board Specific Register Locations
 #define ETM_CAN_REGISTER_HV_LAMBDA_SET_1_LAMBDA_SET_POINT               0x4200
 
@@ -490,6 +872,15 @@ unsigned int ETMCanBufferNotEmpty(ETMCanMessageBuffer* buffer_ptr);
 #define ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_2                   0x220 // This gets or'd with board address
 #define ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_3                   0x230 // This gets or'd with board address
 
+#define ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_0                  0x240 // This gets or'd with board address
+#define ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_1                  0x250 // This gets or'd with board address
+#define ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_2                  0x260 // This gets or'd with board address
+#define ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_3                  0x270 // This gets or'd with board address
+#define ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_4                  0x2A0 // This gets or'd with board address
+#define ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_5                  0x2B0 // This gets or'd with board address
+#define ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_6                  0x2C0 // This gets or'd with board address
+#define ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_7                  0x2D0 // This gets or'd with board address
+
 
 #define ETM_CAN_DATA_LOG_REGISTER_DEFAULT_SYSTEM_ERROR_0                0x280 // This gets or'd with board address
 #define ETM_CAN_DATA_LOG_REGISTER_DEFAULT_SYSTEM_ERROR_1                0x290 // This gets or'd with board address
@@ -507,6 +898,7 @@ unsigned int ETMCanBufferNotEmpty(ETMCanMessageBuffer* buffer_ptr);
 #define ETM_CAN_DATA_LOG_REGISTER_AFC_FAST_LOG_0                        ETM_CAN_DATA_LOG_REGISTER_FAST_LOG_0 | ETM_CAN_ADDR_AFC_CONTROL_BOARD
 #define ETM_CAN_DATA_LOG_REGISTER_AFC_FAST_LOG_1                        ETM_CAN_DATA_LOG_REGISTER_FAST_LOG_1 | ETM_CAN_ADDR_AFC_CONTROL_BOARD
 #define ETM_CAN_DATA_LOG_REGISTER_PULSE_SYNC_FAST_LOG_0                 ETM_CAN_DATA_LOG_REGISTER_FAST_LOG_0 | ETM_CAN_ADDR_PULSE_SYNC_BOARD
+#define ETM_CAN_DATA_LOG_REGISTER_ION_PUMP_FAST_LOG_0                   ETM_CAN_DATA_LOG_REGISTER_FAST_LOG_0 | ETM_CAN_ADDR_ION_PUMP_BOARD
 
 
 
@@ -516,6 +908,7 @@ unsigned int ETMCanBufferNotEmpty(ETMCanMessageBuffer* buffer_ptr);
 #define TX_REQ_BIT         0x0008
 #define RX0_INT_FLAG_BIT   0xFFFE
 #define RX1_INT_FLAG_BIT   0xFFFD
+#define TX_INT_FLAG_BITS   0xFFE3    // Clears TX0IF, TX1IF and TX2IF
 #define ERROR_FLAG_BIT     0x0020
   
 
@@ -523,7 +916,8 @@ unsigned int ETMCanBufferNotEmpty(ETMCanMessageBuffer* buffer_ptr);
 
 //#define MacroETMCanCheckTXBuffer() if (!CXTX0CONbits.TXREQ) { _CXIF = 1; }
 // DPARKER this macro needs to be extended to work with both CAN PORTS
-#define MacroETMCanCheckTXBuffer() if (!(*CXTX0CON_ptr & TX_REQ_BIT)) { if (_C1IE) {_C1IF = 1;} else {_C2IF = 1;}}
+// If any TX buffer is empty, trigger the CAN interrupt so that the transmit scheduler can load the new message
+#define MacroETMCanCheckTXBuffer() if (!(*CXTX0CON_ptr & *CXTX1CON_ptr & *CXTX2CON_ptr & TX_REQ_BIT)) { if (_C1IE) {_C1IF = 1;} else {_C2IF = 1;}}
 
 
 
@@ -2,10 +2,18 @@
         .include "p30fxxxx.inc"
 .endif
 
+;; This file is replaced by P1395_CAN_CORE.c when __P1395_CAN_CORE_C is defined
+.ifndef __P1395_CAN_CORE_C
+
 
-.equ buffer_length, 15
 .equ error_identifier, 0b0001011111111000
 
+;; Offsets into the ETMCanBuffer structure (see P1395_CAN_CORE.h)
+.equ buffer_high_water,		0x8
+.equ buffer_index_mask,		0xA
+.equ buffer_message_data,	0xC
+.equ buffer_high_water_clear,	0x10
+
 
 
 ;; DPARKER consider disabling CAN interrupt while these functions are running so that we can overwrite read/write pointers
@@ -13,14 +21,15 @@
 
 .global  _ETMCanBufferRowsAvailable
 	;; Address of the Buffer Data Structure is in W0
-	;; Uses W0,W1,W2,SR
+	;; Uses W0,W1,W2,W3,SR
 .text
 _ETMCanBufferRowsAvailable:
+	MOV		[W0+buffer_index_mask], W3 ; Move index_mask to W3
 	MOV		[W0+0x2], W2 ; Move read_index to W2
 	MOV		[W0], W1     ; Move write_index to W1
 	SUB		W2, W1, W0
 	DEC		W0, W0
-	AND		#buffer_length, W0
+	AND		W0, W3, W0
 Return
 	
 
@@ -28,20 +37,21 @@ Return
 
 .global  _ETMCanBufferNotEmpty
 	;; Address of the Buffer Data Structure is in W0
-	;; Uses W0,W1,W2,SR	
+	;; Uses W0,W1,W2,W3,SR	
 .text
 _ETMCanBufferNotEmpty:
+	MOV		[W0+buffer_index_mask], W3 ; Move index_mask to W3
 	MOV		[W0+0x2], W2 ; Move read_index to W1
 	MOV		[W0], W1     ; Move write_index to W1
 	SUB		W1,W2,W0
-	AND		#buffer_length, W0
+	AND		W0, W3, W0
 Return
 
 	
 
 	
 .global  _ETMCanRXMessageBuffer
-	;; Uses W0,W1,W2,W3,SR
+	;; Uses W0,W1,W2,W3,W4,W5,SR
 	;; Address of the Message Buffer Data Structure is in W0
 	;; Address of the RX buffer is in W1
 .text
@@ -56,16 +66,17 @@ _ETMCanRXMessageBuffer:
 	
 	;; Check to see if the message buffer is full
 	;; WO initial points to the write_index
-	MOV		[W0+0x2], W3 ; Move read index to W3
+	MOV		[W0+buffer_index_mask], W4 ; Move index_mask to W4
+	MOV		[W0+0x2], W5 ; Move read index to W5
 	INC             [W0], W2 ; W2 = Write Index + 1
-	AND		#buffer_length, W2 ; Wrap the write index
-	CP		W2, W3 ; If (write_index +1) = Read Index 
+	AND		W2, W4, W2 ; Wrap the write index
+	CP		W2, W5 ; If (write_index +1) = Read Index 
 	BRA		Z, _ETMCanRXMessageBuffer_BUFFER_FULL
 
 	;; Calculate where the data should be added
 	MOV		[W0], W2
 	MUL.UU 		W2,#10,W2 ; W2 is now the offset based on write index 
-	ADD		W0,#8, W3 ; Move Start of data to W3
+	MOV		[W0+buffer_message_data], W3 ; Move Start of data to W3
 	ADD		W3,W2,W3 ; W3 is now the start address for this data row 
 
 	;; Copy the data from the SFRs to the data buffer
@@ -79,9 +90,21 @@ _ETMCanRXMessageBuffer:
 
 	;; Increment the write Index and store
 	INC		[W0], W2 ; W2 = Write Index + 1
-	AND		#buffer_length, W2 ; Wrap the write index
+	AND		W2, W4, W2 ; Wrap the write index
 	MOV		W2, [W0]
 
+	;; Update the high water mark
+	SUB		W2, W5, W2 ; W2 = Write Index - Read Index
+	AND		W2, W4, W2 ; W2 is now the number of rows in use
+	MOV		[W0+buffer_high_water_clear], W3
+	CP0		W3
+	BRA		NZ, _ETMCanRXMessageBuffer_HIGH_WATER_CLEAR
+	MOV		[W0+buffer_high_water], W3
+	CP		W2, W3
+	BRA		LEU, _ETMCanRXMessageBuffer_HIGH_WATER_DONE
+	MOV		W2, [W0+buffer_high_water]
+_ETMCanRXMessageBuffer_HIGH_WATER_DONE:
+
 	;; Decrement to the overwrite counter
 	ADD		W0, #6, W3
 	DEC		[W3], [W3]
@@ -97,6 +120,13 @@ _ETMCanRXMessageBuffer_RX_EMPTY:
 	
 RETURN
 
+_ETMCanRXMessageBuffer_HIGH_WATER_CLEAR:
+	;; The high water mark was asked to be cleared, restart it from the rows in use
+	MOV		W2, [W0+buffer_high_water]
+	CLR		W3
+	MOV		W3, [W0+buffer_high_water_clear]
+	BRA		_ETMCanRXMessageBuffer_HIGH_WATER_DONE
+
 
 
 
@@ -167,7 +197,7 @@ RETURN
 
 	
 .global  _ETMCanAddMessageToBuffer
-	;; Uses W0,W1,W2,W3,SR
+	;; Uses W0,W1,W2,W3,W4,W5,SR
 	;; Address of the Message Buffer Data Structure is in W0
 	;; Address of the Message is in W1
 .text
@@ -178,16 +208,17 @@ _ETMCanAddMessageToBuffer:
 	
 	;; Check to see if the message buffer is full
 	;; WO initial points to the write_index
-	MOV		[W0+0x2], W3 ; Move read index to W3
+	MOV		[W0+buffer_index_mask], W4 ; Move index_mask to W4
+	MOV		[W0+0x2], W5 ; Move read index to W5
 	INC             [W0], W2 ; W2 = Write Index + 1
-	AND		#buffer_length, W2 ; Wrap the write index
-	CP		W2, W3 ; If (write_index +1) = Read Index 
+	AND		W2, W4, W2 ; Wrap the write index
+	CP		W2, W5 ; If (write_index +1) = Read Index 
 	BRA		Z, _ETMCanAddMessageToBuffer_BUFFER_FULL
 
 	;; Calculate where the data should be added
 	MOV		[W0], W2
 	MUL.UU 		W2,#10,W2 ; W2 is now the offset based on write index 
-	ADD		W0,#8, W3 ; Move Start of data to W3
+	MOV		[W0+buffer_message_data], W3 ; Move Start of data to W3
 	ADD		W3,W2,W3 ; W3 is now the start address for this data row 
 
 	;; Copy the data from the message to the data buffer
@@ -199,9 +230,21 @@ _ETMCanAddMessageToBuffer:
 
 	;; Increment the write Index and store
 	INC		[W0], W2 ; W2 = Write Index + 1
-	AND		#buffer_length, W2 ; Wrap the write index
+	AND		W2, W4, W2 ; Wrap the write index
 	MOV		W2, [W0]
 
+	;; Update the high water mark
+	SUB		W2, W5, W2 ; W2 = Write Index - Read Index
+	AND		W2, W4, W2 ; W2 is now the number of rows in use
+	MOV		[W0+buffer_high_water_clear], W3
+	CP0		W3
+	BRA		NZ, _ETMCanAddMessageToBuffer_HIGH_WATER_CLEAR
+	MOV		[W0+buffer_high_water], W3
+	CP		W2, W3
+	BRA		LEU, _ETMCanAddMessageToBuffer_HIGH_WATER_DONE
+	MOV		W2, [W0+buffer_high_water]
+_ETMCanAddMessageToBuffer_HIGH_WATER_DONE:
+
 	;; Decrement to the overwrite counter
 	ADD		W0, #6, W3
 	DEC		[W3], [W3]
@@ -213,6 +256,13 @@ _ETMCanAddMessageToBuffer_BUFFER_FULL:
 	
 RETURN
 
+_ETMCanAddMessageToBuffer_HIGH_WATER_CLEAR:
+	;; The high water mark was asked to be cleared, restart it from the rows in use
+	MOV		W2, [W0+buffer_high_water]
+	CLR		W3
+	MOV		W3, [W0+buffer_high_water_clear]
+	BRA		_ETMCanAddMessageToBuffer_HIGH_WATER_DONE
+
 
 	
 
@@ -248,8 +298,8 @@ _ETMCanReadMessageFromBuffer_NOT_EMPTY:
 
 	;; First calculate the address for the data that we want
 	MUL.UU		W2, #10, W2
-	ADD		W2, #8, W2
-	ADD 		W2, W0, W2 ;W2 is now the base address of the data that we want to copy
+	MOV		[W0+buffer_message_data], W3
+	ADD 		W2, W3, W2 ;W2 is now the base address of the data that we want to copy
 
 	;; Copy the data from can message buffer to the message data
 	MOV 		[W2++], [W1++]
@@ -261,7 +311,8 @@ _ETMCanReadMessageFromBuffer_NOT_EMPTY:
 	;; increment the read pointer
 	MOV		[W0+0x2], W2 ; Move read_index to W2
 	INC 		W2, W2
-	AND		#buffer_length, W2
+	MOV		[W0+buffer_index_mask], W3
+	AND		W2, W3, W2
 	MOV		W2, [W0+0x2]
 	
 _ETMCanReadMessageFromBuffer_DONE:	
@@ -281,6 +332,113 @@ RETURN
 	
 
 
+.global  _ETMCanReadMessagesFromBuffer
+	;; Address of the Buffer Data Structure is in W0
+	;; Address of Message array (return data) is in W1
+	;; Maximum number of messages to read is in W2
+	;; Returns the number of messages read in W0
+	;; Uses W0,W1,W2,W3,W4,W5,W6,W7,SR
+.text
+_ETMCanReadMessagesFromBuffer:
+	;; Calculate the address of the oldest message
+	MOV		[W0+0x2], W3 ; Move read_index to W3
+	MUL.UU		W3, #10, W6  ; W6 is now the offset based on read index
+	MOV		[W0+buffer_message_data], W7
+	ADD		W6, W7, W6   ; W6 is now the address of the oldest message
+
+	MOV		[W0], W4     ; Move write_index to W4
+	MOV		[W0+buffer_index_mask], W5 ; Move index_mask to W5
+	CLR		W7           ; W7 counts the messages read
+
+_ETMCanReadMessagesFromBuffer_LOOP:
+	;; Stop when max messages have been read or the buffer is empty
+	CP0		W2
+	BRA		Z, _ETMCanReadMessagesFromBuffer_DONE
+	CP		W3, W4
+	BRA		Z, _ETMCanReadMessagesFromBuffer_DONE
+
+	;; Copy the data from can message buffer to the message data
+	MOV 		[W6++], [W1++]
+	MOV 		[W6++], [W1++]
+	MOV 		[W6++], [W1++]
+	MOV 		[W6++], [W1++]
+	MOV 		[W6++], [W1++]
+
+	;; Increment the local read index, go back to the start of the data when it wraps
+	INC		W3, W3
+	AND		W3, W5, W3
+	BRA		NZ, _ETMCanReadMessagesFromBuffer_NO_WRAP
+	MOV		[W0+buffer_message_data], W6
+_ETMCanReadMessagesFromBuffer_NO_WRAP:
+	INC		W7, W7
+	DEC		W2, W2
+	BRA		_ETMCanReadMessagesFromBuffer_LOOP
+
+_ETMCanReadMessagesFromBuffer_DONE:
+	;; Store the read index once all the data has been copied
+	MOV		W3, [W0+0x2]
+	MOV		W7, W0
+RETURN
+
+
+
+
+
+
+
+.global  _ETMCanBufferPeek
+	;; Address of the Buffer Data Structure is in W0
+	;; Address of the Message pointer (return data) is in W1
+	;; Returns the number of messages stored in order from the oldest message in W0
+	;; Uses W0,W1,W2,W3,W4,W5,W6,SR
+.text
+_ETMCanBufferPeek:
+	MOV		[W0+0x2], W2 ; Move read_index to W2
+	MOV		[W0], W3     ; Move write_index to W3
+	MOV		[W0+buffer_index_mask], W6 ; Move index_mask to W6
+
+	;; Return the address of the oldest message
+	MUL.UU		W2, #10, W4  ; W4 is now the offset based on read index
+	MOV		[W0+buffer_message_data], W5
+	ADD		W4, W5, W4
+	MOV		W4, [W1]
+
+	;; If write_index >= read_index the messages are in order up to the write index
+	SUB		W3, W2, W0
+	BRA		C, _ETMCanBufferPeek_DONE
+
+	;; Otherwise the messages wrap around, return the number of messages up to the end of the buffer
+	INC		W6, W6
+	SUB		W6, W2, W0
+	
+_ETMCanBufferPeek_DONE:
+RETURN
+
+
+
+
+
+
+
+.global  _ETMCanBufferCommit
+	;; Address of the Buffer Data Structure is in W0
+	;; Number of messages to release is in W1
+	;; Uses W0,W1,W2,W3,SR
+.text
+_ETMCanBufferCommit:
+	MOV		[W0+0x2], W2 ; Move read_index to W2
+	ADD		W2, W1, W2
+	MOV		[W0+buffer_index_mask], W3
+	AND		W2, W3, W2
+	MOV		W2, [W0+0x2]
+RETURN
+
+
+
+
+
+
+
 .global  _ETMCanTXMessageBuffer
 	;; Address of the Buffer Data Structure is in W0
 	;; Address of CxTXxCON register is in W1
@@ -302,8 +460,8 @@ _ETMCanTXMessageBuffer:
 
 	;; First calculate the address for the data that we want
 	MUL.UU		W2, #10, W2
-	ADD		W2, #8, W2
-	ADD 		W2, W0, W2 ;W2 is now the base address of the data that we want to copy
+	MOV		[W0+buffer_message_data], W3
+	ADD 		W2, W3, W2 ;W2 is now the base address of the data that we want to copy
 
 	;; Copy the data from can message buffer to the TX buffer
 	SUB		W1, #14, W3
@@ -321,7 +479,8 @@ _ETMCanTXMessageBuffer:
 	;; increment the read pointer
 	MOV		[W0+0x2], W2 ; Move read_index to W2
 	INC 		W2, W2
-	AND		#buffer_length, W2
+	MOV		[W0+buffer_index_mask], W3
+	AND		W2, W3, W2
 	MOV		W2, [W0+0x2]
 	
 _ETMCanTXMessageBuffer_DONE:	
@@ -369,10 +528,13 @@ RETURN
 	;; Uses W0
 .text
 _ETMCanBufferInitialize:
-	;; Initialize the buffer by setting read and write pointers to zero
+	;; Initialize the buffer by setting read and write pointers, counters and high water mark to zero
+	;; The index mask and data pointer are set when the buffer is declared
+	CLR		[W0++]
 	CLR		[W0++]
 	CLR		[W0++]
 	CLR		[W0++]
 	CLR		[W0]	
 Return
-	
+
+.endif
@@ -1,8 +1,11 @@
 #include <xc.h>
 #include <timer.h>
+#include <stddef.h>
 #include "P1395_CAN_MASTER.h"
 #include "ETM_IO_PORTS.H"
 #include "ETM_SCALE.H"
+#include "ETM_EEPROM.h"
+#include "ETM_CRC.h"
 //#include "A36507.h"
 
 // DPARKER fix these
@@ -25,60 +28,183 @@ typedef struct {
 } TYPE_CAN_PARAMETERS;
 
 
-typedef struct {
-  unsigned unused_0:1;
-  unsigned ion_pump_board:1;
-  unsigned magnetron_current_board:1;
-  unsigned pulse_sync_board:1;
-  unsigned hv_lambda_board:1;
-  unsigned afc_board:1;
-  unsigned cooling_interface_board:1;
-  unsigned heater_magnet_board:1;
-  unsigned gun_driver_board:1;
-  unsigned unused_9:1;
-  unsigned unused_10:1;
-  unsigned unused_11:1;
-  unsigned unused_12:1;
-  unsigned unused_13:1;
-  unsigned ethernet_board:1;
-  unsigned unused_15:1;
-} P1395BoardBits;
 
 
 
 typedef struct {
-  unsigned int no_connect_count_ion_pump_board;
-  unsigned int no_connect_count_magnetron_current_board;
-  unsigned int no_connect_count_pulse_sync_board;
-  unsigned int no_connect_count_hv_lambda_board;
-  unsigned int no_connect_count_afc_board;
-  unsigned int no_connect_count_cooling_interface_board;
-  unsigned int no_connect_count_heater_magnet_board;
-  unsigned int no_connect_count_gun_driver_board;
-  
-  unsigned int event_log_counter;
+  unsigned int last_seen_tick;          // etm_can_master_tick when the last status message was received
+  unsigned int deadline_tick;           // Communication is lost if there is no status message by this tick
+  unsigned int deadline;                // etm_can_master_tick periods allowed between status messages
+  unsigned int no_connect_count;        // Number of deadlines that have been missed
+} TYPE_BOARD_COMMUNICATION;
+
+
+typedef struct {
   unsigned int time_seconds_now;
   unsigned int millisecond_counter;
-  
-  unsigned int buffer_a_ready_to_send;
-  unsigned int buffer_a_sent;
-  
-  unsigned int buffer_b_ready_to_send;
-  unsigned int buffer_b_sent;
 } TYPE_GLOBAL_DATA_CAN_MASTER;
 
 TYPE_GLOBAL_DATA_CAN_MASTER global_data_can_master;
 
 // --------- Global Buffers --------------- //
 TYPE_EVENT_LOG              event_log;
-ETMCanHighSpeedData         high_speed_data_buffer_a[HIGH_SPEED_DATA_BUFFER_SIZE];
-ETMCanHighSpeedData         high_speed_data_buffer_b[HIGH_SPEED_DATA_BUFFER_SIZE];
+ETMCanCalibrationTransfers  etm_can_master_calibration;
+ETMCanDebugMirror           etm_can_master_debug_mirror[ETM_CAN_MASTER_DEBUG_MIRRORS];
+ETMCanHighSpeedDataRing     etm_can_high_speed_data_ring;
+ETMCanTiming                timing_data_ecb;
+#ifdef ETM_CAN_MASTER_ISR_CYCLES
+ETMCanMasterIsrCycles       etm_can_master_isr_cycles;
+#endif
 
 
 // --------- Local Buffers ---------------- // 
-ETMCanMessageBuffer         etm_can_master_rx_data_log_buffer;
-ETMCanMessageBuffer         etm_can_master_rx_message_buffer;
-ETMCanMessageBuffer         etm_can_master_tx_message_buffer;
+// The depth of each buffer must be a power of 2.  These can be overridden from the project preprocessor macros.
+// During high speed logging all of the pulse by pulse data arrives through the data log buffer
+#ifndef ETM_CAN_MASTER_RX_DATA_LOG_BUFFER_DEPTH
+#define ETM_CAN_MASTER_RX_DATA_LOG_BUFFER_DEPTH   32
+#endif
+
+#ifndef ETM_CAN_MASTER_RX_MESSAGE_BUFFER_DEPTH
+#define ETM_CAN_MASTER_RX_MESSAGE_BUFFER_DEPTH    16
+#endif
+
+#ifndef ETM_CAN_MASTER_TX_MESSAGE_BUFFER_DEPTH
+#define ETM_CAN_MASTER_TX_MESSAGE_BUFFER_DEPTH    16
+#endif
+
+#ifndef ETM_CAN_MASTER_TX_SYNC_BUFFER_DEPTH
+#define ETM_CAN_MASTER_TX_SYNC_BUFFER_DEPTH       4
+#endif
+
+ETM_CAN_MESSAGE_BUFFER(etm_can_master_rx_data_log_buffer, ETM_CAN_MASTER_RX_DATA_LOG_BUFFER_DEPTH);
+ETM_CAN_MESSAGE_BUFFER(etm_can_master_rx_message_buffer,  ETM_CAN_MASTER_RX_MESSAGE_BUFFER_DEPTH);
+ETM_CAN_MESSAGE_BUFFER(etm_can_master_tx_message_buffer,  ETM_CAN_MASTER_TX_MESSAGE_BUFFER_DEPTH);
+ETM_CAN_MESSAGE_BUFFER(etm_can_master_tx_sync_buffer,     ETM_CAN_MASTER_TX_SYNC_BUFFER_DEPTH);
+
+// Sync messages and commands are sent through the transmit scheduler
+ETMCanTXScheduler           etm_can_master_tx_scheduler;
+
+
+// ---------------------- Data Log Routing ------------------------ //
+/*
+  ETMCanMasterProcessLogData stores every slow logging register with one lookup in each of these tables.
+  To add a board or a logging register, add it to the table, no code changes are needed.
+
+  etm_can_master_log_route is indexed by the logging register (bits 9:4 of the data log index).
+   - Board registers are stored in the ETMCanBoardData mirror of the board that sent them, at board_offset words.
+     word0 is stored first.
+   - Debug registers are stored in the ETMCanDebugMirror of the board that sent them, at offset words.  They are
+     discarded if the board does not have a debug mirror.
+     word3 is stored first (the order that the slave passes them to ETMCanSlaveLogData).
+   - A register with words = 0 is not known to the ECB
+  The fast logging registers (FAST_LOG_0 -> FAST_LOG_3) are stored in the high speed data buffers instead.
+
+  Board registers from addresses that are not in ETM_CAN_MASTER_MIRROR_BOARDS are discarded.
+*/
+
+typedef struct {
+  unsigned int   debug;                 // 1 for debug registers, 0 for board registers
+  unsigned int   offset;                // Word offset in ETMCanDebugMirror (debug registers) or ETMCanBoardData
+  unsigned int   words;                 // Number of words to store, 0 if the register is not routed
+} ETMCanLogRoute;
+
+#define LOG_ROUTE_BOARD(member)         {0, (offsetof(ETMCanBoardData, member) / sizeof(unsigned int)), 4}
+#define LOG_ROUTE_DEBUG(member)         {1, (offsetof(ETMCanDebugMirror, member) / sizeof(unsigned int)), 4}
+
+static const ETMCanLogRoute etm_can_master_log_route[64] = {
+  {0, 0, 0},                                                     // 0x000 FAST_LOG_0 (handled separately)
+  {0, 0, 0},                                                     // 0x010 FAST_LOG_1 (handled separately)
+  {0, 0, 0},                                                     // 0x020 FAST_LOG_2 (handled separately)
+  {0, 0, 0},                                                     // 0x030 FAST_LOG_3 (handled separately)
+  LOG_ROUTE_BOARD(log_data[0]),                                  // 0x040 BOARD_SPECIFIC_0
+  LOG_ROUTE_BOARD(log_data[4]),                                  // 0x050 BOARD_SPECIFIC_1
+  LOG_ROUTE_BOARD(log_data[8]),                                  // 0x060 BOARD_SPECIFIC_2
+  LOG_ROUTE_BOARD(log_data[12]),                                 // 0x070 BOARD_SPECIFIC_3
+  LOG_ROUTE_BOARD(log_data[16]),                                 // 0x080 BOARD_SPECIFIC_4
+  LOG_ROUTE_BOARD(log_data[20]),                                 // 0x090 BOARD_SPECIFIC_5
+  {0, 0, 0},                                                     // 0x0A0
+  {0, 0, 0},                                                     // 0x0B0
+  {0, 0, 0},                                                     // 0x0C0
+  {0, 0, 0},                                                     // 0x0D0
+  LOG_ROUTE_BOARD(config_data[0]),                               // 0x0E0 DEFAULT_CONFIG_0
+  LOG_ROUTE_BOARD(config_data[4]),                               // 0x0F0 DEFAULT_CONFIG_1
+  LOG_ROUTE_DEBUG(debug_data.debug_reg[0]),         // 0x100 DEFAULT_DEBUG_0
+  LOG_ROUTE_DEBUG(debug_data.debug_reg[4]),         // 0x110 DEFAULT_DEBUG_1
+  LOG_ROUTE_DEBUG(debug_data.debug_reg[8]),         // 0x120 DEFAULT_DEBUG_2
+  LOG_ROUTE_DEBUG(debug_data.debug_reg[12]),        // 0x130 DEFAULT_DEBUG_3
+  {0, 0, 0},                                                     // 0x140
+  {0, 0, 0},                                                     // 0x150
+  {0, 0, 0},                                                     // 0x160
+  {0, 0, 0},                                                     // 0x170
+  {0, 0, 0},                                                     // 0x180
+  {0, 0, 0},                                                     // 0x190
+  {0, 0, 0},                                                     // 0x1A0
+  {0, 0, 0},                                                     // 0x1B0
+  {0, 0, 0},                                                     // 0x1C0
+  {0, 0, 0},                                                     // 0x1D0
+  {0, 0, 0},                                                     // 0x1E0
+  {0, 0, 0},                                                     // 0x1F0
+  LOG_ROUTE_DEBUG(debug_data.can_tx_0),             // 0x200 DEFAULT_CAN_ERROR_0
+  LOG_ROUTE_DEBUG(debug_data.can_rx_0_filt_0),      // 0x210 DEFAULT_CAN_ERROR_1
+  LOG_ROUTE_DEBUG(debug_data.can_unknown_msg_id),   // 0x220 DEFAULT_CAN_ERROR_2
+  LOG_ROUTE_DEBUG(debug_data.can_tx_buf_overflow),  // 0x230 DEFAULT_CAN_ERROR_3
+  LOG_ROUTE_DEBUG(timing_data.tx_histogram[0][0]),  // 0x240 DEFAULT_CAN_TIMING_0
+  LOG_ROUTE_DEBUG(timing_data.tx_histogram[1][0]),  // 0x250 DEFAULT_CAN_TIMING_1
+  LOG_ROUTE_DEBUG(timing_data.tx_histogram[2][0]),  // 0x260 DEFAULT_CAN_TIMING_2
+  LOG_ROUTE_DEBUG(timing_data.tx_histogram[3][0]),  // 0x270 DEFAULT_CAN_TIMING_3
+  LOG_ROUTE_DEBUG(debug_data.reset_count),          // 0x280 DEFAULT_SYSTEM_ERROR_0
+  LOG_ROUTE_DEBUG(debug_data.i2c_bus_error_count),  // 0x290 DEFAULT_SYSTEM_ERROR_1
+  LOG_ROUTE_DEBUG(timing_data.tx_max[0]),           // 0x2A0 DEFAULT_CAN_TIMING_4
+  LOG_ROUTE_DEBUG(timing_data.tx_buffer_max[0]),    // 0x2B0 DEFAULT_CAN_TIMING_5
+  LOG_ROUTE_DEBUG(timing_data.rx_histogram[0]),     // 0x2C0 DEFAULT_CAN_TIMING_6
+  LOG_ROUTE_DEBUG(timing_data.rx_max),              // 0x2D0 DEFAULT_CAN_TIMING_7
+  {0, 0, 0},                                                     // 0x2E0
+  {0, 0, 0},                                                     // 0x2F0
+  {0, 0, 0},                                                     // 0x300
+  {0, 0, 0},                                                     // 0x310
+  {0, 0, 0},                                                     // 0x320
+  {0, 0, 0},                                                     // 0x330
+  {0, 0, 0},                                                     // 0x340
+  {0, 0, 0},                                                     // 0x350
+  {0, 0, 0},                                                     // 0x360
+  {0, 0, 0},                                                     // 0x370
+  {0, 0, 0},                                                     // 0x380
+  {0, 0, 0},                                                     // 0x390
+  {0, 0, 0},                                                     // 0x3A0
+  {0, 0, 0},                                                     // 0x3B0
+  {0, 0, 0},                                                     // 0x3C0
+  {0, 0, 0},                                                     // 0x3D0
+  {0, 0, 0},                                                     // 0x3E0
+  {0, 0, 0}                                                      // 0x3F0
+};
+
+// The boards that must connect for the ECB to run by default, one bit per board address
+static const unsigned int etm_can_master_default_expected_boards = 0
+#ifndef __IGNORE_ION_PUMP_MODULE
+  | (1 << ETM_CAN_ADDR_ION_PUMP_BOARD)
+#endif
+#ifndef __IGNORE_PULSE_CURRENT_MODULE
+  | (1 << ETM_CAN_ADDR_MAGNETRON_CURRENT_BOARD)
+#endif
+#ifndef __IGNORE_PULSE_SYNC_MODULE
+  | (1 << ETM_CAN_ADDR_PULSE_SYNC_BOARD)
+#endif
+#ifndef __IGNORE_HV_LAMBDA_MODULE
+  | (1 << ETM_CAN_ADDR_HV_LAMBDA_BOARD)
+#endif
+#ifndef __IGNORE_AFC_MODULE
+  | (1 << ETM_CAN_ADDR_AFC_CONTROL_BOARD)
+#endif
+#ifndef __IGNORE_COOLING_INTERFACE_MODULE
+  | (1 << ETM_CAN_ADDR_COOLING_INTERFACE_BOARD)
+#endif
+#ifndef __IGNORE_HEATER_MAGNET_MODULE
+  | (1 << ETM_CAN_ADDR_HEATER_MAGNET_BOARD)
+#endif
+#ifndef __IGNORE_GUN_DRIVER_MODULE
+  | (1 << ETM_CAN_ADDR_GUN_DRIVER_BOARD)
+#endif
+  ;
 
 
 // ------------- Global Variables ------------ //
@@ -87,10 +213,11 @@ unsigned int etm_can_master_next_pulse_count;
 
 
 // --------------------- Local Variables -------------------------- //
-unsigned int master_high_speed_update_index;
-unsigned int master_low_speed_update_index;
-P1395BoardBits board_status_received;
-P1395BoardBits board_com_fault;
+unsigned int board_status_received;   // One bit per board address, status received since the last timeout check
+unsigned int board_com_fault;         // One bit per board address, board has lost communication
+unsigned int etm_can_master_expected_boards;  // One bit per board address, boards that must be connected
+unsigned int etm_can_master_timeout_tick;     // etm_can_master_tick of the last deadline check
+TYPE_BOARD_COMMUNICATION board_communication[ETM_CAN_MASTER_BOARDS];  // Indexed by board address
 TYPE_CAN_PARAMETERS can_params;
 
 
@@ -105,15 +232,7 @@ volatile unsigned int *CXTX2CON_ptr;
 
 
 // --------- Ram Structures that store the module status ---------- //
-ETMCanBoardData local_data_ecb;
-ETMCanBoardData mirror_hv_lambda;
-ETMCanBoardData mirror_ion_pump;
-ETMCanBoardData mirror_afc;
-ETMCanBoardData mirror_cooling;
-ETMCanBoardData mirror_htr_mag;
-ETMCanBoardData mirror_gun_drv;
-ETMCanBoardData mirror_magnetron_mon;
-ETMCanBoardData mirror_pulse_sync;
+ETMCanBoardData etm_can_master_mirror[ETM_CAN_MASTER_BOARDS];
 
 
 // ---------------- CAN Message Defines ---------------------- //
@@ -134,12 +253,26 @@ void ETMCanMasterProcessMessage(void);
 
 void ETMCanMasterCheckForTimeOut(void);
 
+void ETMCanMasterCalibrationProcess(void);
+/*
+  Sends the next page of every calibration block transfer and retries the pages that the slave has not answered
+*/
+
+void ETMCanMasterCalibrationBlockReturn(ETMCanMessage* message_ptr);
+/*
+  This processes a calibration block write acknowledge or a frame of calibration block read data from a slave
+*/
+
+void ETMCanMasterEventLogStore(void);
+/*
+  Writes the next page of the event log to the EEPROM (if it is full or has waited ETM_CAN_MASTER_EVENT_LOG_FLUSH)
+*/
+
 
 
 void ETMCanMasterTimedTransmit(void);
 /*
-  This schedules all of the Master commands (listed below)
-  
+  This schedules all of the Master commands (listed below) from etm_can_master_job_table
 */
 
 
@@ -147,29 +280,115 @@ void ETMCanMasterTimedTransmit(void);
 
 // These are the regularly scheduled commands that the ECB sends to sub boards
 void ETMCanMasterSendSync();                          // This gets sent out 1 time every 50ms
-void ETMCanMasterHVLambdaUpdateOutput(void);          // This gets sent out 1 time every 200ms
-void ETMCanMasterHtrMagnetUpdateOutput(void);         // This gets sent out 1 time every 200ms 
-void ETMCanMasterGunDriverUpdatePulseTop(void);       // This gets sent out 1 time every 200ms
-void ETMCanMasterAFCUpdateHomeOffset(void);           // This gets sent out at 200ms / 6 = 1.2 Seconds
-void ETMCanMasterGunDriverUpdateHeaterCathode(void);  // This gets sent out at 200ms / 6 = 1.2 Seconds
-void ETMCanMasterPulseSyncUpdateHighRegZero(void);    // This gets sent out at 200ms / 6 = 1.2 Seconds
-void ETMCanMasterPulseSyncUpdateHighRegOne(void);     // This gets sent out at 200ms / 6 = 1.2 Seconds
-void ETMCanMasterPulseSyncUpdateLowRegZero(void);     // This gets sent out at 200ms / 6 = 1.2 Seconds
-void ETMCanMasterPulseSyncUpdateLowRegOne(void);      // This gets sent out at 200ms / 6 = 1.2 Seconds
+// The set point commands are sent within 25ms of a set point change and refreshed every ETM_CAN_MASTER_SETPOINT_REFRESH
+void ETMCanMasterHVLambdaUpdateOutput(void);
+void ETMCanMasterHtrMagnetUpdateOutput(void);
+void ETMCanMasterGunDriverUpdatePulseTop(void);
+void ETMCanMasterAFCUpdateHomeOffset(void);
+void ETMCanMasterGunDriverUpdateHeaterCathode(void);
+void ETMCanMasterPulseSyncUpdateHighRegZero(void);
+void ETMCanMasterPulseSyncUpdateHighRegOne(void);
+void ETMCanMasterPulseSyncUpdateLowRegZero(void);
+void ETMCanMasterPulseSyncUpdateLowRegOne(void);
 
 // DPARKER how are the LEDs set on Pulse Sync Board?? Missing that command
 
+
+
+// ---------------------- Periodic Transmit Jobs ------------------------ //
+/*
+  Every command that the ECB sends on a regular schedule is a job in etm_can_master_job_table.
+  To add a command, add it to the table and set ETM_CAN_MASTER_JOBS in P1395_CAN_MASTER.h to the new number of entries.
+  No other code changes are needed.  The build fails if ETM_CAN_MASTER_JOBS does not match the table.
+
+  Times are in T4 ticks (25ms).
+   - A job is released every period ticks, the first release is phase ticks after startup.
+     Give jobs with the same period different phases so that they do not all load the bus on the same tick.
+   - A released job must be sent before it is released again (deadline = release + period).
+   - Every tick up to ETM_CAN_MASTER_JOBS_PER_TICK released jobs are sent, earliest deadline first.
+   - If a job is released again before it was sent, overrun_count is incremented and only one copy is sent.
+   - Jobs without ETM_CAN_MASTER_JOB_ALWAYS are not released until the personality has been loaded.
+
+  Set point commands
+  A job with a setpoint pointer is also released on the first tick that any of its setpoint_words differ from the
+  values it last sent (the values are copied just before the job is sent).  While it differs the deadline is kept
+  ETM_CAN_MASTER_SETPOINT_SLACK ticks ahead, so a changed set point goes out ahead of the periodic jobs except sync (the
+  first job in the table wins the tie).  The period is then only a keep alive.
+  Until a set point job has been sent its last sent values are kept different from the set point (at startup and while
+  the job is held for the personality).  Every set point job is then sent within 6 ticks (150ms) of the personality
+  loading, without delaying sync.
+  
+  Sync is sent every 50ms and the set point commands are refreshed every 2 seconds (staggered across the 2 seconds)
+*/
+
+#ifndef ETM_CAN_MASTER_JOBS_PER_TICK
+#define ETM_CAN_MASTER_JOBS_PER_TICK              2
+#endif
+
+#ifndef ETM_CAN_MASTER_SETPOINT_REFRESH
+#define ETM_CAN_MASTER_SETPOINT_REFRESH           80      // T4 ticks (2 seconds)
+#endif
+
+#define ETM_CAN_MASTER_SETPOINT_SLACK             2       // T4 ticks, the sync period
+
+#define ETM_CAN_MASTER_JOB_ALWAYS                 0x0001  // Send this job before the personality is loaded
+
+typedef struct {
+  void         (*send)(void);
+  unsigned int period;            // T4 ticks
+  unsigned int phase;             // T4 ticks
+  unsigned int flags;
+  unsigned int* setpoint;         // First set point word that the job sends, 0 if the job is only periodic
+  unsigned int setpoint_words;    // Number of consecutive set point words (ETM_CAN_MASTER_JOB_SETPOINT_WORDS max)
+} ETMCanMasterJob;
+
+#define SETPOINT_REFRESH(phase)   ETM_CAN_MASTER_SETPOINT_REFRESH, ((phase) * ETM_CAN_MASTER_SETPOINT_REFRESH / 10 + 1), 0
+
+static const ETMCanMasterJob etm_can_master_job_table[] = {
+  {ETMCanMasterSendSync,                     2, 0, ETM_CAN_MASTER_JOB_ALWAYS,  0,                                           0},
+  {ETMCanMasterHVLambdaUpdateOutput,         SETPOINT_REFRESH(0),              &local_hv_lambda_high_en_set_point,          2},
+  {ETMCanMasterHtrMagnetUpdateOutput,        SETPOINT_REFRESH(1),              &local_heater_current_scaled_set_point,      2},
+  {ETMCanMasterGunDriverUpdatePulseTop,      SETPOINT_REFRESH(2),              &local_gun_drv_high_en_pulse_top_v,          2},
+  {ETMCanMasterGunDriverUpdateHeaterCathode, SETPOINT_REFRESH(3),              &local_gun_drv_heater_v_set_point,           2},
+  {ETMCanMasterAFCUpdateHomeOffset,          SETPOINT_REFRESH(4),              &local_afc_home_position,                    2},
+  {ETMCanMasterPulseSyncUpdateHighRegZero,   SETPOINT_REFRESH(5),              &local_pulse_sync_timing_reg_0_word_0,       3},
+  {ETMCanMasterPulseSyncUpdateHighRegOne,    SETPOINT_REFRESH(6),              &local_pulse_sync_timing_reg_1_word_0,       3},
+  {ETMCanMasterPulseSyncUpdateLowRegZero,    SETPOINT_REFRESH(7),              &local_pulse_sync_timing_reg_2_word_0,       3},
+  {ETMCanMasterPulseSyncUpdateLowRegOne,     SETPOINT_REFRESH(8),              &local_pulse_sync_timing_reg_3_word_0,       3}
+};
+
+// The array size in the table is not given so that a missing or extra entry is caught here instead of sending a null job
+typedef char etm_can_master_job_table_must_have_ETM_CAN_MASTER_JOBS_entries[(sizeof(etm_can_master_job_table) / sizeof(etm_can_master_job_table[0]) == ETM_CAN_MASTER_JOBS) ? 1 : -1];
+
+ETMCanMasterJobState etm_can_master_job_state[ETM_CAN_MASTER_JOBS];
+unsigned int etm_can_master_tick;
+
+void ETMCanMasterJobsInitialize(void);
+/*
+  Sets the first release of every job from the phase in etm_can_master_job_table
+*/
+
+unsigned int ETMCanMasterJobSetpointChanged(unsigned int job);
+/*
+  Returns 1 if the set point of this job is different from the last values that were sent
+*/
+
+void ETMCanMasterJobSetpointForce(unsigned int job);
+/*
+  Makes the last sent values of a set point job differ from its set point so that the job is released as changed
+*/
+
 void ETMCanMasterDataReturnFromSlave(ETMCanMessage* message_ptr);
 /*
   This processes Return Commands (From slave board).
-  This is used to return EEprom Data
+  This is used to return EEprom Data and calibration blocks
 */
 
 
 void ETMCanMasterUpdateSlaveStatus(ETMCanMessage* message_ptr);
 /*
   This moves the data from the status message into the RAM copy on the master
-  It also keeps track of which boards have sent a status message and clears TMR5 once all boards have reported a status message
+  It also records when each board last sent a status message and moves that board's communication deadline
 */
 
 void ETMCanMasterProcessLogData(void);
@@ -178,6 +397,16 @@ void ETMCanMasterProcessLogData(void);
 */
 
 
+static void ETMCanMasterDebugMirrorAssign(ETMCanDebugMirror* mirror_ptr, unsigned int board);
+/*
+  This zeros a debug mirror and assigns it to a board
+*/
+
+unsigned int ETMCanMasterT4Flag(unsigned int clear);
+/*
+  This reads (and clears) _T4IF for the CAN latency timing, see ETMCanTimerFlag
+*/
+
 void ETMCanMasterClearDebug(void);
 /*
   This sets all the debug data to zero.
@@ -188,6 +417,9 @@ void ETMCanMasterClearDebug(void);
 
 void ETMCanMasterInitialize(unsigned int requested_can_port, unsigned long fcy, unsigned int etm_can_address, unsigned long can_operation_led, unsigned int can_interrupt_priority) {
   unsigned long timer_period_value;
+  ETMCanBitTiming bit_timing;
+  unsigned int bit_timing_error;
+  unsigned int n;
 
   if (can_interrupt_priority > 7) {
     can_interrupt_priority = 7;
@@ -200,7 +432,7 @@ void ETMCanMasterInitialize(unsigned int requested_can_port, unsigned long fcy,
   
   _SYNC_CONTROL_WORD = 0;
   etm_can_sync_message.sync_1_ecb_state_for_fault_logic = 0;
-  etm_can_sync_message.sync_2 = 0;
+  etm_can_sync_message.sync_2_debug_boards = 0;
   etm_can_sync_message.sync_3 = 0;
   
   debug_data_ecb.reset_count = etm_can_persistent_data.reset_count;
@@ -209,6 +441,43 @@ void ETMCanMasterInitialize(unsigned int requested_can_port, unsigned long fcy,
   ETMCanBufferInitialize(&etm_can_master_rx_message_buffer);
   ETMCanBufferInitialize(&etm_can_master_tx_message_buffer);
   ETMCanBufferInitialize(&etm_can_master_rx_data_log_buffer);
+  ETMCanBufferInitialize(&etm_can_master_tx_sync_buffer);
+
+  etm_can_high_speed_data_ring.write_index = 0;
+  etm_can_high_speed_data_ring.start_index = 0;
+  etm_can_high_speed_data_ring.read_index = 0;
+  etm_can_high_speed_data_ring.release_index = 0;
+  etm_can_high_speed_data_ring.resync_count = 0;
+  etm_can_high_speed_data_ring.overrun_count = 0;
+  etm_can_high_speed_data_ring.export_count = 0;
+  etm_can_high_speed_data_ring.incomplete_count = 0;
+  etm_can_high_speed_data_ring.expected_mask = ETM_CAN_HIGH_SPEED_DATA_EXPECTED;
+  etm_can_high_speed_data_ring.late_count = 0;
+
+  for (n = 0; n < ETM_CAN_MASTER_CALIBRATION_TRANSFERS; n++) {
+    etm_can_master_calibration.transfer[n].board = 0;
+  }
+  etm_can_master_calibration.sequence = 0;
+  etm_can_master_calibration.page_count = 0;
+  etm_can_master_calibration.retry_count = 0;
+  etm_can_master_calibration.failed_count = 0;
+
+  // Mirror 0 is assigned to the GUI selection by the first sync message
+  for (n = 0; n < ETM_CAN_MASTER_DEBUG_MIRRORS; n++) {
+    etm_can_master_debug_mirror[n].board = ETM_CAN_MASTER_DEBUG_MIRROR_FREE;
+  }
+
+#ifdef ETM_CAN_MASTER_ISR_CYCLES
+  etm_can_master_isr_cycles.min = 0xFFFF;
+  etm_can_master_isr_cycles.max = 0;
+  etm_can_master_isr_cycles.avg_x16 = 0;
+  etm_can_master_isr_cycles.count = 0;
+#endif
+
+  etm_can_master_tx_scheduler.queue[ETM_CAN_TX_CLASS_PULSE_LEVEL] = 0;
+  etm_can_master_tx_scheduler.queue[ETM_CAN_TX_CLASS_STATUS_SYNC] = &etm_can_master_tx_sync_buffer;
+  etm_can_master_tx_scheduler.queue[ETM_CAN_TX_CLASS_CMD]         = &etm_can_master_tx_message_buffer;
+  etm_can_master_tx_scheduler.queue[ETM_CAN_TX_CLASS_LOG]         = 0;
 
 
   // Configure T4
@@ -225,6 +494,22 @@ void ETMCanMasterInitialize(unsigned int requested_can_port, unsigned long fcy,
   _T4IE = 0;
   T4CONbits.TON = 1;
 
+  // TMR4 is also the time base for the CAN latency timing
+  ETMCanTimingInitialize(&timing_data_ecb, &TMR4, &ETMCanMasterT4Flag, PR4, fcy);
+  ETMCanMasterJobsInitialize();
+
+  // Every board gets its default deadline, starting now
+  etm_can_master_timeout_tick = etm_can_master_tick;
+  board_status_received = 0x0000;
+  board_com_fault = 0x0000;
+  etm_can_master_expected_boards = 0x0000;
+  for (n = 0; n < ETM_CAN_MASTER_BOARDS; n++) {
+    board_communication[n].last_seen_tick = etm_can_master_tick;
+    board_communication[n].deadline = ETM_CAN_MASTER_BOARD_DEADLINE;
+    board_communication[n].no_connect_count = 0;
+  }
+  ETMCanMasterSetExpectedBoards(etm_can_master_default_expected_boards);
+
   // Configure T5
   timer_period_value = fcy;
   timer_period_value >>= 8;
@@ -253,6 +538,7 @@ void ETMCanMasterInitialize(unsigned int requested_can_port, unsigned long fcy,
     CXTX1CON_ptr = &C1TX1CON;
     CXTX2CON_ptr = &C1TX2CON;
     
+    ETMCanTXSchedulerInitialize(&etm_can_master_tx_scheduler, CXTX0CON_ptr, CXTX1CON_ptr, CXTX2CON_ptr, &debug_data_ecb.can_tx_0, &timing_data_ecb);
     
     _C1IE = 0;
     _C1IF = 0;
@@ -263,6 +549,8 @@ void ETMCanMasterInitialize(unsigned int requested_can_port, unsigned long fcy,
     C1INTEbits.RX0IE = 1; // Enable RXB0 interrupt
     C1INTEbits.RX1IE = 1; // Enable RXB1 interrupt
     C1INTEbits.TX0IE = 1; // Enable TXB0 interrupt
+    C1INTEbits.TX1IE = 1; // Enable TXB1 interrupt
+    C1INTEbits.TX2IE = 1; // Enable TXB2 interrupt
     C1INTEbits.ERRIE = 1; // Enable Error interrupt
 
   
@@ -273,20 +561,14 @@ void ETMCanMasterInitialize(unsigned int requested_can_port, unsigned long fcy,
     C1CTRL = CXCTRL_CONFIG_MODE_VALUE;
     while(C1CTRLbits.OPMODE != 4);
   
-    if (fcy == 25000000) {
-      C1CFG1 = CXCFG1_25MHZ_FCY_VALUE;    
-    } else if (fcy == 20000000) {
-      C1CFG1 = CXCFG1_20MHZ_FCY_VALUE;    
-    } else if (fcy == 10000000) {
-      C1CFG1 = CXCFG1_10MHZ_FCY_VALUE;    
-    } else {
-      // If you got here we can't configure the can module
-      // Try to set to operate in 10MHZ mode.
-      // Can probably won't talk
-      C1CFG1 = CXCFG1_10MHZ_FCY_VALUE;    
+    bit_timing_error = ETMCanBitTimingSolve(&bit_timing, fcy, ETM_CAN_BIT_RATE, ETM_CAN_SAMPLE_POINT);
+    if (bit_timing_error) {
+      // If you got here we can't configure the can module for ETM_CAN_BIT_RATE
+      // The module is left in configuration mode so that it can not disturb the rest of the network
+      debug_data_ecb.self_test_results.st_can_bit_timing = 1;
     }
-    
-    C1CFG2 = CXCFG2_VALUE;
+    C1CFG1 = bit_timing.cfg1;
+    C1CFG2 = bit_timing.cfg2;
     
     // Load Mask registers for RX0 and RX1
     C1RXM0SID = ETM_CAN_MASTER_RX0_MASK;
@@ -313,14 +595,16 @@ void ETMCanMasterInitialize(unsigned int requested_can_port, unsigned long fcy,
     C1RX0CON = CXRXXCON_VALUE;
     C1RX1CON = CXRXXCON_VALUE;
   
-    // Switch to normal operation
-    C1CTRL = CXCTRL_OPERATE_MODE_VALUE;
-    while(C1CTRLbits.OPMODE != 0);
-    
-    //etm_can_ethernet_board_data.status_received_register = 0x0000;
-    
-    // Enable Can interrupt
-    _C1IE = 1;
+    if (!bit_timing_error) {
+      // Switch to normal operation
+      C1CTRL = CXCTRL_OPERATE_MODE_VALUE;
+      while(C1CTRLbits.OPMODE != 0);
+      
+      //etm_can_ethernet_board_data.status_received_register = 0x0000;
+      
+      // Enable Can interrupt
+      _C1IE = 1;
+    }
   } else {
     // Use CAN2
   }
@@ -343,10 +627,17 @@ void ETMCanMasterLoadConfiguration(unsigned long agile_id, unsigned int agile_da
 
 
 void ETMCanMasterDoCan(void) {
+#ifdef ETM_CAN_MASTER_ISR_CYCLES
+  unsigned int isr_count;
+  unsigned long isr_avg_x16;
+#endif
+
   ETMCanMasterProcessMessage();
   ETMCanMasterTimedTransmit();
   ETMCanMasterProcessLogData();
   ETMCanMasterCheckForTimeOut();
+  ETMCanMasterCalibrationProcess();
+  ETMCanMasterEventLogStore();
   if (_SYNC_CONTROL_CLEAR_DEBUG_DATA) {
     ETMCanMasterClearDebug();
   }
@@ -356,6 +647,19 @@ void ETMCanMasterDoCan(void) {
   // Record the RCON state
   debug_data_ecb.RCON_value = RCON;
 
+#ifdef ETM_CAN_MASTER_ISR_CYCLES
+  // CAN interrupt cycles (min, max, average, interrupt count)
+  // The average is two words, read it again if the CAN interrupt ran in between
+  do {
+    isr_count = etm_can_master_isr_cycles.count;
+    isr_avg_x16 = etm_can_master_isr_cycles.avg_x16;
+  } while (isr_count != etm_can_master_isr_cycles.count);
+  debug_data_ecb.debug_reg[ETM_CAN_MASTER_ISR_CYCLES_DEBUG_REG]     = etm_can_master_isr_cycles.min;
+  debug_data_ecb.debug_reg[ETM_CAN_MASTER_ISR_CYCLES_DEBUG_REG + 1] = etm_can_master_isr_cycles.max;
+  debug_data_ecb.debug_reg[ETM_CAN_MASTER_ISR_CYCLES_DEBUG_REG + 2] = (unsigned int)(isr_avg_x16 >> 4);
+  debug_data_ecb.debug_reg[ETM_CAN_MASTER_ISR_CYCLES_DEBUG_REG + 3] = isr_count;
+#endif
+
   // Record the max TX counter
   if ((*CXEC_ptr & 0xFF00) > (debug_data_ecb.CXEC_reg_max & 0xFF00)) {
     debug_data_ecb.CXEC_reg_max &= 0x00FF;
@@ -371,21 +675,28 @@ void ETMCanMasterDoCan(void) {
 
 
 void ETMCanMasterProcessMessage(void) {
-  ETMCanMessage next_message;
-  while (ETMCanBufferNotEmpty(&etm_can_master_rx_message_buffer)) {
-    ETMCanReadMessageFromBuffer(&etm_can_master_rx_message_buffer, &next_message);
-    if ((next_message.identifier & ETM_CAN_MASTER_RX0_MASK) == ETM_CAN_MSG_RTN_RX) {
-      ETMCanMasterDataReturnFromSlave(&next_message);
-    } else if ((next_message.identifier & ETM_CAN_MASTER_RX0_MASK) == ETM_CAN_MSG_STATUS_RX) {
-      ETMCanMasterUpdateSlaveStatus(&next_message);
-    } else {
-      debug_data_ecb.can_unknown_msg_id++;
-    } 
+  ETMCanMessage* next_message;
+  unsigned int messages;
+  unsigned int n;
+  while ((messages = ETMCanBufferPeek(&etm_can_master_rx_message_buffer, &next_message))) {
+    for (n = messages; n; n--, next_message++) {
+      ETMCanTimingRecordRX(&timing_data_ecb, &etm_can_master_rx_message_buffer, next_message);
+      if ((next_message->identifier & ETM_CAN_MASTER_MSG_TYPE_MASK) == ETM_CAN_MSG_RTN_RX) {
+	ETMCanMasterDataReturnFromSlave(next_message);
+      } else if ((next_message->identifier & ETM_CAN_MASTER_MSG_TYPE_MASK) == ETM_CAN_MSG_STATUS_RX) {
+	ETMCanMasterUpdateSlaveStatus(next_message);
+      } else {
+	debug_data_ecb.can_unknown_msg_id++;
+      } 
+    }
+    ETMCanBufferCommit(&etm_can_master_rx_message_buffer, messages);
   }
   
-  debug_data_ecb.can_tx_buf_overflow = etm_can_master_tx_message_buffer.message_overwrite_count;
+  debug_data_ecb.can_tx_buf_overflow = etm_can_master_tx_message_buffer.message_overwrite_count + etm_can_master_tx_sync_buffer.message_overwrite_count;
   debug_data_ecb.can_rx_buf_overflow = etm_can_master_rx_message_buffer.message_overwrite_count;
   debug_data_ecb.can_rx_log_buf_overflow = etm_can_master_rx_data_log_buffer.message_overwrite_count;
+  debug_data_ecb.can_buf_high_water = ((etm_can_master_tx_message_buffer.message_high_water << 8) +
+				       etm_can_master_rx_data_log_buffer.message_high_water);
 }
 
 
@@ -395,12 +706,59 @@ void ETMCanMasterProcessMessage(void) {
 #define _STATUS_PERSONALITY_LOADED local_data_ecb.status.control_notice_bits.control_not_configured
 
 
+void ETMCanMasterJobsInitialize(void) {
+  unsigned int n;
+  unsigned int word;
+  
+  etm_can_master_tick = 0;
+  for (n = 0; n < ETM_CAN_MASTER_JOBS; n++) {
+    etm_can_master_job_state[n].release = etm_can_master_job_table[n].phase;
+    etm_can_master_job_state[n].deadline = etm_can_master_job_table[n].phase;
+    etm_can_master_job_state[n].pending = 0;
+    etm_can_master_job_state[n].sent_count = 0;
+    etm_can_master_job_state[n].overrun_count = 0;
+    etm_can_master_job_state[n].change_count = 0;
+    for (word = 0; word < ETM_CAN_MASTER_JOB_SETPOINT_WORDS; word++) {
+      etm_can_master_job_state[n].sent_setpoint[word] = 0;
+    }
+    ETMCanMasterJobSetpointForce(n);
+  }
+}
+
+
+unsigned int ETMCanMasterJobSetpointChanged(unsigned int job) {
+  unsigned int word;
+  
+  for (word = 0; word < etm_can_master_job_table[job].setpoint_words; word++) {
+    if (etm_can_master_job_table[job].setpoint[word] != etm_can_master_job_state[job].sent_setpoint[word]) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+void ETMCanMasterJobSetpointForce(unsigned int job) {
+  unsigned int word;
+  
+  for (word = 0; word < etm_can_master_job_table[job].setpoint_words; word++) {
+    etm_can_master_job_state[job].sent_setpoint[word] = ~etm_can_master_job_table[job].setpoint[word];
+  }
+}
+
+
 void ETMCanMasterTimedTransmit(void) {
   /*
-    One command is schedule to be sent every 25ms
-    This loops through 8 times so each command is sent once every 200mS (5Hz)
-    The sync command and Pulse Sync enable command are each sent twice for an effecive rate of 100ms (10Hz)
+    The job table is run once every 25ms (T4)
+    Jobs that are due are released and then up to ETM_CAN_MASTER_JOBS_PER_TICK of the released jobs are sent,
+    earliest deadline first
   */
+  unsigned int n;
+  unsigned int sent;
+  unsigned int next_job;
+  int next_slack;
+  int slack;
+  ETMCanMasterJobState* state_ptr;
   
   if ((_STATUS_X_RAY_DISABLED == 0) && (_SYNC_CONTROL_PULSE_SYNC_DISABLE_XRAY)) {
     // We need to immediately send out a sync message
@@ -408,96 +766,69 @@ void ETMCanMasterTimedTransmit(void) {
   }
   
   
-  if (_T4IF) {
-    // should be true once every 25mS
-    // each of the 8 cases will be true once every 200mS
-    _T4IF = 0;
-
-    if (!_STATUS_PERSONALITY_LOADED) {
-      // Just send out a sync message
-      ETMCanMasterSendSync();
-    } else {
-      master_high_speed_update_index++;
-      master_high_speed_update_index &= 0x7;
-      
-      
-      switch (master_high_speed_update_index) 
-	{
-	case 0x0:
-	  // Send Sync Command (this is on TX1) - This also includes Pulse Sync Enable/Disable
-	  ETMCanMasterSendSync();
-	  break;
-	  
-	case 0x1:
-	  // Send High/Low Energy Program voltage to Lambda Board
-	  ETMCanMasterHVLambdaUpdateOutput();
-	  break;
-	  
-	case 0x2:
-	  // Send Sync Command (this is on TX1) - This also includes Pulse Sync Enable/Disable
-	  ETMCanMasterSendSync();
-	  break;
-	  
-	case 0x3:
-	  // Send Heater/Magnet Current to Heater Magnet Board
-	  ETMCanMasterHtrMagnetUpdateOutput();
-	  break;
-	  
-	case 0x4:
-	  // Send Sync Command (this is on TX1) - This also includes Pulse Sync Enable/Disable
-	  ETMCanMasterSendSync();
-	  break;
-	  
-	case 0x5:
-	  // Send High/Low Energy Pulse top voltage to Gun Driver
-	  ETMCanMasterGunDriverUpdatePulseTop();
-	  break;
-	  
-	case 0x6:
-	  // Send Sync Command (this is on TX1) - This also includes Pulse Sync Enable/Disable
-	  ETMCanMasterSendSync();
-	  break;
-	  
-	case 0x7:
-	  // LOOP THROUGH SLOWER SPEED TRANSMITS
-	  /*
-	    THis is the following messages
-	    Gun Driver Heater/Cathode
-	    AFC Home/Offset
-	    Pulse Sync Registers 1,2,3,4
-	  */
-
-	  master_low_speed_update_index++;
-	  if (master_low_speed_update_index >= 6) {
-	    master_low_speed_update_index = 0;
-	  } 
-	  
-	  if (master_low_speed_update_index == 0) {
-	    ETMCanMasterGunDriverUpdateHeaterCathode();  
-	  }
-
-	  if (master_low_speed_update_index == 1) {
-	    ETMCanMasterAFCUpdateHomeOffset();	   
-	  }
-
-	  if (master_low_speed_update_index == 2) {
-	    ETMCanMasterPulseSyncUpdateHighRegZero();	   
-	  }
-
-	  if (master_low_speed_update_index == 3) {
-	    ETMCanMasterPulseSyncUpdateHighRegOne();	   
-	  }
-
-	  if (master_low_speed_update_index == 4) {
-	    ETMCanMasterPulseSyncUpdateLowRegZero();	   
-	  }
+  if (ETMCanTimingRollover(&timing_data_ecb)) {
+    // should be true once every 25mS (this clears _T4IF)
+
+    // Release every job that is due
+    for (n = 0; n < ETM_CAN_MASTER_JOBS; n++) {
+      state_ptr = &etm_can_master_job_state[n];
+      if (!_STATUS_PERSONALITY_LOADED && !(etm_can_master_job_table[n].flags & ETM_CAN_MASTER_JOB_ALWAYS)) {
+	// Hold this job until the personality is loaded
+	if ((int)(etm_can_master_tick - state_ptr->release) >= 0) {
+	  state_ptr->release += etm_can_master_job_table[n].period;
+	}
+	state_ptr->pending = 0;
+	// Send the current set point as soon as the personality is loaded
+	ETMCanMasterJobSetpointForce(n);
+	continue;
+      }
+      if ((int)(etm_can_master_tick - state_ptr->release) >= 0) {
+	state_ptr->release += etm_can_master_job_table[n].period;
+	if (state_ptr->pending) {
+	  // The last release was not sent before its deadline
+	  state_ptr->overrun_count++;
+	}
+	state_ptr->pending = 1;
+	state_ptr->deadline = state_ptr->release;
+      }
+      if (etm_can_master_job_table[n].setpoint && ETMCanMasterJobSetpointChanged(n)) {
+	// Send the new set point in the next free slot
+	if (!state_ptr->pending || ((int)(state_ptr->deadline - etm_can_master_tick) >= ETM_CAN_MASTER_SETPOINT_SLACK)) {
+	  state_ptr->change_count++;
+	}
+	state_ptr->pending = 1;
+	state_ptr->deadline = etm_can_master_tick + ETM_CAN_MASTER_SETPOINT_SLACK;
+      }
+    }
 
-	  if (master_low_speed_update_index == 5) {
-	    ETMCanMasterPulseSyncUpdateLowRegOne();	   
-	  }
-	  break;
+    // Send the released jobs, earliest deadline first
+    for (sent = 0; sent < ETM_CAN_MASTER_JOBS_PER_TICK; sent++) {
+      next_job = ETM_CAN_MASTER_JOBS;
+      next_slack = 0;
+      for (n = 0; n < ETM_CAN_MASTER_JOBS; n++) {
+	state_ptr = &etm_can_master_job_state[n];
+	if (!state_ptr->pending) {
+	  continue;
+	}
+	slack = (int)(state_ptr->deadline - etm_can_master_tick);
+	if ((next_job == ETM_CAN_MASTER_JOBS) || (slack < next_slack)) {
+	  next_job = n;
+	  next_slack = slack;
 	}
+      }
+      if (next_job == ETM_CAN_MASTER_JOBS) {
+	break;
+      }
+      state_ptr = &etm_can_master_job_state[next_job];
+      state_ptr->pending = 0;
+      state_ptr->sent_count++;
+      for (n = 0; n < etm_can_master_job_table[next_job].setpoint_words; n++) {
+	state_ptr->sent_setpoint[n] = etm_can_master_job_table[next_job].setpoint[n];
+      }
+      etm_can_master_job_table[next_job].send();
     }
+
+    etm_can_master_tick++;
   }
 }
 
@@ -506,14 +837,22 @@ void ETMCanMasterTimedTransmit(void) {
 
 void ETMCanMasterSendSync(void) {
   ETMCanMessage sync_message;
+
+  // Mirror 0 follows the board selected on the GUI
+  if (etm_can_master_debug_mirror[0].board != etm_can_active_debugging_board_id) {
+    ETMCanMasterDebugMirrorAssign(&etm_can_master_debug_mirror[0], etm_can_active_debugging_board_id);
+  }
+  etm_can_sync_message.sync_2_debug_boards = ETMCanMasterGetDebugBoards();
+  _SYNC_CONTROL_DEBUG_BOARDS_SELECTED = 1;  // Tells the slaves that sync_2_debug_boards is valid
+
   sync_message.identifier = ETM_CAN_MSG_SYNC_TX;
   sync_message.word0 = _SYNC_CONTROL_WORD;
-  sync_message.word2 = etm_can_sync_message.sync_1_ecb_state_for_fault_logic; // DPARKER update with the current state or point to the current state
-  sync_message.word2 = etm_can_sync_message.sync_2;
+  sync_message.word1 = etm_can_sync_message.sync_1_ecb_state_for_fault_logic; // DPARKER update with the current state or point to the current state
+  sync_message.word2 = etm_can_sync_message.sync_2_debug_boards;
   sync_message.word3 = etm_can_sync_message.sync_3;
   
-  ETMCanTXMessage(&sync_message, CXTX1CON_ptr);
-  debug_data_ecb.can_tx_1++;
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_STATUS_SYNC, &sync_message);
+  MacroETMCanCheckTXBuffer();
 
   _STATUS_X_RAY_DISABLED = _SYNC_CONTROL_PULSE_SYNC_DISABLE_XRAY;
 }
@@ -521,101 +860,101 @@ void ETMCanMasterSendSync(void) {
 void ETMCanMasterHVLambdaUpdateOutput(void) {
   ETMCanMessage can_message;
   
-  can_message.identifier = (ETM_CAN_MSG_CMD_TX | (ETM_CAN_ADDR_HV_LAMBDA_BOARD << 2));
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, ETM_CAN_ADDR_HV_LAMBDA_BOARD);
   can_message.word3 = ETM_CAN_REGISTER_HV_LAMBDA_SET_1_LAMBDA_SET_POINT;
   can_message.word2 = local_hv_lambda_low_en_set_point;
   can_message.word1 = local_hv_lambda_high_en_set_point;
   can_message.word0 = 0;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
 }
 
 void ETMCanMasterAFCUpdateHomeOffset(void) {
   ETMCanMessage can_message;
-  can_message.identifier = (ETM_CAN_MSG_CMD_TX | (ETM_CAN_ADDR_AFC_CONTROL_BOARD << 2));
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, ETM_CAN_ADDR_AFC_CONTROL_BOARD);
   can_message.word3 = ETM_CAN_REGISTER_AFC_SET_1_HOME_POSITION_AND_OFFSET;
   can_message.word2 = local_afc_aft_control_voltage;
   can_message.word1 = 0;
   can_message.word0 = local_afc_home_position;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
 }
 
 void ETMCanMasterHtrMagnetUpdateOutput(void) {
   ETMCanMessage can_message;
-  can_message.identifier = (ETM_CAN_MSG_CMD_TX | (ETM_CAN_ADDR_HEATER_MAGNET_BOARD << 2));
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, ETM_CAN_ADDR_HEATER_MAGNET_BOARD);
   can_message.word3 = ETM_CAN_REGISTER_HEATER_MAGNET_SET_1_CURRENT_SET_POINT;
   can_message.word2 = 0;
   can_message.word1 = local_heater_current_scaled_set_point;
   can_message.word0 = local_magnet_current_set_point;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
 }
 
 void ETMCanMasterGunDriverUpdatePulseTop(void) {
   ETMCanMessage can_message;
-    can_message.identifier = (ETM_CAN_MSG_CMD_TX | (ETM_CAN_ADDR_GUN_DRIVER_BOARD << 2));
+    can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, ETM_CAN_ADDR_GUN_DRIVER_BOARD);
   can_message.word3 = ETM_CAN_REGISTER_GUN_DRIVER_SET_1_GRID_TOP_SET_POINT;
   can_message.word2 = 0;
   can_message.word1 = local_gun_drv_high_en_pulse_top_v;
   can_message.word0 = local_gun_drv_low_en_pulse_top_v;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
 }
 
 void ETMCanMasterGunDriverUpdateHeaterCathode(void) {
   ETMCanMessage can_message;
-  can_message.identifier = (ETM_CAN_MSG_CMD_TX | (ETM_CAN_ADDR_GUN_DRIVER_BOARD << 2));
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, ETM_CAN_ADDR_GUN_DRIVER_BOARD);
   can_message.word3 = ETM_CAN_REGISTER_GUN_DRIVER_SET_1_HEATER_CATHODE_SET_POINT;
   can_message.word2 = 0;
   can_message.word1 = local_gun_drv_cathode_set_point;
   can_message.word0 = local_gun_drv_heater_v_set_point;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
 }
 
 void ETMCanMasterPulseSyncUpdateHighRegZero(void) {
   ETMCanMessage can_message;
-  can_message.identifier = (ETM_CAN_MSG_CMD_TX | (ETM_CAN_ADDR_PULSE_SYNC_BOARD << 2));
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, ETM_CAN_ADDR_PULSE_SYNC_BOARD);
   can_message.word3 = ETM_CAN_REGISTER_PULSE_SYNC_SET_1_HIGH_ENERGY_TIMING_REG_0;
   can_message.word2 = local_pulse_sync_timing_reg_0_word_2;
   can_message.word1 = local_pulse_sync_timing_reg_0_word_1;
   can_message.word0 = local_pulse_sync_timing_reg_0_word_0;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
 }
 
 void ETMCanMasterPulseSyncUpdateHighRegOne(void) {
   ETMCanMessage can_message;
-  can_message.identifier = (ETM_CAN_MSG_CMD_TX | (ETM_CAN_ADDR_PULSE_SYNC_BOARD << 2));
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, ETM_CAN_ADDR_PULSE_SYNC_BOARD);
   can_message.word3 = ETM_CAN_REGISTER_PULSE_SYNC_SET_1_HIGH_ENERGY_TIMING_REG_1;
   can_message.word2 = local_pulse_sync_timing_reg_1_word_2;
   can_message.word1 = local_pulse_sync_timing_reg_1_word_1;
   can_message.word0 = local_pulse_sync_timing_reg_1_word_0;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
 }
 
 void ETMCanMasterPulseSyncUpdateLowRegZero(void) {
   ETMCanMessage can_message;
-  can_message.identifier = (ETM_CAN_MSG_CMD_TX | (ETM_CAN_ADDR_PULSE_SYNC_BOARD << 2));
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, ETM_CAN_ADDR_PULSE_SYNC_BOARD);
   can_message.word3 = ETM_CAN_REGISTER_PULSE_SYNC_SET_1_LOW_ENERGY_TIMING_REG_0;
   can_message.word2 = local_pulse_sync_timing_reg_2_word_2;
   can_message.word1 = local_pulse_sync_timing_reg_2_word_1;
   can_message.word0 = local_pulse_sync_timing_reg_2_word_0;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
 }
 
 void ETMCanMasterPulseSyncUpdateLowRegOne(void) {
   ETMCanMessage can_message;
-  can_message.identifier = (ETM_CAN_MSG_CMD_TX | (ETM_CAN_ADDR_PULSE_SYNC_BOARD << 2));
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, ETM_CAN_ADDR_PULSE_SYNC_BOARD);
   can_message.word3 = ETM_CAN_REGISTER_PULSE_SYNC_SET_1_LOW_ENERGY_TIMING_REG_1;
   can_message.word2 = local_pulse_sync_timing_reg_3_word_2;
   can_message.word1 = local_pulse_sync_timing_reg_3_word_1;
   can_message.word0 = local_pulse_sync_timing_reg_3_word_0;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
 }
 
 
@@ -630,6 +969,9 @@ void ETMCanMasterDataReturnFromSlave(ETMCanMessage* message_ptr) {
     // This is Calibration data that was read from the slave EEPROM
     SendCalibrationData(message_ptr->word3, message_ptr->word1, message_ptr->word0);
     // DPARKER SendCalibrationData Sends data to the GUI over TCP/IP.  Could use a better name
+  } else if ((index_word & 0x0E00) == ETM_CAN_REGISTER_CALIBRATION_BLOCK_WRITE) {
+    // Calibration block write acknowledge or calibration block read data
+    ETMCanMasterCalibrationBlockReturn(message_ptr);
   } else {
     // It was not a set value index 
     debug_data_ecb.can_invalid_index++;
@@ -640,10 +982,8 @@ void ETMCanMasterDataReturnFromSlave(ETMCanMessage* message_ptr) {
 void ETMCanMasterUpdateSlaveStatus(ETMCanMessage* message_ptr) {
   ETMCanStatusRegister status_message;
   unsigned int source_board;
-  unsigned int all_boards_connected;
   unsigned int message_bit;
-  source_board = (message_ptr->identifier >> 3);
-  source_board &= 0x000F;
+  source_board = ETM_CAN_ID_ADDRESS(ETM_CAN_RX_SID_TO_ID(message_ptr->identifier));
   message_bit = 1 << source_board;
   
   status_message.control_notice_bits = *(ETMCanStatusRegisterControlAndNoticeBits*)&message_ptr->word0;
@@ -652,544 +992,421 @@ void ETMCanMasterUpdateSlaveStatus(ETMCanMessage* message_ptr) {
   status_message.not_logged_bits     = *(ETMCanStatusRegisterNotLoggedBits*)&message_ptr->word3;
   ClrWdt();
 
-  switch (source_board) {
-    /*
-      Place all board specific status updates here
-    */
-
-  case ETM_CAN_ADDR_ION_PUMP_BOARD:
-    mirror_ion_pump.status = status_message;
-    board_status_received.ion_pump_board = 1;
-    break;
-
-  case ETM_CAN_ADDR_MAGNETRON_CURRENT_BOARD:
-    mirror_magnetron_mon.status = status_message;
-    board_status_received.magnetron_current_board = 1;
-    break;
-
-  case ETM_CAN_ADDR_PULSE_SYNC_BOARD:
-    mirror_pulse_sync.status = status_message;
-    board_status_received.pulse_sync_board = 1;
-    break;
-
-  case ETM_CAN_ADDR_HV_LAMBDA_BOARD:
-    mirror_hv_lambda.status = status_message;
-    board_status_received.hv_lambda_board = 1;
-    break;
-
-  case ETM_CAN_ADDR_AFC_CONTROL_BOARD:
-    mirror_afc.status = status_message;
-    board_status_received.afc_board = 1;
-    break;
-    
-  case ETM_CAN_ADDR_COOLING_INTERFACE_BOARD:
-    mirror_cooling.status = status_message;
-    board_status_received.cooling_interface_board = 1;
-    break;
-
-  case ETM_CAN_ADDR_HEATER_MAGNET_BOARD:
-    mirror_htr_mag.status = status_message;
-    board_status_received.heater_magnet_board = 1;
-    break;
-
-  case ETM_CAN_ADDR_GUN_DRIVER_BOARD:
-    mirror_gun_drv.status = status_message;
-    board_status_received.gun_driver_board = 1;
-    break;
-
-
-  default:
+  if (message_bit & ETM_CAN_MASTER_MIRROR_BOARDS) {
+    etm_can_master_mirror[source_board].status = status_message;
+    board_status_received |= message_bit;
+    board_communication[source_board].last_seen_tick = etm_can_master_tick;
+    board_communication[source_board].deadline_tick = etm_can_master_tick + board_communication[source_board].deadline;
+  } else {
     debug_data_ecb.can_address_error++;
-    break;
-  }
-
-  // Figure out if all the boards are connected
-  all_boards_connected = 1;
-
-#ifndef __IGNORE_ION_PUMP_MODULE
-  if (!board_status_received.ion_pump_board) {
-    all_boards_connected = 0;
-  }
-#endif
-
-
-#ifndef __IGNORE_PULSE_CURRENT_MODULE
-  if (!board_status_received.magnetron_current_board) {
-    all_boards_connected = 0;
-  }
-#endif
-
-#ifndef __IGNORE_PULSE_SYNC_MODULE
-  if (!board_status_received.pulse_sync_board) {
-    all_boards_connected = 0;
-  }
-#endif
-
-#ifndef __IGNORE_HV_LAMBDA_MODULE
-  if (!board_status_received.hv_lambda_board) {
-    all_boards_connected = 0;
-  }
-#endif
-
-#ifndef __IGNORE_AFC_MODULE
-  if (!board_status_received.afc_board) {
-    all_boards_connected = 0;
-  }
-#endif
-
-#ifndef __IGNORE_COOLING_INTERFACE_MODULE
-  if (!board_status_received.cooling_interface_board) {
-    all_boards_connected = 0;
-  }
-#endif
-
-#ifndef __IGNORE_HEATER_MAGNET_MODULE
-  if (!board_status_received.heater_magnet_board) {
-    all_boards_connected = 0;
-  }
-#endif
-
-#ifndef __IGNORE_GUN_DRIVER_MODULE
-  if (!board_status_received.gun_driver_board) {
-    all_boards_connected = 0;
   }
-#endif
-
-  if (all_boards_connected) {
-    // Clear the status received register
-    *(unsigned int*)&board_status_received = 0x0000; 
-    
-    // Reset T5 to start the next timer cycle
-    TMR5 = 0;
-  } 
 }
 
 
 
 
 void ETMCanMasterProcessLogData(void) {
-  ETMCanMessage          next_message;
+  ETMCanMessage*         next_message;
+  unsigned int           messages;
+  unsigned int           n;
   unsigned int           data_log_index;
   unsigned int           board_id;
   unsigned int           log_id;
 
-  ETMCanBoardData*       board_data_ptr;
+  const ETMCanLogRoute*  route_ptr;
+  unsigned int*          destination_ptr;
+  unsigned int*          source_ptr;
+  unsigned int           words;
+  ETMCanDebugMirror*     mirror_ptr;
 
-  unsigned int           fast_log_buffer_index;
   ETMCanHighSpeedData*   ptr_high_speed_data;
 
 
-  while (ETMCanBufferNotEmpty(&etm_can_master_rx_data_log_buffer)) {
-    ETMCanReadMessageFromBuffer(&etm_can_master_rx_data_log_buffer, &next_message);
-    data_log_index = next_message.identifier;
-    data_log_index >>= 2;
-    data_log_index &= 0x03FF;
-    board_id = data_log_index & 0x000F;
-    log_id = data_log_index & 0x03F0;
+  while ((messages = ETMCanBufferPeek(&etm_can_master_rx_data_log_buffer, &next_message))) {
+    // Process the messages in place, then release them all at once
+    for (n = messages; n; n--, next_message++) {
+      ETMCanTimingRecordRX(&timing_data_ecb, &etm_can_master_rx_data_log_buffer, next_message);
+      data_log_index = ETM_CAN_RX_SID_TO_ID(next_message->identifier);
+      board_id = ETM_CAN_ID_ADDRESS(data_log_index);
+      log_id = ETM_CAN_ID_LOG_REGISTER(data_log_index);
+      data_log_index = log_id | board_id;
 
 
 
-    if (log_id <= 0x03F) {
-      // It is high speed logging data that must be handled manually
-      // It is board specific logging data
-      
-      // Figure out where to store high speed logging data (this will only be used if it IS high speed data logging)
-      // But I'm going to go ahead and calculate where to store it for all messages
-      fast_log_buffer_index = next_message.word3 & 0x000F;
-      if (next_message.word3 & 0x0010) {
-	ptr_high_speed_data = &high_speed_data_buffer_a[fast_log_buffer_index];
-      } else {
-	ptr_high_speed_data = &high_speed_data_buffer_b[fast_log_buffer_index];
-      }
+      if (log_id <= 0x03F) {
+	// It is high speed logging data that must be handled manually
+	// It is board specific logging data
       
-      switch (data_log_index) 
-	{
- 	case ETM_CAN_DATA_LOG_REGISTER_HV_LAMBDA_FAST_LOG_0:
-	  // Update the high speed data table
-	  ptr_high_speed_data->hvlambda_readback_high_energy_lambda_program_voltage = next_message.word2;
-	  ptr_high_speed_data->hvlambda_readback_low_energy_lambda_program_voltage = next_message.word1;
-	  ptr_high_speed_data->hvlambda_readback_peak_lambda_voltage = next_message.word0;
-	  break;
-
-	case ETM_CAN_DATA_LOG_REGISTER_AFC_FAST_LOG_0:
-	  ptr_high_speed_data->afc_readback_current_position = next_message.word2;
-	  ptr_high_speed_data->afc_readback_target_position = next_message.word1;
-	  // unused word 0
-	  break;
-	  
-	case ETM_CAN_DATA_LOG_REGISTER_AFC_FAST_LOG_1:
-	  ptr_high_speed_data->afc_readback_a_input = next_message.word2;
-	  ptr_high_speed_data->afc_readback_b_input = next_message.word1;
-	  ptr_high_speed_data->afc_readback_filtered_error_reading = next_message.word0;
-	  break;
-	  
-	case ETM_CAN_DATA_LOG_REGISTER_MAGNETRON_MON_FAST_LOG_0:
-	  ptr_high_speed_data->magmon_readback_magnetron_low_energy_current = next_message.word2;  // Internal DAC Reading
-	  ptr_high_speed_data->magmon_readback_magnetron_high_energy_current = next_message.word1; // External DAC Reading
-	  if (next_message.word0) {
-	    ptr_high_speed_data->status_bits.arc_this_pulse = 1;
-	  }
-	  break;
-	  
-	case ETM_CAN_DATA_LOG_REGISTER_PULSE_SYNC_FAST_LOG_0:
-	  ptr_high_speed_data->psync_readback_trigger_width_and_filtered_trigger_width = next_message.word2;
-	  ptr_high_speed_data->psync_readback_high_energy_grid_width_and_delay = next_message.word1;
-	  ptr_high_speed_data->psync_readback_low_energy_grid_width_and_delay = next_message.word0;
-	  break;
-	  
-	default:
-	  debug_data_ecb.can_unknown_msg_id++;
-	  break;
+	// The record for this pulse (word3 is the pulse count) can only be updated if it has not been handed out or reused
+	ptr_high_speed_data = &etm_can_high_speed_data_ring.record[next_message->word3 & (ETM_CAN_HIGH_SPEED_DATA_DEPTH - 1)];
+	if ((ptr_high_speed_data->pulse_count != next_message->word3) ||
+	    ((int)(next_message->word3 - etm_can_high_speed_data_ring.release_index) < 0)) {
+	  etm_can_high_speed_data_ring.late_count++;
+	  continue;
 	}
-    } else if (log_id >= 0x100) {
-      // It is debugging information, load into the common debugging register if that board is actively being debugged
-      // DPARKER impliment this using used debug_data_slave_mirror
-      if (board_id == etm_can_active_debugging_board_id) {
-	switch (log_id) 
+      
+	switch (data_log_index) 
 	  {
-	  case ETM_CAN_DATA_LOG_REGISTER_DEFAULT_DEBUG_0:
-	    debug_data_slave_mirror.debug_reg[0]            = next_message.word3;
-	    debug_data_slave_mirror.debug_reg[1]            = next_message.word2;
-	    debug_data_slave_mirror.debug_reg[2]            = next_message.word1;
-	    debug_data_slave_mirror.debug_reg[3]            = next_message.word0;
-	    break;
-	    
-	  case ETM_CAN_DATA_LOG_REGISTER_DEFAULT_DEBUG_1:
-	    debug_data_slave_mirror.debug_reg[4]            = next_message.word3;
-	    debug_data_slave_mirror.debug_reg[5]            = next_message.word2;
-	    debug_data_slave_mirror.debug_reg[6]            = next_message.word1;
-	    debug_data_slave_mirror.debug_reg[7]            = next_message.word0;
-	    break;
-
-	  case ETM_CAN_DATA_LOG_REGISTER_DEFAULT_DEBUG_2:
-	    debug_data_slave_mirror.debug_reg[8]            = next_message.word3;
-	    debug_data_slave_mirror.debug_reg[9]            = next_message.word2;
-	    debug_data_slave_mirror.debug_reg[10]           = next_message.word1;
-	    debug_data_slave_mirror.debug_reg[11]           = next_message.word0;
-	    break;
-
-	  case ETM_CAN_DATA_LOG_REGISTER_DEFAULT_DEBUG_3:
-	    debug_data_slave_mirror.debug_reg[12]           = next_message.word3;
-	    debug_data_slave_mirror.debug_reg[13]           = next_message.word2;
-	    debug_data_slave_mirror.debug_reg[14]           = next_message.word1;
-	    debug_data_slave_mirror.debug_reg[15]           = next_message.word0;
-	    break;
-
-	  case ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_0:
-	    debug_data_slave_mirror.can_tx_0                = next_message.word3;
-	    debug_data_slave_mirror.can_tx_1                = next_message.word2;
-	    debug_data_slave_mirror.can_tx_2                = next_message.word1;
-	    debug_data_slave_mirror.CXEC_reg_max            = next_message.word0;
+	  case ETM_CAN_DATA_LOG_REGISTER_HV_LAMBDA_FAST_LOG_0:
+	    // Update the high speed data table
+	    ptr_high_speed_data->hvlambda_readback_high_energy_lambda_program_voltage = next_message->word2;
+	    ptr_high_speed_data->hvlambda_readback_low_energy_lambda_program_voltage = next_message->word1;
+	    ptr_high_speed_data->hvlambda_readback_peak_lambda_voltage = next_message->word0;
+	    ptr_high_speed_data->status_bits.hv_lambda_fast_log_0 = 1;
 	    break;
 
-	  case ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_1:
-	    debug_data_slave_mirror.can_rx_0_filt_0         = next_message.word3;
-	    debug_data_slave_mirror.can_rx_0_filt_1         = next_message.word2;
-	    debug_data_slave_mirror.can_rx_1_filt_2         = next_message.word1;
-	    debug_data_slave_mirror.CXINTF_max              = next_message.word0;
+	  case ETM_CAN_DATA_LOG_REGISTER_AFC_FAST_LOG_0:
+	    ptr_high_speed_data->afc_readback_current_position = next_message->word2;
+	    ptr_high_speed_data->afc_readback_target_position = next_message->word1;
+	    // unused word 0
+	    ptr_high_speed_data->status_bits.afc_fast_log_0 = 1;
 	    break;
-
-	  case ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_2:
-	    debug_data_slave_mirror.can_unknown_msg_id      = next_message.word3;
-	    debug_data_slave_mirror.can_invalid_index       = next_message.word2;
-	    debug_data_slave_mirror.can_address_error       = next_message.word1;
-	    debug_data_slave_mirror.can_error_flag          = next_message.word0;
+	  
+	  case ETM_CAN_DATA_LOG_REGISTER_AFC_FAST_LOG_1:
+	    ptr_high_speed_data->afc_readback_a_input = next_message->word2;
+	    ptr_high_speed_data->afc_readback_b_input = next_message->word1;
+	    ptr_high_speed_data->afc_readback_filtered_error_reading = next_message->word0;
+	    ptr_high_speed_data->status_bits.afc_fast_log_1 = 1;
 	    break;
-
-	  case ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_3:
-	    debug_data_slave_mirror.can_tx_buf_overflow     = next_message.word3;
-	    debug_data_slave_mirror.can_rx_buf_overflow     = next_message.word2;
-	    debug_data_slave_mirror.can_rx_log_buf_overflow = next_message.word1;
-	    debug_data_slave_mirror.can_timeout             = next_message.word0;
+	  
+	  case ETM_CAN_DATA_LOG_REGISTER_MAGNETRON_MON_FAST_LOG_0:
+	    ptr_high_speed_data->magmon_readback_magnetron_low_energy_current = next_message->word2;  // Internal DAC Reading
+	    ptr_high_speed_data->magmon_readback_magnetron_high_energy_current = next_message->word1; // External DAC Reading
+	    if (next_message->word0) {
+	      ptr_high_speed_data->status_bits.arc_this_pulse = 1;
+	    }
+	    ptr_high_speed_data->status_bits.magnetron_mon_fast_log_0 = 1;
 	    break;
-
-	  case ETM_CAN_DATA_LOG_REGISTER_DEFAULT_SYSTEM_ERROR_0:
-	    debug_data_slave_mirror.reset_count             = next_message.word3;
-	    debug_data_slave_mirror.RCON_value              = next_message.word2;
-	    debug_data_slave_mirror.reserved_1              = next_message.word1;
-	    debug_data_slave_mirror.reserved_0              = next_message.word0;
+	  
+	  case ETM_CAN_DATA_LOG_REGISTER_PULSE_SYNC_FAST_LOG_0:
+	    ptr_high_speed_data->psync_readback_trigger_width_and_filtered_trigger_width = next_message->word2;
+	    ptr_high_speed_data->psync_readback_high_energy_grid_width_and_delay = next_message->word1;
+	    ptr_high_speed_data->psync_readback_low_energy_grid_width_and_delay = next_message->word0;
+	    ptr_high_speed_data->status_bits.pulse_sync_fast_log_0 = 1;
 	    break;
 
-	  case ETM_CAN_DATA_LOG_REGISTER_DEFAULT_SYSTEM_ERROR_1:
-	    debug_data_slave_mirror.i2c_bus_error_count     = next_message.word3;
-	    debug_data_slave_mirror.spi_bus_error_count     = next_message.word2;
-	    debug_data_slave_mirror.scale_error_count       = next_message.word1;
-	    debug_data_slave_mirror.self_test_results       = *(ETMCanSelfTestRegister*)&next_message.word0;
+	  case ETM_CAN_DATA_LOG_REGISTER_ION_PUMP_FAST_LOG_0:
+	    ptr_high_speed_data->ionpump_readback_high_energy_target_current_reading = next_message->word2;
+	    ptr_high_speed_data->ionpump_readback_low_energy_target_current_reading = next_message->word1;
+	    // unused word 0
+	    ptr_high_speed_data->status_bits.ion_pump_fast_log_0 = 1;
 	    break;
-	    
+	  
 	  default:
 	    debug_data_ecb.can_unknown_msg_id++;
 	    break;
 	  }
-      }
-    } else {
-      // It is data that needs to be stored for a specific board. 
-
-      // First figure out which board the data is from
-      switch (board_id) 
-	{
-	case ETM_CAN_ADDR_ION_PUMP_BOARD:
-	  board_data_ptr = &mirror_ion_pump;
-	  break;
-	  
-	case ETM_CAN_ADDR_MAGNETRON_CURRENT_BOARD:
-	  board_data_ptr = &mirror_magnetron_mon;
-	  break;
-
-	case ETM_CAN_ADDR_PULSE_SYNC_BOARD:
-	  board_data_ptr = &mirror_pulse_sync;
-	  break;
-	  
-	case ETM_CAN_ADDR_HV_LAMBDA_BOARD:
-	  board_data_ptr = &mirror_hv_lambda;
-	  break;
-	  
-	case ETM_CAN_ADDR_AFC_CONTROL_BOARD:
-	  board_data_ptr = &mirror_afc;
-	  break;
-
-	case ETM_CAN_ADDR_COOLING_INTERFACE_BOARD:
-	  board_data_ptr = &mirror_cooling;
-	  break;
-	  
-	case ETM_CAN_ADDR_HEATER_MAGNET_BOARD:
-	  board_data_ptr = &mirror_htr_mag;
-	  break;
-
-	case ETM_CAN_ADDR_GUN_DRIVER_BOARD:
-	  board_data_ptr = &mirror_gun_drv;
-	  break;
-
-	default:
+      } else {
+	// Slow logging data, look up where it is stored
+	route_ptr = &etm_can_master_log_route[log_id >> 4];
+	if (route_ptr->words == 0) {
+	  debug_data_ecb.can_unknown_msg_id++;
+	} else if (route_ptr->debug) {
+	  // It is debugging information, store it in every debug mirror of that board
+	  for (mirror_ptr = etm_can_master_debug_mirror; mirror_ptr < &etm_can_master_debug_mirror[ETM_CAN_MASTER_DEBUG_MIRRORS]; mirror_ptr++) {
+	    if (mirror_ptr->board == board_id) {
+	      destination_ptr = (unsigned int*)mirror_ptr + route_ptr->offset;
+	      source_ptr = &next_message->word3;
+	      for (words = route_ptr->words; words; words--) {
+		*destination_ptr++ = *source_ptr--;
+	      }
+	    }
+	  }
+	} else if (!((1 << board_id) & ETM_CAN_MASTER_MIRROR_BOARDS)) {
+	  // There is no mirror for this board, discard the data
 	  debug_data_ecb.can_address_error++;
-	  break;
-	  
+	} else {
+	  destination_ptr = (unsigned int*)&etm_can_master_mirror[board_id] + route_ptr->offset;
+	  source_ptr = &next_message->word0;
+	  for (words = route_ptr->words; words; words--) {
+	    *destination_ptr++ = *source_ptr++;
+	  }
 	}
-      
-      // Now figure out which data log it is
-      switch (log_id)
-	{
-	case ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_0:
-	  board_data_ptr->log_data[0]  = next_message.word0;
-	  board_data_ptr->log_data[1]  = next_message.word1;
-	  board_data_ptr->log_data[2]  = next_message.word2;
-	  board_data_ptr->log_data[3]  = next_message.word3;
-	  break;
-
-	case ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_1:
-	  board_data_ptr->log_data[4]  = next_message.word0;
-	  board_data_ptr->log_data[5]  = next_message.word1;
-	  board_data_ptr->log_data[6]  = next_message.word2;
-	  board_data_ptr->log_data[7]  = next_message.word3;
-	  break;
-
-	case ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_2:
-	  board_data_ptr->log_data[8]  = next_message.word0;
-	  board_data_ptr->log_data[9]  = next_message.word1;
-	  board_data_ptr->log_data[10] = next_message.word2;
-	  board_data_ptr->log_data[11] = next_message.word3;
-	  break;
-
-	case ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_3:
-	  board_data_ptr->log_data[12] = next_message.word0;
-	  board_data_ptr->log_data[13] = next_message.word1;
-	  board_data_ptr->log_data[14] = next_message.word2;
-	  board_data_ptr->log_data[15] = next_message.word3;
-	  break;
-
-	case ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_4:
-	  board_data_ptr->log_data[16] = next_message.word0;
-	  board_data_ptr->log_data[17] = next_message.word1;
-	  board_data_ptr->log_data[18] = next_message.word2;
-	  board_data_ptr->log_data[19] = next_message.word3;
-	  break;
-
-	case ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_5:
-	  board_data_ptr->log_data[20] = next_message.word0;
-	  board_data_ptr->log_data[21] = next_message.word1;
-	  board_data_ptr->log_data[22] = next_message.word2;
-	  board_data_ptr->log_data[23] = next_message.word3;
-	  break;
-
-	case ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CONFIG_0:
-	  board_data_ptr->config_data[0] = next_message.word0;
-	  board_data_ptr->config_data[1] = next_message.word1;
-	  board_data_ptr->config_data[2] = next_message.word2;
-	  board_data_ptr->config_data[3] = next_message.word3;
-	  break;
-
-	case ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CONFIG_1:
-	  board_data_ptr->config_data[4] = next_message.word0;
-	  board_data_ptr->config_data[5] = next_message.word1;
-	  board_data_ptr->config_data[6] = next_message.word2;
-	  board_data_ptr->config_data[7] = next_message.word3;
-	  break;
-	  
-	default:
-	  debug_data_ecb.can_unknown_msg_id++;
-	  break;
-	} 
+      }
     }
+    ETMCanBufferCommit(&etm_can_master_rx_data_log_buffer, messages);
   }
 }
 
 
-void ETMCanMasterCheckForTimeOut(void) {
-  
-  // Check to see if a faulted board has regained communication.  If so, clear the fault bit and write to event log
-
-  // Ion Pump Board
-  if (board_status_received.ion_pump_board && board_com_fault.ion_pump_board) {
-    // The slave board has regained communication
-    SendToEventLog(LOG_ID_CONNECTED_ION_PUMP_BOARD);
-    board_com_fault.ion_pump_board = 0;
+static void ETMCanHighSpeedDataClearMissing(ETMCanHighSpeedData* ptr_high_speed_data) {
+  // The CAN interrupt does not clear the readings when it starts a record, zero the ones that were not received
+  if (!ptr_high_speed_data->status_bits.hv_lambda_fast_log_0) {
+    ptr_high_speed_data->hvlambda_readback_high_energy_lambda_program_voltage = 0;
+    ptr_high_speed_data->hvlambda_readback_low_energy_lambda_program_voltage = 0;
+    ptr_high_speed_data->hvlambda_readback_peak_lambda_voltage = 0;
   }
-  
-  // Pulse Current Monitor Board
-  if (board_status_received.magnetron_current_board && board_com_fault.magnetron_current_board) {
-    // The slave board has regained communication
-    SendToEventLog(LOG_ID_CONNECTED_MAGNETRON_CURRENT_BOARD);
-    board_com_fault.magnetron_current_board = 0;
+  if (!ptr_high_speed_data->status_bits.afc_fast_log_0) {
+    ptr_high_speed_data->afc_readback_current_position = 0;
+    ptr_high_speed_data->afc_readback_target_position = 0;
   }
-  
-  // Pulse Sync Board
-  if (board_status_received.pulse_sync_board && board_com_fault.pulse_sync_board) {
-    // The slave board has regained communication
-    SendToEventLog(LOG_ID_CONNECTED_PULSE_SYNC_BOARD);
-    board_com_fault.pulse_sync_board = 0;
+  if (!ptr_high_speed_data->status_bits.afc_fast_log_1) {
+    ptr_high_speed_data->afc_readback_a_input = 0;
+    ptr_high_speed_data->afc_readback_b_input = 0;
+    ptr_high_speed_data->afc_readback_filtered_error_reading = 0;
   }
-  
-  // HV Lambda Board
-  if (board_status_received.hv_lambda_board && board_com_fault.hv_lambda_board) {
-    SendToEventLog(LOG_ID_CONNECTED_HV_LAMBDA_BOARD);
-    board_com_fault.hv_lambda_board = 0;
+  if (!ptr_high_speed_data->status_bits.ion_pump_fast_log_0) {
+    ptr_high_speed_data->ionpump_readback_high_energy_target_current_reading = 0;
+    ptr_high_speed_data->ionpump_readback_low_energy_target_current_reading = 0;
   }
-  
-  // AFC Board
-  if (board_status_received.afc_board  && board_com_fault.afc_board) {
-    SendToEventLog(LOG_ID_CONNECTED_AFC_BOARD);
-    board_com_fault.afc_board = 0;
+  if (!ptr_high_speed_data->status_bits.magnetron_mon_fast_log_0) {
+    ptr_high_speed_data->magmon_readback_magnetron_high_energy_current = 0;
+    ptr_high_speed_data->magmon_readback_magnetron_low_energy_current = 0;
   }
-  
-  // Cooling Interface
-  if (board_status_received.cooling_interface_board && board_com_fault.cooling_interface_board) {
-    SendToEventLog(LOG_ID_CONNECTED_COOLING_BOARD);
-    board_com_fault.cooling_interface_board = 0;
+  if (!ptr_high_speed_data->status_bits.pulse_sync_fast_log_0) {
+    ptr_high_speed_data->psync_readback_trigger_width_and_filtered_trigger_width = 0;
+    ptr_high_speed_data->psync_readback_high_energy_grid_width_and_delay = 0;
+    ptr_high_speed_data->psync_readback_low_energy_grid_width_and_delay = 0;
   }
-  
-  // Heater Magnet Supply
-  if (board_status_received.heater_magnet_board && board_com_fault.heater_magnet_board) {
-    SendToEventLog(LOG_ID_CONNECTED_HEATER_MAGNET_BOARD);
-    board_com_fault.heater_magnet_board = 0;
+}
+
+
+unsigned int ETMCanHighSpeedDataPeek(ETMCanHighSpeedData** record_ptr) {
+  unsigned int write_index;
+  unsigned int start_index;
+  unsigned int read_index;
+  unsigned int records;
+  unsigned int contiguous;
+  unsigned int expected_mask;
+  ETMCanHighSpeedData* ptr_high_speed_data;
+
+  // Read a matching pair of indexes from the CAN interrupt
+  do {
+    start_index = etm_can_high_speed_data_ring.start_index;
+    write_index = etm_can_high_speed_data_ring.write_index;
+  } while (start_index != etm_can_high_speed_data_ring.start_index);
+
+  read_index = etm_can_high_speed_data_ring.read_index;
+  if ((write_index - read_index) > (write_index - start_index)) {
+    // The pulse count jumped after read_index, the records before start_index are not valid
+    read_index = start_index;
   }
-  
-  // Gun Driver
-  if (board_status_received.gun_driver_board && board_com_fault.gun_driver_board) {
-    SendToEventLog(LOG_ID_CONNECTED_GUN_DRIVER_BOARD);
-    board_com_fault.gun_driver_board = 0;
+  if ((write_index - read_index) > ETM_CAN_HIGH_SPEED_DATA_DEPTH) {
+    // The oldest records have been overwritten
+    etm_can_high_speed_data_ring.overrun_count += (write_index - read_index) - ETM_CAN_HIGH_SPEED_DATA_DEPTH;
+    read_index = write_index - ETM_CAN_HIGH_SPEED_DATA_DEPTH;
   }
-  
-  if (_T5IF) {
-    // At least one board failed to communicate durring the T5 period
-    _T5IF = 0;
-    debug_data_ecb.can_timeout++;
-    etm_can_persistent_data.can_timeout_count = debug_data_ecb.can_timeout;
-    // _CONTROL_CAN_COM_LOSS = 1; // DPARKER change this to a fault
-    
-    // store which boards are not connect and write to the event log
-    
-    // Ion Pump Board
-#ifndef __IGNORE_ION_PUMP_MODULE
-    if (!board_status_received.ion_pump_board) {                          // The slave board is not connected
-      global_data_can_master.no_connect_count_ion_pump_board++;
-      if (!board_com_fault.ion_pump_board) {                              // The slave board has lost communication
-	SendToEventLog(LOG_ID_NOT_CONNECTED_ION_PUMP_BOARD);
+  etm_can_high_speed_data_ring.read_index = read_index;
+  if ((etm_can_high_speed_data_ring.release_index - read_index) > (write_index - read_index)) {
+    // The records that were handed out were skipped
+    etm_can_high_speed_data_ring.release_index = read_index;
+  }
+
+  // Stop at the end of the ring so that the records are contiguous
+  contiguous = ETM_CAN_HIGH_SPEED_DATA_DEPTH - (read_index & (ETM_CAN_HIGH_SPEED_DATA_DEPTH - 1));
+  if (contiguous > (write_index - read_index)) {
+    contiguous = write_index - read_index;
+  }
+  if (contiguous > (ETM_CAN_HIGH_SPEED_DATA_DEPTH - ETM_CAN_HIGH_SPEED_DATA_PEEK_MARGIN)) {
+    // Leave room for the pulses that arrive while these records are sent
+    contiguous = ETM_CAN_HIGH_SPEED_DATA_DEPTH - ETM_CAN_HIGH_SPEED_DATA_PEEK_MARGIN;
+  }
+
+  // Release records in pulse order until one is found that is still waiting for data
+  expected_mask = etm_can_high_speed_data_ring.expected_mask;
+  *record_ptr = &etm_can_high_speed_data_ring.record[read_index & (ETM_CAN_HIGH_SPEED_DATA_DEPTH - 1)];
+  ptr_high_speed_data = *record_ptr;
+  for (records = 0; records < contiguous; records++, read_index++, ptr_high_speed_data++) {
+    if (((*(unsigned int*)&ptr_high_speed_data->status_bits & expected_mask) != expected_mask) &&
+	(!ptr_high_speed_data->status_bits.data_incomplete)) {
+      if (((write_index - read_index) <= ETM_CAN_HIGH_SPEED_DATA_TIMEOUT_PULSES) &&
+	  ((etm_can_master_tick - etm_can_high_speed_data_ring.record_tick[read_index & (ETM_CAN_HIGH_SPEED_DATA_DEPTH - 1)]) < ETM_CAN_HIGH_SPEED_DATA_TIMEOUT)) {
+	break;
       }
-      board_com_fault.ion_pump_board = 1;
+      ptr_high_speed_data->status_bits.data_incomplete = 1;
+      etm_can_high_speed_data_ring.incomplete_count++;
     }
-#endif
-    
-    // Pulse Current Monitor Board
-#ifndef __IGNORE_PULSE_CURRENT_MODULE
-    if (!board_status_received.magnetron_current_board) {                 // The slave board is not connected
-      global_data_can_master.no_connect_count_magnetron_current_board++;
-      if (!board_com_fault.magnetron_current_board) {                     // The slave board has lost communication
-	SendToEventLog(LOG_ID_NOT_CONNECTED_MAGNETRON_CURRENT_BOARD);
+    ETMCanHighSpeedDataClearMissing(ptr_high_speed_data);
+  }
+  if ((int)(read_index - etm_can_high_speed_data_ring.release_index) > 0) {
+    etm_can_high_speed_data_ring.release_index = read_index;
+  }
+
+  return records;
+}
+
+
+void ETMCanHighSpeedDataCommit(unsigned int records) {
+  unsigned int write_index;
+  unsigned int start_index;
+  unsigned int read_index;
+  unsigned int overwritten;
+  unsigned int n;
+
+  // Read a matching pair of indexes from the CAN interrupt
+  do {
+    start_index = etm_can_high_speed_data_ring.start_index;
+    write_index = etm_can_high_speed_data_ring.write_index;
+  } while (start_index != etm_can_high_speed_data_ring.start_index);
+
+  read_index = etm_can_high_speed_data_ring.read_index;
+  overwritten = 0;
+  if ((write_index - read_index) > (write_index - start_index)) {
+    // The pulse count jumped while the records were handed out, check each record
+    for (n = 0; n < records; n++) {
+      if (etm_can_high_speed_data_ring.record[(read_index + n) & (ETM_CAN_HIGH_SPEED_DATA_DEPTH - 1)].pulse_count != (read_index + n)) {
+	overwritten++;
       }
-      board_com_fault.magnetron_current_board = 1;
     }
-#endif
-    
+  } else if ((write_index - read_index) > ETM_CAN_HIGH_SPEED_DATA_DEPTH) {
+    // The oldest records were overwritten while they were handed out
+    overwritten = (write_index - read_index) - ETM_CAN_HIGH_SPEED_DATA_DEPTH;
+    if (overwritten > records) {
+      overwritten = records;
+    }
+  }
 
-    // Pulse Sync Board
-#ifndef __IGNORE_PULSE_SYNC_MODULE
-    if (!board_status_received.pulse_sync_board) {                        // The slave board is not connected
-      global_data_can_master.no_connect_count_pulse_sync_board++;
-      if (!board_com_fault.pulse_sync_board) {                            // The slave board has lost communication
-	SendToEventLog(LOG_ID_NOT_CONNECTED_PULSE_SYNC_BOARD);
-      }
-      board_com_fault.pulse_sync_board = 1;
+  etm_can_high_speed_data_ring.read_index = read_index + records;
+  etm_can_high_speed_data_ring.export_count += records - overwritten;
+  etm_can_high_speed_data_ring.overrun_count += overwritten;
+}
+
+
+void ETMCanMasterSetExpectedBoards(unsigned int boards) {
+  unsigned int board;
+  unsigned int added;
+
+  boards &= ETM_CAN_MASTER_MIRROR_BOARDS;
+  added = boards & ~etm_can_master_expected_boards;
+  etm_can_master_expected_boards = boards;
+  board_com_fault &= boards;
+
+  // A board that was just added gets a full deadline to report
+  for (board = 0; added; board++, added >>= 1) {
+    if (added & 0x0001) {
+      board_communication[board].deadline_tick = etm_can_master_tick + board_communication[board].deadline;
     }
-#endif
+  }
+}
 
-    // HV Lambda Board
-#ifndef __IGNORE_HV_LAMBDA_MODULE
-    if (!board_status_received.hv_lambda_board) {                         // The slave board is not connected
-      global_data_can_master.no_connect_count_hv_lambda_board++;
-      if (!board_com_fault.hv_lambda_board) {                             // The slave board has lost communication
-	SendToEventLog(LOG_ID_NOT_CONNECTED_HV_LAMBDA_BOARD);
-      }
-      board_com_fault.hv_lambda_board = 1;
+
+unsigned int ETMCanMasterGetExpectedBoards(void) {
+  return etm_can_master_expected_boards;
+}
+
+
+static void ETMCanMasterDebugMirrorAssign(ETMCanDebugMirror* mirror_ptr, unsigned int board) {
+  unsigned int* data_ptr;
+  unsigned int words;
+
+  // Zero the data left by the previous board
+  data_ptr = (unsigned int*)mirror_ptr;
+  for (words = sizeof(ETMCanDebugMirror) / sizeof(unsigned int); words; words--) {
+    *data_ptr++ = 0;
+  }
+  mirror_ptr->board = board;
+}
+
+
+ETMCanDebugMirror* ETMCanMasterDebugSubscribe(unsigned int board) {
+  unsigned int n;
+
+  if ((board >= ETM_CAN_MASTER_BOARDS) || !((1 << board) & ETM_CAN_MASTER_MIRROR_BOARDS)) {
+    return 0;
+  }
+  for (n = 0; n < ETM_CAN_MASTER_DEBUG_MIRRORS; n++) {
+    if (etm_can_master_debug_mirror[n].board == board) {
+      return &etm_can_master_debug_mirror[n];
     }
-#endif
+  }
+  // Mirror 0 belongs to the GUI selection
+  for (n = 1; n < ETM_CAN_MASTER_DEBUG_MIRRORS; n++) {
+    if (etm_can_master_debug_mirror[n].board == ETM_CAN_MASTER_DEBUG_MIRROR_FREE) {
+      ETMCanMasterDebugMirrorAssign(&etm_can_master_debug_mirror[n], board);
+      return &etm_can_master_debug_mirror[n];
+    }
+  }
+  return 0;
+}
 
-    // AFC Board
-#ifndef __IGNORE_AFC_MODULE
-    if (!board_status_received.afc_board) {                               // The slave board is not connected
-      global_data_can_master.no_connect_count_afc_board++;
-      if (!board_com_fault.afc_board) {                                   // The slave board has lost communication
-	SendToEventLog(LOG_ID_NOT_CONNECTED_AFC_BOARD);
-      }
-      board_com_fault.afc_board = 1;
-    }    
-#endif
 
-    // Cooling Interface
-#ifndef __IGNORE_COOLING_INTERFACE_MODULE
-    if (!board_status_received.cooling_interface_board) {                 // The slave board is not connected
-      global_data_can_master.no_connect_count_cooling_interface_board++;
-      if (!board_com_fault.cooling_interface_board) {                     // The slave board has lost communication
-	SendToEventLog(LOG_ID_NOT_CONNECTED_COOLING_BOARD);
-      }
-      board_com_fault.cooling_interface_board = 1;
+void ETMCanMasterDebugUnsubscribe(unsigned int board) {
+  unsigned int n;
+
+  for (n = 1; n < ETM_CAN_MASTER_DEBUG_MIRRORS; n++) {
+    if (etm_can_master_debug_mirror[n].board == board) {
+      etm_can_master_debug_mirror[n].board = ETM_CAN_MASTER_DEBUG_MIRROR_FREE;
     }
-#endif
+  }
+}
 
-    // Heater Magnet Supply
-#ifndef __IGNORE_HEATER_MAGNET_MODULE
-    if (!board_status_received.heater_magnet_board) {                     // The slave board is not connected
-      global_data_can_master.no_connect_count_heater_magnet_board++;
-      if (!board_com_fault.heater_magnet_board) {                         // The slave board has lost communication
-	SendToEventLog(LOG_ID_NOT_CONNECTED_HEATER_MAGNET_BOARD);
-      }
-      board_com_fault.heater_magnet_board = 1;
+
+unsigned int ETMCanMasterGetDebugBoards(void) {
+  unsigned int boards;
+  unsigned int n;
+
+  boards = 0;
+  for (n = 0; n < ETM_CAN_MASTER_DEBUG_MIRRORS; n++) {
+    if (etm_can_master_debug_mirror[n].board < ETM_CAN_MASTER_BOARDS) {
+      boards |= 1 << etm_can_master_debug_mirror[n].board;
     }
-#endif
+  }
+  return boards & ETM_CAN_MASTER_MIRROR_BOARDS;
+}
 
-    // Gun Driver
-#ifndef __IGNORE_GUN_DRIVER_MODULE
-    if (!board_status_received.gun_driver_board) {                        // The slave board is not connected
-      global_data_can_master.no_connect_count_gun_driver_board++;
-      if (!board_com_fault.gun_driver_board) {                            // The slave board has lost communication
-	SendToEventLog(LOG_ID_NOT_CONNECTED_GUN_DRIVER_BOARD);
-      }
-      board_com_fault.gun_driver_board = 1;
+
+void ETMCanMasterSetBoardDeadline(unsigned int board, unsigned int ticks) {
+  if ((board >= ETM_CAN_MASTER_BOARDS) || (ticks == 0)) {
+    return;
+  }
+  board_communication[board].deadline = ticks;
+  board_communication[board].deadline_tick = board_communication[board].last_seen_tick + ticks;
+}
+
+
+static void ETMCanMasterLogBoardEvents(unsigned int boards, unsigned int board_0_log_id) {
+  // Writes board_0_log_id + (board address << 4) to the event log for every bit that is set in boards
+  while (boards) {
+    if (boards & 0x0001) {
+      SendToEventLog(board_0_log_id);
     }
-#endif
+    boards >>= 1;
+    board_0_log_id += 0x0010;
+  }
+}
 
-    // Clear the status received register
-    *(unsigned int*)&board_status_received = 0x0000;
 
+void ETMCanMasterCheckForTimeOut(void) {
+  unsigned int boards;
+  unsigned int board;
+  unsigned int lost;
+  TYPE_BOARD_COMMUNICATION* communication_ptr;
+  
+  // Check to see if a faulted board has regained communication.  If so, clear the fault bit and write to event log
+  boards = board_status_received & board_com_fault;
+  board_status_received = 0x0000;
+  if (boards) {
+    board_com_fault ^= boards;
+    ETMCanMasterLogBoardEvents(boards, LOG_ID_CONNECTED_BOARD(0));
+  }
+  
+  if (etm_can_master_timeout_tick == etm_can_master_tick) {
+    // The deadlines are only checked once per tick
+    return;
+  }
+  etm_can_master_timeout_tick = etm_can_master_tick;
+
+  // Find the boards that have passed their deadline
+  lost = 0x0000;
+  boards = etm_can_master_expected_boards;
+  communication_ptr = board_communication;
+  for (board = 0x0001; boards; board <<= 1, boards >>= 1, communication_ptr++) {
+    if ((boards & 0x0001) && ((int)(etm_can_master_tick - communication_ptr->deadline_tick) > 0)) {
+      // No status message before the deadline, the next deadline is one full period from now
+      communication_ptr->deadline_tick = etm_can_master_tick + communication_ptr->deadline;
+      communication_ptr->no_connect_count++;
+      debug_data_ecb.can_timeout++;
+      lost |= board;
+    }
+  }
+
+  if (lost) {
+    etm_can_persistent_data.can_timeout_count = debug_data_ecb.can_timeout;
+    // _CONTROL_CAN_COM_LOSS = 1; // DPARKER change this to a fault
+
+    // Write the boards that have just lost communication to the event log
+    ETMCanMasterLogBoardEvents(lost & ~board_com_fault, LOG_ID_NOT_CONNECTED_BOARD(0));
+    board_com_fault |= lost;
   }
 }
 
@@ -1202,13 +1419,13 @@ void SendCalibrationSetPointToSlave(unsigned int index, unsigned int data_1, uns
   board_id >>= 12;
   
   
-  can_message.identifier = (ETM_CAN_MSG_CMD_TX | (board_id << 2));
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, board_id);
   can_message.word3 = index;
   can_message.word2 = 0;
   can_message.word1 = data_1;
   can_message.word0 = data_0;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()  
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()  
 }
 
 void ReadCalibrationSetPointFromSlave(unsigned int index) {
@@ -1217,41 +1434,268 @@ void ReadCalibrationSetPointFromSlave(unsigned int index) {
   board_id = index & 0xF000;
   board_id >>= 12;
   
-  can_message.identifier = (ETM_CAN_MSG_CMD_TX | (board_id << 2));
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, board_id);
   can_message.word3 = index;
   can_message.word2 = 0;
   can_message.word1 = 0;
   can_message.word0 = 0;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()  
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()  
+}
+
+// ---------- Calibration Block Transfer ---------------
+static unsigned int ETMCanMasterCalibrationBlockStart(unsigned int board, unsigned int first_page, unsigned int pages) {
+  ETMCanCalibrationTransfer* transfer_ptr;
+  unsigned int n;
+
+  if (!((1 << (board & 0x000F)) & ETM_CAN_MASTER_MIRROR_BOARDS) || (board > 0x000F) ||
+      (pages == 0) || (first_page >= ETM_CAN_CALIBRATION_BLOCK_PAGES) || (pages > (ETM_CAN_CALIBRATION_BLOCK_PAGES - first_page))) {
+    return ETM_CAN_MASTER_CALIBRATION_TRANSFERS;
+  }
+  if (ETMCanMasterCalibrationBlockBusy(board)) {
+    // A slave only buffers one page at a time
+    return ETM_CAN_MASTER_CALIBRATION_TRANSFERS;
+  }
+  for (n = 0; n < ETM_CAN_MASTER_CALIBRATION_TRANSFERS; n++) {
+    transfer_ptr = &etm_can_master_calibration.transfer[n];
+    if (transfer_ptr->board == 0) {
+      transfer_ptr->board = board;
+      transfer_ptr->page = first_page;
+      transfer_ptr->last_page = first_page + pages - 1;
+      transfer_ptr->sent = 0;
+      transfer_ptr->retries = 0;
+      break;
+    }
+  }
+  return n;
+}
+
+
+unsigned int ETMCanMasterCalibrationBlockWrite(unsigned int board, unsigned int first_page, unsigned int pages, unsigned int* data) {
+  unsigned int n;
+  n = ETMCanMasterCalibrationBlockStart(board, first_page, pages);
+  if (n >= ETM_CAN_MASTER_CALIBRATION_TRANSFERS) {
+    return 1;
+  }
+  etm_can_master_calibration.transfer[n].write = 1;
+  etm_can_master_calibration.transfer[n].data = data;
+  return 0;
+}
+
+
+unsigned int ETMCanMasterCalibrationBlockRead(unsigned int board, unsigned int first_page, unsigned int pages) {
+  unsigned int n;
+  n = ETMCanMasterCalibrationBlockStart(board, first_page, pages);
+  if (n >= ETM_CAN_MASTER_CALIBRATION_TRANSFERS) {
+    return 1;
+  }
+  etm_can_master_calibration.transfer[n].write = 0;
+  etm_can_master_calibration.transfer[n].data = 0;
+  return 0;
+}
+
+
+unsigned int ETMCanMasterCalibrationBlockBusy(unsigned int board) {
+  unsigned int n;
+  for (n = 0; n < ETM_CAN_MASTER_CALIBRATION_TRANSFERS; n++) {
+    if (etm_can_master_calibration.transfer[n].board == board) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+
+static void ETMCanMasterCalibrationBlockRetry(ETMCanCalibrationTransfer* transfer_ptr) {
+  if (transfer_ptr->retries >= ETM_CAN_MASTER_CALIBRATION_RETRIES) {
+    etm_can_master_calibration.failed_count++;
+    transfer_ptr->board = 0;
+  } else {
+    etm_can_master_calibration.retry_count++;
+    transfer_ptr->retries++;
+    transfer_ptr->sent = 0;
+  }
+}
+
+
+static void ETMCanMasterCalibrationBlockNextPage(ETMCanCalibrationTransfer* transfer_ptr) {
+  etm_can_master_calibration.page_count++;
+  if (transfer_ptr->page == transfer_ptr->last_page) {
+    transfer_ptr->board = 0;
+    return;
+  }
+  transfer_ptr->page++;
+  if (transfer_ptr->write) {
+    transfer_ptr->data += ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS;
+  }
+  transfer_ptr->retries = 0;
+  transfer_ptr->sent = 0;
+}
+
+
+static void ETMCanMasterCalibrationBlockSend(ETMCanCalibrationTransfer* transfer_ptr) {
+  ETMCanMessage can_message;
+  unsigned int frame;
+  unsigned int* block_ptr;
+
+  transfer_ptr->sequence = ++etm_can_master_calibration.sequence;
+  transfer_ptr->received_frames = 0;
+  transfer_ptr->sent = 1;
+  transfer_ptr->sent_tick = etm_can_master_tick;
+
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, transfer_ptr->board);
+  if (transfer_ptr->write) {
+    // The whole page is sent at once, the slave acknowledges it after it has been written to EEPROM
+    block_ptr = transfer_ptr->block;
+    for (frame = 0; frame < ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS; frame++) {
+      block_ptr[frame] = transfer_ptr->data[frame];
+    }
+    block_ptr[ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS] = transfer_ptr->sequence;
+    block_ptr[ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS + 1] = ETMCRC16(block_ptr, (ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS + 1) * sizeof(unsigned int));
+    for (frame = 0; frame < ETM_CAN_CALIBRATION_BLOCK_FRAMES; frame++, block_ptr += 3) {
+      can_message.word3 = (transfer_ptr->board << 12) + ETM_CAN_REGISTER_CALIBRATION_BLOCK_WRITE + (transfer_ptr->page << 4) + frame;
+      can_message.word2 = block_ptr[0];
+      can_message.word1 = block_ptr[1];
+      can_message.word0 = block_ptr[2];
+      ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+    }
+  } else {
+    can_message.word3 = (transfer_ptr->board << 12) + ETM_CAN_REGISTER_CALIBRATION_BLOCK_READ + (transfer_ptr->page << 4);
+    can_message.word2 = transfer_ptr->sequence;
+    can_message.word1 = 0;
+    can_message.word0 = 0;
+    ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  }
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
+}
+
+
+void ETMCanMasterCalibrationProcess(void) {
+  ETMCanCalibrationTransfer* transfer_ptr;
+  unsigned int n;
+
+  for (n = 0; n < ETM_CAN_MASTER_CALIBRATION_TRANSFERS; n++) {
+    transfer_ptr = &etm_can_master_calibration.transfer[n];
+    if (transfer_ptr->board == 0) {
+      continue;
+    }
+    if (transfer_ptr->sent) {
+      if ((etm_can_master_tick - transfer_ptr->sent_tick) >= ETM_CAN_MASTER_CALIBRATION_TIMEOUT) {
+	// The slave did not answer
+	ETMCanMasterCalibrationBlockRetry(transfer_ptr);
+      }
+    } else if (ETMCanBufferRowsAvailable(&etm_can_master_tx_message_buffer) >= ETM_CAN_CALIBRATION_BLOCK_FRAMES) {
+      // Only send when the whole page fits so that the command buffer is never overwritten
+      ETMCanMasterCalibrationBlockSend(transfer_ptr);
+    }
+  }
+}
+
+
+void ETMCanMasterCalibrationBlockReturn(ETMCanMessage* message_ptr) {
+  ETMCanCalibrationTransfer* transfer_ptr;
+  unsigned int board;
+  unsigned int write;
+  unsigned int page;
+  unsigned int frame;
+  unsigned int n;
+
+  board = ETM_CAN_ID_ADDRESS(ETM_CAN_RX_SID_TO_ID(message_ptr->identifier));
+  write = ((message_ptr->word3 & 0x0F00) == ETM_CAN_REGISTER_CALIBRATION_BLOCK_WRITE);
+  page = (message_ptr->word3 >> 4) & 0x000F;
+  frame = message_ptr->word3 & 0x000F;
+
+  for (n = 0; n < ETM_CAN_MASTER_CALIBRATION_TRANSFERS; n++) {
+    transfer_ptr = &etm_can_master_calibration.transfer[n];
+    if ((transfer_ptr->board == board) && transfer_ptr->sent && (transfer_ptr->write == write) && (transfer_ptr->page == page)) {
+      break;
+    }
+  }
+  if (n >= ETM_CAN_MASTER_CALIBRATION_TRANSFERS) {
+    // A late answer to a page that has already been retried or abandoned
+    return;
+  }
+
+  if (write) {
+    if ((frame != ETM_CAN_CALIBRATION_BLOCK_ACK_FRAME) || (message_ptr->word2 != transfer_ptr->sequence)) {
+      return;
+    }
+    if (message_ptr->word1 == ETM_CAN_CALIBRATION_BLOCK_STATUS_OK) {
+      ETMCanMasterCalibrationBlockNextPage(transfer_ptr);
+    } else {
+      ETMCanMasterCalibrationBlockRetry(transfer_ptr);
+    }
+    return;
+  }
+
+  if (frame >= ETM_CAN_CALIBRATION_BLOCK_FRAMES) {
+    debug_data_ecb.can_invalid_index++;
+    return;
+  }
+  transfer_ptr->block[frame * 3] = message_ptr->word2;
+  transfer_ptr->block[frame * 3 + 1] = message_ptr->word1;
+  transfer_ptr->block[frame * 3 + 2] = message_ptr->word0;
+  transfer_ptr->received_frames |= (1 << frame);
+  if (transfer_ptr->received_frames != ETM_CAN_CALIBRATION_BLOCK_ALL_FRAMES) {
+    return;
+  }
+
+  if ((transfer_ptr->block[ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS] != transfer_ptr->sequence) ||
+      (ETMCRC16(transfer_ptr->block, (ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS + 1) * sizeof(unsigned int)) !=
+       transfer_ptr->block[ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS + 1])) {
+    ETMCanMasterCalibrationBlockRetry(transfer_ptr);
+    return;
+  }
+
+  // Pass the calibration pairs on the same way as ReadCalibrationSetPointFromSlave() returns
+  for (n = 0; n < ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS; n += 2) {
+    SendCalibrationData((board << 12) + ((ETM_CAN_CALIBRATION_BLOCK_FIRST_PAGE + page) << 4) + n,
+			transfer_ptr->block[n + 1], transfer_ptr->block[n]);
+  }
+  ETMCanMasterCalibrationBlockNextPage(transfer_ptr);
 }
 
+
+
 void SendSlaveLoadDefaultEEpromData(unsigned int board_id) {
   ETMCanMessage can_message;
   board_id &= 0x000F;
-  can_message.identifier = (ETM_CAN_MSG_CMD_TX | (board_id << 2));
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, board_id);
   can_message.word3 = (board_id << 12) + ETM_CAN_REGISTER_DEFAULT_CMD_RESET_ANALOG_CALIBRATION;
   can_message.word2 = 0;
   can_message.word1 = 0;
   can_message.word0 = 0;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()  
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()  
 }
 
 void SendSlaveReset(unsigned int board_id) {
   ETMCanMessage can_message;
   board_id &= 0x000F;
-  can_message.identifier = (ETM_CAN_MSG_CMD_TX | (board_id << 2));
+  can_message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_CMD, board_id);
   can_message.word3 = (board_id << 12) + ETM_CAN_REGISTER_DEFAULT_CMD_RESET_MCU;
   can_message.word2 = 0;
   can_message.word1 = 0;
   can_message.word0 = 0;
-  ETMCanAddMessageToBuffer(&etm_can_master_tx_message_buffer, &can_message);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()  
+  ETMCanTXSchedulerAddMessage(&etm_can_master_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &can_message);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()  
+}
+
+
+unsigned int ETMCanMasterT4Flag(unsigned int clear) {
+  unsigned int flag;
+
+  flag = _T4IF;
+  if (clear) {
+    _T4IF = 0;
+  }
+  return flag;
 }
 
 
 void ETMCanMasterClearDebug(void) {
+  unsigned int n;
+
   debug_data_ecb.debug_reg[0]        = 0;
   debug_data_ecb.debug_reg[1]        = 0;
   debug_data_ecb.debug_reg[2]        = 0;
@@ -1296,7 +1740,7 @@ void ETMCanMasterClearDebug(void) {
   debug_data_ecb.reset_count         = 0;
   debug_data_ecb.RCON_value          = 0;
   debug_data_ecb.reserved_1          = 0;
-  debug_data_ecb.reserved_0          = 0;
+  debug_data_ecb.can_buf_high_water  = 0;
 
   debug_data_ecb.i2c_bus_error_count = 0;
   debug_data_ecb.spi_bus_error_count = 0;
@@ -1304,8 +1748,34 @@ void ETMCanMasterClearDebug(void) {
   //self test results
 
   etm_can_master_tx_message_buffer.message_overwrite_count = 0;
+  etm_can_master_tx_sync_buffer.message_overwrite_count = 0;
   etm_can_master_rx_message_buffer.message_overwrite_count = 0;
   etm_can_master_rx_data_log_buffer.message_overwrite_count = 0;
+  ETMCanBufferClearHighWater(&etm_can_master_tx_message_buffer);
+  ETMCanBufferClearHighWater(&etm_can_master_tx_sync_buffer);
+  ETMCanBufferClearHighWater(&etm_can_master_rx_message_buffer);
+  ETMCanBufferClearHighWater(&etm_can_master_rx_data_log_buffer);
+  ETMCanTimingClear(&timing_data_ecb);
+  for (n = 0; n < ETM_CAN_MASTER_JOBS; n++) {
+    etm_can_master_job_state[n].sent_count = 0;
+    etm_can_master_job_state[n].overrun_count = 0;
+    etm_can_master_job_state[n].change_count = 0;
+  }
+  etm_can_high_speed_data_ring.resync_count = 0;
+  etm_can_high_speed_data_ring.overrun_count = 0;
+  etm_can_high_speed_data_ring.export_count = 0;
+  etm_can_high_speed_data_ring.incomplete_count = 0;
+  etm_can_high_speed_data_ring.late_count = 0;
+  etm_can_master_calibration.page_count = 0;
+  etm_can_master_calibration.retry_count = 0;
+  etm_can_master_calibration.failed_count = 0;
+#ifdef ETM_CAN_MASTER_ISR_CYCLES
+  // The CAN interrupt may update these while they are cleared, this is only debugging data
+  etm_can_master_isr_cycles.min = 0xFFFF;
+  etm_can_master_isr_cycles.max = 0;
+  etm_can_master_isr_cycles.avg_x16 = 0;
+  etm_can_master_isr_cycles.count = 0;
+#endif
   etm_can_persistent_data.reset_count = 0;
   etm_can_persistent_data.can_timeout_count = 0;
 
@@ -1325,27 +1795,419 @@ void ETMCanMasterClearDebug(void) {
 
 
 
-  global_data_can_master.no_connect_count_ion_pump_board = 0;
-  global_data_can_master.no_connect_count_magnetron_current_board = 0;
-  global_data_can_master.no_connect_count_pulse_sync_board = 0;
-  global_data_can_master.no_connect_count_hv_lambda_board = 0;
-  global_data_can_master.no_connect_count_afc_board = 0;
-  global_data_can_master.no_connect_count_cooling_interface_board = 0;
-  global_data_can_master.no_connect_count_heater_magnet_board = 0;
-  global_data_can_master.no_connect_count_gun_driver_board = 0;
+  for (n = 0; n < ETM_CAN_MASTER_BOARDS; n++) {
+    board_communication[n].no_connect_count = 0;
+  }
 
 }
 
 
 
+// ---------- Event Log ---------------
+static const unsigned int event_log_id_high_byte[3] = {0x0000, 0x1000, 0x1100};
+
+
+static unsigned int ETMCanMasterEventLogDecode(TYPE_EVENT_LOG_POSITION* position, TYPE_EVENT* event_ptr) {
+  // Decodes the event at position and moves position to the next event.  Returns the number of words used by the event.
+  unsigned int entry[5];
+  unsigned int words;
+  unsigned int n;
+
+  entry[0] = event_log.event_words[position->index];
+  if ((entry[0] & ETM_CAN_MASTER_EVENT_LOG_EXTENDED_WORD) == ETM_CAN_MASTER_EVENT_LOG_EXTENDED_WORD) {
+    words = 2;
+  } else if ((entry[0] & ETM_CAN_MASTER_EVENT_LOG_EXTENDED_WORD) == ETM_CAN_MASTER_EVENT_LOG_KEYFRAME_WORD) {
+    words = 5;
+  } else {
+    words = 1;
+  }
+  for (n = 0; n < words; n++) {
+    entry[n] = event_log.event_words[position->index];
+    position->index++;
+    if (position->index >= ETM_CAN_MASTER_EVENT_LOG_WORDS) {
+      position->index = 0;
+    }
+  }
+
+  if (words == 5) {
+    event_ptr->event_number = entry[1];
+    event_ptr->event_time   = entry[3];
+    event_ptr->event_time <<= 16;
+    event_ptr->event_time  += entry[2];
+    event_ptr->event_id     = entry[4];
+  } else if (words == 2) {
+    event_ptr->event_number = position->event_number;
+    event_ptr->event_time   = (entry[0] >> 10) & 0x07;
+    event_ptr->event_time <<= 16;
+    event_ptr->event_time  += entry[1];
+    event_ptr->event_time  += position->event_time;
+    event_ptr->event_id     = event_log_id_high_byte[(entry[0] >> 8) & 0x03] + (entry[0] & 0xFF);
+  } else {
+    event_ptr->event_number = position->event_number;
+    event_ptr->event_time   = position->event_time + ((entry[0] >> 8) & 0x3F);
+    event_ptr->event_id     = event_log_id_high_byte[entry[0] >> 14] + (entry[0] & 0xFF);
+  }
+  position->event_number = event_ptr->event_number + 1;
+  position->event_time = event_ptr->event_time;
+  return words;
+}
+
+
+static void ETMCanMasterEventLogAppend(unsigned int event_number, unsigned long event_time, unsigned int event_id) {
+  unsigned int entry[5];
+  unsigned int words;
+  unsigned int id_class;
+  unsigned int n;
+  unsigned long delta;
+  TYPE_EVENT removed_event;
+
+  for (id_class = 0; id_class < 3; id_class++) {
+    if ((event_id & 0xFF00) == event_log_id_high_byte[id_class]) {
+      break;
+    }
+  }
+
+  delta = event_time - event_log.write.event_time;
+  if ((event_log.keyframe_countdown == 0) || (id_class >= 3) || (event_number != event_log.write.event_number) ||
+      (event_time < event_log.write.event_time) || (delta > 0x7FFFF)) {
+    entry[0] = ETM_CAN_MASTER_EVENT_LOG_KEYFRAME_WORD;
+    entry[1] = event_number;
+    entry[2] = event_time & 0xFFFF;
+    entry[3] = (event_time >> 16) & 0xFFFF;
+    entry[4] = event_id;
+    words = 5;
+    event_log.keyframe_countdown = ETM_CAN_MASTER_EVENT_LOG_KEYFRAME;
+  } else if (delta > 0x3F) {
+    entry[0] = ETM_CAN_MASTER_EVENT_LOG_EXTENDED_WORD + (((unsigned int)(delta >> 16)) << 10) + (id_class << 8) + (event_id & 0xFF);
+    entry[1] = delta & 0xFFFF;
+    words = 2;
+    event_log.keyframe_countdown--;
+  } else {
+    entry[0] = (id_class << 14) + (((unsigned int)delta) << 8) + (event_id & 0xFF);
+    words = 1;
+    event_log.keyframe_countdown--;
+  }
+
+  // Remove the oldest events to make room
+  while ((event_log.words_used + words) > ETM_CAN_MASTER_EVENT_LOG_WORDS) {
+    event_log.words_used -= ETMCanMasterEventLogDecode(&event_log.oldest, &removed_event);
+  }
+  if (event_log.words_used == 0) {
+    // This is the only event, it is also the oldest (the first event is always a keyframe)
+    event_log.oldest = event_log.write;
+    event_log.oldest.event_number = event_number;
+  }
+
+  for (n = 0; n < words; n++) {
+    event_log.event_words[event_log.write.index] = entry[n];
+    event_log.write.index++;
+    if (event_log.write.index >= ETM_CAN_MASTER_EVENT_LOG_WORDS) {
+      event_log.write.index = 0;
+    }
+  }
+  event_log.words_used += words;
+  event_log.write.event_number = event_number + 1;
+  event_log.write.event_time = event_time;
+}
+
+
 void SendToEventLog(unsigned int log_id) {
-  event_log.event_data[event_log.write_index].event_number = global_data_can_master.event_log_counter;
-  event_log.event_data[event_log.write_index].event_time   = global_data_can_master.time_seconds_now;
-  event_log.event_data[event_log.write_index].event_id     = log_id;
-  event_log.write_index++;
-  event_log.write_index &= 0x7F;
-  global_data_can_master.event_log_counter++;
-  // DPARKER need to check the EEPROM and TCP locations and advance them as nesseasry so that we don't pass them when advancing the write_index
+  if (event_log.eeprom_pages && (event_log.write.event_number == event_log.reader[ETM_CAN_MASTER_EVENT_LOG_READER_EEPROM].position.event_number)) {
+    // This is the oldest event that has not been stored, start the flush timer
+    event_log.eeprom_flush_tick = etm_can_master_tick;
+  }
+  ETMCanMasterEventLogAppend(event_log.write.event_number, global_data_can_master.time_seconds_now, log_id);
+}
+
+
+static unsigned int ETMCanMasterEventLogLapped(TYPE_EVENT_LOG_POSITION* position) {
+  // Returns 1 if the event at position has been removed
+  return ((int)(position->event_number - event_log.oldest.event_number) < 0);
+}
+
+
+unsigned int ETMCanMasterEventLogPeek(unsigned int reader, TYPE_EVENT** event_ptr) {
+  TYPE_EVENT_LOG_POSITION iterator;
+  unsigned int events;
+
+  if (reader >= ETM_CAN_MASTER_EVENT_LOG_READERS) {
+    return 0;
+  }
+  ETMCanMasterEventLogRead(reader, &iterator);
+  for (events = 0; events < ETM_CAN_MASTER_EVENT_LOG_WINDOW; events++) {
+    if (!ETMCanMasterEventLogNext(&iterator, &event_log.reader[reader].window[events])) {
+      break;
+    }
+  }
+  *event_ptr = event_log.reader[reader].window;
+  return events;
+}
+
+
+void ETMCanMasterEventLogCommit(unsigned int reader, unsigned int events) {
+  TYPE_EVENT_LOG_POSITION iterator;
+  TYPE_EVENT event;
+  unsigned int end_number;
+
+  if (reader >= ETM_CAN_MASTER_EVENT_LOG_READERS) {
+    return;
+  }
+  iterator = event_log.reader[reader].position;
+  end_number = iterator.event_number + events;
+  if (ETMCanMasterEventLogLapped(&iterator)) {
+    // The reader was lapped after the span was handed out, the events in the window were decoded before they were removed
+    if ((int)(end_number - event_log.oldest.event_number) < 0) {
+      event_log.reader[reader].dropped_count += event_log.oldest.event_number - end_number;
+    }
+    iterator = event_log.oldest;
+  }
+  while (((int)(iterator.event_number - end_number) < 0) && ETMCanMasterEventLogNext(&iterator, &event));
+  event_log.reader[reader].position = iterator;
+}
+
+
+unsigned int ETMCanMasterEventLogRead(unsigned int reader, TYPE_EVENT_LOG_POSITION* iterator) {
+  TYPE_EVENT_LOG_READER* reader_ptr;
+
+  if (reader >= ETM_CAN_MASTER_EVENT_LOG_READERS) {
+    *iterator = event_log.write;
+    return 0;
+  }
+  reader_ptr = &event_log.reader[reader];
+  if (ETMCanMasterEventLogLapped(&reader_ptr->position)) {
+    // The reader has been lapped
+    reader_ptr->dropped_count += event_log.oldest.event_number - reader_ptr->position.event_number;
+    reader_ptr->position = event_log.oldest;
+  }
+  *iterator = reader_ptr->position;
+  return event_log.write.event_number - iterator->event_number;
+}
+
+
+unsigned int ETMCanMasterEventLogNext(TYPE_EVENT_LOG_POSITION* iterator, TYPE_EVENT* event_ptr) {
+  if ((iterator->event_number == event_log.write.event_number) || ETMCanMasterEventLogLapped(iterator)) {
+    return 0;
+  }
+  ETMCanMasterEventLogDecode(iterator, event_ptr);
+  return 1;
+}
+
+
+void ETMCanMasterEventLogCommitIterator(unsigned int reader, TYPE_EVENT_LOG_POSITION* iterator) {
+  if (reader >= ETM_CAN_MASTER_EVENT_LOG_READERS) {
+    return;
+  }
+  if (ETMCanMasterEventLogLapped(iterator)) {
+    // The events from iterator to the oldest event were removed before they were read
+    event_log.reader[reader].dropped_count += event_log.oldest.event_number - iterator->event_number;
+    event_log.reader[reader].position = event_log.oldest;
+  } else {
+    event_log.reader[reader].position = *iterator;
+  }
+}
+
+
+// ---------- Event Log EEPROM Storage ---------------
+#define EVENT_LOG_PAGE_SEQUENCE              0
+#define EVENT_LOG_PAGE_FIRST_EVENT           1
+#define EVENT_LOG_PAGE_EVENTS                2
+#define EVENT_LOG_PAGE_DATA                  3
+#define EVENT_LOG_PAGE_CHECK                 15
+#define EVENT_LOG_PAGE_WORDS                 16
+#define EVENT_LOG_WORDS_PER_EVENT            3
+
+
+static unsigned int ETMCanMasterEventLogCheckWord(unsigned int* page_data) {
+  unsigned int sum;
+  unsigned int n;
+
+  sum = 0;
+  for (n = 0; n < EVENT_LOG_PAGE_CHECK; n++) {
+    sum += page_data[n];
+  }
+  return (~sum) & 0xFFFF;
+}
+
+
+static unsigned int ETMCanMasterEventLogReadPage(unsigned int page, unsigned int* page_data) {
+  // Returns 1 if the page holds valid events
+  ETMEEPromReadPage(event_log.eeprom_first_page + page, EVENT_LOG_PAGE_WORDS, page_data);
+  if (page_data[EVENT_LOG_PAGE_CHECK] != ETMCanMasterEventLogCheckWord(page_data)) {
+    return 0;
+  }
+  if ((page_data[EVENT_LOG_PAGE_EVENTS] == 0) || (page_data[EVENT_LOG_PAGE_EVENTS] > ETM_CAN_MASTER_EVENT_LOG_EVENTS_PER_PAGE)) {
+    return 0;
+  }
+  return 1;
+}
+
+
+void ETMCanMasterEventLogInitialize(unsigned int first_page, unsigned int pages) {
+  unsigned int page_data[EVENT_LOG_PAGE_WORDS];
+  unsigned int first_sequence;
+  unsigned int sequence;
+  unsigned int low;
+  unsigned int high;
+  unsigned int mid;
+  unsigned int page;
+  unsigned int loaded;
+  unsigned int n;
+  unsigned int* data_ptr;
+  unsigned long event_time;
+
+  event_log.write.index = 0;
+  event_log.write.event_number = 0;
+  event_log.write.event_time = 0;
+  event_log.oldest = event_log.write;
+  event_log.words_used = 0;
+  event_log.keyframe_countdown = 0;
+  for (n = 0; n < ETM_CAN_MASTER_EVENT_LOG_READERS; n++) {
+    event_log.reader[n].position = event_log.write;
+    event_log.reader[n].dropped_count = 0;
+  }
+  event_log.eeprom_first_page = first_page;
+  event_log.eeprom_pages = pages;
+  event_log.eeprom_next_page = 0;
+  event_log.eeprom_sequence = 0;
+  event_log.eeprom_flush_tick = etm_can_master_tick;
+  event_log.eeprom_page_writes = 0;
+
+  if (pages == 0) {
+    return;
+  }
+
+  // Only the page that was being written when the power failed can be bad, if it is page 0 start from page 1
+  low = 0;
+  if (!ETMCanMasterEventLogReadPage(0, page_data)) {
+    low = 1;
+    if ((pages == 1) || !ETMCanMasterEventLogReadPage(1, page_data)) {
+      // There is no event log in the EEPROM, start a new one at the first page
+      return;
+    }
+  }
+
+  /*
+    Find the newest page.
+    Page n was written in the same pass through the region as page low if its sequence number is (page low sequence) +
+    (n - low).  That is true for every page up to the newest and false after it (older pass, never written or not
+    completely written)
+  */
+  first_sequence = page_data[EVENT_LOG_PAGE_SEQUENCE] - low;
+  high = pages - 1;
+  while (low < high) {
+    mid = high - ((high - low) >> 1);
+    if (ETMCanMasterEventLogReadPage(mid, page_data) && ((unsigned int)(page_data[EVENT_LOG_PAGE_SEQUENCE] - first_sequence) == mid)) {
+      low = mid;
+    } else {
+      high = mid - 1;
+    }
+  }
+  event_log.eeprom_sequence = first_sequence + low + 1;
+  event_log.eeprom_next_page = low + 1;
+  if (event_log.eeprom_next_page >= pages) {
+    event_log.eeprom_next_page = 0;
+  }
+
+  // Count the newest pages that can be loaded back into RAM, working back from the newest page
+  page = low;
+  sequence = first_sequence + low;
+  for (loaded = 0; (loaded < pages) && (loaded < (ETM_CAN_MASTER_EVENT_LOG_WORDS / ETM_CAN_MASTER_EVENT_LOG_EVENTS_PER_PAGE)); loaded++) {
+    if (!ETMCanMasterEventLogReadPage(page, page_data) || (page_data[EVENT_LOG_PAGE_SEQUENCE] != sequence)) {
+      break;
+    }
+    sequence--;
+    if (page == 0) {
+      page = pages;
+    }
+    page--;
+  }
+
+  // Load them, oldest first
+  for (; loaded; loaded--) {
+    page++;
+    if (page >= pages) {
+      page = 0;
+    }
+    ETMCanMasterEventLogReadPage(page, page_data);
+    data_ptr = &page_data[EVENT_LOG_PAGE_DATA];
+    for (n = 0; n < page_data[EVENT_LOG_PAGE_EVENTS]; n++) {
+      event_time = data_ptr[1];
+      event_time <<= 16;
+      event_time += data_ptr[0];
+      ETMCanMasterEventLogAppend(page_data[EVENT_LOG_PAGE_FIRST_EVENT] + n, event_time, data_ptr[2]);
+      data_ptr += EVENT_LOG_WORDS_PER_EVENT;
+    }
+  }
+
+  // The loaded events have already been stored, the other readers have not read them
+  for (n = 0; n < ETM_CAN_MASTER_EVENT_LOG_READERS; n++) {
+    event_log.reader[n].position = event_log.oldest;
+  }
+  event_log.reader[ETM_CAN_MASTER_EVENT_LOG_READER_EEPROM].position = event_log.write;
+}
+
+
+void ETMCanMasterEventLogStore(void) {
+  unsigned int page_data[EVENT_LOG_PAGE_WORDS];
+  unsigned int events;
+  unsigned int n;
+  unsigned int* data_ptr;
+  TYPE_EVENT_LOG_POSITION iterator;
+  TYPE_EVENT_LOG_POSITION previous;
+  TYPE_EVENT event;
+
+  if (event_log.eeprom_pages == 0) {
+    return;
+  }
+
+  events = ETMCanMasterEventLogRead(ETM_CAN_MASTER_EVENT_LOG_READER_EEPROM, &iterator);
+  if (events == 0) {
+    return;
+  }
+  if ((events < ETM_CAN_MASTER_EVENT_LOG_EVENTS_PER_PAGE) && ((etm_can_master_tick - event_log.eeprom_flush_tick) < ETM_CAN_MASTER_EVENT_LOG_FLUSH)) {
+    // Wait for more events to fill the page
+    return;
+  }
+
+  // The events in a page must have sequential event numbers
+  data_ptr = &page_data[EVENT_LOG_PAGE_DATA];
+  for (events = 0; events < ETM_CAN_MASTER_EVENT_LOG_EVENTS_PER_PAGE; events++) {
+    previous = iterator;
+    if (!ETMCanMasterEventLogNext(&iterator, &event)) {
+      break;
+    }
+    if (events == 0) {
+      page_data[EVENT_LOG_PAGE_FIRST_EVENT] = event.event_number;
+    } else if (event.event_number != (unsigned int)(page_data[EVENT_LOG_PAGE_FIRST_EVENT] + events)) {
+      iterator = previous;
+      break;
+    }
+    data_ptr[0] = event.event_time & 0xFFFF;
+    data_ptr[1] = (event.event_time >> 16) & 0xFFFF;
+    data_ptr[2] = event.event_id;
+    data_ptr += EVENT_LOG_WORDS_PER_EVENT;
+  }
+  for (n = events; n < ETM_CAN_MASTER_EVENT_LOG_EVENTS_PER_PAGE; n++) {
+    data_ptr[0] = 0xFFFF;
+    data_ptr[1] = 0xFFFF;
+    data_ptr[2] = 0xFFFF;
+    data_ptr += EVENT_LOG_WORDS_PER_EVENT;
+  }
+  page_data[EVENT_LOG_PAGE_SEQUENCE] = event_log.eeprom_sequence;
+  page_data[EVENT_LOG_PAGE_EVENTS]   = events;
+  page_data[EVENT_LOG_PAGE_CHECK]    = ETMCanMasterEventLogCheckWord(page_data);
+
+  ETMEEPromWritePage(event_log.eeprom_first_page + event_log.eeprom_next_page, EVENT_LOG_PAGE_WORDS, page_data);
+  event_log.eeprom_page_writes++;
+
+  ETMCanMasterEventLogCommitIterator(ETM_CAN_MASTER_EVENT_LOG_READER_EEPROM, &iterator);
+  event_log.eeprom_sequence++;
+  event_log.eeprom_next_page++;
+  if (event_log.eeprom_next_page >= event_log.eeprom_pages) {
+    event_log.eeprom_next_page = 0;
+  }
+  // Any events that are left were logged after the oldest event in this page
+  event_log.eeprom_flush_tick = etm_can_master_tick;
 }
 
 
@@ -1369,16 +2231,14 @@ void __attribute__((interrupt(__save__(CORCON,SR)), no_auto_psv)) _C2Interrupt(v
 
 void DoCanInterrupt(void) {
   ETMCanMessage can_message;
-  unsigned int fast_log_buffer_index;
-  unsigned int pulse_time;
-  
-  // Calculate the time (in milliseconds) that this interrupt occured
-  // This is used for logging pulse messages
-  pulse_time = global_data_can_master.millisecond_counter;
-  pulse_time += ETMScaleFactor2((TMR5>>11),MACRO_DEC_TO_CAL_FACTOR_2(.8192),0);
-  if (_T2IF) {
-    pulse_time += 10;
-  }
+  ETMCanHighSpeedData* ptr_high_speed_data;
+  unsigned int record_index;
+  unsigned int isr_time;
+#ifdef ETM_CAN_MASTER_ISR_CYCLES
+  unsigned int isr_cycles;
+
+  isr_cycles = ETM_CAN_MASTER_ISR_CYCLES;
+#endif
 
   debug_data_ecb.CXINTF_max |= *CXINTF_ptr;
 
@@ -1390,124 +2250,70 @@ void DoCanInterrupt(void) {
     if (!(*CXRX0CON_ptr & FILTER_SELECT_BIT)) {
       // The command was received by Filter 0
       // It is a Next Pulse Level Command 
+      isr_time = ETMCanTimingNow(&timing_data_ecb);
       debug_data_ecb.can_rx_0_filt_0++;
       ETMCanRXMessage(&can_message, CXRX0CON_ptr);
       etm_can_master_next_pulse_level = can_message.word1;
       etm_can_master_next_pulse_count = can_message.word0;
 
       if (_SYNC_CONTROL_HIGH_SPEED_LOGGING) {
-	// Prepare the buffer to store the data
-	fast_log_buffer_index = etm_can_master_next_pulse_count & 0x000F;
-	if (etm_can_master_next_pulse_count & 0x0010) {
-	  // We are putting data into buffer A
-	  global_data_can_master.buffer_a_ready_to_send = 0;
-	  global_data_can_master.buffer_a_sent = 0;
-	  if (fast_log_buffer_index >= 3) {
-	    global_data_can_master.buffer_b_ready_to_send = 1;
-	  }
-	  
-	  *(unsigned int*)&high_speed_data_buffer_a[fast_log_buffer_index].status_bits = 0; // clear the status bits register
-	  high_speed_data_buffer_a[fast_log_buffer_index].pulse_count = etm_can_master_next_pulse_count;
-	  if (etm_can_master_next_pulse_level) {
-	    high_speed_data_buffer_a[fast_log_buffer_index].status_bits.high_energy_pulse = 1;
-	  }
-
-	  high_speed_data_buffer_a[fast_log_buffer_index].x_ray_on_seconds_lsw = global_data_can_master.time_seconds_now;
-	  high_speed_data_buffer_a[fast_log_buffer_index].x_ray_on_milliseconds = pulse_time;
-	  
-	  high_speed_data_buffer_a[fast_log_buffer_index].hvlambda_readback_high_energy_lambda_program_voltage = 0;
-	  high_speed_data_buffer_a[fast_log_buffer_index].hvlambda_readback_low_energy_lambda_program_voltage = 0;
-	  high_speed_data_buffer_a[fast_log_buffer_index].hvlambda_readback_peak_lambda_voltage = 0;
-	  
-	  high_speed_data_buffer_a[fast_log_buffer_index].afc_readback_current_position = 0;
-	  high_speed_data_buffer_a[fast_log_buffer_index].afc_readback_target_position = 0;
-	  high_speed_data_buffer_a[fast_log_buffer_index].afc_readback_a_input = 0;
-	  high_speed_data_buffer_a[fast_log_buffer_index].afc_readback_b_input = 0;
-	  high_speed_data_buffer_a[fast_log_buffer_index].afc_readback_filtered_error_reading = 0;
-	  
-	  high_speed_data_buffer_a[fast_log_buffer_index].ionpump_readback_high_energy_target_current_reading = 0;
-	  high_speed_data_buffer_a[fast_log_buffer_index].ionpump_readback_low_energy_target_current_reading = 0;
-	  
-	  high_speed_data_buffer_a[fast_log_buffer_index].magmon_readback_magnetron_high_energy_current = 0;
-	  high_speed_data_buffer_a[fast_log_buffer_index].magmon_readback_magnetron_low_energy_current = 0;
-	  
-	  high_speed_data_buffer_a[fast_log_buffer_index].psync_readback_trigger_width_and_filtered_trigger_width = 0;
-	  high_speed_data_buffer_a[fast_log_buffer_index].psync_readback_high_energy_grid_width_and_delay = 0;
-	  high_speed_data_buffer_a[fast_log_buffer_index].psync_readback_low_energy_grid_width_and_delay = 0;
-	  
-
-
-	  high_speed_data_buffer_a[fast_log_buffer_index].ionpump_readback_high_energy_target_current_reading = etm_can_master_next_pulse_level;
-
-	} else {
-	  // We are putting data into buffer B
-	  global_data_can_master.buffer_b_ready_to_send = 0;
-	  global_data_can_master.buffer_b_sent = 0;
-	  if (fast_log_buffer_index >= 3) {
-	    global_data_can_master.buffer_a_ready_to_send = 1;
-	  }
-	  
-	  *(unsigned int*)&high_speed_data_buffer_b[fast_log_buffer_index].status_bits = 0; // Clear the status bits register
-	  high_speed_data_buffer_b[fast_log_buffer_index].pulse_count = etm_can_master_next_pulse_count;
-	  if (etm_can_master_next_pulse_level) {
-	    high_speed_data_buffer_b[fast_log_buffer_index].status_bits.high_energy_pulse = 1;
-	  }
-	  
-	  high_speed_data_buffer_b[fast_log_buffer_index].x_ray_on_seconds_lsw = global_data_can_master.time_seconds_now;
-	  high_speed_data_buffer_b[fast_log_buffer_index].x_ray_on_milliseconds = pulse_time;
-	  
-	  high_speed_data_buffer_b[fast_log_buffer_index].hvlambda_readback_high_energy_lambda_program_voltage = 0;
-	  high_speed_data_buffer_b[fast_log_buffer_index].hvlambda_readback_low_energy_lambda_program_voltage = 0;
-	  high_speed_data_buffer_b[fast_log_buffer_index].hvlambda_readback_peak_lambda_voltage = 0;
-	  
-	  high_speed_data_buffer_b[fast_log_buffer_index].afc_readback_current_position = 0;
-	  high_speed_data_buffer_b[fast_log_buffer_index].afc_readback_target_position = 0;
-	  high_speed_data_buffer_b[fast_log_buffer_index].afc_readback_a_input = 0;
-	  high_speed_data_buffer_b[fast_log_buffer_index].afc_readback_b_input = 0;
-	  high_speed_data_buffer_b[fast_log_buffer_index].afc_readback_filtered_error_reading = 0;
-	  
-	  high_speed_data_buffer_b[fast_log_buffer_index].ionpump_readback_high_energy_target_current_reading = 0;
-	  high_speed_data_buffer_b[fast_log_buffer_index].ionpump_readback_low_energy_target_current_reading = 0;
-	  
-	  high_speed_data_buffer_b[fast_log_buffer_index].magmon_readback_magnetron_high_energy_current = 0;
-	  high_speed_data_buffer_b[fast_log_buffer_index].magmon_readback_magnetron_low_energy_current = 0;
-	  
-	  high_speed_data_buffer_b[fast_log_buffer_index].psync_readback_trigger_width_and_filtered_trigger_width = 0;
-	  high_speed_data_buffer_b[fast_log_buffer_index].psync_readback_high_energy_grid_width_and_delay = 0;
-	  high_speed_data_buffer_b[fast_log_buffer_index].psync_readback_low_energy_grid_width_and_delay = 0;
-
-
-	  high_speed_data_buffer_b[fast_log_buffer_index].ionpump_readback_high_energy_target_current_reading = etm_can_master_next_pulse_level;
+	// Start the record for this pulse
+	if (etm_can_master_next_pulse_count != etm_can_high_speed_data_ring.write_index) {
+	  // The pulse count jumped, the records before this pulse will not be exported
+	  etm_can_high_speed_data_ring.start_index = etm_can_master_next_pulse_count;
+	  etm_can_high_speed_data_ring.resync_count++;
+	}
+	record_index = etm_can_master_next_pulse_count & (ETM_CAN_HIGH_SPEED_DATA_DEPTH - 1);
+	ptr_high_speed_data = &etm_can_high_speed_data_ring.record[record_index];
+	etm_can_high_speed_data_ring.record_tick[record_index] = etm_can_master_tick;
+
+	/*
+	  Only the header is written here.  Clearing status_bits marks every fast logging register as not received, the
+	  readings are not cleared.  ETMCanHighSpeedDataPeek() zeros the readings that were not received when the record is
+	  released.
+	*/
+	ptr_high_speed_data->pulse_count = etm_can_master_next_pulse_count;
+	*(unsigned int*)&ptr_high_speed_data->status_bits = etm_can_master_next_pulse_level ? 0x0001 : 0x0000; // high_energy_pulse
+
+	// Calculate the time (in milliseconds) that this pulse occured
+	ptr_high_speed_data->x_ray_on_seconds_lsw = global_data_can_master.time_seconds_now;
+	ptr_high_speed_data->x_ray_on_milliseconds = global_data_can_master.millisecond_counter;
+	ptr_high_speed_data->x_ray_on_milliseconds += ETMScaleFactor2((TMR5>>11),MACRO_DEC_TO_CAL_FACTOR_2(.8192),0);
+	if (_T2IF) {
+	  ptr_high_speed_data->x_ray_on_milliseconds += 10;
 	}
+
+	// The record is ready, hand it to the consumer
+	etm_can_high_speed_data_ring.write_index = etm_can_master_next_pulse_count + 1;
       }
+      ETMCanTimingRecordISR(&timing_data_ecb, isr_time);
     } else {
       // The commmand was received by Filter 1
-      // The command is a data log.  Add it to the data log buffer
+      // The command is a status or return message.  Add it to the message buffer
       debug_data_ecb.can_rx_0_filt_1++;
-      ETMCanRXMessageBuffer(&etm_can_master_rx_data_log_buffer, CXRX0CON_ptr);
+      ETMCanTimeStampNextMessage(&timing_data_ecb, &etm_can_master_rx_message_buffer);
+      ETMCanRXMessageBuffer(&etm_can_master_rx_message_buffer, CXRX0CON_ptr);
     }
-    *CXINTF_ptr &= RX1_INT_FLAG_BIT; // Clear the RX1 Interrupt Flag
+    *CXINTF_ptr &= RX0_INT_FLAG_BIT; // Clear the RX0 Interrupt Flag
   }
  
   if (*CXRX1CON_ptr & BUFFER_FULL_BIT) { 
     /* 
        A message has been recieved in Buffer 1
-       This command gets pushed onto the command message buffer
+       This is logging data, it gets pushed onto the data log buffer
     */
     debug_data_ecb.can_rx_1_filt_2++;
-    ETMCanRXMessageBuffer(&etm_can_master_rx_message_buffer, CXRX1CON_ptr);
+    ETMCanTimeStampNextMessage(&timing_data_ecb, &etm_can_master_rx_data_log_buffer);
+    ETMCanRXMessageBuffer(&etm_can_master_rx_data_log_buffer, CXRX1CON_ptr);
     *CXINTF_ptr &= RX1_INT_FLAG_BIT; // Clear the RX1 Interrupt Flag
   }
 
-  if (!(*CXTX0CON_ptr & TX_REQ_BIT) && ((ETMCanBufferNotEmpty(&etm_can_master_tx_message_buffer)))) {  
-    /*
-      TX0 is empty and there is a message waiting in the transmit message buffer
-      Load the next message into TX0
-    */
-    ETMCanTXMessageBuffer(&etm_can_master_tx_message_buffer, CXTX0CON_ptr);
-    *CXINTF_ptr &= 0xFFFB; // Clear the TX0 Interrupt Flag
-    debug_data_ecb.can_tx_0++;
-  }
+  /*
+    Load any empty TX buffer from the transmit queues (sync and commands)
+    The flags are cleared first so that a TX buffer that empties while this is running will trigger the interrupt again
+  */
+  *CXINTF_ptr &= TX_INT_FLAG_BITS; // Clear the TX0, TX1, TX2 Interrupt Flags
+  ETMCanTXSchedulerService(&etm_can_master_tx_scheduler);
   
   if (*CXINTF_ptr & ERROR_FLAG_BIT) {
     // There was some sort of CAN Error
@@ -1522,6 +2328,17 @@ void DoCanInterrupt(void) {
     }
   }
 
+#ifdef ETM_CAN_MASTER_ISR_CYCLES
+  isr_cycles = ETM_CAN_MASTER_ISR_CYCLES - isr_cycles;
+  if (isr_cycles < etm_can_master_isr_cycles.min) {
+    etm_can_master_isr_cycles.min = isr_cycles;
+  }
+  if (isr_cycles > etm_can_master_isr_cycles.max) {
+    etm_can_master_isr_cycles.max = isr_cycles;
+  }
+  etm_can_master_isr_cycles.avg_x16 = etm_can_master_isr_cycles.avg_x16 - (etm_can_master_isr_cycles.avg_x16 >> 4) + isr_cycles;
+  etm_can_master_isr_cycles.count++;
+#endif
 }
 
 
@@ -7,15 +7,15 @@
 typedef struct {
   unsigned high_energy_pulse:1;
   unsigned arc_this_pulse:1;
-  unsigned tbd_2:1;
-  unsigned tbd_3:1;
+  unsigned hv_lambda_fast_log_0:1;   // The fast logging registers that have been received for this pulse
+  unsigned afc_fast_log_0:1;
 
-  unsigned tbd_4:1;
-  unsigned tbd_5:1;
-  unsigned tbd_6:1;
-  unsigned tbd_7:1;
+  unsigned afc_fast_log_1:1;
+  unsigned magnetron_mon_fast_log_0:1;
+  unsigned pulse_sync_fast_log_0:1;
+  unsigned ion_pump_fast_log_0:1;
 
-  unsigned tbd_8:1;
+  unsigned data_incomplete:1;        // The record was released by timeout before all the expected registers were received
   unsigned tbd_9:1;
   unsigned tbd_A:1;
   unsigned tbd_B:1;
@@ -56,15 +56,28 @@ typedef struct {
 // 19 words
 
 
-extern ETMCanBoardData local_data_ecb;
-extern ETMCanBoardData mirror_hv_lambda;
-extern ETMCanBoardData mirror_ion_pump;
-extern ETMCanBoardData mirror_afc;
-extern ETMCanBoardData mirror_cooling;
-extern ETMCanBoardData mirror_htr_mag;
-extern ETMCanBoardData mirror_gun_drv;
-extern ETMCanBoardData mirror_magnetron_mon;
-extern ETMCanBoardData mirror_pulse_sync;
+#define ETM_CAN_MASTER_BOARDS                    16
+
+extern ETMCanBoardData etm_can_master_mirror[ETM_CAN_MASTER_BOARDS];
+/*
+  The ECB's copy of the data from every board, indexed by CAN address.
+  Status messages and logging data from a board are stored directly in etm_can_master_mirror[board address].
+  The ECB's own data is stored at its own address, nothing on the bus is written there.
+  Address 0 is not used.
+*/
+
+#define ETM_CAN_MASTER_MIRROR_BOARDS             (0xFFFE & ~(1 << ETM_CAN_ADDR_ETHERNET_BOARD))
+// Board addresses that are stored in etm_can_master_mirror when received from the bus (all except 0 and the ECB)
+
+#define local_data_ecb                           etm_can_master_mirror[ETM_CAN_ADDR_ETHERNET_BOARD]
+#define mirror_ion_pump                          etm_can_master_mirror[ETM_CAN_ADDR_ION_PUMP_BOARD]
+#define mirror_magnetron_mon                     etm_can_master_mirror[ETM_CAN_ADDR_MAGNETRON_CURRENT_BOARD]
+#define mirror_pulse_sync                        etm_can_master_mirror[ETM_CAN_ADDR_PULSE_SYNC_BOARD]
+#define mirror_hv_lambda                         etm_can_master_mirror[ETM_CAN_ADDR_HV_LAMBDA_BOARD]
+#define mirror_afc                               etm_can_master_mirror[ETM_CAN_ADDR_AFC_CONTROL_BOARD]
+#define mirror_cooling                           etm_can_master_mirror[ETM_CAN_ADDR_COOLING_INTERFACE_BOARD]
+#define mirror_htr_mag                           etm_can_master_mirror[ETM_CAN_ADDR_HEATER_MAGNET_BOARD]
+#define mirror_gun_drv                           etm_can_master_mirror[ETM_CAN_ADDR_GUN_DRIVER_BOARD]
 
 
 
@@ -171,7 +184,35 @@ extern ETMCanBoardData mirror_pulse_sync;
 
 
 ETMCanBoardDebuggingData debug_data_ecb;
-ETMCanBoardDebuggingData debug_data_slave_mirror;
+extern ETMCanTiming      timing_data_ecb;             // CAN latency timing for the ECB, the CAN_TIMING registers are in timing_data_ecb.data
+
+// ---------- Debug Mirrors ---------------
+/*
+  The debugging registers of a slave (DEBUG, CAN_ERROR, SYSTEM_ERROR and CAN_TIMING) are only sent while the board is
+  subscribed, the ECB sends the subscribed boards to the slaves in sync_2_debug_boards of every sync message.
+  Each subscribed board is stored in one of the ETM_CAN_MASTER_DEBUG_MIRRORS debug mirrors.
+   - Mirror 0 always follows the board selected on the GUI (etm_can_active_debugging_board_id).  It is also available
+     as debug_data_slave_mirror and timing_data_slave_mirror.
+   - The other mirrors are assigned with ETMCanMasterDebugSubscribe()
+  A mirror is zeroed when it is assigned to a board.  Nothing is subscribed while the GUI has the ECB selected.
+*/
+#ifndef ETM_CAN_MASTER_DEBUG_MIRRORS
+#define ETM_CAN_MASTER_DEBUG_MIRRORS             2    // Boards that can be debugged at once, including the GUI selection
+#endif
+
+#define ETM_CAN_MASTER_DEBUG_MIRROR_FREE         0xFFFF
+
+typedef struct {
+  unsigned int             board;                        // Board address, ETM_CAN_MASTER_DEBUG_MIRROR_FREE if not in use
+  ETMCanBoardDebuggingData debug_data;
+  ETMCanLatencyData        timing_data;                  // CAN_TIMING registers
+} ETMCanDebugMirror;
+
+extern ETMCanDebugMirror etm_can_master_debug_mirror[ETM_CAN_MASTER_DEBUG_MIRRORS];
+extern unsigned int etm_can_active_debugging_board_id;
+
+#define debug_data_slave_mirror                  etm_can_master_debug_mirror[0].debug_data
+#define timing_data_slave_mirror                 etm_can_master_debug_mirror[0].timing_data
 
 
 
@@ -251,14 +292,157 @@ ETMCanBoardDebuggingData debug_data_slave_mirror;
 #define _PULSE_SYNC_CUSTOMER_XRAY_OFF      etm_can_pulse_sync_mirror.status_data.status_bits.status_1
 
 // PUBLIC Variables
-#define HIGH_SPEED_DATA_BUFFER_SIZE   16
-extern ETMCanHighSpeedData high_speed_data_buffer_a[HIGH_SPEED_DATA_BUFFER_SIZE];
-extern ETMCanHighSpeedData high_speed_data_buffer_b[HIGH_SPEED_DATA_BUFFER_SIZE];
+
+// ---------- High Speed Data Ring ---------------
+/*
+  The pulse by pulse (high speed logging) records are stored in a ring that is indexed by pulse count.
+  The record for a pulse is at record[pulse_count & (ETM_CAN_HIGH_SPEED_DATA_DEPTH - 1)]
+
+  The indexes are free running pulse counts (they are not masked)
+   - write_index is the pulse count after the newest record.  It is only written by the CAN interrupt when a next pulse
+     level command starts a new record
+   - start_index is the first pulse count after the pulse count jumped (missed or reset pulse level commands).  Records
+     before it are never exported.  It is only written by the CAN interrupt.
+   - read_index is the pulse count of the oldest record that has not been exported.  It is only written by the consumer
+     (ETMCanHighSpeedDataPeek / ETMCanHighSpeedDataCommit)
+   - release_index is the pulse count after the newest record that ETMCanHighSpeedDataPeek() has handed out.  It is
+     only written by ETMCanHighSpeedDataPeek() and is never behind read_index.
+
+  Each record carries a bitmask of the fast logging registers that have been received for it (the *_fast_log_* bits of
+  status_bits).  A record is released to the consumer as soon as every register in expected_mask has been received.
+  If that takes longer than ETM_CAN_HIGH_SPEED_DATA_TIMEOUT (in 25mS ticks) or ETM_CAN_HIGH_SPEED_DATA_TIMEOUT_PULSES
+  newer pulses the record is released anyway with status_bits.data_incomplete set and counted in incomplete_count.
+  Records are released in pulse order, a record that is still waiting holds back the complete records after it.
+  The CAN interrupt only writes the record header, the readings of registers that were not received are zeroed when the
+  record is released.
+  Fast logging data for a record before release_index (already handed out or exported) is discarded and counted in
+  late_count, so a record does not change after it was handed out.
+
+  If the consumer falls behind by more than ETM_CAN_HIGH_SPEED_DATA_DEPTH records the oldest records are overwritten,
+  they are skipped and counted in overrun_count.
+  The CAN interrupt keeps writing records while the consumer sends the ones it was handed.  ETMCanHighSpeedDataPeek()
+  hands out at most ETM_CAN_HIGH_SPEED_DATA_DEPTH - ETM_CAN_HIGH_SPEED_DATA_PEEK_MARGIN records, and
+  ETMCanHighSpeedDataCommit() counts the records that were overwritten before they were committed in overrun_count
+  instead of export_count.
+*/
+#ifndef ETM_CAN_HIGH_SPEED_DATA_DEPTH
+#define ETM_CAN_HIGH_SPEED_DATA_DEPTH            32   // Must be a power of 2
+#endif
+
+#ifndef ETM_CAN_HIGH_SPEED_DATA_PEEK_MARGIN
+#define ETM_CAN_HIGH_SPEED_DATA_PEEK_MARGIN      (ETM_CAN_HIGH_SPEED_DATA_DEPTH / 4)  // Pulses that may arrive while the handed out records are sent
+#endif
+
+#ifndef ETM_CAN_HIGH_SPEED_DATA_TIMEOUT
+#define ETM_CAN_HIGH_SPEED_DATA_TIMEOUT          4    // 25mS ticks (100mS)
+#endif
+
+#ifndef ETM_CAN_HIGH_SPEED_DATA_TIMEOUT_PULSES
+#define ETM_CAN_HIGH_SPEED_DATA_TIMEOUT_PULSES   (ETM_CAN_HIGH_SPEED_DATA_DEPTH / 2)
+#endif
+
+// status_bits masks for the fast logging registers
+#define ETM_CAN_HIGH_SPEED_DATA_HV_LAMBDA_FAST_LOG_0       0x0004
+#define ETM_CAN_HIGH_SPEED_DATA_AFC_FAST_LOG_0             0x0008
+#define ETM_CAN_HIGH_SPEED_DATA_AFC_FAST_LOG_1             0x0010
+#define ETM_CAN_HIGH_SPEED_DATA_MAGNETRON_MON_FAST_LOG_0   0x0020
+#define ETM_CAN_HIGH_SPEED_DATA_PULSE_SYNC_FAST_LOG_0      0x0040
+#define ETM_CAN_HIGH_SPEED_DATA_ION_PUMP_FAST_LOG_0        0x0080
+#define ETM_CAN_HIGH_SPEED_DATA_INCOMPLETE                 0x0100
+
+#ifndef ETM_CAN_HIGH_SPEED_DATA_EXPECTED
+#define ETM_CAN_HIGH_SPEED_DATA_EXPECTED         (ETM_CAN_HIGH_SPEED_DATA_HV_LAMBDA_FAST_LOG_0 | ETM_CAN_HIGH_SPEED_DATA_AFC_FAST_LOG_0 | ETM_CAN_HIGH_SPEED_DATA_AFC_FAST_LOG_1 | ETM_CAN_HIGH_SPEED_DATA_MAGNETRON_MON_FAST_LOG_0 | ETM_CAN_HIGH_SPEED_DATA_PULSE_SYNC_FAST_LOG_0)
+#endif
+
+typedef struct {
+  unsigned int        write_index;      // Producer - pulse count after the newest record
+  unsigned int        start_index;      // Producer - first pulse count after the last jump in pulse count
+  unsigned int        resync_count;     // Producer - number of times the pulse count jumped
+  unsigned int        read_index;       // Consumer - pulse count of the oldest record that has not been exported
+  unsigned int        release_index;    // Consumer - pulse count after the newest record handed out by ETMCanHighSpeedDataPeek()
+  unsigned int        overrun_count;    // Consumer - records that were overwritten before they were exported
+  unsigned int        export_count;     // Consumer - records that have been exported
+  unsigned int        incomplete_count; // Consumer - records that were released by timeout
+  unsigned int        expected_mask;    // Consumer - the fast logging registers that make a record complete (ETM_CAN_HIGH_SPEED_DATA_EXPECTED)
+  unsigned int        late_count;       // Fast logging messages for a pulse that is no longer in the ring
+  unsigned int        record_tick[ETM_CAN_HIGH_SPEED_DATA_DEPTH]; // etm_can_master_tick when each record was started
+  ETMCanHighSpeedData record[ETM_CAN_HIGH_SPEED_DATA_DEPTH];
+} ETMCanHighSpeedDataRing;
+
+extern ETMCanHighSpeedDataRing etm_can_high_speed_data_ring;
+
+
+unsigned int ETMCanHighSpeedDataPeek(ETMCanHighSpeedData** record_ptr);
+/*
+  Hands out the released (complete or timed out) records that have not been exported yet without copying them.
+  *record_ptr is set to the oldest record and the number of contiguous records (up to the end of the ring and at most
+  ETM_CAN_HIGH_SPEED_DATA_DEPTH - ETM_CAN_HIGH_SPEED_DATA_PEEK_MARGIN) is returned.
+  Returns 0 if there are no released records.
+  The records must be released with ETMCanHighSpeedDataCommit() once they have been sent.
+*/
+
+void ETMCanHighSpeedDataCommit(unsigned int records);
+/*
+  Releases records that were handed out by ETMCanHighSpeedDataPeek()
+  Records that the CAN interrupt overwrote after they were handed out are counted in overrun_count, the rest in
+  export_count.
+*/
 
 
 extern ETMCanHighSpeedData              etm_can_high_speed_data_test;
 
 
+// ---------- CAN Interrupt Cycle Timing ---------------
+/*
+  Build option for checking the CAN interrupt against its cycle budget.
+  Define ETM_CAN_MASTER_ISR_CYCLES as a timer register (for example TMR1) that the application runs from Fcy with a 1:1
+  prescale and PRx = 0xFFFF.  The CAN interrupt then records the cycles from entry to exit of DoCanInterrupt() (the
+  context save and restore are not included).  ETMCanMasterDoCan() copies min, max, average and the interrupt count to
+  debug_data_ecb.debug_reg[ETM_CAN_MASTER_ISR_CYCLES_DEBUG_REG] -> [ETM_CAN_MASTER_ISR_CYCLES_DEBUG_REG + 3], the
+  application must not use those debug registers.
+*/
+#ifdef ETM_CAN_MASTER_ISR_CYCLES
+#ifndef ETM_CAN_MASTER_ISR_CYCLES_DEBUG_REG
+#define ETM_CAN_MASTER_ISR_CYCLES_DEBUG_REG      12
+#endif
+
+typedef struct {
+  unsigned int min;
+  unsigned int max;
+  unsigned long avg_x16;  // Filtered average (1/16 weight for each interrupt) * 16, long so it holds 0xFFFF cycles * 16
+  volatile unsigned int count;  // Also used by ETMCanMasterDoCan() to check that avg_x16 was read in one piece
+} ETMCanMasterIsrCycles;
+
+extern ETMCanMasterIsrCycles etm_can_master_isr_cycles;
+#endif
+
+
+// ---------- Periodic Transmit Jobs ---------------
+#define ETM_CAN_MASTER_JOBS                      10      // Must match the number of entries in etm_can_master_job_table
+#define ETM_CAN_MASTER_JOB_SETPOINT_WORDS        3
+
+typedef struct {
+  unsigned int release;           // T4 tick of the next release
+  unsigned int deadline;          // T4 tick that the pending release must be sent by
+  unsigned int pending;           // The job has been released and has not been sent yet
+  unsigned int sent_count;        // Number of times the job was sent
+  unsigned int overrun_count;     // Releases that were dropped because the previous release had not been sent yet
+  unsigned int change_count;      // Number of times the job was released because its set point changed
+  unsigned int sent_setpoint[ETM_CAN_MASTER_JOB_SETPOINT_WORDS];  // The set point values that were last sent
+} ETMCanMasterJobState;
+
+extern ETMCanMasterJobState etm_can_master_job_state[ETM_CAN_MASTER_JOBS];
+/*
+  The state of each job in the periodic transmit table (etm_can_master_job_table in P1395_CAN_MASTER.c), in table order
+  sent_count, overrun_count and change_count are cleared with the rest of the debug data
+*/
+
+extern unsigned int etm_can_master_tick;
+/*
+  Free running count of T4 ticks (25ms), this is the time base for the periodic transmit jobs
+*/
+
+
 void ETMCanMasterDoCan(void);
 
 // Public Functions
@@ -274,12 +458,108 @@ void ETMCanMasterLoadConfiguration(unsigned long agile_id, unsigned int agile_da
 
 // DPARKER how do you set the agile rev and the serial number?? Should this be done over can?
 
+void ETMCanMasterSetExpectedBoards(unsigned int boards);
+/*
+  Selects the boards that must be connected, one bit per board address (bit n = address n).
+  Boards that are not expected are still mirrored, but they do not hold off the ECB and are never reported as not connected.
+  A board that is removed from the set has its communication fault cleared.
+  ETMCanMasterInitialize() selects every board that is not excluded with a __IGNORE_xxx_MODULE option.
+*/
+
+unsigned int ETMCanMasterGetExpectedBoards(void);
+/*
+  Returns the boards that must be connected, one bit per board address.
+*/
+
+#ifndef ETM_CAN_MASTER_BOARD_DEADLINE
+#define ETM_CAN_MASTER_BOARD_DEADLINE            10   // etm_can_master_tick periods (250mS)
+#endif
+
+void ETMCanMasterSetBoardDeadline(unsigned int board, unsigned int ticks);
+/*
+  Sets the time allowed between status messages from a board, in etm_can_master_tick periods (25mS).
+  A board that is expected and does not send a status message within ticks of its last one has lost communication.
+  Every board starts with ETM_CAN_MASTER_BOARD_DEADLINE.
+*/
+
+
+
+ETMCanDebugMirror* ETMCanMasterDebugSubscribe(unsigned int board);
+/*
+  Starts mirroring the debugging registers of a board.
+  Returns the debug mirror for the board, or 0 if the board can not be mirrored or every other mirror is in use.
+  Subscribing a board that is already mirrored returns its mirror.
+*/
+
+void ETMCanMasterDebugUnsubscribe(unsigned int board);
+/*
+  Stops mirroring the debugging registers of a board and frees its mirror.
+  This does not affect mirror 0, it follows etm_can_active_debugging_board_id.
+*/
+
+unsigned int ETMCanMasterGetDebugBoards(void);
+/*
+  Returns the boards that are sending their debugging registers, one bit per board address.
+*/
+
 
 
 void SendCalibrationSetPointToSlave(unsigned int index, unsigned int data_1, unsigned int data_0);
 
 void ReadCalibrationSetPointFromSlave(unsigned int index);
 
+// ---------- Calibration Block Transfer ---------------
+#ifndef ETM_CAN_MASTER_CALIBRATION_TRANSFERS
+#define ETM_CAN_MASTER_CALIBRATION_TRANSFERS     2    // Calibration pages that can be in flight at once, each to a different board
+#endif
+#define ETM_CAN_MASTER_CALIBRATION_TIMEOUT       8    // etm_can_master_tick periods (200mS) to wait for the slave to answer
+#define ETM_CAN_MASTER_CALIBRATION_RETRIES       3    // A page is sent this many more times before the transfer is abandoned
+
+typedef struct {
+  unsigned int  board;                                   // Board address, 0 if the transfer is not in use
+  unsigned int  write;                                   // 1 = ECB to slave, 0 = slave to ECB
+  unsigned int  page;                                    // Calibration page (0 -> F) that is being transferred
+  unsigned int  last_page;
+  unsigned int* data;                                    // Write only - source of the current page
+  unsigned int  sequence;                                // Sequence number of the current attempt
+  unsigned int  sent;                                    // The current page has been sent and the ECB is waiting for the slave
+  unsigned int  sent_tick;                               // etm_can_master_tick when the current page was sent
+  unsigned int  retries;                                 // Retries of the current page
+  unsigned int  received_frames;                         // Read only - one bit per frame
+  unsigned int  block[ETM_CAN_CALIBRATION_BLOCK_WORDS];  // Page, sequence, CRC
+} ETMCanCalibrationTransfer;
+
+typedef struct {
+  ETMCanCalibrationTransfer transfer[ETM_CAN_MASTER_CALIBRATION_TRANSFERS];
+  unsigned int              sequence;                    // Sequence number of the last page sent
+  unsigned int              page_count;                  // Pages that have been transferred and checked
+  unsigned int              retry_count;                 // Pages that were sent again (timeout, CRC error)
+  unsigned int              failed_count;                // Transfers abandoned after ETM_CAN_MASTER_CALIBRATION_RETRIES
+} ETMCanCalibrationTransfers;
+
+extern ETMCanCalibrationTransfers etm_can_master_calibration;
+
+unsigned int ETMCanMasterCalibrationBlockWrite(unsigned int board, unsigned int first_page, unsigned int pages, unsigned int* data);
+/*
+  Writes calibration pages first_page -> first_page + pages - 1 of a board (16 words per page, see P1395_CAN_CORE.h).
+  data must hold pages x 16 words and must not change until ETMCanMasterCalibrationBlockBusy() returns 0.
+  Returns 0 if the transfer was started, 1 if the request is invalid, the board already has a transfer in progress or all
+  ETM_CAN_MASTER_CALIBRATION_TRANSFERS are in use.
+*/
+
+unsigned int ETMCanMasterCalibrationBlockRead(unsigned int board, unsigned int first_page, unsigned int pages);
+/*
+  Reads calibration pages first_page -> first_page + pages - 1 of a board.
+  The calibration pairs of each page are passed to SendCalibrationData() as they arrive, the same as single pair reads.
+  Returns 0 if the transfer was started, 1 if it was not (see ETMCanMasterCalibrationBlockWrite).
+*/
+
+unsigned int ETMCanMasterCalibrationBlockBusy(unsigned int board);
+/*
+  Returns 1 while a calibration block transfer to or from the board is in progress.
+  A transfer that fails after ETM_CAN_MASTER_CALIBRATION_RETRIES is counted in etm_can_master_calibration.failed_count.
+*/
+
 void SendSlaveLoadDefaultEEpromData(unsigned int board_id);
 
 void SendSlaveReset(unsigned int board_id);
@@ -321,6 +601,10 @@ void SendToEventLog(unsigned int log_id);
 
 
 
+// The board specific log ids are 0x11n0 -> 0x11nF where n is the board address
+#define LOG_ID_NOT_CONNECTED_BOARD(board)                                     (0x1104 | ((board) << 4))
+#define LOG_ID_CONNECTED_BOARD(board)                                         (0x1105 | ((board) << 4))
+
 #define LOG_ID_NOT_READY_ION_PUMP_BOARD                                       0x1110
 #define LOG_ID_READY_ION_PUMP_BOARD                                           0x1111
 #define LOG_ID_NOT_CONFIGURED_ION_PUMP_BOARD                                  0x1112
@@ -417,7 +701,7 @@ void SendToEventLog(unsigned int log_id);
 
 
 typedef struct {
-  unsigned int  event_number; // this resets to zero at power up
+  unsigned int  event_number; // this resets to zero at power up (it continues from the EEPROM log if that is used)
   unsigned long event_time;   // this is the custom time format
   unsigned int  event_id;     // This tells what the event was
 
@@ -425,16 +709,152 @@ typedef struct {
 } TYPE_EVENT;
 
 
+/*
+  The event log is stored delta encoded in a ring of ETM_CAN_MASTER_EVENT_LOG_WORDS words.
+  Event numbers are sequential and the time only moves forward, so most events are stored in a single word
+    bits 15-14  event_id high byte (0 - 0x00, 1 - 0x10, 2 - 0x11)
+    bits 13-8   seconds since the previous event (0 -> 63)
+    bits 7-0    event_id low byte
+  An event more than 63 seconds after the previous one is stored in 2 words (ETM_CAN_MASTER_EVENT_LOG_EXTENDED_WORD)
+    word 0  bits 15-13 111, bits 12-10 seconds since the previous event bits 18-16, bits 9-8 id class, bits 7-0 event_id low byte
+    word 1  seconds since the previous event bits 15-0
+  Every ETM_CAN_MASTER_EVENT_LOG_KEYFRAME events, when the event number jumps, when the time moves backwards, for a gap
+  of more than 0x7FFFF seconds (6 days) and for an event_id outside the 3 classes, a 5 word keyframe is stored instead
+  (ETM_CAN_MASTER_EVENT_LOG_KEYFRAME_WORD, event_number, event_time lsw, event_time msw, event_id).
+  The default size (1056 bytes, the size of 132 TYPE_EVENT) holds
+   - 512 events when they are less than 64 seconds apart
+   - at least 259 events when every event is more than 63 seconds after the one before it
+   - 105 events if every event needs a keyframe (time moving backwards or ids outside the 3 classes)
+
+  There is one writer (SendToEventLog) and a position for each reader.  A position holds the word index and the event
+  number of the next event and the time of the event before it, ETMCanMasterEventLogNext() decodes the events from a
+  position into full TYPE_EVENT values.
+  A reader can take its events as spans without copying them (ETMCanMasterEventLogPeek / ETMCanMasterEventLogCommit).
+  The events are decoded into the reader's window of ETM_CAN_MASTER_EVENT_LOG_WINDOW events, which only that reader
+  uses, so a span stays valid until the reader commits it even if the events are removed from event_words.
+  Or it can walk them one at a time (ETMCanMasterEventLogRead / ETMCanMasterEventLogNext / ETMCanMasterEventLogCommitIterator).
+  The writer never waits for the readers, the oldest events are removed as new ones are added.  A reader that falls
+  behind the oldest event has been lapped.  ETMCanMasterEventLogNext() stops at a lapped position, and the next commit or
+  read moves the reader to the oldest event and adds the events it missed to its dropped_count.  One slow reader does not
+  affect the others.
+  The encoding, the readers and the EEPROM recovery are checked on the host with make event_log_check (ETM_LINAC_CAN_SIM).
+*/
+#ifndef ETM_CAN_MASTER_EVENT_LOG_WORDS
+#define ETM_CAN_MASTER_EVENT_LOG_WORDS            528
+#endif
+
+#ifndef ETM_CAN_MASTER_EVENT_LOG_KEYFRAME
+#define ETM_CAN_MASTER_EVENT_LOG_KEYFRAME         128   // Events
+#endif
+
+#ifndef ETM_CAN_MASTER_EVENT_LOG_WINDOW
+#define ETM_CAN_MASTER_EVENT_LOG_WINDOW           4     // Events, 8 bytes each for every reader
+#endif
+
+#define ETM_CAN_MASTER_EVENT_LOG_KEYFRAME_WORD    0xC000  // Bits 15-13 of the first word of a keyframe
+#define ETM_CAN_MASTER_EVENT_LOG_EXTENDED_WORD    0xE000  // Bits 15-13 of the first word of an extended delta
+
+#define ETM_CAN_MASTER_EVENT_LOG_READER_GUI       0     // Sent to the GUI over TCP/IP by the ECB application
+#define ETM_CAN_MASTER_EVENT_LOG_READER_EEPROM    1     // Stored in the EEPROM by ETMCanMasterEventLogStore()
+#define ETM_CAN_MASTER_EVENT_LOG_READER_DIAG      2     // Diagnostics
+#define ETM_CAN_MASTER_EVENT_LOG_READERS          3
+
+typedef struct {
+  unsigned int  index;              // Word index of the next event in event_words
+  unsigned int  event_number;       // event_number of the next event
+  unsigned long event_time;         // event_time of the event before the next event
+} TYPE_EVENT_LOG_POSITION;
+
 typedef struct {
-  TYPE_EVENT event_data[128];
-  unsigned int write_index;
-  unsigned int gui_index;
-  unsigned int eeprom_index;
+  TYPE_EVENT_LOG_POSITION position; // The next event this reader has not read
+  unsigned int dropped_count;       // Events that were removed before this reader read them
+  TYPE_EVENT window[ETM_CAN_MASTER_EVENT_LOG_WINDOW]; // The events handed out by ETMCanMasterEventLogPeek()
+} TYPE_EVENT_LOG_READER;
+
+typedef struct {
+  unsigned int event_words[ETM_CAN_MASTER_EVENT_LOG_WORDS];
+  TYPE_EVENT_LOG_POSITION write;    // After the newest event
+  TYPE_EVENT_LOG_POSITION oldest;   // The oldest event in event_words
+  unsigned int words_used;
+  unsigned int keyframe_countdown;  // Events until the next keyframe
+  TYPE_EVENT_LOG_READER reader[ETM_CAN_MASTER_EVENT_LOG_READERS];
+
+  unsigned int eeprom_first_page;   // The EEPROM pages reserved for the event log
+  unsigned int eeprom_pages;        // 0 - the event log is not stored in the EEPROM
+  unsigned int eeprom_next_page;    // The page (from eeprom_first_page) that will be written next
+  unsigned int eeprom_sequence;     // The sequence number of the next page
+  unsigned int eeprom_flush_tick;   // etm_can_master_tick when the oldest event that has not been stored was logged
+  unsigned int eeprom_page_writes;
 } TYPE_EVENT_LOG;
  
 
 extern TYPE_EVENT_LOG event_log;
 
+
+unsigned int ETMCanMasterEventLogPeek(unsigned int reader, TYPE_EVENT** event_ptr);
+/*
+  Hands out the oldest events that reader has not read without copying them.
+  *event_ptr is set to the reader's window and the number of events in it is returned (up to
+  ETM_CAN_MASTER_EVENT_LOG_WINDOW).  Returns 0 if there are no unread events.
+  The events must be released with ETMCanMasterEventLogCommit() once they have been sent.
+*/
+
+void ETMCanMasterEventLogCommit(unsigned int reader, unsigned int events);
+/*
+  Marks the first events of the span handed out by ETMCanMasterEventLogPeek() as read by reader
+*/
+
+unsigned int ETMCanMasterEventLogRead(unsigned int reader, TYPE_EVENT_LOG_POSITION* iterator);
+/*
+  Sets iterator to the oldest event that reader has not read and returns the number of unread events.
+*/
+
+unsigned int ETMCanMasterEventLogNext(TYPE_EVENT_LOG_POSITION* iterator, TYPE_EVENT* event_ptr);
+/*
+  Decodes the event at iterator into *event_ptr and moves iterator to the next event.
+  Returns 0 (and does not change *event_ptr) if iterator is already after the newest event, or if it has been lapped
+  (the event at iterator was removed by SendToEventLog()).
+*/
+
+void ETMCanMasterEventLogCommitIterator(unsigned int reader, TYPE_EVENT_LOG_POSITION* iterator);
+/*
+  Marks the events before iterator as read by reader
+  If iterator was lapped the reader is moved to the oldest event and the events it missed are added to dropped_count.
+*/
+
+
+// ---------- Event Log EEPROM Storage ---------------
+/*
+  The event log can be kept in a reserved region of the EEPROM so that it survives a power cycle.
+  The events are packed into 16 word pages that are written with a single ETMEEPromWritePage() by the main loop.
+  A page is written when it is full or ETM_CAN_MASTER_EVENT_LOG_FLUSH after the oldest event in it was logged, each page
+  is written once.  The pages are written in order through the region and then start again at the first page, so every
+  page is written the same number of times.
+
+  Page format
+  word 0            sequence number, this increases by 1 for every page written
+  word 1            event_number of the first event in the page, the others follow in order
+  word 2            number of events in the page (1 -> ETM_CAN_MASTER_EVENT_LOG_EVENTS_PER_PAGE)
+  word 3  -> 14     events, 3 words each (event_time lsw, event_time msw, event_id)
+  word 15           check word, the ones complement of the sum of words 0 -> 14
+*/
+
+#define ETM_CAN_MASTER_EVENT_LOG_EVENTS_PER_PAGE  4
+
+#ifndef ETM_CAN_MASTER_EVENT_LOG_FLUSH
+#define ETM_CAN_MASTER_EVENT_LOG_FLUSH            200   // 25mS ticks (5 seconds)
+#endif
+
+void ETMCanMasterEventLogInitialize(unsigned int first_page, unsigned int pages);
+/*
+  Stores the event log in the EEPROM pages first_page -> first_page + pages - 1.
+  This is called once at startup, after the EEPROM has been configured and after ETMCanMasterInitialize().
+  The newest page is found with a binary search on the sequence numbers and the newest events are loaded back into
+  event_log.  Numbering continues from the newest stored event.
+  The loaded events are unread for every reader except ETM_CAN_MASTER_EVENT_LOG_READER_EEPROM.
+  If this is not called the event log is only kept in RAM.
+*/
+
 /* 
    The ethernet control board keeps a record of standard data from all the slave boards
    This includes status, low level errors, configuration, and debug information
@@ -451,6 +871,7 @@ extern ETMCanSyncMessage    etm_can_master_sync_message;
 #define _SYNC_CONTROL_PULSE_SYNC_DISABLE_XRAY etm_can_master_sync_message.sync_0_control_word.sync_3_pulse_sync_disable_xray
 #define _SYNC_CONTROL_COOLING_FAULT           etm_can_master_sync_message.sync_0_control_word.sync_4_cooling_fault
 #define _SYNC_CONTROL_CLEAR_DEBUG_DATA        etm_can_master_sync_message.sync_0_control_word.sync_F_clear_debug_data
+#define _SYNC_CONTROL_DEBUG_BOARDS_SELECTED   etm_can_master_sync_message.sync_0_control_word.sync_E_debug_boards_selected
 
 #define _SYNC_CONTROL_PULSE_SYNC_WARMUP_LED   etm_can_master_sync_message.sync_0_control_word.sync_A_pulse_sync_warmup_led_on
 #define _SYNC_CONTROL_PULSE_SYNC_STANDBY_LED  etm_can_master_sync_message.sync_0_control_word.sync_B_pulse_sync_standby_led_on
@@ -29,7 +29,7 @@ void ETMCanSlaveExecuteCMD(ETMCanMessage* message_ptr);
    This is the generic subroutine to handle commands.
    It will check that the message is valid and then call
    ETMCanSlaveExecuteCMDCommon (if it is a generic message that applies to all boards)
-   ETMCanSlaveExecuteCMDBoardSpecific (if it is a command processed only by this board)  -- THIS IS LOCATED in file XXXXX
+   ETMCanSlaveExecuteCMDRegistered (if it is a command processed only by this board)
 
 */
 
@@ -42,12 +42,19 @@ void ETMCanSlaveExecuteCMDCommon(ETMCanMessage* message_ptr);
 */
 
 
-void ETMCanSlaveExecuteCMDBoardSpecific(ETMCanMessage* message_ptr);
+void ETMCanSlaveExecuteCMDRegistered(ETMCanMessage* message_ptr);
 /*
   This is a set value helper function
   If the index indicates a board specific command, this function will be called
-  This function is custom for each board.  
-  The source for this function must be included in the project directory of each board.
+  It executes the command from the table registered with ETMCanSlaveRegisterCommands()
+*/
+
+void ETMCanSlaveExecuteCMDBoardSpecific(ETMCanMessage* message_ptr);
+/*
+  This is a set value helper function
+  If the index indicates a board specific command and the board has not registered a command table, this function will
+  be called.  Boards that do not register a table provide it in their project directory, the library version counts
+  every command as an invalid index.
 */
 
 
@@ -68,17 +75,38 @@ void ETMCanSlaveReturnCalibrationPair(ETMCanMessage* message_ptr);
   It reads from the EEPROM and returns the results to the ECB
 */
 
+void ETMCanSlaveCalibrationBlockWrite(ETMCanMessage* message_ptr);
+/*
+  This stores one frame of a calibration block in the page buffer.
+  Once every frame of the page has been received the CRC is checked, the page is written to EEPROM with one
+  ETMEEPromWritePage() and the result is returned to the ECB.
+*/
+
+void ETMCanSlaveCalibrationBlockRead(ETMCanMessage* message_ptr);
+/*
+  This reads one calibration page from EEPROM and returns it to the ECB as a calibration block
+*/
+
 void ETMCanSlaveTimedTransmit(void);
 /*
   This uses TMR4 to schedule transmissions from the Slave to the Master
   TMR4 is set to expire at 100ms Interval
-  Every 100ms a status message is set and 1 (of the 16) data log messages is sent
+  Every 100ms the logging registers that are due are sent (see ETMCanSlaveSendScheduledLogs)
+  A status message is sent if the warning or not logged bits have changed, otherwise once every
+  ETM_CAN_SLAVE_STATUS_HEARTBEAT periods
 */
 
-void ETMCanSlaveSendStatus(void);
+void ETMCanSlaveSendScheduledLogs(void);
 /*
   This is a ETMCanSlaveTimedTransmit helper function.
-  This function sends the status from the slave board to the master
+  It sends every register in etm_can_slave_log_schedule that is due this 100ms period
+*/
+
+unsigned int ETMCanSlaveSendStatus(void);
+/*
+  This is a ETMCanSlaveTimedTransmit helper function.
+  This function sends the status from the slave board to the master and remembers what was sent
+  Returns 0 (and nothing is remembered or cleared) if the status queue is full, the status is sent again on the next call
 */
 
 
@@ -95,9 +123,11 @@ void ETMCanSlaveCheckForTimeOut(void);
   TMR5 is cleared every time a sync message is recieved from the ECB
 */
 
-void ETMCanSlaveSendUpdateIfNewNotReady(void);
+void ETMCanSlaveSendUpdateIfChanged(void);
 /*
-  This is used to immediately send a status message to the ECB when the _CONTROL_NOT_READY bit is first set 
+  This is used to immediately send a status message to the ECB when a control or fault bit changes or a notice bit is set
+  Changes are held off until ETM_CAN_SLAVE_STATUS_HOLDOFF_MS after the last status message, so a bit that is toggling
+  can not flood the bus.  The status that is current when the hold off expires is sent.
 */
 
 void ETMCanSlaveDoSync(ETMCanMessage* message_ptr);
@@ -106,6 +136,11 @@ void ETMCanSlaveDoSync(ETMCanMessage* message_ptr);
   This process the sync message from the ECB and loads it into RAM
 */
 
+unsigned int ETMCanSlaveT4Flag(unsigned int clear);
+/*
+  This reads (and clears) _T4IF for the CAN latency timing, see ETMCanTimerFlag
+*/
+
 void ETMCanSlaveClearDebug(void);
 /*
   This zeros all the debug data.
@@ -128,15 +163,72 @@ ETMCanBoardData           slave_board_data;            // This contains informat
 ETMCanBoardDebuggingData  etm_can_slave_debug_data;    // This information is only mirrored on ECB if this module is selected on the GUI
 ETMCanSyncMessage         etm_can_slave_sync_message;  // This is the most recent sync message recieved from the ECB
 
-ETMCanMessageBuffer etm_can_slave_rx_message_buffer;
-ETMCanMessageBuffer etm_can_slave_tx_message_buffer;
+// The depth of each buffer must be a power of 2.  These can be overridden from the project preprocessor macros.
+#ifndef ETM_CAN_SLAVE_RX_MESSAGE_BUFFER_DEPTH
+#define ETM_CAN_SLAVE_RX_MESSAGE_BUFFER_DEPTH   16
+#endif
+
+#ifndef ETM_CAN_SLAVE_TX_MESSAGE_BUFFER_DEPTH
+#define ETM_CAN_SLAVE_TX_MESSAGE_BUFFER_DEPTH   16
+#endif
+
+#ifndef ETM_CAN_SLAVE_TX_LOG_BUFFER_DEPTH
+#define ETM_CAN_SLAVE_TX_LOG_BUFFER_DEPTH       16
+#endif
+
+#ifndef ETM_CAN_SLAVE_TX_STATUS_BUFFER_DEPTH
+#define ETM_CAN_SLAVE_TX_STATUS_BUFFER_DEPTH    4
+#endif
+
+#ifndef ETM_CAN_SLAVE_TX_PULSE_LEVEL_BUFFER_DEPTH
+#define ETM_CAN_SLAVE_TX_PULSE_LEVEL_BUFFER_DEPTH   4
+#endif
+
+ETM_CAN_MESSAGE_BUFFER(etm_can_slave_rx_message_buffer, ETM_CAN_SLAVE_RX_MESSAGE_BUFFER_DEPTH);
+ETM_CAN_MESSAGE_BUFFER(etm_can_slave_tx_message_buffer, ETM_CAN_SLAVE_TX_MESSAGE_BUFFER_DEPTH);      // Command returns
+ETM_CAN_MESSAGE_BUFFER(etm_can_slave_tx_log_buffer, ETM_CAN_SLAVE_TX_LOG_BUFFER_DEPTH);
+ETM_CAN_MESSAGE_BUFFER(etm_can_slave_tx_status_buffer, ETM_CAN_SLAVE_TX_STATUS_BUFFER_DEPTH);
+ETM_CAN_MESSAGE_BUFFER(etm_can_slave_tx_pulse_level_buffer, ETM_CAN_SLAVE_TX_PULSE_LEVEL_BUFFER_DEPTH);
 
-unsigned int slave_data_log_index;      
-unsigned int slave_data_log_sub_index;
-// These two variables are used to rotate through all the possible logging messages
-// One logging message is sent out once every 100ms
+// All messages are sent through the transmit scheduler
+ETMCanTXScheduler etm_can_slave_tx_scheduler;
+ETMCanTiming      etm_can_slave_timing;         // CAN latency timing, sent to the ECB as the CAN_TIMING registers
 
-unsigned int previous_ready_status;  // DPARKER - Need better name
+unsigned int slave_flash_led_count;     // 100ms periods since the flashing LED was toggled
+
+#ifndef ETM_CAN_SLAVE_STATUS_HEARTBEAT
+#define ETM_CAN_SLAVE_STATUS_HEARTBEAT          2     // 100mS periods between status messages if nothing changes
+#endif
+// The heartbeat must be shorter than the time the ECB allows between status messages (ETM_CAN_MASTER_BOARD_DEADLINE)
+
+#ifndef ETM_CAN_SLAVE_STATUS_HOLDOFF_MS
+#define ETM_CAN_SLAVE_STATUS_HOLDOFF_MS         2     // mS after a status message before a control or fault change is sent
+#endif
+// The hold off must be shorter than one TMR4 period (100mS)
+typedef char etm_can_slave_status_holdoff_must_be_less_than_100ms[(ETM_CAN_SLAVE_STATUS_HOLDOFF_MS < 100) ? 1 : -1];
+
+typedef struct {
+  unsigned int control;                  // The status words in the last status message
+  unsigned int fault;
+  unsigned int warning;
+  unsigned int not_logged;
+  unsigned int heartbeat_count;          // 100mS periods since the last status message
+  unsigned int time;                     // ETMCanTimingNow() when the last status message was queued
+  unsigned int holdoff;                  // ETM_CAN_SLAVE_STATUS_HOLDOFF_MS in TMR4 counts
+} TYPE_STATUS_SENT;
+
+TYPE_STATUS_SENT status_sent;
+
+typedef struct {
+  unsigned int page;                                     // Calibration page (0 -> F) that is being received
+  unsigned int received_frames;                          // One bit per frame
+  unsigned int block[ETM_CAN_CALIBRATION_BLOCK_WORDS];   // Page data, sequence, CRC
+} TYPE_CALIBRATION_BLOCK;
+
+TYPE_CALIBRATION_BLOCK calibration_block;
+
+const ETMCanSlaveCommand* command_table;                 // Registered board specific commands, 0 if none
+unsigned char command_slot[ETM_CAN_SLAVE_COMMAND_INDEXES];  // Position in command_table + 1 for each index 0x200 ->, 0 if not registered
 
 typedef struct {
   unsigned int reset_count;
@@ -176,6 +268,100 @@ TYPE_CAN_PARAMETERS can_params;
 
 
 #define _SYNC_CONTROL_WORD                    *(unsigned int*)&etm_can_slave_sync_message.sync_0_control_word
+#define _SYNC_CONTROL_HIGH_SPEED_LOGGING      etm_can_slave_sync_message.sync_0_control_word.sync_1_high_speed_logging_enabled
+#define _SYNC_CONTROL_DEBUG_BOARDS_SELECTED   etm_can_slave_sync_message.sync_0_control_word.sync_E_debug_boards_selected
+
+
+// ---------------------- Logging Schedule ------------------------ //
+/*
+  Every logging register that the slave sends is listed in etm_can_slave_log_schedule with its own period (in 100ms
+  TMR4 periods).  To change how often a register is sent, change its period, no code changes are needed.
+   - burst_period is used instead of period while _SYNC_CONTROL_HIGH_SPEED_LOGGING is set, 0 to keep period
+   - LOG_SCHEDULE_DEBUG registers are only sent while this board is set in sync_2_debug_boards (always if the ECB does
+     not set _SYNC_CONTROL_DEBUG_BOARDS_SELECTED)
+   - LOG_SCHEDULE_IF_CHANGED registers are skipped if the data has not changed since it was last sent.  They are sent
+     anyway after ETM_CAN_SLAVE_LOG_REFRESH skipped periods and when communication with the ECB is restored.
+   - LOG_SCHEDULE_WORD3_FIRST registers send data[0] in word3 (the order the ECB expects for those registers), the
+     others send data[0] in word0
+  The registers are staggered by their position in the table so that registers with the same period are not all
+  sent in the same 100ms period.
+*/
+
+#ifndef ETM_CAN_SLAVE_LOG_PERIOD_BOARD
+#define ETM_CAN_SLAVE_LOG_PERIOD_BOARD          10    // BOARD_SPECIFIC_x - 1S
+#endif
+
+#ifndef ETM_CAN_SLAVE_LOG_PERIOD_BURST
+#define ETM_CAN_SLAVE_LOG_PERIOD_BURST          2     // BOARD_SPECIFIC_x while high speed logging - 200mS
+#endif
+
+#ifndef ETM_CAN_SLAVE_LOG_PERIOD_DEBUG
+#define ETM_CAN_SLAVE_LOG_PERIOD_DEBUG          20    // DEFAULT_DEBUG_x - 2S
+#endif
+
+#ifndef ETM_CAN_SLAVE_LOG_PERIOD_ERROR
+#define ETM_CAN_SLAVE_LOG_PERIOD_ERROR          80    // DEFAULT_CAN_ERROR_x, DEFAULT_SYSTEM_ERROR_x, DEFAULT_CAN_TIMING_x - 8S
+#endif
+
+#ifndef ETM_CAN_SLAVE_LOG_PERIOD_CONFIG
+#define ETM_CAN_SLAVE_LOG_PERIOD_CONFIG         10    // DEFAULT_CONFIG_x are checked for changes every 1S
+#endif
+
+#ifndef ETM_CAN_SLAVE_LOG_REFRESH
+#define ETM_CAN_SLAVE_LOG_REFRESH               60    // An unchanged LOG_SCHEDULE_IF_CHANGED register is sent after 60 skipped periods
+#endif
+
+#define LOG_SCHEDULE_WORD3_FIRST                0x0001
+#define LOG_SCHEDULE_DEBUG                      0x0002
+#define LOG_SCHEDULE_IF_CHANGED                 0x0004
+
+typedef struct {
+  unsigned int   log_register;          // ETM_CAN_DATA_LOG_REGISTER_xxx
+  unsigned int*  data;                  // The 4 words that are sent
+  unsigned int   period;                // 100mS periods between transmissions
+  unsigned int   burst_period;          // Period while _SYNC_CONTROL_HIGH_SPEED_LOGGING is set, 0 to use period
+  unsigned int   flags;                 // LOG_SCHEDULE_xxx
+} ETMCanSlaveLogSchedule;
+
+#define ETM_CAN_SLAVE_LOG_SCHEDULE_SIZE         26
+
+static const ETMCanSlaveLogSchedule etm_can_slave_log_schedule[ETM_CAN_SLAVE_LOG_SCHEDULE_SIZE] = {
+  {ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_0,       &slave_board_data.log_data[0],                    ETM_CAN_SLAVE_LOG_PERIOD_BOARD,  ETM_CAN_SLAVE_LOG_PERIOD_BURST, 0},
+  {ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_1,       &slave_board_data.log_data[4],                    ETM_CAN_SLAVE_LOG_PERIOD_BOARD,  ETM_CAN_SLAVE_LOG_PERIOD_BURST, 0},
+  {ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_2,       &slave_board_data.log_data[8],                    ETM_CAN_SLAVE_LOG_PERIOD_BOARD,  ETM_CAN_SLAVE_LOG_PERIOD_BURST, 0},
+  {ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_3,       &slave_board_data.log_data[12],                   ETM_CAN_SLAVE_LOG_PERIOD_BOARD,  ETM_CAN_SLAVE_LOG_PERIOD_BURST, 0},
+  {ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_4,       &slave_board_data.log_data[16],                   ETM_CAN_SLAVE_LOG_PERIOD_BOARD,  ETM_CAN_SLAVE_LOG_PERIOD_BURST, 0},
+  {ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_5,       &slave_board_data.log_data[20],                   ETM_CAN_SLAVE_LOG_PERIOD_BOARD,  ETM_CAN_SLAVE_LOG_PERIOD_BURST, 0},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CONFIG_0,       &slave_board_data.config_data[0],                 ETM_CAN_SLAVE_LOG_PERIOD_CONFIG, 0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_IF_CHANGED},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CONFIG_1,       &slave_board_data.config_data[4],                 ETM_CAN_SLAVE_LOG_PERIOD_CONFIG, 0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_IF_CHANGED},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_DEBUG_0,        &etm_can_slave_debug_data.debug_reg[0],           ETM_CAN_SLAVE_LOG_PERIOD_DEBUG,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_DEBUG_1,        &etm_can_slave_debug_data.debug_reg[4],           ETM_CAN_SLAVE_LOG_PERIOD_DEBUG,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_DEBUG_2,        &etm_can_slave_debug_data.debug_reg[8],           ETM_CAN_SLAVE_LOG_PERIOD_DEBUG,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_DEBUG_3,        &etm_can_slave_debug_data.debug_reg[12],          ETM_CAN_SLAVE_LOG_PERIOD_DEBUG,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_0,    &etm_can_slave_debug_data.can_tx_0,               ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_1,    &etm_can_slave_debug_data.can_rx_0_filt_0,        ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_2,    &etm_can_slave_debug_data.can_unknown_msg_id,     ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_3,    &etm_can_slave_debug_data.can_tx_buf_overflow,    ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_SYSTEM_ERROR_0, &etm_can_slave_debug_data.reset_count,            ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_SYSTEM_ERROR_1, &etm_can_slave_debug_data.i2c_bus_error_count,    ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_0,   &etm_can_slave_timing.data.tx_histogram[0][0],    ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_1,   &etm_can_slave_timing.data.tx_histogram[1][0],    ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_2,   &etm_can_slave_timing.data.tx_histogram[2][0],    ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_3,   &etm_can_slave_timing.data.tx_histogram[3][0],    ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_4,   &etm_can_slave_timing.data.tx_max[0],             ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_5,   &etm_can_slave_timing.data.tx_buffer_max[0],      ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_6,   &etm_can_slave_timing.data.rx_histogram[0],       ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+  {ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_TIMING_7,   &etm_can_slave_timing.data.rx_max,                ETM_CAN_SLAVE_LOG_PERIOD_ERROR,  0, LOG_SCHEDULE_WORD3_FIRST | LOG_SCHEDULE_DEBUG},
+};
+
+typedef struct {
+  unsigned int countdown;               // 100mS periods until the register is due
+  unsigned int crc;                     // LOG_SCHEDULE_IF_CHANGED - ETMCRC16 of the data that was last sent
+  unsigned int skipped;                 // LOG_SCHEDULE_IF_CHANGED - periods skipped since the data was last sent
+} TYPE_LOG_SCHEDULE_STATE;
+
+TYPE_LOG_SCHEDULE_STATE log_schedule_state[ETM_CAN_SLAVE_LOG_SCHEDULE_SIZE];
+unsigned int log_schedule_com_loss;     // etm_can_slave_com_loss from the last period, to see communication restored
 
 
 // ---------- Pointers to CAN stucutres so that we can use CAN1 or CAN2
@@ -193,6 +379,9 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
 			   unsigned long flash_led, unsigned long not_ready_led) {
 
   unsigned long timer_period_value;
+  ETMCanBitTiming bit_timing;
+  unsigned int bit_timing_error;
+  unsigned int n;
 
   etm_can_slave_debug_data.reserved_1          = P1395_CAN_SLAVE_VERSION;
 
@@ -214,11 +403,21 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
   
   _SYNC_CONTROL_WORD = 0;
   etm_can_slave_sync_message.sync_1_ecb_state_for_fault_logic = 0;
-  etm_can_slave_sync_message.sync_2 = 0;
+  etm_can_slave_sync_message.sync_2_debug_boards = 0;
   etm_can_slave_sync_message.sync_3 = 0;
   
   etm_can_slave_com_loss = 0;
 
+  // The first status message goes out with the first TMR4 period
+  status_sent.heartbeat_count = ETM_CAN_SLAVE_STATUS_HEARTBEAT;
+
+  // Stagger the logging registers, every LOG_SCHEDULE_IF_CHANGED register is sent the first time it is due
+  for (n = 0; n < ETM_CAN_SLAVE_LOG_SCHEDULE_SIZE; n++) {
+    log_schedule_state[n].countdown = 1 + (n % etm_can_slave_log_schedule[n].period);
+    log_schedule_state[n].skipped = ETM_CAN_SLAVE_LOG_REFRESH;
+  }
+  log_schedule_com_loss = 0;
+
   etm_can_slave_debug_data.reset_count = etm_can_persistent_data.reset_count;
   etm_can_slave_debug_data.can_timeout = etm_can_persistent_data.can_timeout_count;
 
@@ -226,6 +425,14 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
   
   ETMCanBufferInitialize(&etm_can_slave_rx_message_buffer);
   ETMCanBufferInitialize(&etm_can_slave_tx_message_buffer);
+  ETMCanBufferInitialize(&etm_can_slave_tx_log_buffer);
+  ETMCanBufferInitialize(&etm_can_slave_tx_status_buffer);
+  ETMCanBufferInitialize(&etm_can_slave_tx_pulse_level_buffer);
+
+  etm_can_slave_tx_scheduler.queue[ETM_CAN_TX_CLASS_PULSE_LEVEL] = &etm_can_slave_tx_pulse_level_buffer;
+  etm_can_slave_tx_scheduler.queue[ETM_CAN_TX_CLASS_STATUS_SYNC] = &etm_can_slave_tx_status_buffer;
+  etm_can_slave_tx_scheduler.queue[ETM_CAN_TX_CLASS_CMD]         = &etm_can_slave_tx_message_buffer;
+  etm_can_slave_tx_scheduler.queue[ETM_CAN_TX_CLASS_LOG]         = &etm_can_slave_tx_log_buffer;
   
   // Configure T4
   timer_period_value = fcy;
@@ -240,6 +447,17 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
   _T4IF = 0;
   _T4IE = 0;
   T4CONbits.TON = 1;
+
+  // TMR4 is also the time base for the CAN latency timing
+  ETMCanTimingInitialize(&etm_can_slave_timing, &TMR4, &ETMCanSlaveT4Flag, PR4, fcy);
+
+  // The status hold off is timed with TMR4
+  timer_period_value = fcy;
+  timer_period_value >>= 8;
+  timer_period_value *= ETM_CAN_SLAVE_STATUS_HOLDOFF_MS;
+  timer_period_value /= 1000;
+  status_sent.holdoff = timer_period_value;
+  status_sent.time = ETMCanTimingNow(&etm_can_slave_timing);
   
   // Configure T5
   timer_period_value = fcy;
@@ -267,6 +485,8 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
     CXTX1CON_ptr = &C1TX1CON;
     CXTX2CON_ptr = &C1TX2CON;
 
+    ETMCanTXSchedulerInitialize(&etm_can_slave_tx_scheduler, CXTX0CON_ptr, CXTX1CON_ptr, CXTX2CON_ptr, &etm_can_slave_debug_data.can_tx_0, &etm_can_slave_timing);
+
     _C1IE = 0;
     _C1IF = 0;
     _C1IP = can_interrupt_priority;
@@ -276,6 +496,8 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
     C1INTEbits.RX0IE = 1; // Enable RXB0 interrupt
     C1INTEbits.RX1IE = 1; // Enable RXB1 interrupt
     C1INTEbits.TX0IE = 1; // Enable TXB0 interrupt
+    C1INTEbits.TX1IE = 1; // Enable TXB1 interrupt
+    C1INTEbits.TX2IE = 1; // Enable TXB2 interrupt
     C1INTEbits.ERRIE = 1; // Enable Error interrupt
   
     // ---------------- Set up CAN Control Registers ---------------- //
@@ -284,18 +506,14 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
     C1CTRL = CXCTRL_CONFIG_MODE_VALUE;
     while(C1CTRLbits.OPMODE != 4);
     
-    if (fcy == 25000000) {
-      C1CFG1 = CXCFG1_25MHZ_FCY_VALUE;    
-    } else if (fcy == 20000000) {
-      C1CFG1 = CXCFG1_20MHZ_FCY_VALUE;    
-    } else if (fcy == 10000000) {
-      C1CFG1 = CXCFG1_10MHZ_FCY_VALUE;    
-    } else {
-      // If you got here we can't configure the can module
-      // DPARKER WHAT TO DO HERE
+    bit_timing_error = ETMCanBitTimingSolve(&bit_timing, fcy, ETM_CAN_BIT_RATE, ETM_CAN_SAMPLE_POINT);
+    if (bit_timing_error) {
+      // If you got here we can't configure the can module for ETM_CAN_BIT_RATE
+      // The module is left in configuration mode so that it can not disturb the rest of the network
+      etm_can_slave_debug_data.self_test_results.st_can_bit_timing = 1;
     }
-    
-    C1CFG2 = CXCFG2_VALUE;
+    C1CFG1 = bit_timing.cfg1;
+    C1CFG2 = bit_timing.cfg2;
     
     
     // Load Mask registers for RX0 and RX1
@@ -305,7 +523,7 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
     // Load Filter registers
     C1RXF0SID = ETM_CAN_SLAVE_MSG_FILTER_RF0;
     C1RXF1SID = ETM_CAN_SLAVE_MSG_FILTER_RF1;
-    C1RXF2SID = (ETM_CAN_SLAVE_MSG_FILTER_RF2 | (can_params.address << 2));
+    C1RXF2SID = (ETM_CAN_SLAVE_MSG_FILTER_RF2 | ETM_CAN_ID_TO_RX_SID(can_params.address));
     //C1RXF3SID = ETM_CAN_MSG_FILTER_OFF;
     //C1RXF4SID = ETM_CAN_MSG_FILTER_OFF;
     //C1RXF5SID = ETM_CAN_MSG_FILTER_OFF;
@@ -325,13 +543,15 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
     C1RX1CON = CXRXXCON_VALUE;
     
 
-    // Switch to normal operation
-    C1CTRL = CXCTRL_OPERATE_MODE_VALUE;
-    while(C1CTRLbits.OPMODE != 0);
-    
-    // Enable Can interrupt
-    _C1IE = 1;
     _C2IE = 0;
+    if (!bit_timing_error) {
+      // Switch to normal operation
+      C1CTRL = CXCTRL_OPERATE_MODE_VALUE;
+      while(C1CTRLbits.OPMODE != 0);
+      
+      // Enable Can interrupt
+      _C1IE = 1;
+    }
     
   } else {
     // Use CAN2
@@ -343,6 +563,8 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
     CXTX1CON_ptr = &C2TX1CON;
     CXTX2CON_ptr = &C2TX2CON;
 
+    ETMCanTXSchedulerInitialize(&etm_can_slave_tx_scheduler, CXTX0CON_ptr, CXTX1CON_ptr, CXTX2CON_ptr, &etm_can_slave_debug_data.can_tx_0, &etm_can_slave_timing);
+
     _C2IE = 0;
     _C2IF = 0;
     _C2IP = can_interrupt_priority;
@@ -352,6 +574,8 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
     C2INTEbits.RX0IE = 1; // Enable RXB0 interrupt
     C2INTEbits.RX1IE = 1; // Enable RXB1 interrupt
     C2INTEbits.TX0IE = 1; // Enable TXB0 interrupt
+    C2INTEbits.TX1IE = 1; // Enable TXB1 interrupt
+    C2INTEbits.TX2IE = 1; // Enable TXB2 interrupt
     C2INTEbits.ERRIE = 1; // Enable Error interrupt
   
     // ---------------- Set up CAN Control Registers ---------------- //
@@ -360,18 +584,14 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
     C2CTRL = CXCTRL_CONFIG_MODE_VALUE;
     while(C2CTRLbits.OPMODE != 4);
     
-    if (fcy == 25000000) {
-      C2CFG1 = CXCFG1_25MHZ_FCY_VALUE;    
-    } else if (fcy == 20000000) {
-      C2CFG1 = CXCFG1_20MHZ_FCY_VALUE;    
-    } else if (fcy == 10000000) {
-      C2CFG1 = CXCFG1_10MHZ_FCY_VALUE;    
-    } else {
-      // If you got here we can't configure the can module
-      // DPARKER WHAT TO DO HERE
+    bit_timing_error = ETMCanBitTimingSolve(&bit_timing, fcy, ETM_CAN_BIT_RATE, ETM_CAN_SAMPLE_POINT);
+    if (bit_timing_error) {
+      // If you got here we can't configure the can module for ETM_CAN_BIT_RATE
+      // The module is left in configuration mode so that it can not disturb the rest of the network
+      etm_can_slave_debug_data.self_test_results.st_can_bit_timing = 1;
     }
-    
-    C2CFG2 = CXCFG2_VALUE;
+    C2CFG1 = bit_timing.cfg1;
+    C2CFG2 = bit_timing.cfg2;
     
     
     // Load Mask registers for RX0 and RX1
@@ -381,7 +601,7 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
     // Load Filter registers
     C2RXF0SID = ETM_CAN_SLAVE_MSG_FILTER_RF0;
     C2RXF1SID = ETM_CAN_SLAVE_MSG_FILTER_RF1;
-    C2RXF2SID = (ETM_CAN_SLAVE_MSG_FILTER_RF2 | (can_params.address << 2));
+    C2RXF2SID = (ETM_CAN_SLAVE_MSG_FILTER_RF2 | ETM_CAN_ID_TO_RX_SID(can_params.address));
     //C2RXF3SID = ETM_CAN_MSG_FILTER_OFF;
     //C2RXF4SID = ETM_CAN_MSG_FILTER_OFF;
     //C2RXF5SID = ETM_CAN_MSG_FILTER_OFF;
@@ -401,13 +621,15 @@ void ETMCanSlaveInitialize(unsigned int requested_can_port, unsigned long fcy, u
     C2RX1CON = CXRXXCON_VALUE;
     
 
-    // Switch to normal operation
-    C2CTRL = CXCTRL_OPERATE_MODE_VALUE;
-    while(C2CTRLbits.OPMODE != 0);
-    
-    // Enable Can interrupt
-    _C2IE = 1;
     _C1IE = 0;
+    if (!bit_timing_error) {
+      // Switch to normal operation
+      C2CTRL = CXCTRL_OPERATE_MODE_VALUE;
+      while(C2CTRLbits.OPMODE != 0);
+      
+      // Enable Can interrupt
+      _C2IE = 1;
+    }
   }
   
   if (!ETMAnalogCheckEEPromInitialized()) {
@@ -438,7 +660,7 @@ void ETMCanSlaveDoCan(void) {
   ETMCanSlaveProcessMessage();
   ETMCanSlaveTimedTransmit();
   ETMCanSlaveCheckForTimeOut();
-  ETMCanSlaveSendUpdateIfNewNotReady();
+  ETMCanSlaveSendUpdateIfChanged();
   if (etm_can_slave_sync_message.sync_0_control_word.sync_F_clear_debug_data) {
     ETMCanSlaveClearDebug();
   }
@@ -463,7 +685,7 @@ void ETMCanSlaveDoCan(void) {
 
 void ETMCanSlavePulseSyncSendNextPulseLevel(unsigned int next_pulse_level, unsigned int next_pulse_count, unsigned int rep_rate_deci_herz) {
   ETMCanMessage message;
-  message.identifier = ETM_CAN_MSG_LVL_TX | (can_params.address << 2); 
+  message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_LVL, can_params.address);
   message.word0      = next_pulse_count;
   if (next_pulse_level) {
     message.word1    = 0xFFFF;
@@ -472,20 +694,30 @@ void ETMCanSlavePulseSyncSendNextPulseLevel(unsigned int next_pulse_level, unsig
   }
   message.word2 = rep_rate_deci_herz;
 
-  ETMCanTXMessage(&message, CXTX2CON_ptr);
-  etm_can_slave_debug_data.can_tx_2++;
+  ETMCanTXSchedulerAddMessage(&etm_can_slave_tx_scheduler, ETM_CAN_TX_CLASS_PULSE_LEVEL, &message);
+  MacroETMCanCheckTXBuffer();
 }
 
 
 void ETMCanSlaveProcessMessage(void) {
-  ETMCanMessage next_message;
-  while (ETMCanBufferNotEmpty(&etm_can_slave_rx_message_buffer)) {
-    ETMCanReadMessageFromBuffer(&etm_can_slave_rx_message_buffer, &next_message);
-    ETMCanSlaveExecuteCMD(&next_message);      
+  ETMCanMessage* next_message;
+  unsigned int messages;
+  unsigned int n;
+  while ((messages = ETMCanBufferPeek(&etm_can_slave_rx_message_buffer, &next_message))) {
+    for (n = messages; n; n--, next_message++) {
+      ETMCanTimingRecordRX(&etm_can_slave_timing, &etm_can_slave_rx_message_buffer, next_message);
+      ETMCanSlaveExecuteCMD(next_message);      
+    }
+    ETMCanBufferCommit(&etm_can_slave_rx_message_buffer, messages);
   }
   
-  etm_can_slave_debug_data.can_tx_buf_overflow = etm_can_slave_tx_message_buffer.message_overwrite_count;
+  etm_can_slave_debug_data.can_tx_buf_overflow = (etm_can_slave_tx_message_buffer.message_overwrite_count +
+						  etm_can_slave_tx_log_buffer.message_overwrite_count +
+						  etm_can_slave_tx_status_buffer.message_overwrite_count +
+						  etm_can_slave_tx_pulse_level_buffer.message_overwrite_count);
   etm_can_slave_debug_data.can_rx_buf_overflow = etm_can_slave_rx_message_buffer.message_overwrite_count;
+  etm_can_slave_debug_data.can_buf_high_water = ((etm_can_slave_tx_log_buffer.message_high_water << 8) +
+						 etm_can_slave_rx_message_buffer.message_high_water);
 }
 
 
@@ -495,8 +727,10 @@ void ETMCanSlaveExecuteCMD(ETMCanMessage* message_ptr) {
     CMD Index allocations
     0xZ000 -> 0xZ0FF  -> Common Slave Commands and Set Values    - ETMCanSlaveExecuteCMDCommon()
     0xZ100 -> 0xZ1FF  -> Calibration Write Registers             - ETMCanSlaveSetCalibrationPair()
-    0xZ200 -> 0xZ3FF  -> Slave Specific Commands and Set Values  - ETMCanSlaveExecuteCMD()
+    0xZ200 -> 0xZ3FF  -> Slave Specific Commands and Set Values  - ETMCanSlaveExecuteCMDRegistered()
     0xZ900 -> 0xZ9FF  -> Calibration Read Registers              - ETMCanSlaveReturnCalibrationPair()
+    0xZA00 -> 0xZAFF  -> Calibration Block Write                 - ETMCanSlaveCalibrationBlockWrite()
+    0xZB00 -> 0xZBFF  -> Calibration Block Read                  - ETMCanSlaveCalibrationBlockRead()
   */
   unsigned int index_word;
   index_word = message_ptr->word3;
@@ -517,10 +751,14 @@ void ETMCanSlaveExecuteCMD(ETMCanMessage* message_ptr) {
     ETMCanSlaveSetCalibrationPair(message_ptr);
   } else if (index_word <= 0x3FF) {
     // It is a board specific command
-    ETMCanSlaveExecuteCMDBoardSpecific(message_ptr);
+    ETMCanSlaveExecuteCMDRegistered(message_ptr);
   } else if ((index_word >= 0x900) && (index_word <= 0x9FF)) {
     // It is Calibration Pair Request
     ETMCanSlaveReturnCalibrationPair(message_ptr);
+  } else if ((index_word & 0xF00) == ETM_CAN_REGISTER_CALIBRATION_BLOCK_WRITE) {
+    ETMCanSlaveCalibrationBlockWrite(message_ptr);
+  } else if ((index_word & 0xF00) == ETM_CAN_REGISTER_CALIBRATION_BLOCK_READ) {
+    ETMCanSlaveCalibrationBlockRead(message_ptr);
   } else {
     // It was not a command ID
     etm_can_slave_debug_data.can_invalid_index++;
@@ -552,6 +790,74 @@ void ETMCanSlaveExecuteCMDCommon(ETMCanMessage* message_ptr) {
 }
 
 
+unsigned int ETMCanSlaveRegisterCommands(const ETMCanSlaveCommand* table, unsigned int commands) {
+  unsigned int n;
+  unsigned int slot;
+  unsigned int error;
+
+  error = 0;
+  command_table = 0;
+  for (n = 0; n < ETM_CAN_SLAVE_COMMAND_INDEXES; n++) {
+    command_slot[n] = 0;
+  }
+  for (n = 0; n < commands; n++) {
+    slot = (table[n].index & 0x0FFF) - 0x0200;
+    if ((slot >= ETM_CAN_SLAVE_COMMAND_INDEXES) || command_slot[slot] || (n >= 0xFF) || (table[n].words > 3)) {
+      error = 1;
+    } else {
+      command_slot[slot] = n + 1;
+    }
+  }
+  command_table = table;
+  return error;
+}
+
+
+void ETMCanSlaveExecuteCMDRegistered(ETMCanMessage* message_ptr) {
+  const ETMCanSlaveCommand* command_ptr;
+  unsigned int* data_ptr;
+  unsigned int slot;
+  unsigned int n;
+
+  if (command_table == 0) {
+    // This board still decodes its own commands
+    ETMCanSlaveExecuteCMDBoardSpecific(message_ptr);
+    return;
+  }
+
+  slot = (message_ptr->word3 & 0x0FFF) - 0x0200;
+  if ((slot >= ETM_CAN_SLAVE_COMMAND_INDEXES) || (command_slot[slot] == 0)) {
+    etm_can_slave_debug_data.can_invalid_index++;
+    return;
+  }
+
+  command_ptr = &command_table[command_slot[slot] - 1];
+  data_ptr = &message_ptr->word0;
+  for (n = 0; n < command_ptr->words; n++) {
+    if ((data_ptr[n] < command_ptr->min) || (data_ptr[n] > command_ptr->max)) {
+      etm_can_slave_debug_data.can_invalid_index++;
+      return;
+    }
+  }
+  // The handler validates the command, a rejected command is not stored
+  if (command_ptr->handler && command_ptr->handler(message_ptr)) {
+    etm_can_slave_debug_data.can_invalid_index++;
+    return;
+  }
+  if (command_ptr->target) {
+    for (n = 0; n < command_ptr->words; n++) {
+      command_ptr->target[n] = data_ptr[n];
+    }
+  }
+}
+
+
+void __attribute__((weak)) ETMCanSlaveExecuteCMDBoardSpecific(ETMCanMessage* message_ptr) {
+  // Only used if the board has not registered a command table and does not provide its own version
+  etm_can_slave_debug_data.can_invalid_index++;
+}
+
+
 void ETMCanSlaveSetCalibrationPair(ETMCanMessage* message_ptr) {
   unsigned int eeprom_register;
 
@@ -570,15 +876,88 @@ void ETMCanSlaveReturnCalibrationPair(ETMCanMessage* message_ptr) {
   
   index_word -= 0x0800;
   // The request is valid, return the data stored in eeprom
-  return_msg.identifier = ETM_CAN_MSG_RTN_TX | (can_params.address << 2);
+  return_msg.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_RTN, can_params.address);
   return_msg.word3 = message_ptr->word3 - 0x0800;
   return_msg.word2 = 0;
   return_msg.word1 = ETMEEPromReadWord(index_word + 1);
   return_msg.word0 = ETMEEPromReadWord(index_word);
 
   // Send Message Back to ECB with data
-  ETMCanAddMessageToBuffer(&etm_can_slave_tx_message_buffer, &return_msg);
-  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanAddMessageToBuffer()
+  ETMCanTXSchedulerAddMessage(&etm_can_slave_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &return_msg);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
+}
+
+void ETMCanSlaveCalibrationBlockWrite(ETMCanMessage* message_ptr) {
+  ETMCanMessage return_msg;
+  unsigned int page;
+  unsigned int frame;
+  unsigned int* block_ptr;
+
+  page = (message_ptr->word3 >> 4) & 0x000F;
+  frame = message_ptr->word3 & 0x000F;
+  if (frame >= ETM_CAN_CALIBRATION_BLOCK_FRAMES) {
+    etm_can_slave_debug_data.can_invalid_index++;
+    return;
+  }
+
+  if (frame == 0) {
+    // Frame 0 starts a block, anything left from a block that was not completed is discarded
+    calibration_block.page = page;
+    calibration_block.received_frames = 0;
+  } else if (page != calibration_block.page) {
+    // The start of this block was lost, the ECB will send it again
+    return;
+  }
+  block_ptr = &calibration_block.block[frame * 3];
+  block_ptr[0] = message_ptr->word2;
+  block_ptr[1] = message_ptr->word1;
+  block_ptr[2] = message_ptr->word0;
+  calibration_block.received_frames |= (1 << frame);
+
+  if (calibration_block.received_frames != ETM_CAN_CALIBRATION_BLOCK_ALL_FRAMES) {
+    return;
+  }
+  calibration_block.received_frames = 0;
+
+  return_msg.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_RTN, can_params.address);
+  return_msg.word3 = (message_ptr->word3 & 0xFFF0) | ETM_CAN_CALIBRATION_BLOCK_ACK_FRAME;
+  return_msg.word2 = calibration_block.block[ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS];
+  return_msg.word0 = calibration_block.block[ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS + 1];
+  if (ETMCRC16(calibration_block.block, (ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS + 1) * sizeof(unsigned int)) == return_msg.word0) {
+    ETMEEPromWritePage(ETM_CAN_CALIBRATION_BLOCK_FIRST_PAGE + page, ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS, calibration_block.block);
+    return_msg.word1 = ETM_CAN_CALIBRATION_BLOCK_STATUS_OK;
+  } else {
+    // The ECB will send the page again
+    return_msg.word1 = ETM_CAN_CALIBRATION_BLOCK_STATUS_CRC_ERROR;
+  }
+
+  ETMCanTXSchedulerAddMessage(&etm_can_slave_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &return_msg);
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
+}
+
+void ETMCanSlaveCalibrationBlockRead(ETMCanMessage* message_ptr) {
+  ETMCanMessage return_msg;
+  unsigned int block[ETM_CAN_CALIBRATION_BLOCK_WORDS];
+  unsigned int frame;
+
+  if (ETMCanBufferRowsAvailable(&etm_can_slave_tx_message_buffer) < ETM_CAN_CALIBRATION_BLOCK_FRAMES) {
+    // There is no room for the whole block, the ECB will ask again
+    return;
+  }
+
+  ETMEEPromReadPage(ETM_CAN_CALIBRATION_BLOCK_FIRST_PAGE + ((message_ptr->word3 >> 4) & 0x000F), ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS, block);
+  block[ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS] = message_ptr->word2;
+  block[ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS + 1] = ETMCRC16(block, (ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS + 1) * sizeof(unsigned int));
+
+  return_msg.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_RTN, can_params.address);
+  for (frame = 0; frame < ETM_CAN_CALIBRATION_BLOCK_FRAMES; frame++) {
+    return_msg.word3 = (message_ptr->word3 & 0xFFF0) | frame;
+    return_msg.word2 = block[frame * 3];
+    return_msg.word1 = block[frame * 3 + 1];
+    return_msg.word0 = block[frame * 3 + 2];
+    ETMCanTXSchedulerAddMessage(&etm_can_slave_tx_scheduler, ETM_CAN_TX_CLASS_CMD, &return_msg);
+  }
+  MacroETMCanCheckTXBuffer();  // DPARKER - Figure out how to build this into ETMCanTXSchedulerAddMessage()
 }
 
 /*
@@ -603,9 +982,8 @@ void ETMCanSlaveLogBoardData(unsigned int data_register) {
 
 void ETMCanSlaveTimedTransmit(void) {
   // Sends the debug information up as log data  
-  if (_T4IF) {
-    // should be true once every 100mS
-    _T4IF = 0;
+  if (ETMCanTimingRollover(&etm_can_slave_timing)) {
+    // should be true once every 100mS (this clears _T4IF)
     
     // Set the Ready LED
     if (_CONTROL_NOT_READY) {
@@ -615,11 +993,9 @@ void ETMCanSlaveTimedTransmit(void) {
     }
 
     
-    slave_data_log_index++;
-    if (slave_data_log_index >= 10) {
-      slave_data_log_index = 0;
-      slave_data_log_sub_index++;
-      slave_data_log_sub_index &= 0b11;
+    slave_flash_led_count++;
+    if (slave_flash_led_count >= 10) {
+      slave_flash_led_count = 0;
       // Flash the flashing LED
       if (ETMReadPinLatch(can_params.flash_led)) {
 	ETMClearPin(can_params.flash_led);
@@ -628,171 +1004,105 @@ void ETMCanSlaveTimedTransmit(void) {
       }
     }
 
-    ETMCanSlaveSendStatus(); // Send out the status every 100mS
-
-    // Also send out one bit of logging data every 100mS
-    switch (slave_data_log_index) 
-      {
-      case 0:
-      ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_0,
-			 slave_board_data.log_data[3],
-			 slave_board_data.log_data[2],
-			 slave_board_data.log_data[1],
-			 slave_board_data.log_data[0]);
-	break;
-	
-      case 1:
-      ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_1,
-			 slave_board_data.log_data[7],
-			 slave_board_data.log_data[6],
-			 slave_board_data.log_data[5],
-			 slave_board_data.log_data[4]);
-	break;
-
-      case 2:
-      ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_2,
-			 slave_board_data.log_data[11],
-			 slave_board_data.log_data[10],
-			 slave_board_data.log_data[9],
-			 slave_board_data.log_data[8]);
-	break;
-
-      case 3:
-      ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_3,
-			 slave_board_data.log_data[15],
-			 slave_board_data.log_data[14],
-			 slave_board_data.log_data[13],
-			 slave_board_data.log_data[12]);
-	break;
-
-      case 4:
-      ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_4,
-			 slave_board_data.log_data[19],
-			 slave_board_data.log_data[18],
-			 slave_board_data.log_data[17],
-			 slave_board_data.log_data[16]);
-	break;
-
-      case 5:
-      ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_BOARD_SPECIFIC_5,
-			 slave_board_data.log_data[23],
-			 slave_board_data.log_data[22],
-			 slave_board_data.log_data[21],
-			 slave_board_data.log_data[20]);
-	break;
-      
-      case 6:
-	if ((slave_data_log_sub_index == 0) || (slave_data_log_sub_index == 2)) {
-	  ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_DEFAULT_DEBUG_0,
-			     etm_can_slave_debug_data.debug_reg[0],
-			     etm_can_slave_debug_data.debug_reg[1],
-			     etm_can_slave_debug_data.debug_reg[2],
-			     etm_can_slave_debug_data.debug_reg[3]);
-	} else {
-	  ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_DEFAULT_DEBUG_1,
-			     etm_can_slave_debug_data.debug_reg[4],
-			     etm_can_slave_debug_data.debug_reg[5],
-			     etm_can_slave_debug_data.debug_reg[6],
-			     etm_can_slave_debug_data.debug_reg[7]);
-	}
-	break;
-
-      case 7:
-	if ((slave_data_log_sub_index == 0) || (slave_data_log_sub_index == 2)) {
-	  ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_DEFAULT_DEBUG_2,
-			     etm_can_slave_debug_data.debug_reg[8],
-			     etm_can_slave_debug_data.debug_reg[9],
-			     etm_can_slave_debug_data.debug_reg[10],
-			     etm_can_slave_debug_data.debug_reg[11]);
-	} else {
-	  ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_DEFAULT_DEBUG_3,
-			     etm_can_slave_debug_data.debug_reg[12],
-			     etm_can_slave_debug_data.debug_reg[13],
-			     etm_can_slave_debug_data.debug_reg[14],
-			     etm_can_slave_debug_data.debug_reg[15]);
-	}
-	break;
-
-      case 8:
-	if (slave_data_log_sub_index == 0) {
-	  ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_0,
-			     etm_can_slave_debug_data.can_tx_0,
-			     etm_can_slave_debug_data.can_tx_1,
-			     etm_can_slave_debug_data.can_tx_2,
-			     etm_can_slave_debug_data.CXEC_reg_max);
-			     
-
-
-
-	} else if (slave_data_log_sub_index == 1) {
-	  ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_1,
-			     etm_can_slave_debug_data.can_rx_0_filt_0,
-			     etm_can_slave_debug_data.can_rx_0_filt_1,
-			     etm_can_slave_debug_data.can_rx_1_filt_2,
-			     etm_can_slave_debug_data.CXINTF_max);
-	  
-	} else if (slave_data_log_sub_index == 2) {
-	  ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_2,
-			     etm_can_slave_debug_data.can_unknown_msg_id,
-			     etm_can_slave_debug_data.can_invalid_index,
-			     etm_can_slave_debug_data.can_address_error,
-			     etm_can_slave_debug_data.can_error_flag);
-
-	} else {
-	  ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CAN_ERROR_3,
-			     etm_can_slave_debug_data.can_tx_buf_overflow,
-			     etm_can_slave_debug_data.can_rx_buf_overflow,
-			     etm_can_slave_debug_data.can_rx_log_buf_overflow,
-			     etm_can_slave_debug_data.can_timeout);
-	}
-	break;
-
-      case 9:
-	if (slave_data_log_sub_index == 0) {
-	    ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CONFIG_0,
-			       config_agile_number_high_word,
-			       config_agile_number_low_word,
-			       config_agile_dash,
-			       config_agile_rev_ascii);
-
-	} else if (slave_data_log_sub_index == 1) {
-	    ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_DEFAULT_CONFIG_1,
-			       config_serial_number,
-			       config_firmware_agile_rev,
-			       config_firmware_branch,
-			       config_firmware_branch_rev);
-
-	} else if (slave_data_log_sub_index == 2) {
-	  ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_DEFAULT_SYSTEM_ERROR_0, 
-			     etm_can_slave_debug_data.reset_count, 
-			     etm_can_slave_debug_data.RCON_value,
-			     etm_can_slave_debug_data.reserved_1, 
-			     0x5050);//etm_can_slave_debug_data.reserved_0);	  	  
-
-	} else {
-	  ETMCanSlaveLogData(ETM_CAN_DATA_LOG_REGISTER_DEFAULT_SYSTEM_ERROR_1, 
-			     etm_can_slave_debug_data.i2c_bus_error_count, 
-			     etm_can_slave_debug_data.spi_bus_error_count,
-			     etm_can_slave_debug_data.scale_error_count,
-			     *(unsigned int*)&etm_can_slave_debug_data.self_test_results);      
-	}
-	break;
+    // Control and fault changes have already been sent by ETMCanSlaveSendUpdateIfChanged()
+    status_sent.heartbeat_count++;
+    if ((status_sent.heartbeat_count >= ETM_CAN_SLAVE_STATUS_HEARTBEAT) ||
+	(_WARNING_REGISTER != status_sent.warning) ||
+	(_NOT_LOGGED_REGISTER != status_sent.not_logged)) {
+      ETMCanSlaveSendStatus();
+    }
+
+    ETMCanSlaveSendScheduledLogs();
+  }
+}
+
+
+void ETMCanSlaveSendScheduledLogs(void) {
+  const ETMCanSlaveLogSchedule* schedule_ptr;
+  TYPE_LOG_SCHEDULE_STATE* state_ptr;
+  unsigned int debugging;
+  unsigned int period;
+  unsigned int crc;
+  unsigned int n;
+
+  // The debugging registers are only sent while the ECB is mirroring this board.  An older ECB does not select boards.
+  debugging = 1;
+  if (_SYNC_CONTROL_DEBUG_BOARDS_SELECTED) {
+    debugging = etm_can_slave_sync_message.sync_2_debug_boards & (1 << can_params.address);
+  }
+
+  // The ECB may have been reset, send the LOG_SCHEDULE_IF_CHANGED registers again
+  if (log_schedule_com_loss && !etm_can_slave_com_loss) {
+    for (n = 0; n < ETM_CAN_SLAVE_LOG_SCHEDULE_SIZE; n++) {
+      log_schedule_state[n].skipped = ETM_CAN_SLAVE_LOG_REFRESH;
+    }
+  }
+  log_schedule_com_loss = etm_can_slave_com_loss;
+
+  schedule_ptr = etm_can_slave_log_schedule;
+  state_ptr = log_schedule_state;
+  for (n = ETM_CAN_SLAVE_LOG_SCHEDULE_SIZE; n; n--, schedule_ptr++, state_ptr++) {
+    period = schedule_ptr->period;
+    if (_SYNC_CONTROL_HIGH_SPEED_LOGGING && schedule_ptr->burst_period) {
+      period = schedule_ptr->burst_period;
+    }
+    if (state_ptr->countdown > period) {
+      // The period just got shorter
+      state_ptr->countdown = period;
+    }
+    if (state_ptr->countdown > 1) {
+      state_ptr->countdown--;
+      continue;
+    }
+    state_ptr->countdown = period;
+
+    if ((schedule_ptr->flags & LOG_SCHEDULE_DEBUG) && !debugging) {
+      continue;
+    }
+
+    if (schedule_ptr->flags & LOG_SCHEDULE_IF_CHANGED) {
+      crc = ETMCRC16(schedule_ptr->data, 4 * sizeof(unsigned int));
+      if ((crc == state_ptr->crc) && (state_ptr->skipped < ETM_CAN_SLAVE_LOG_REFRESH)) {
+	state_ptr->skipped++;
+	continue;
       }
+      state_ptr->crc = crc;
+      state_ptr->skipped = 0;
+    }
+
+    if (schedule_ptr->flags & LOG_SCHEDULE_WORD3_FIRST) {
+      ETMCanSlaveLogData(schedule_ptr->log_register, schedule_ptr->data[0], schedule_ptr->data[1], schedule_ptr->data[2], schedule_ptr->data[3]);
+    } else {
+      ETMCanSlaveLogData(schedule_ptr->log_register, schedule_ptr->data[3], schedule_ptr->data[2], schedule_ptr->data[1], schedule_ptr->data[0]);
+    }
   }
 }
 
 
-void ETMCanSlaveSendStatus(void) {
+unsigned int ETMCanSlaveSendStatus(void) {
   ETMCanMessage message;
-  message.identifier = ETM_CAN_MSG_STATUS_TX | (can_params.address << 2);
+
+  if (ETMCanBufferRowsAvailable(&etm_can_slave_tx_status_buffer) == 0) {
+    // Nothing was sent, so nothing is remembered and the notice bits are kept for the next try
+    return 0;
+  }
+
+  message.identifier = ETM_CAN_TX_SID(ETM_CAN_ID_STATUS, can_params.address);
   
   message.word0 = _CONTROL_REGISTER;
   message.word1 = _FAULT_REGISTER;
   message.word2 = _WARNING_REGISTER;
   message.word3 = _NOT_LOGGED_REGISTER;
 
-  ETMCanTXMessage(&message, CXTX1CON_ptr);  
-  etm_can_slave_debug_data.can_tx_1++;
+  ETMCanTXSchedulerAddMessage(&etm_can_slave_tx_scheduler, ETM_CAN_TX_CLASS_STATUS_SYNC, &message);
+  MacroETMCanCheckTXBuffer();
+
+  status_sent.control = message.word0 & 0x00FF;  // The notice bits are cleared below
+  status_sent.fault = message.word1;
+  status_sent.warning = message.word2;
+  status_sent.not_logged = message.word3;
+  status_sent.heartbeat_count = 0;
+  status_sent.time = ETMCanTimingNow(&etm_can_slave_timing);
   
   _NOTICE_0 = 0;
   _NOTICE_1 = 0;
@@ -803,7 +1113,7 @@ void ETMCanSlaveSendStatus(void) {
   _NOTICE_6 = 0;
   _NOTICE_7 = 0;
   
-
+  return 1;
 }
 
 
@@ -814,22 +1124,15 @@ void ETMCanSlaveLogPulseData(unsigned int packet_id, unsigned int word3, unsigne
 void ETMCanSlaveLogData(unsigned int packet_id, unsigned int word3, unsigned int word2, unsigned int word1, unsigned int word0) {
   ETMCanMessage log_message;
   
-  packet_id |= can_params.address; // Add the board address to the packet_id
-  packet_id |= 0b0000010000000000; // Add the Data log identifier
-  
-  // Format the packet Id for the PIC Register
-  packet_id <<= 2;
-  log_message.identifier = packet_id;
-  log_message.identifier &= 0xFF00;
-  log_message.identifier <<= 3;
-  log_message.identifier |= (packet_id & 0x00FF);
+  // Add the data log identifier and the board address to the packet_id and format it for the PIC Register
+  log_message.identifier = ETM_CAN_LOG_TX_SID(packet_id, can_params.address);
   
   log_message.word0 = word0;
   log_message.word1 = word1;
   log_message.word2 = word2;
   log_message.word3 = word3;
   
-  ETMCanAddMessageToBuffer(&etm_can_slave_tx_message_buffer, &log_message);
+  ETMCanTXSchedulerAddMessage(&etm_can_slave_tx_scheduler, ETM_CAN_TX_CLASS_LOG, &log_message);
   MacroETMCanCheckTXBuffer();
 }
 
@@ -843,14 +1146,17 @@ void ETMCanSlaveCheckForTimeOut(void) {
 }
 
 
-// DPARKER this needs to get fixed
-void ETMCanSlaveSendUpdateIfNewNotReady(void) {
-  if ((previous_ready_status == 0) && (_CONTROL_NOT_READY)) {
-    // There is new condition that is causing this board to inhibit operation.
-    // Send a status update upstream to Master
-    ETMCanSlaveSendStatus();
+void ETMCanSlaveSendUpdateIfChanged(void) {
+  // The notice bits are cleared every time the status is sent, so any notice bit that is set is new
+  if ((_CONTROL_REGISTER != status_sent.control) || (_FAULT_REGISTER != status_sent.fault)) {
+    // Hold off until ETM_CAN_SLAVE_STATUS_HOLDOFF_MS after the last status message
+    // The elapsed time is a 16 bit count, once heartbeat_count reaches 2 the hold off has always expired
+    if ((status_sent.heartbeat_count >= 2) ||
+	((unsigned int)(ETMCanTimingNow(&etm_can_slave_timing) - status_sent.time) >= status_sent.holdoff)) {
+      // Send a status update upstream to Master, status messages are sent ahead of commands and logging data
+      ETMCanSlaveSendStatus();
+    }
   }
-  previous_ready_status = _CONTROL_NOT_READY;
 }
 
 
@@ -873,13 +1179,13 @@ void ETMCanSlaveDoSync(ETMCanMessage* message_ptr) {
 
   _SYNC_CONTROL_WORD = message_ptr->word0;
   etm_can_slave_sync_message.sync_1_ecb_state_for_fault_logic = message_ptr->word1;
-  etm_can_slave_sync_message.sync_2 = message_ptr->word2;
+  etm_can_slave_sync_message.sync_2_debug_boards = message_ptr->word2;
   etm_can_slave_sync_message.sync_3 = message_ptr->word3;
 
 
   test0 = _SYNC_CONTROL_WORD;
   test1 = etm_can_slave_sync_message.sync_1_ecb_state_for_fault_logic;
-  test2 = etm_can_slave_sync_message.sync_2;
+  test2 = etm_can_slave_sync_message.sync_2_debug_boards;
   test3 = etm_can_slave_sync_message.sync_3;
 
 
@@ -905,6 +1211,17 @@ void ETMCanSlaveDoSync(ETMCanMessage* message_ptr) {
 }
 
 
+unsigned int ETMCanSlaveT4Flag(unsigned int clear) {
+  unsigned int flag;
+
+  flag = _T4IF;
+  if (clear) {
+    _T4IF = 0;
+  }
+  return flag;
+}
+
+
 void ETMCanSlaveClearDebug(void) {
   etm_can_slave_debug_data.debug_reg[0]        = 0;
   etm_can_slave_debug_data.debug_reg[1]        = 0;
@@ -950,7 +1267,7 @@ void ETMCanSlaveClearDebug(void) {
   etm_can_slave_debug_data.reset_count         = 0;
   etm_can_slave_debug_data.RCON_value          = 0;
   etm_can_slave_debug_data.reserved_1          = P1395_CAN_SLAVE_VERSION;
-  etm_can_slave_debug_data.reserved_0          = 0;
+  etm_can_slave_debug_data.can_buf_high_water  = 0;
 
   etm_can_slave_debug_data.i2c_bus_error_count = 0;
   etm_can_slave_debug_data.spi_bus_error_count = 0;
@@ -958,7 +1275,16 @@ void ETMCanSlaveClearDebug(void) {
   //self test results
 
   etm_can_slave_tx_message_buffer.message_overwrite_count = 0;
+  etm_can_slave_tx_log_buffer.message_overwrite_count = 0;
+  etm_can_slave_tx_status_buffer.message_overwrite_count = 0;
+  etm_can_slave_tx_pulse_level_buffer.message_overwrite_count = 0;
   etm_can_slave_rx_message_buffer.message_overwrite_count = 0;
+  ETMCanBufferClearHighWater(&etm_can_slave_tx_message_buffer);
+  ETMCanBufferClearHighWater(&etm_can_slave_tx_log_buffer);
+  ETMCanBufferClearHighWater(&etm_can_slave_tx_status_buffer);
+  ETMCanBufferClearHighWater(&etm_can_slave_tx_pulse_level_buffer);
+  ETMCanBufferClearHighWater(&etm_can_slave_rx_message_buffer);
+  ETMCanTimingClear(&etm_can_slave_timing);
   etm_can_persistent_data.reset_count = 0;
   etm_can_persistent_data.can_timeout_count = 0;
 
@@ -991,11 +1317,13 @@ void __attribute__((interrupt(__save__(CORCON,SR)), no_auto_psv)) _C2Interrupt(v
 
 void DoCanInterrupt(void) {
   ETMCanMessage can_message;
+  unsigned int isr_time;
 
   etm_can_slave_debug_data.CXINTF_max |= *CXINTF_ptr;
   
   if (*CXRX0CON_ptr & BUFFER_FULL_BIT) {
     // A message has been received in Buffer Zero
+    isr_time = ETMCanTimingNow(&etm_can_slave_timing);
     if (!(*CXRX0CON_ptr & FILTER_SELECT_BIT)) {
       // The command was received by Filter 0
       // It is a Next Pulse Level Command
@@ -1011,6 +1339,7 @@ void DoCanInterrupt(void) {
       ETMCanRXMessage(&can_message, CXRX0CON_ptr);
       ETMCanSlaveDoSync(&can_message);
     }
+    ETMCanTimingRecordISR(&etm_can_slave_timing, isr_time);
     *CXINTF_ptr &= RX0_INT_FLAG_BIT; // Clear the RX0 Interrupt Flag
   }
   
@@ -1020,19 +1349,17 @@ void DoCanInterrupt(void) {
        This command gets pushed onto the command message buffer
     */
     etm_can_slave_debug_data.can_rx_1_filt_2++;
+    ETMCanTimeStampNextMessage(&etm_can_slave_timing, &etm_can_slave_rx_message_buffer);
     ETMCanRXMessageBuffer(&etm_can_slave_rx_message_buffer, CXRX1CON_ptr);
     *CXINTF_ptr &= RX1_INT_FLAG_BIT; // Clear the RX1 Interrupt Flag
   }
 
-  if (!(*CXTX0CON_ptr & TX_REQ_BIT) && ((ETMCanBufferNotEmpty(&etm_can_slave_tx_message_buffer)))) {
-    /*
-      TX0 is empty and there is a message waiting in the transmit message buffer
-      Load the next message into TX0
-    */
-    ETMCanTXMessageBuffer(&etm_can_slave_tx_message_buffer, CXTX0CON_ptr);
-    *CXINTF_ptr &= 0xFFFB; // Clear the TX0 Interrupt Flag
-    etm_can_slave_debug_data.can_tx_0++;
-  }
+  /*
+    Load any empty TX buffer from the transmit queues (pulse level, status, command returns, logging)
+    The flags are cleared first so that a TX buffer that empties while this is running will trigger the interrupt again
+  */
+  *CXINTF_ptr &= TX_INT_FLAG_BITS; // Clear the TX0, TX1, TX2 Interrupt Flags
+  ETMCanTXSchedulerService(&etm_can_slave_tx_scheduler);
   
   if (*CXINTF_ptr & ERROR_FLAG_BIT) {
     // There was some sort of CAN Error
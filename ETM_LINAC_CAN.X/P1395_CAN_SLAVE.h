@@ -109,6 +109,46 @@ void ETMCanSlaveIncrementInvalidIndex(void);
 */
 
 
+// ---------- Board Specific Commands ---------------
+/*
+  The board specific commands (index 0xZ200 -> 0xZ3FF) are described by a const table in the board code that is passed to
+  ETMCanSlaveRegisterCommands().  The library looks each command up through a direct index and then
+   - checks that the first "words" data words (word0, word1, word2) are in min -> max
+   - calls handler (if handler is not 0), before anything is stored.  The handler reads the data from the message.
+   - stores those words at target (if target is not 0), word0 at target[0], only if the handler accepted the command
+  A command that is not in the table, is out of range or is rejected by its handler is counted in can_invalid_index.
+  A rejected command does not change target, so a handler can veto a set point with checks that min/max can not
+  express (one word against another for example).
+  Plain set points only need a target, commands that do more than store a value need a handler.
+
+  Boards that do not register a table are passed every board specific command through
+  ETMCanSlaveExecuteCMDBoardSpecific() as before.
+*/
+
+#ifndef ETM_CAN_SLAVE_COMMAND_INDEXES
+#define ETM_CAN_SLAVE_COMMAND_INDEXES           32    // Size of the direct index, commands 0x200 -> 0x21F can be registered
+#endif
+
+typedef unsigned int (*ETMCanSlaveCommandHandler)(ETMCanMessage* message_ptr);
+// Returns 0 if the command was executed, anything else if it was rejected (target is then not written)
+
+typedef struct {
+  unsigned int               index;     // Command index 0x200 -> (0x200 + ETM_CAN_SLAVE_COMMAND_INDEXES - 1), the board address is ignored
+  ETMCanSlaveCommandHandler  handler;   // 0 if the command only stores its data at target
+  unsigned int               min;       // Range of every data word
+  unsigned int               max;
+  unsigned int*              target;    // Where the data words are stored, 0 if the handler takes care of them
+  unsigned int               words;     // Number of data words (0 -> 3) that are checked and stored
+} ETMCanSlaveCommand;
+
+unsigned int ETMCanSlaveRegisterCommands(const ETMCanSlaveCommand* table, unsigned int commands);
+/*
+  Replaces the board specific command table.  The table must not change after it is registered.
+  Returns 0 if every command was registered, 1 if an index is outside of the direct index or is in the table twice, or
+  an entry has more than 3 words (those entries are not registered).
+*/
+
+
 // Only used by Pulse Sync Board
 void ETMCanSlavePulseSyncSendNextPulseLevel(unsigned int next_pulse_level, unsigned int next_pulse_count, unsigned int rep_rate_deci_herz);
 
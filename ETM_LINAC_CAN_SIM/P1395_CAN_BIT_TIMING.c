@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <xc.h>
+#include "P1395_CAN_CORE.h"
+
+/*
+  P1395 CAN bit timing tables
+
+  Usage: p1395_can_bit_timing [options]
+    -f fcy          instruction clock in Hz, 0 = table of the common clocks     (default 0)
+    -b bit_rate     bit rate in bits/second, 0 = table of the common bit rates  (default 0)
+    -s sample_point sample point in 0.1% of the bit time                       (default ETM_CAN_SAMPLE_POINT)
+
+  Runs ETMCanBitTimingSolve() from P1395_CAN_CORE.c for every combination of Fcy and bit rate and prints the CxCFG1 and
+  CxCFG2 values that ETMCanMasterInitialize() / ETMCanSlaveInitialize() would load.
+  Rows marked OFF BUS have no setting within ETM_CAN_BIT_RATE_TOLERANCE, the board would stay off the bus and set
+  st_can_bit_timing in its self test register.
+
+  Then the library defaults (ETM_CAN_BIT_RATE, ETM_CAN_SAMPLE_POINT) are checked against the fixed CXCFG1_xxMHZ_FCY_VALUE
+  and CXCFG2_VALUE registers that the existing network was built with.  Exits with 1 if any of them do not match.
+*/
+
+
+static const unsigned long bit_timing_fcy[] = {
+  8000000, 10000000, 16000000, 20000000, 25000000, 29491200,
+};
+
+static const unsigned long bit_timing_bit_rate[] = {
+  125000, 250000, 500000, 800000, 833333, 1000000,
+};
+
+
+// The clocks that had fixed CxCFG1 values, CxCFG2 was CXCFG2_VALUE for all of them
+static const struct {
+  unsigned long fcy;
+  unsigned int  cfg1;
+} bit_timing_fixed[] = {
+  {10000000, CXCFG1_10MHZ_FCY_VALUE},
+  {20000000, CXCFG1_20MHZ_FCY_VALUE},
+  {25000000, CXCFG1_25MHZ_FCY_VALUE},
+};
+
+
+static void BitTimingPrintRow(unsigned long fcy, unsigned long bit_rate, unsigned int sample_point) {
+  ETMCanBitTiming timing;
+  unsigned int off_bus;
+  unsigned int brp;
+  unsigned int sjw;
+  unsigned int prop;
+  unsigned int phase1;
+  unsigned int phase2;
+  double tq_ns;
+  double error_ppm;
+
+  off_bus = ETMCanBitTimingSolve(&timing, fcy, bit_rate, sample_point);
+  if (off_bus) {
+    printf("%10lu %9lu %4s %4s %7s %4s %4s %4s %4s %7s %10s %9s  %6s  %6s  OFF BUS\n",
+	   fcy, bit_rate, "-", "-", "-", "-", "-", "-", "-", "-", "-", "-", "-", "-");
+    return;
+  }
+
+  brp = timing.cfg1 & 0x3F;
+  sjw = ((timing.cfg1 >> 6) & 0x03) + 1;
+  prop = (timing.cfg2 & 0x07) + 1;
+  phase1 = ((timing.cfg2 >> 3) & 0x07) + 1;
+  phase2 = ((timing.cfg2 >> 8) & 0x07) + 1;
+  tq_ns = (2.0 * (brp + 1) * 1.0e9) / (4.0 * (double)fcy);
+  error_ppm = (((double)fcy * 2.0 / (brp + 1) / timing.tq_per_bit) - (double)bit_rate) * 1.0e6 / (double)bit_rate;
+
+  printf("%10lu %9lu %4u %4u %7.1f %4u %4u %4u %4u %6.1f%% %10.0f %9.0f  0x%04X  0x%04X\n",
+	 fcy, bit_rate, brp, timing.tq_per_bit, tq_ns, prop, phase1, phase2, sjw, timing.sample_point / 10.0,
+	 (double)fcy * 2.0 / (brp + 1) / timing.tq_per_bit, error_ppm, timing.cfg1, timing.cfg2);
+}
+
+
+static unsigned int BitTimingCheckFixed(void) {
+  ETMCanBitTiming timing;
+  unsigned int errors;
+  unsigned int f;
+
+  errors = 0;
+  for (f = 0; f < sizeof(bit_timing_fixed) / sizeof(bit_timing_fixed[0]); f++) {
+    if (ETMCanBitTimingSolve(&timing, bit_timing_fixed[f].fcy, ETM_CAN_BIT_RATE, ETM_CAN_SAMPLE_POINT) ||
+	(timing.cfg1 != bit_timing_fixed[f].cfg1) || (timing.cfg2 != CXCFG2_VALUE)) {
+      printf("FAIL %lu Hz: CFG1 0x%04X CFG2 0x%04X, the fixed timing was CFG1 0x%04X CFG2 0x%04X\n", bit_timing_fixed[f].fcy,
+	     timing.cfg1, timing.cfg2, bit_timing_fixed[f].cfg1, CXCFG2_VALUE);
+      errors++;
+    }
+  }
+  return errors;
+}
+
+
+static void BitTimingUsage(const char* program) {
+  fprintf(stderr, "usage: %s [-f fcy] [-b bit_rate] [-s sample_point]\n", program);
+  exit(1);
+}
+
+
+int main(int argc, char** argv) {
+  unsigned long fcy = 0;
+  unsigned long bit_rate = 0;
+  unsigned int sample_point = ETM_CAN_SAMPLE_POINT;
+  unsigned int f;
+  unsigned int b;
+  int option;
+
+  while ((option = getopt(argc, argv, "f:b:s:")) != -1) {
+    switch (option)
+      {
+      case 'f': fcy = strtoul(optarg, NULL, 0); break;
+      case 'b': bit_rate = strtoul(optarg, NULL, 0); break;
+      case 's': sample_point = strtoul(optarg, NULL, 0); break;
+      default: BitTimingUsage(argv[0]);
+      }
+  }
+  if ((sample_point == 0) || (sample_point >= 1000)) {
+    BitTimingUsage(argv[0]);
+  }
+
+  printf("CAN bit timing, Fcan = 4xFcy, requested sample point %.1f%%, library default %lu bits/second\n\n",
+	 sample_point / 10.0, (unsigned long)ETM_CAN_BIT_RATE);
+  printf("%10s %9s %4s %4s %7s %4s %4s %4s %4s %7s %10s %9s  %6s  %6s\n",
+	 "fcy", "bit rate", "brp", "tq", "tq ns", "prop", "ph1", "ph2", "sjw", "sample", "actual", "err ppm", "CFG1", "CFG2");
+
+  for (f = 0; f < sizeof(bit_timing_fcy) / sizeof(bit_timing_fcy[0]); f++) {
+    if (fcy && (f > 0)) {
+      break;
+    }
+    for (b = 0; b < sizeof(bit_timing_bit_rate) / sizeof(bit_timing_bit_rate[0]); b++) {
+      if (bit_rate && (b > 0)) {
+	break;
+      }
+      BitTimingPrintRow(fcy ? fcy : bit_timing_fcy[f], bit_rate ? bit_rate : bit_timing_bit_rate[b], sample_point);
+    }
+    if (!fcy && !bit_rate) {
+      printf("\n");
+    }
+  }
+
+  if (BitTimingCheckFixed()) {
+    return 1;
+  }
+  printf("Default %lu bits/second matches the fixed CXCFG1/CXCFG2 values at 10, 20 and 25MHz PASS\n",
+	 (unsigned long)ETM_CAN_BIT_RATE);
+  return 0;
+}
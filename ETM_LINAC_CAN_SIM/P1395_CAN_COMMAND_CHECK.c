@@ -0,0 +1,246 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <xc.h>
+#include "P1395_CAN_SIM.h"
+#include "P1395_CAN_SLAVE.h"
+
+/*
+  P1395 CAN board specific command check
+
+  Usage: p1395_can_command_check
+
+  Checks ETMCanSlaveRegisterCommands() and ETMCanSlaveExecuteCMDRegistered() from P1395_CAN_SLAVE.c.
+   - A board that has not registered a table gets every board specific command through
+     ETMCanSlaveExecuteCMDBoardSpecific() (the default version counts it in can_invalid_index).
+   - Registration returns 1 for an index outside of the direct index, an index that is in the table twice and an entry
+     with more than 3 words, and those entries are not registered.  The board address in the index is ignored.
+     Registering a new table replaces the old one.
+   - An accepted command stores its first "words" data words at target and nothing else, and calls its handler once,
+     before anything is stored.
+   - A data word outside of min -> max, a handler that rejects the command, an index that is not registered and an
+     index past the direct index leave every target unchanged and add 1 to can_invalid_index.
+
+  Returns 0 if every check passes.
+*/
+
+void ETMCanSlaveExecuteCMDRegistered(ETMCanMessage* message_ptr);
+
+extern ETMCanBoardDebuggingData etm_can_slave_debug_data;
+
+
+#define CHECK_FILL                0xA5A5  // Target words that have not been written
+
+static unsigned int command_check_failures;
+static unsigned int check_handler_calls;
+static unsigned int check_handler_target_word;      // target[0] of the handler command when its handler was called
+static ETMCanMessage check_handler_message;         // The message the handler got
+static unsigned int check_set_point[4];             // Plain set point, 2 words
+static unsigned int check_limits[4];                // 3 words with a handler that can reject the command
+static unsigned int check_single[4];                // 1 word, full range
+static unsigned int check_spare[4];                 // Target of the entries that must not be registered
+
+
+static void CommandCheckFail(const char* message, unsigned int got, unsigned int expected) {
+  printf("FAIL: %s (%u, expected %u)\n", message, got, expected);
+  command_check_failures++;
+}
+
+
+static void CommandCheckValue(const char* message, unsigned int got, unsigned int expected) {
+  if (got != expected) {
+    CommandCheckFail(message, got, expected);
+  }
+}
+
+
+static unsigned int CheckLimitsHandler(ETMCanMessage* message_ptr) {
+  // Rejects the command if word1 is greater than word0 (a check that min / max can not do)
+  check_handler_calls++;
+  check_handler_target_word = check_limits[0];
+  check_handler_message = *message_ptr;
+  return (message_ptr->word1 > message_ptr->word0);
+}
+
+
+static unsigned int CheckActionHandler(ETMCanMessage* message_ptr) {
+  // A command that does something instead of storing a value
+  check_handler_calls++;
+  check_handler_message = *message_ptr;
+  return 0;
+}
+
+
+static const ETMCanSlaveCommand check_commands[] = {
+  {0x0200, 0,                  100,    200,    check_set_point, 2},
+  {0x5203, CheckLimitsHandler, 0,      1000,   check_limits,    3},  // The board address (5) is ignored
+  {0x0204, 0,                  0x0000, 0xFFFF, check_single,    1},
+  {0x021F, CheckActionHandler, 0,      0,      0,               0},
+};
+
+static const ETMCanSlaveCommand check_bad_commands[] = {
+  {0x0201, 0,                  0,      0xFFFF, check_set_point, 1},
+  {0x0201, 0,                  0,      0xFFFF, check_spare,     1},  // Already in the table
+  {0x01FF, 0,                  0,      0xFFFF, check_spare,     1},  // Below the direct index
+  {0x0200 + ETM_CAN_SLAVE_COMMAND_INDEXES, 0, 0, 0xFFFF, check_spare, 1},  // Past the direct index
+  {0x0202, 0,                  0,      0xFFFF, check_spare,     4},  // More than 3 words
+};
+
+
+static void CheckFillTargets(void) {
+  unsigned int n;
+
+  for (n = 0; n < 4; n++) {
+    check_set_point[n] = CHECK_FILL;
+    check_limits[n] = CHECK_FILL;
+    check_single[n] = CHECK_FILL;
+    check_spare[n] = CHECK_FILL;
+  }
+}
+
+
+static unsigned int CheckTargetsUnchanged(void) {
+  unsigned int n;
+
+  for (n = 0; n < 4; n++) {
+    if ((check_set_point[n] != CHECK_FILL) || (check_limits[n] != CHECK_FILL) || (check_single[n] != CHECK_FILL) ||
+	(check_spare[n] != CHECK_FILL)) {
+      return 0;
+    }
+  }
+  return 1;
+}
+
+
+static void CheckExecute(unsigned int index, unsigned int word0, unsigned int word1, unsigned int word2) {
+  ETMCanMessage message;
+
+  message.identifier = ETM_CAN_ID_TO_RX_SID(ETM_CAN_ID_CMD);
+  message.word3 = index;
+  message.word2 = word2;
+  message.word1 = word1;
+  message.word0 = word0;
+  ETMCanSlaveExecuteCMDRegistered(&message);
+}
+
+
+static void CheckRejected(const char* message, unsigned int index, unsigned int word0, unsigned int word1, unsigned int word2,
+			  unsigned int handler_calls) {
+  // The command must be counted as invalid and must not change any target
+  unsigned int invalid;
+  char text[160];
+
+  CheckFillTargets();
+  invalid = etm_can_slave_debug_data.can_invalid_index;
+  check_handler_calls = 0;
+  CheckExecute(index, word0, word1, word2);
+  snprintf(text, sizeof(text), "%s: can_invalid_index", message);
+  CommandCheckValue(text, etm_can_slave_debug_data.can_invalid_index - invalid, 1);
+  snprintf(text, sizeof(text), "%s: handler calls", message);
+  CommandCheckValue(text, check_handler_calls, handler_calls);
+  if (!CheckTargetsUnchanged()) {
+    snprintf(text, sizeof(text), "%s: a target was changed", message);
+    CommandCheckFail(text, 1, 0);
+  }
+}
+
+
+static void CheckAccepted(const char* message, unsigned int index, unsigned int word0, unsigned int word1, unsigned int word2,
+			  unsigned int handler_calls) {
+  unsigned int invalid;
+  char text[160];
+
+  CheckFillTargets();
+  invalid = etm_can_slave_debug_data.can_invalid_index;
+  check_handler_calls = 0;
+  CheckExecute(index, word0, word1, word2);
+  snprintf(text, sizeof(text), "%s: can_invalid_index", message);
+  CommandCheckValue(text, etm_can_slave_debug_data.can_invalid_index - invalid, 0);
+  snprintf(text, sizeof(text), "%s: handler calls", message);
+  CommandCheckValue(text, check_handler_calls, handler_calls);
+}
+
+
+int main(void) {
+  unsigned int n;
+
+  // ---------- No table ---------------
+  // The host xc.h drops __attribute__((weak)), so the default ETMCanSlaveExecuteCMDBoardSpecific() is always used
+  CheckRejected("no table", 0x0200, 150, 150, 0, 0);
+
+  // ---------- Registration ---------------
+  CommandCheckValue("register a table with a bad entry", ETMCanSlaveRegisterCommands(check_bad_commands, 2), 1);
+  CommandCheckValue("register a table with a bad entry", ETMCanSlaveRegisterCommands(check_bad_commands + 1, 2), 1);
+  CommandCheckValue("register a table with a bad entry", ETMCanSlaveRegisterCommands(check_bad_commands + 3, 1), 1);
+  CommandCheckValue("register a table with a bad entry", ETMCanSlaveRegisterCommands(check_bad_commands + 4, 1), 1);
+  CommandCheckValue("register the bad table", ETMCanSlaveRegisterCommands(check_bad_commands, 5), 1);
+  CheckAccepted("first of a duplicate index", 0x0201, 7, 0, 0, 0);
+  CommandCheckValue("first of a duplicate index: target", check_set_point[0], 7);
+  CommandCheckValue("first of a duplicate index: the duplicate was stored", check_spare[0], CHECK_FILL);
+  CheckRejected("entry with more than 3 words", 0x0202, 1, 2, 3, 0);
+
+  CommandCheckValue("register the table", ETMCanSlaveRegisterCommands(check_commands, sizeof(check_commands) / sizeof(check_commands[0])), 0);
+  CheckRejected("index from the replaced table", 0x0201, 7, 0, 0, 0);
+
+  // ---------- Plain set point ---------------
+  CheckAccepted("set point", 0x0200, 100, 200, 0xFFFF, 0);
+  CommandCheckValue("set point: target[0]", check_set_point[0], 100);
+  CommandCheckValue("set point: target[1]", check_set_point[1], 200);
+  CommandCheckValue("set point: word2 was stored", check_set_point[2], CHECK_FILL);
+  CheckAccepted("set point with a board address", 0x3200, 150, 150, 0, 0);
+  CommandCheckValue("set point with a board address: target[0]", check_set_point[0], 150);
+  CheckRejected("set point word0 below min", 0x0200, 99, 150, 0, 0);
+  CheckRejected("set point word0 above max", 0x0200, 201, 150, 0, 0);
+  CheckRejected("set point word1 below min", 0x0200, 150, 99, 0, 0);
+  CheckRejected("set point word1 above max", 0x0200, 150, 201, 0, 0);
+  CheckAccepted("single word", 0x0204, 0xFFFF, 0, 0, 0);
+  CommandCheckValue("single word: target[0]", check_single[0], 0xFFFF);
+  CommandCheckValue("single word: target[1]", check_single[1], CHECK_FILL);
+
+  // ---------- Handler that validates ---------------
+  check_limits[0] = CHECK_FILL;
+  CheckAccepted("handler accepts", 0x0203, 1000, 10, 500, 1);
+  CommandCheckValue("handler accepts: target[0]", check_limits[0], 1000);
+  CommandCheckValue("handler accepts: target[1]", check_limits[1], 10);
+  CommandCheckValue("handler accepts: target[2]", check_limits[2], 500);
+  CommandCheckValue("handler accepts: target[3]", check_limits[3], CHECK_FILL);
+  CommandCheckValue("handler accepts: target[0] before the handler returned", check_handler_target_word, CHECK_FILL);
+  CommandCheckValue("handler accepts: message word0", check_handler_message.word0, 1000);
+  CommandCheckValue("handler accepts: message word2", check_handler_message.word2, 500);
+  CheckRejected("handler rejects", 0x0203, 10, 1000, 500, 1);
+  CheckRejected("handler command word2 above max", 0x0203, 1000, 10, 1001, 0);
+
+  // ---------- Handler only ---------------
+  CheckAccepted("handler without a target", 0x021F, 0x1234, 0x5678, 0x9ABC, 1);
+  CommandCheckValue("handler without a target: message word1", check_handler_message.word1, 0x5678);
+  CommandCheckValue("handler without a target: a target was changed", CheckTargetsUnchanged(), 1);
+
+  // ---------- Not registered ---------------
+  CheckRejected("index that is not registered", 0x0210, 150, 150, 0, 0);
+  CheckRejected("index past the direct index", 0x0200 + ETM_CAN_SLAVE_COMMAND_INDEXES, 150, 150, 0, 0);
+  CheckRejected("index 0x3FF", 0x03FF, 150, 150, 0, 0);
+
+  // ---------- Empty table ---------------
+  CommandCheckValue("register an empty table", ETMCanSlaveRegisterCommands(check_commands, 0), 0);
+  for (n = 0; n < sizeof(check_commands) / sizeof(check_commands[0]); n++) {
+    CheckRejected("empty table", check_commands[n].index, 150, 150, 0, 0);
+  }
+
+  if (command_check_failures) {
+    printf("%u checks FAILED\n", command_check_failures);
+    return 1;
+  }
+  printf("Board specific command registration, range checks, handlers and targets PASS\n");
+  return 0;
+}
+
+
+// The node start up and main loop are not used, the check calls the command table directly
+void SimAppInitialize(const SimNodeConfig* config) {
+}
+
+void SimAppMainLoop(unsigned long long time_ns) {
+}
+
+void SimAppReport(SimNodeReportData* report) {
+}
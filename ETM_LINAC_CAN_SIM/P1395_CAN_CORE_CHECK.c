@@ -0,0 +1,2055 @@
+#define _GNU_SOURCE
+#include <ctype.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <ucontext.h>
+#include <unistd.h>
+#include <xc.h>
+#include "P1395_CAN_CORE.h"
+
+/*
+  P1395 CAN buffer routine check
+
+  Usage: p1395_can_core_check [options]
+    -a file         assembly version of the buffer routines                  (default ../ETM_LINAC_CAN.X/P1395_CAN_CORE.s)
+    -n calls        random calls per buffer depth in the lockstep check      (default 20000)
+    -i steps        random steps per buffer depth in the interleaving check  (default 100)
+    -s seed         random seed                                              (default 1)
+    -f fcy          instruction clock for the dsPIC messages/second          (default 10000000)
+
+  Checks the buffer routines in P1395_CAN_CORE.c against P1395_CAN_CORE.s.  The assembly file is loaded and run on a
+  model of the dsPIC30F core (only the instructions that P1395_CAN_CORE.s uses, with the 16 bit ETMCanBuffer layout
+  in its data memory).  Every buffer depth from 4 to 256 is checked.
+
+   - Lockstep: the same random sequence of calls to every buffer routine (full and empty buffers, RXFUL and TXREQ set
+     and clear) is applied to both versions.  The buffer, every row, the SFRs and the returned data are compared after
+     every call.
+   - Interleaving: each main loop call is interrupted at every instruction boundary in turn (dsPIC instructions for the
+     assembly, x86 instructions single stepped with the trap flag for the C version) by a CAN interrupt that moves up to
+     3 frames.  The set of states that the interrupt can leave must be the same for both versions, and every one of them
+     must be a correct single producer / single consumer FIFO: no torn rows, no lost or repeated messages, no row that
+     the consumer holds is overwritten and the counters add up.  One state is picked at random to continue from.  RX
+     (ISR producer, main loop consumer) and TX (main loop producer, ISR consumer) are both checked.
+   - Throughput: the instruction cycles of each assembly routine (from the model) and the messages/second that gives
+     at Fcy, and the messages/second of the C version on this host.  The dsPIC cycles of the C version depend on XC16
+     and are not measured here.
+
+  Returns 0 if every check passes.
+*/
+
+#if !defined(__x86_64__) || !defined(__linux__)
+#error "The interleaving check single steps the C routines with the x86-64 trap flag"
+#endif
+
+
+static unsigned long long check_random_state = 1;
+
+static unsigned int CheckRandom(void) {
+  // xorshift64*
+  check_random_state ^= check_random_state >> 12;
+  check_random_state ^= check_random_state << 25;
+  check_random_state ^= check_random_state >> 27;
+  return (unsigned int)((check_random_state * 2685821657736338717ULL) >> 32);
+}
+
+
+// ---------- dsPIC30F model ---------------
+
+#define ASM_MAX_INSTRUCTIONS          1024
+#define ASM_MAX_SYMBOLS               256
+#define ASM_MAX_NAME                  64
+#define ASM_MAX_NESTING               8
+#define ASM_MEMORY_WORDS              0x8000
+#define ASM_NO_PREEMPT                0xFFFFFFFFUL
+
+enum {
+  ASM_OPERAND_REGISTER,               // Wn
+  ASM_OPERAND_INDIRECT,               // [Wn]
+  ASM_OPERAND_POST_INCREMENT,         // [Wn++]
+  ASM_OPERAND_OFFSET,                 // [Wn+lit]
+  ASM_OPERAND_LITERAL,                // #lit
+  ASM_OPERAND_NAME,                   // Branch label or condition
+};
+
+enum {
+  ASM_MOV, ASM_ADD, ASM_SUB, ASM_INC, ASM_DEC, ASM_AND, ASM_CP, ASM_CP0, ASM_MUL_UU,
+  ASM_CLR, ASM_BSET, ASM_BCLR, ASM_BTSS, ASM_BTSC, ASM_BRA, ASM_RETURN, ASM_OPCODES
+};
+
+static const char* asm_mnemonic[ASM_OPCODES] = {
+  "MOV", "ADD", "SUB", "INC", "DEC", "AND", "CP", "CP0", "MUL.UU",
+  "CLR", "BSET", "BCLR", "BTSS", "BTSC", "BRA", "RETURN"
+};
+
+static const unsigned int asm_operand_count[ASM_OPCODES] = {
+  2, 3, 3, 2, 2, 3, 2, 1, 3,
+  1, 2, 2, 2, 2, 1, 0
+};
+
+enum {
+  ASM_ALWAYS, ASM_Z, ASM_NZ, ASM_C, ASM_NC, ASM_N, ASM_NN, ASM_LEU, ASM_GTU, ASM_CONDITIONS
+};
+
+static const char* asm_condition[ASM_CONDITIONS] = {
+  "", "Z", "NZ", "C", "NC", "N", "NN", "LEU", "GTU"
+};
+
+
+typedef struct {
+  unsigned int mode;
+  unsigned int reg;
+  unsigned int value;
+  char         name[ASM_MAX_NAME];
+} AsmOperand;
+
+typedef struct {
+  unsigned int opcode;
+  unsigned int condition;
+  unsigned int operands;
+  AsmOperand   operand[3];
+  unsigned int target;                // Instruction index of a branch target
+  unsigned int line;
+} AsmInstruction;
+
+typedef struct {
+  char         name[ASM_MAX_NAME];
+  unsigned int value;
+} AsmSymbol;
+
+typedef struct {
+  unsigned int w[16];
+  unsigned int c;
+  unsigned int z;
+  unsigned int n;
+} AsmRegisters;
+
+typedef void (*AsmInterrupt)(void);
+
+typedef struct {
+  const char*     file;
+  unsigned int    line;               // Source line that is being parsed or run
+  AsmInstruction  instruction[ASM_MAX_INSTRUCTIONS];
+  unsigned int    instructions;
+  AsmSymbol       label[ASM_MAX_SYMBOLS];
+  unsigned int    labels;
+  AsmSymbol       equ[ASM_MAX_SYMBOLS];
+  unsigned int    equs;
+  unsigned short  memory[ASM_MEMORY_WORDS];
+  unsigned char   writable[ASM_MEMORY_WORDS];
+  AsmRegisters    r;
+  unsigned long   steps;              // Instructions run by the last AsmCall (not counting the interrupt)
+  unsigned long   cycles;             // Instruction cycles of the last AsmCall including the CALL
+} AsmModel;
+
+static AsmModel asm_model;
+
+
+static void AsmError(const char* message, const char* detail) {
+  fprintf(stderr, "%s:%u: %s%s%s\n", asm_model.file, asm_model.line, message, detail ? " " : "", detail ? detail : "");
+  exit(2);
+}
+
+
+static char* AsmTrim(char* text) {
+  char* end;
+
+  while (isspace((unsigned char)*text)) {
+    text++;
+  }
+  end = text + strlen(text);
+  while ((end > text) && isspace((unsigned char)end[-1])) {
+    end--;
+  }
+  *end = 0;
+  return text;
+}
+
+
+static int AsmFindSymbol(const AsmSymbol* table, unsigned int symbols, const char* name) {
+  unsigned int n;
+
+  for (n = 0; n < symbols; n++) {
+    if (strcmp(table[n].name, name) == 0) {
+      return n;
+    }
+  }
+  return -1;
+}
+
+
+static void AsmAddSymbol(AsmSymbol* table, unsigned int* symbols, const char* name, unsigned int value) {
+  if ((*symbols >= ASM_MAX_SYMBOLS) || (strlen(name) >= ASM_MAX_NAME)) {
+    AsmError("too many symbols or symbol too long", name);
+  }
+  if (AsmFindSymbol(table, *symbols, name) >= 0) {
+    AsmError("symbol defined twice", name);
+  }
+  strcpy(table[*symbols].name, name);
+  table[*symbols].value = value;
+  (*symbols)++;
+}
+
+
+static unsigned int AsmValue(const char* text) {
+  char* end;
+  unsigned long value;
+  int index;
+
+  if (isdigit((unsigned char)text[0])) {
+    if ((text[0] == '0') && ((text[1] == 'b') || (text[1] == 'B'))) {
+      value = strtoul(text + 2, &end, 2);
+    } else {
+      value = strtoul(text, &end, 0);
+    }
+    if (*end) {
+      AsmError("bad number", text);
+    }
+    return value;
+  }
+  index = AsmFindSymbol(asm_model.equ, asm_model.equs, text);
+  if (index < 0) {
+    AsmError("unknown symbol", text);
+  }
+  return asm_model.equ[index].value;
+}
+
+
+static unsigned int AsmRegister(const char* text, unsigned int* reg) {
+  char* end;
+  unsigned long value;
+
+  if (((text[0] != 'W') && (text[0] != 'w')) || !isdigit((unsigned char)text[1])) {
+    return 0;
+  }
+  value = strtoul(text + 1, &end, 10);
+  if (*end || (value > 15)) {
+    return 0;
+  }
+  *reg = value;
+  return 1;
+}
+
+
+static void AsmParseOperand(AsmOperand* operand, char* text) {
+  char* inner;
+  char* plus;
+  unsigned int length;
+
+  memset(operand, 0, sizeof(AsmOperand));
+  if (text[0] == '#') {
+    operand->mode = ASM_OPERAND_LITERAL;
+    operand->value = AsmValue(AsmTrim(text + 1));
+    return;
+  }
+
+  if (text[0] == '[') {
+    length = strlen(text);
+    if (text[length - 1] != ']') {
+      AsmError("bad indirect operand", text);
+    }
+    text[length - 1] = 0;
+    inner = AsmTrim(text + 1);
+    length = strlen(inner);
+    if ((length > 2) && (strcmp(inner + length - 2, "++") == 0)) {
+      inner[length - 2] = 0;
+      operand->mode = ASM_OPERAND_POST_INCREMENT;
+    } else if ((plus = strchr(inner, '+')) != NULL) {
+      *plus = 0;
+      operand->mode = ASM_OPERAND_OFFSET;
+      operand->value = AsmValue(AsmTrim(plus + 1));
+    } else {
+      operand->mode = ASM_OPERAND_INDIRECT;
+    }
+    if (!AsmRegister(AsmTrim(inner), &operand->reg)) {
+      AsmError("unsupported indirect operand", inner);
+    }
+    return;
+  }
+
+  if (AsmRegister(text, &operand->reg)) {
+    operand->mode = ASM_OPERAND_REGISTER;
+    return;
+  }
+
+  if (strlen(text) >= ASM_MAX_NAME) {
+    AsmError("name too long", text);
+  }
+  operand->mode = ASM_OPERAND_NAME;
+  strcpy(operand->name, text);
+}
+
+
+static void AsmParseInstruction(char* text) {
+  AsmInstruction* instruction;
+  char* field[4];
+  char* operands;
+  unsigned int fields;
+  unsigned int n;
+
+  if (asm_model.instructions >= ASM_MAX_INSTRUCTIONS) {
+    AsmError("too many instructions", NULL);
+  }
+  instruction = &asm_model.instruction[asm_model.instructions];
+  memset(instruction, 0, sizeof(AsmInstruction));
+  instruction->line = asm_model.line;
+
+  operands = text;
+  while (*operands && !isspace((unsigned char)*operands)) {
+    *operands = toupper((unsigned char)*operands);
+    operands++;
+  }
+  if (*operands) {
+    *operands++ = 0;
+  }
+  for (n = 0; n < ASM_OPCODES; n++) {
+    if (strcmp(text, asm_mnemonic[n]) == 0) {
+      break;
+    }
+  }
+  if (n == ASM_OPCODES) {
+    AsmError("instruction is not in the model", text);
+  }
+  instruction->opcode = n;
+
+  fields = 0;
+  operands = AsmTrim(operands);
+  while (*operands) {
+    if (fields == 3) {
+      AsmError("too many operands", NULL);
+    }
+    field[fields++] = operands;
+    while (*operands && (*operands != ',')) {
+      operands++;
+    }
+    if (*operands) {
+      *operands++ = 0;
+    }
+  }
+  for (n = 0; n < fields; n++) {
+    AsmParseOperand(&instruction->operand[n], AsmTrim(field[n]));
+  }
+
+  if ((instruction->opcode == ASM_BRA) && (fields == 2)) {
+    // BRA condition, label
+    for (n = 1; n < ASM_CONDITIONS; n++) {
+      if ((instruction->operand[0].mode == ASM_OPERAND_NAME) && (strcasecmp(instruction->operand[0].name, asm_condition[n]) == 0)) {
+	break;
+      }
+    }
+    if (n == ASM_CONDITIONS) {
+      AsmError("branch condition is not in the model", instruction->operand[0].name);
+    }
+    instruction->condition = n;
+    instruction->operand[0] = instruction->operand[1];
+    fields = 1;
+  }
+  if (fields != asm_operand_count[instruction->opcode]) {
+    AsmError("wrong number of operands for", asm_mnemonic[instruction->opcode]);
+  }
+  instruction->operands = fields;
+  asm_model.instructions++;
+}
+
+
+static void AsmLoad(const char* file) {
+  FILE* source;
+  char line[256];
+  char* text;
+  char* comment;
+  char* colon;
+  char* directive;
+  char* argument;
+  unsigned int active[ASM_MAX_NESTING];
+  unsigned int nesting;
+  unsigned int n;
+  int index;
+
+  source = fopen(file, "r");
+  if (source == NULL) {
+    perror(file);
+    exit(2);
+  }
+  asm_model.file = file;
+  asm_model.line = 0;
+
+  // No assembler symbols are defined, so the p30fxxxx.inc include is skipped and the routines are not left out
+  nesting = 0;
+  active[0] = 1;
+  while (fgets(line, sizeof(line), source)) {
+    asm_model.line++;
+    comment = strchr(line, ';');
+    if (comment) {
+      *comment = 0;
+    }
+    text = AsmTrim(line);
+    if (*text == 0) {
+      continue;
+    }
+
+    if (*text == '.') {
+      directive = text;
+      argument = text;
+      while (*argument && !isspace((unsigned char)*argument)) {
+	argument++;
+      }
+      if (*argument) {
+	*argument++ = 0;
+      }
+      argument = AsmTrim(argument);
+      if ((strcasecmp(directive, ".ifdef") == 0) || (strcasecmp(directive, ".ifndef") == 0)) {
+	if (nesting == (ASM_MAX_NESTING - 1)) {
+	  AsmError("conditionals nested too deep", NULL);
+	}
+	nesting++;
+	active[nesting] = active[nesting - 1] && (strcasecmp(directive, ".ifndef") == 0);
+      } else if (strcasecmp(directive, ".else") == 0) {
+	if (nesting == 0) {
+	  AsmError(".else without .if", NULL);
+	}
+	active[nesting] = active[nesting - 1] && !active[nesting];
+      } else if (strcasecmp(directive, ".endif") == 0) {
+	if (nesting == 0) {
+	  AsmError(".endif without .if", NULL);
+	}
+	nesting--;
+      } else if (active[nesting] && (strcasecmp(directive, ".equ") == 0)) {
+	comment = strchr(argument, ',');
+	if (comment == NULL) {
+	  AsmError("bad .equ", argument);
+	}
+	*comment = 0;
+	AsmAddSymbol(asm_model.equ, &asm_model.equs, AsmTrim(argument), AsmValue(AsmTrim(comment + 1)));
+      }
+      // .global, .text and .include do not change the routines
+      continue;
+    }
+
+    if (!active[nesting]) {
+      continue;
+    }
+
+    colon = strchr(text, ':');
+    if (colon) {
+      *colon = 0;
+      AsmAddSymbol(asm_model.label, &asm_model.labels, AsmTrim(text), asm_model.instructions);
+      text = AsmTrim(colon + 1);
+      if (*text == 0) {
+	continue;
+      }
+    }
+    AsmParseInstruction(text);
+  }
+  fclose(source);
+
+  if (nesting) {
+    AsmError("missing .endif", NULL);
+  }
+
+  // Resolve the branch targets
+  for (n = 0; n < asm_model.instructions; n++) {
+    asm_model.line = asm_model.instruction[n].line;
+    if (asm_model.instruction[n].opcode != ASM_BRA) {
+      continue;
+    }
+    if (asm_model.instruction[n].operand[0].mode != ASM_OPERAND_NAME) {
+      AsmError("branch target must be a label", NULL);
+    }
+    index = AsmFindSymbol(asm_model.label, asm_model.labels, asm_model.instruction[n].operand[0].name);
+    if (index < 0) {
+      AsmError("unknown label", asm_model.instruction[n].operand[0].name);
+    }
+    asm_model.instruction[n].target = asm_model.label[index].value;
+  }
+}
+
+
+static unsigned int AsmRead(unsigned int address) {
+  address &= 0xFFFF;
+  if (address & 1) {
+    AsmError("word read from an odd address", NULL);
+  }
+  return asm_model.memory[address >> 1];
+}
+
+
+static void AsmWrite(unsigned int address, unsigned int value) {
+  char detail[16];
+
+  address &= 0xFFFF;
+  if (address & 1) {
+    AsmError("word write to an odd address", NULL);
+  }
+  if (!asm_model.writable[address >> 1]) {
+    sprintf(detail, "0x%04X", address);
+    AsmError("write outside the buffer, the message and the SFRs at", detail);
+  }
+  asm_model.memory[address >> 1] = value;
+}
+
+
+static unsigned int AsmAddress(const AsmOperand* operand) {
+  switch (operand->mode)
+    {
+    case ASM_OPERAND_INDIRECT:
+    case ASM_OPERAND_POST_INCREMENT:
+      return asm_model.r.w[operand->reg];
+
+    case ASM_OPERAND_OFFSET:
+      return (asm_model.r.w[operand->reg] + operand->value) & 0xFFFF;
+    }
+  AsmError("operand is not in memory", NULL);
+  return 0;
+}
+
+
+static unsigned int AsmSource(const AsmOperand* operand) {
+  unsigned int value;
+
+  switch (operand->mode)
+    {
+    case ASM_OPERAND_REGISTER:
+      return asm_model.r.w[operand->reg];
+
+    case ASM_OPERAND_LITERAL:
+      return operand->value & 0xFFFF;
+
+    case ASM_OPERAND_INDIRECT:
+    case ASM_OPERAND_OFFSET:
+      return AsmRead(AsmAddress(operand));
+
+    case ASM_OPERAND_POST_INCREMENT:
+      value = AsmRead(AsmAddress(operand));
+      asm_model.r.w[operand->reg] = (asm_model.r.w[operand->reg] + 2) & 0xFFFF;
+      return value;
+    }
+  AsmError("bad source operand", operand->name);
+  return 0;
+}
+
+
+static void AsmDestination(const AsmOperand* operand, unsigned int value) {
+  value &= 0xFFFF;
+  switch (operand->mode)
+    {
+    case ASM_OPERAND_REGISTER:
+      asm_model.r.w[operand->reg] = value;
+      return;
+
+    case ASM_OPERAND_INDIRECT:
+    case ASM_OPERAND_OFFSET:
+      AsmWrite(AsmAddress(operand), value);
+      return;
+
+    case ASM_OPERAND_POST_INCREMENT:
+      AsmWrite(AsmAddress(operand), value);
+      asm_model.r.w[operand->reg] = (asm_model.r.w[operand->reg] + 2) & 0xFFFF;
+      return;
+    }
+  AsmError("bad destination operand", operand->name);
+}
+
+
+static void AsmFlags(unsigned int result, unsigned int carry) {
+  asm_model.r.z = ((result & 0xFFFF) == 0);
+  asm_model.r.n = (result >> 15) & 1;
+  asm_model.r.c = carry;
+}
+
+
+static unsigned int AsmCondition(unsigned int condition) {
+  switch (condition)
+    {
+    case ASM_Z:   return asm_model.r.z;
+    case ASM_NZ:  return !asm_model.r.z;
+    case ASM_C:   return asm_model.r.c;
+    case ASM_NC:  return !asm_model.r.c;
+    case ASM_N:   return asm_model.r.n;
+    case ASM_NN:  return !asm_model.r.n;
+    case ASM_LEU: return (!asm_model.r.c || asm_model.r.z);
+    case ASM_GTU: return (asm_model.r.c && !asm_model.r.z);
+    }
+  return 1;
+}
+
+
+static unsigned int AsmBitOperand(const AsmOperand* operand, unsigned int* address) {
+  // BSET, BCLR, BTSS and BTSC on a working register or on a word in memory
+  if (operand->mode == ASM_OPERAND_REGISTER) {
+    return asm_model.r.w[operand->reg];
+  }
+  if (operand->mode != ASM_OPERAND_INDIRECT) {
+    AsmError("bit operand must be Wn or [Wn]", NULL);
+  }
+  *address = AsmAddress(operand);
+  return AsmRead(*address);
+}
+
+
+static unsigned int AsmCall(const char* routine, const unsigned int* argument, unsigned int arguments, unsigned long preempt, AsmInterrupt interrupt) {
+  /*
+    Runs the routine with W0.. set to the arguments and returns W0
+    When interrupt is not NULL it is called once, before the instruction that follows the first (preempt) instructions
+    (after the RETURN if the routine is shorter than that).  The registers are saved and restored around it.
+  */
+  const AsmInstruction* instruction;
+  AsmRegisters saved;
+  unsigned int preserved[8];
+  unsigned long steps;
+  unsigned long cycles;
+  unsigned int pc;
+  unsigned int a;
+  unsigned int b;
+  unsigned int address;
+  unsigned long product;
+  unsigned int n;
+  int index;
+
+  index = AsmFindSymbol(asm_model.label, asm_model.labels, routine);
+  if (index < 0) {
+    fprintf(stderr, "%s: %s is missing\n", asm_model.file, routine);
+    exit(2);
+  }
+  pc = asm_model.label[index].value;
+
+  // Every register starts with a random value, the routine may only rely on its arguments
+  for (n = 0; n < 16; n++) {
+    asm_model.r.w[n] = CheckRandom() & 0xFFFF;
+  }
+  for (n = 0; n < arguments; n++) {
+    asm_model.r.w[n] = argument[n] & 0xFFFF;
+  }
+  for (n = 0; n < 8; n++) {
+    preserved[n] = asm_model.r.w[8 + n];
+  }
+  asm_model.r.c = CheckRandom() & 1;
+  asm_model.r.z = CheckRandom() & 1;
+  asm_model.r.n = CheckRandom() & 1;
+
+  steps = 0;
+  cycles = 2;  // CALL
+  while (1) {
+    if (interrupt && (steps == preempt)) {
+      saved = asm_model.r;
+      interrupt();
+      asm_model.r = saved;
+      interrupt = NULL;
+    }
+    if (pc >= asm_model.instructions) {
+      AsmError(routine, "runs past the last instruction");
+    }
+    instruction = &asm_model.instruction[pc];
+    asm_model.line = instruction->line;
+    steps++;
+    cycles++;
+    pc++;
+
+    switch (instruction->opcode)
+      {
+      case ASM_MOV:
+	AsmDestination(&instruction->operand[1], AsmSource(&instruction->operand[0]));
+	break;
+
+      case ASM_ADD:
+	a = AsmSource(&instruction->operand[0]);
+	b = AsmSource(&instruction->operand[1]);
+	AsmFlags(a + b, (a + b) > 0xFFFF);
+	AsmDestination(&instruction->operand[2], a + b);
+	break;
+
+      case ASM_SUB:
+	a = AsmSource(&instruction->operand[0]);
+	b = AsmSource(&instruction->operand[1]);
+	AsmFlags(a - b, a >= b);
+	AsmDestination(&instruction->operand[2], a - b);
+	break;
+
+      case ASM_AND:
+	a = AsmSource(&instruction->operand[0]);
+	b = AsmSource(&instruction->operand[1]);
+	AsmFlags(a & b, asm_model.r.c);
+	AsmDestination(&instruction->operand[2], a & b);
+	break;
+
+      case ASM_INC:
+	a = AsmSource(&instruction->operand[0]);
+	AsmFlags(a + 1, a == 0xFFFF);
+	AsmDestination(&instruction->operand[1], a + 1);
+	break;
+
+      case ASM_DEC:
+	a = AsmSource(&instruction->operand[0]);
+	AsmFlags(a - 1, a != 0);
+	AsmDestination(&instruction->operand[1], a - 1);
+	break;
+
+      case ASM_CP:
+	a = AsmSource(&instruction->operand[0]);
+	b = AsmSource(&instruction->operand[1]);
+	AsmFlags(a - b, a >= b);
+	break;
+
+      case ASM_CP0:
+	a = AsmSource(&instruction->operand[0]);
+	AsmFlags(a, 1);
+	break;
+
+      case ASM_MUL_UU:
+	// The 32 bit product goes to Wnd (low word) and Wnd+1 (high word)
+	if ((instruction->operand[2].mode != ASM_OPERAND_REGISTER) || (instruction->operand[2].reg & 1)) {
+	  AsmError("MUL.UU destination must be an even register", NULL);
+	}
+	product = (unsigned long)AsmSource(&instruction->operand[0]) * AsmSource(&instruction->operand[1]);
+	asm_model.r.w[instruction->operand[2].reg] = product & 0xFFFF;
+	asm_model.r.w[instruction->operand[2].reg + 1] = (product >> 16) & 0xFFFF;
+	break;
+
+      case ASM_CLR:
+	AsmDestination(&instruction->operand[0], 0);
+	break;
+
+      case ASM_BSET:
+      case ASM_BCLR:
+	address = 0;
+	a = AsmBitOperand(&instruction->operand[0], &address);
+	b = 1 << (AsmSource(&instruction->operand[1]) & 0x0F);
+	a = (instruction->opcode == ASM_BSET) ? (a | b) : (a & ~b);
+	if (instruction->operand[0].mode == ASM_OPERAND_REGISTER) {
+	  asm_model.r.w[instruction->operand[0].reg] = a;
+	} else {
+	  AsmWrite(address, a);
+	}
+	break;
+
+      case ASM_BTSS:
+      case ASM_BTSC:
+	// Skipping the next (one word) instruction takes an extra cycle
+	a = AsmBitOperand(&instruction->operand[0], &address);
+	b = (a >> (AsmSource(&instruction->operand[1]) & 0x0F)) & 1;
+	if (b == (instruction->opcode == ASM_BTSS)) {
+	  pc++;
+	  cycles++;
+	}
+	break;
+
+      case ASM_BRA:
+	if (AsmCondition(instruction->condition)) {
+	  pc = instruction->target;
+	  cycles++;
+	}
+	break;
+
+      case ASM_RETURN:
+	cycles += 2;
+	break;
+      }
+
+    if (instruction->opcode == ASM_RETURN) {
+      break;
+    }
+  }
+
+  if (interrupt) {
+    // The routine finished before the interrupt point
+    saved = asm_model.r;
+    interrupt();
+    asm_model.r = saved;
+  }
+
+  for (n = 0; n < 8; n++) {
+    if (asm_model.r.w[8 + n] != preserved[n]) {
+      AsmError(routine, "changed a register that the caller expects to be preserved (W8-W15)");
+    }
+  }
+  asm_model.steps = steps;
+  asm_model.cycles = cycles;
+  return asm_model.r.w[0];
+}
+
+
+// ---------- Buffer state ---------------
+
+#define CHECK_MAX_DEPTH               256
+#define CHECK_MAX_READ                16
+#define CHECK_MAX_OUTCOMES            64
+#define CHECK_POISON                  0xBEEF
+#define CHECK_BAD_POINTER             0xDEAD
+#define CHECK_NOT_A_FRAME             0x10000
+
+// CAN SFR block, SID then 2 unused words, the 4 data words and CxRXxCON / CxTXxCON (same spacing as the dsPIC)
+#define CHECK_SFR_SID                 0
+#define CHECK_SFR_DATA                3
+#define CHECK_SFR_CON                 7
+#define CHECK_SFR_WORDS               8
+
+// Data memory of the model
+#define MODEL_RX_SFR                  0x0300
+#define MODEL_TX_SFR                  0x0320
+#define MODEL_BUFFER                  0x0800
+#define MODEL_OUT                     0x0900
+#define MODEL_INPUT                   0x0A80
+#define MODEL_PEEK                    0x0AA0
+#define MODEL_ROWS                    0x1000
+
+
+typedef struct {
+  // ETMCanBuffer
+  unsigned int write_index;
+  unsigned int read_index;
+  unsigned int write_count;
+  unsigned int overwrite_count;
+  unsigned int high_water;
+  unsigned int index_mask;
+  unsigned int high_water_clear;
+  unsigned int row[CHECK_MAX_DEPTH][5];
+
+  unsigned int rx_sfr[CHECK_SFR_WORDS];
+  unsigned int tx_sfr[CHECK_SFR_WORDS];
+
+  // Returned by the call
+  unsigned int out[CHECK_MAX_READ][5];
+  unsigned int result;
+  unsigned int peek_row;
+} CheckState;
+
+enum {
+  CHECK_RX_MESSAGE_BUFFER, CHECK_RX_MESSAGE, CHECK_TX_MESSAGE_BUFFER, CHECK_TX_MESSAGE, CHECK_ADD, CHECK_READ,
+  CHECK_READ_MESSAGES, CHECK_PEEK, CHECK_COMMIT, CHECK_INITIALIZE, CHECK_ROWS_AVAILABLE, CHECK_NOT_EMPTY,
+  CHECK_RX_INTERRUPT, CHECK_TX_INTERRUPT, CHECK_OPERATIONS
+};
+
+static const char* check_operation_name[CHECK_OPERATIONS] = {
+  "ETMCanRXMessageBuffer", "ETMCanRXMessage", "ETMCanTXMessageBuffer", "ETMCanTXMessage", "ETMCanAddMessageToBuffer",
+  "ETMCanReadMessageFromBuffer", "ETMCanReadMessagesFromBuffer", "ETMCanBufferPeek", "ETMCanBufferCommit",
+  "ETMCanBufferInitialize", "ETMCanBufferRowsAvailable", "ETMCanBufferNotEmpty",
+  "RX interrupt", "TX interrupt"
+};
+
+/*
+  The interrupt in the interleaving check can handle more than one frame, like the CAN ISR does when both RX buffers are
+  full or when a TX buffer finishes while it runs.  This lets the other side of the buffer be lapped in one call.
+   - CHECK_RX_INTERRUPT: (argument) frames, from sequence number (sequence), arrive in the RX buffer one after the other
+     and each one is moved to the message buffer with ETMCanRXMessageBuffer
+   - CHECK_TX_INTERRUPT: up to (argument) messages are moved to the TX buffer with ETMCanTXMessageBuffer.  Each one that
+     is loaded is copied to out[] and, unless it is the last, sent (TXREQ is cleared).  Nothing is loaded while TXREQ is
+     set when the interrupt starts.
+*/
+typedef struct {
+  unsigned int code;
+  unsigned int argument;              // max_messages, messages or frames
+  unsigned int sequence;              // First frame of CHECK_RX_INTERRUPT
+  unsigned int message[5];            // ETMCanAddMessageToBuffer and ETMCanTXMessage
+} CheckOperation;
+
+typedef struct {
+  const char* name;
+  void (*load)(const CheckState* state);
+  void (*save)(CheckState* state);
+  void (*run)(const CheckOperation* operation, const CheckOperation* interrupt, unsigned long preempt, unsigned long* steps);
+} CheckImplementation;
+
+
+// ---------- C version ---------------
+
+static ETMCanBuffer     check_c_buffer;
+static ETMCanMessage           check_c_row[CHECK_MAX_DEPTH];
+static unsigned int            check_c_time_stamp[CHECK_MAX_DEPTH];
+static volatile unsigned int   check_c_rx_sfr[CHECK_SFR_WORDS];
+static volatile unsigned int   check_c_tx_sfr[CHECK_SFR_WORDS];
+static ETMCanMessage           check_c_out[CHECK_MAX_READ];
+static ETMCanMessage           check_c_input;
+static ETMCanMessage*          check_c_peek;
+static unsigned int            check_c_result;
+
+static volatile unsigned long        check_trap_steps;
+static volatile unsigned long        check_trap_preempt;
+static volatile unsigned int         check_trap_pending;
+static const CheckOperation*         check_trap_interrupt;
+
+// Set / clear the trap flag, the kernel sends SIGTRAP after every instruction while it is set
+#define CHECK_TRAP_ON()  __asm__ volatile ("sub $128, %%rsp\n\tpushfq\n\torq $0x100, (%%rsp)\n\tpopfq\n\tadd $128, %%rsp" ::: "memory", "cc")
+#define CHECK_TRAP_OFF() __asm__ volatile ("sub $128, %%rsp\n\tpushfq\n\tandq $~0x100, (%%rsp)\n\tpopfq\n\tadd $128, %%rsp" ::: "memory", "cc")
+
+
+static void CheckFrame(unsigned int* word, unsigned int sequence);
+
+
+static void CheckMessageToWords(unsigned int* word, const ETMCanMessage* message) {
+  word[0] = message->identifier & 0xFFFF;
+  word[1] = message->word0 & 0xFFFF;
+  word[2] = message->word1 & 0xFFFF;
+  word[3] = message->word2 & 0xFFFF;
+  word[4] = message->word3 & 0xFFFF;
+}
+
+
+static void CheckWordsToMessage(ETMCanMessage* message, const unsigned int* word) {
+  message->identifier = word[0];
+  message->word0 = word[1];
+  message->word1 = word[2];
+  message->word2 = word[3];
+  message->word3 = word[4];
+}
+
+
+static void CheckLoadC(const CheckState* state) {
+  unsigned int n;
+
+  check_c_buffer.message_write_index = state->write_index;
+  check_c_buffer.message_read_index = state->read_index;
+  check_c_buffer.message_write_count = state->write_count;
+  check_c_buffer.message_overwrite_count = state->overwrite_count;
+  check_c_buffer.message_high_water = state->high_water;
+  check_c_buffer.message_index_mask = state->index_mask;
+  check_c_buffer.message_data = check_c_row;
+  check_c_buffer.message_time_stamp = check_c_time_stamp;
+  check_c_buffer.message_high_water_clear = state->high_water_clear;
+  for (n = 0; n < CHECK_MAX_DEPTH; n++) {
+    CheckWordsToMessage(&check_c_row[n], state->row[n]);
+  }
+  for (n = 0; n < CHECK_SFR_WORDS; n++) {
+    check_c_rx_sfr[n] = state->rx_sfr[n];
+    check_c_tx_sfr[n] = state->tx_sfr[n];
+  }
+  for (n = 0; n < CHECK_MAX_READ; n++) {
+    CheckWordsToMessage(&check_c_out[n], state->out[n]);
+  }
+  check_c_result = state->result;
+  check_c_peek = NULL;
+  if (state->peek_row != CHECK_POISON) {
+    check_c_peek = check_c_row + state->peek_row;
+  }
+}
+
+
+static void CheckSaveC(CheckState* state) {
+  unsigned int n;
+
+  state->write_index = check_c_buffer.message_write_index & 0xFFFF;
+  state->read_index = check_c_buffer.message_read_index & 0xFFFF;
+  state->write_count = check_c_buffer.message_write_count & 0xFFFF;
+  state->overwrite_count = check_c_buffer.message_overwrite_count & 0xFFFF;
+  state->high_water = check_c_buffer.message_high_water & 0xFFFF;
+  state->index_mask = check_c_buffer.message_index_mask & 0xFFFF;
+  state->high_water_clear = check_c_buffer.message_high_water_clear & 0xFFFF;
+  for (n = 0; n < CHECK_MAX_DEPTH; n++) {
+    CheckMessageToWords(state->row[n], &check_c_row[n]);
+  }
+  for (n = 0; n < CHECK_SFR_WORDS; n++) {
+    state->rx_sfr[n] = check_c_rx_sfr[n] & 0xFFFF;
+    state->tx_sfr[n] = check_c_tx_sfr[n] & 0xFFFF;
+  }
+  for (n = 0; n < CHECK_MAX_READ; n++) {
+    CheckMessageToWords(state->out[n], &check_c_out[n]);
+  }
+  state->result = check_c_result & 0xFFFF;
+  state->peek_row = CHECK_POISON;
+  if (check_c_peek) {
+    state->peek_row = CHECK_BAD_POINTER;
+    if ((check_c_peek >= check_c_row) && (check_c_peek < (check_c_row + CHECK_MAX_DEPTH))) {
+      state->peek_row = check_c_peek - check_c_row;
+    }
+  }
+}
+
+
+static void CheckCallC(const CheckOperation* operation) {
+  unsigned int frame[5];
+  unsigned int n;
+  unsigned int word;
+
+  switch (operation->code)
+    {
+    case CHECK_RX_MESSAGE_BUFFER:
+      ETMCanRXMessageBuffer(&check_c_buffer, &check_c_rx_sfr[CHECK_SFR_CON]);
+      break;
+
+    case CHECK_RX_MESSAGE:
+      ETMCanRXMessage(&check_c_out[0], &check_c_rx_sfr[CHECK_SFR_CON]);
+      break;
+
+    case CHECK_TX_MESSAGE_BUFFER:
+      ETMCanTXMessageBuffer(&check_c_buffer, &check_c_tx_sfr[CHECK_SFR_CON]);
+      break;
+
+    case CHECK_TX_MESSAGE:
+      CheckWordsToMessage(&check_c_input, operation->message);
+      ETMCanTXMessage(&check_c_input, &check_c_tx_sfr[CHECK_SFR_CON]);
+      break;
+
+    case CHECK_ADD:
+      CheckWordsToMessage(&check_c_input, operation->message);
+      ETMCanAddMessageToBuffer(&check_c_buffer, &check_c_input);
+      break;
+
+    case CHECK_READ:
+      ETMCanReadMessageFromBuffer(&check_c_buffer, &check_c_out[0]);
+      break;
+
+    case CHECK_READ_MESSAGES:
+      check_c_result = ETMCanReadMessagesFromBuffer(&check_c_buffer, check_c_out, operation->argument);
+      break;
+
+    case CHECK_PEEK:
+      check_c_result = ETMCanBufferPeek(&check_c_buffer, &check_c_peek);
+      break;
+
+    case CHECK_COMMIT:
+      ETMCanBufferCommit(&check_c_buffer, operation->argument);
+      break;
+
+    case CHECK_INITIALIZE:
+      ETMCanBufferInitialize(&check_c_buffer);
+      break;
+
+    case CHECK_ROWS_AVAILABLE:
+      check_c_result = ETMCanBufferRowsAvailable(&check_c_buffer);
+      break;
+
+    case CHECK_NOT_EMPTY:
+      check_c_result = ETMCanBufferNotEmpty(&check_c_buffer);
+      break;
+
+    case CHECK_RX_INTERRUPT:
+      for (n = 0; n < operation->argument; n++) {
+	CheckFrame(frame, operation->sequence + n);
+	check_c_rx_sfr[CHECK_SFR_SID] = frame[0];
+	for (word = 0; word < 4; word++) {
+	  check_c_rx_sfr[CHECK_SFR_DATA + word] = frame[word + 1];
+	}
+	check_c_rx_sfr[CHECK_SFR_CON] |= BUFFER_FULL_BIT;
+	ETMCanRXMessageBuffer(&check_c_buffer, &check_c_rx_sfr[CHECK_SFR_CON]);
+      }
+      break;
+
+    case CHECK_TX_INTERRUPT:
+      for (n = 0; (n < operation->argument) && !(check_c_tx_sfr[CHECK_SFR_CON] & TX_REQ_BIT); n++) {
+	ETMCanTXMessageBuffer(&check_c_buffer, &check_c_tx_sfr[CHECK_SFR_CON]);
+	if (!(check_c_tx_sfr[CHECK_SFR_CON] & TX_REQ_BIT)) {
+	  break;
+	}
+	check_c_out[n].identifier = check_c_tx_sfr[CHECK_SFR_SID];
+	check_c_out[n].word0 = check_c_tx_sfr[CHECK_SFR_DATA];
+	check_c_out[n].word1 = check_c_tx_sfr[CHECK_SFR_DATA + 1];
+	check_c_out[n].word2 = check_c_tx_sfr[CHECK_SFR_DATA + 2];
+	check_c_out[n].word3 = check_c_tx_sfr[CHECK_SFR_DATA + 3];
+	if ((n + 1) < operation->argument) {
+	  check_c_tx_sfr[CHECK_SFR_CON] &= ~TX_REQ_BIT;
+	}
+      }
+      break;
+    }
+}
+
+
+static void CheckTrap(int signal, siginfo_t* info, void* context) {
+  ucontext_t* user_context = context;
+
+  check_trap_steps++;
+  if (check_trap_pending && (check_trap_steps == check_trap_preempt)) {
+    // The interrupt runs with the trap flag clear, stop single stepping once it has been run
+    CheckCallC(check_trap_interrupt);
+    check_trap_pending = 0;
+    user_context->uc_mcontext.gregs[REG_EFL] &= ~0x100;
+  }
+}
+
+
+static void CheckRunC(const CheckOperation* operation, const CheckOperation* interrupt, unsigned long preempt, unsigned long* steps) {
+  check_trap_steps = 0;
+  check_trap_preempt = preempt;
+  check_trap_interrupt = interrupt;
+  check_trap_pending = (interrupt != NULL);
+
+  if (check_trap_pending && (preempt == 0)) {
+    CheckCallC(interrupt);
+    check_trap_pending = 0;
+  }
+
+  if (check_trap_pending || steps) {
+    CHECK_TRAP_ON();
+    CheckCallC(operation);
+    CHECK_TRAP_OFF();
+  } else {
+    CheckCallC(operation);
+  }
+
+  if (check_trap_pending) {
+    // The call finished before the interrupt point
+    CheckCallC(interrupt);
+    check_trap_pending = 0;
+  }
+  if (steps) {
+    *steps = check_trap_steps;
+  }
+}
+
+
+static const CheckImplementation check_c = {"P1395_CAN_CORE.c", CheckLoadC, CheckSaveC, CheckRunC};
+
+
+// ---------- Assembly version ---------------
+
+static const CheckOperation* check_asm_interrupt;
+static unsigned int check_asm_result;
+
+
+static void CheckModelWritable(unsigned int address, unsigned int words) {
+  while (words--) {
+    asm_model.writable[address >> 1] = 1;
+    address += 2;
+  }
+}
+
+
+static void CheckModelPut(unsigned int address, const unsigned int* word, unsigned int words) {
+  while (words--) {
+    asm_model.memory[address >> 1] = *word++ & 0xFFFF;
+    address += 2;
+  }
+}
+
+
+static void CheckModelGet(unsigned int* word, unsigned int address, unsigned int words) {
+  while (words--) {
+    *word++ = asm_model.memory[address >> 1];
+    address += 2;
+  }
+}
+
+
+static void CheckLoadAsm(const CheckState* state) {
+  unsigned int word[9];
+  unsigned int n;
+
+  word[0] = state->write_index;
+  word[1] = state->read_index;
+  word[2] = state->write_count;
+  word[3] = state->overwrite_count;
+  word[4] = state->high_water;
+  word[5] = state->index_mask;
+  word[6] = MODEL_ROWS;
+  word[7] = 0;
+  word[8] = state->high_water_clear;
+  CheckModelPut(MODEL_BUFFER, word, 9);
+  for (n = 0; n < CHECK_MAX_DEPTH; n++) {
+    CheckModelPut(MODEL_ROWS + n * 10, state->row[n], 5);
+  }
+  CheckModelPut(MODEL_RX_SFR, state->rx_sfr, CHECK_SFR_WORDS);
+  CheckModelPut(MODEL_TX_SFR, state->tx_sfr, CHECK_SFR_WORDS);
+  for (n = 0; n < CHECK_MAX_READ; n++) {
+    CheckModelPut(MODEL_OUT + n * 10, state->out[n], 5);
+  }
+  check_asm_result = state->result;
+  word[0] = 0;
+  if (state->peek_row != CHECK_POISON) {
+    word[0] = MODEL_ROWS + state->peek_row * 10;
+  }
+  CheckModelPut(MODEL_PEEK, word, 1);
+}
+
+
+static void CheckSaveAsm(CheckState* state) {
+  unsigned int word[9];
+  unsigned int n;
+
+  CheckModelGet(word, MODEL_BUFFER, 9);
+  state->write_index = word[0];
+  state->read_index = word[1];
+  state->write_count = word[2];
+  state->overwrite_count = word[3];
+  state->high_water = word[4];
+  state->index_mask = word[5];
+  state->high_water_clear = word[8];
+  for (n = 0; n < CHECK_MAX_DEPTH; n++) {
+    CheckModelGet(state->row[n], MODEL_ROWS + n * 10, 5);
+  }
+  CheckModelGet(state->rx_sfr, MODEL_RX_SFR, CHECK_SFR_WORDS);
+  CheckModelGet(state->tx_sfr, MODEL_TX_SFR, CHECK_SFR_WORDS);
+  for (n = 0; n < CHECK_MAX_READ; n++) {
+    CheckModelGet(state->out[n], MODEL_OUT + n * 10, 5);
+  }
+  state->result = check_asm_result & 0xFFFF;
+  CheckModelGet(word, MODEL_PEEK, 1);
+  state->peek_row = CHECK_POISON;
+  if (word[0]) {
+    state->peek_row = CHECK_BAD_POINTER;
+    if ((word[0] >= MODEL_ROWS) && (word[0] < (MODEL_ROWS + CHECK_MAX_DEPTH * 10)) && (((word[0] - MODEL_ROWS) % 10) == 0)) {
+      state->peek_row = (word[0] - MODEL_ROWS) / 10;
+    }
+  }
+}
+
+
+static void CheckInterruptAsm(void);
+
+static void CheckCallAsm(const CheckOperation* operation, unsigned long preempt) {
+  CheckOperation call;
+  unsigned int argument[3];
+  unsigned int frame[5];
+  unsigned int con;
+  const char* routine;
+  AsmInterrupt interrupt;
+  unsigned int result;
+  unsigned int n;
+
+  if (operation->code == CHECK_RX_INTERRUPT) {
+    // The same frames as CheckCallC()
+    memset(&call, 0, sizeof(call));
+    call.code = CHECK_RX_MESSAGE_BUFFER;
+    for (n = 0; n < operation->argument; n++) {
+      CheckFrame(frame, operation->sequence + n);
+      CheckModelPut(MODEL_RX_SFR + 2 * CHECK_SFR_SID, &frame[0], 1);
+      CheckModelPut(MODEL_RX_SFR + 2 * CHECK_SFR_DATA, &frame[1], 4);
+      CheckModelGet(&con, MODEL_RX_SFR + 2 * CHECK_SFR_CON, 1);
+      con |= BUFFER_FULL_BIT;
+      CheckModelPut(MODEL_RX_SFR + 2 * CHECK_SFR_CON, &con, 1);
+      CheckCallAsm(&call, ASM_NO_PREEMPT);
+    }
+    return;
+  }
+
+  if (operation->code == CHECK_TX_INTERRUPT) {
+    memset(&call, 0, sizeof(call));
+    call.code = CHECK_TX_MESSAGE_BUFFER;
+    for (n = 0; n < operation->argument; n++) {
+      CheckModelGet(&con, MODEL_TX_SFR + 2 * CHECK_SFR_CON, 1);
+      if (con & TX_REQ_BIT) {
+	break;
+      }
+      CheckCallAsm(&call, ASM_NO_PREEMPT);
+      CheckModelGet(&con, MODEL_TX_SFR + 2 * CHECK_SFR_CON, 1);
+      if (!(con & TX_REQ_BIT)) {
+	break;
+      }
+      CheckModelGet(&frame[0], MODEL_TX_SFR + 2 * CHECK_SFR_SID, 1);
+      CheckModelGet(&frame[1], MODEL_TX_SFR + 2 * CHECK_SFR_DATA, 4);
+      CheckModelPut(MODEL_OUT + n * 10, frame, 5);
+      if ((n + 1) < operation->argument) {
+	con &= ~TX_REQ_BIT;
+	CheckModelPut(MODEL_TX_SFR + 2 * CHECK_SFR_CON, &con, 1);
+      }
+    }
+    return;
+  }
+
+  interrupt = (preempt == ASM_NO_PREEMPT) ? NULL : CheckInterruptAsm;
+  routine = NULL;
+  argument[0] = MODEL_BUFFER;
+  argument[1] = 0;
+  argument[2] = operation->argument;
+  switch (operation->code)
+    {
+    case CHECK_RX_MESSAGE_BUFFER: routine = "_ETMCanRXMessageBuffer"; argument[1] = MODEL_RX_SFR + 2 * CHECK_SFR_CON; break;
+    case CHECK_RX_MESSAGE:        routine = "_ETMCanRXMessage"; argument[0] = MODEL_OUT; argument[1] = MODEL_RX_SFR + 2 * CHECK_SFR_CON; break;
+    case CHECK_TX_MESSAGE_BUFFER: routine = "_ETMCanTXMessageBuffer"; argument[1] = MODEL_TX_SFR + 2 * CHECK_SFR_CON; break;
+    case CHECK_TX_MESSAGE:        routine = "_ETMCanTXMessage"; argument[0] = MODEL_INPUT; argument[1] = MODEL_TX_SFR + 2 * CHECK_SFR_CON; break;
+    case CHECK_ADD:               routine = "_ETMCanAddMessageToBuffer"; argument[1] = MODEL_INPUT; break;
+    case CHECK_READ:              routine = "_ETMCanReadMessageFromBuffer"; argument[1] = MODEL_OUT; break;
+    case CHECK_READ_MESSAGES:     routine = "_ETMCanReadMessagesFromBuffer"; argument[1] = MODEL_OUT; break;
+    case CHECK_PEEK:              routine = "_ETMCanBufferPeek"; argument[1] = MODEL_PEEK; break;
+    case CHECK_COMMIT:            routine = "_ETMCanBufferCommit"; argument[1] = operation->argument; break;
+    case CHECK_INITIALIZE:        routine = "_ETMCanBufferInitialize"; break;
+    case CHECK_ROWS_AVAILABLE:    routine = "_ETMCanBufferRowsAvailable"; break;
+    case CHECK_NOT_EMPTY:         routine = "_ETMCanBufferNotEmpty"; break;
+    }
+  if ((operation->code == CHECK_ADD) || (operation->code == CHECK_TX_MESSAGE)) {
+    CheckModelPut(MODEL_INPUT, operation->message, 5);
+  }
+
+  result = AsmCall(routine, argument, 3, preempt, interrupt);
+  if ((operation->code == CHECK_READ_MESSAGES) || (operation->code == CHECK_PEEK) ||
+      (operation->code == CHECK_ROWS_AVAILABLE) || (operation->code == CHECK_NOT_EMPTY)) {
+    check_asm_result = result;
+  }
+}
+
+
+static void CheckInterruptAsm(void) {
+  CheckCallAsm(check_asm_interrupt, ASM_NO_PREEMPT);
+}
+
+
+static void CheckRunAsm(const CheckOperation* operation, const CheckOperation* interrupt, unsigned long preempt, unsigned long* steps) {
+  check_asm_interrupt = interrupt;
+  CheckCallAsm(operation, interrupt ? preempt : ASM_NO_PREEMPT);
+  if (steps) {
+    *steps = asm_model.steps;
+  }
+}
+
+
+static const CheckImplementation check_asm = {"P1395_CAN_CORE.s", CheckLoadAsm, CheckSaveAsm, CheckRunAsm};
+
+
+static void CheckModelInitialize(void) {
+  unsigned int n;
+
+  for (n = 0; n < ASM_MEMORY_WORDS; n++) {
+    asm_model.memory[n] = CheckRandom() & 0xFFFF;
+  }
+  memset(asm_model.writable, 0, sizeof(asm_model.writable));
+  CheckModelWritable(MODEL_RX_SFR, CHECK_SFR_WORDS);
+  CheckModelWritable(MODEL_TX_SFR, CHECK_SFR_WORDS);
+  CheckModelWritable(MODEL_BUFFER, 5);                   // The index mask and the pointers are never written
+  CheckModelWritable(MODEL_BUFFER + 0x10, 1);            // message_high_water_clear
+  CheckModelWritable(MODEL_OUT, CHECK_MAX_READ * 5);
+  CheckModelWritable(MODEL_PEEK, 1);
+  CheckModelWritable(MODEL_ROWS, CHECK_MAX_DEPTH * 5);
+}
+
+
+// ---------- Checks ---------------
+
+static unsigned long check_calls;
+static unsigned long check_interleavings;
+static unsigned long check_outcomes;
+
+
+static void CheckPrintState(const char* name, const CheckState* state) {
+  unsigned int n;
+
+  fprintf(stderr, "  %-17s write %u read %u write_count %u overwrite_count %u high_water %u (clear %u) mask 0x%X result 0x%04X peek_row 0x%X\n",
+	  name, state->write_index, state->read_index, state->write_count, state->overwrite_count, state->high_water,
+	  state->high_water_clear, state->index_mask, state->result, state->peek_row);
+  fprintf(stderr, "  %-17s rx_sfr", "");
+  for (n = 0; n < CHECK_SFR_WORDS; n++) {
+    fprintf(stderr, " %04X", state->rx_sfr[n]);
+  }
+  fprintf(stderr, "  tx_sfr");
+  for (n = 0; n < CHECK_SFR_WORDS; n++) {
+    fprintf(stderr, " %04X", state->tx_sfr[n]);
+  }
+  fprintf(stderr, "\n  %-17s out[0] %04X %04X %04X %04X %04X\n", "", state->out[0][0], state->out[0][1], state->out[0][2],
+	  state->out[0][3], state->out[0][4]);
+}
+
+
+static void CheckFail(const char* message, const CheckOperation* operation, const CheckState* start) {
+  fprintf(stderr, "FAIL: %s\n  call %s(%u)\n", message, check_operation_name[operation->code], operation->argument);
+  CheckPrintState("before", start);
+  exit(1);
+}
+
+
+static void CheckPoisonOutputs(CheckState* state) {
+  unsigned int n;
+  unsigned int word;
+
+  for (n = 0; n < CHECK_MAX_READ; n++) {
+    for (word = 0; word < 5; word++) {
+      state->out[n][word] = CHECK_POISON;
+    }
+  }
+  state->result = CHECK_POISON;
+  state->peek_row = CHECK_POISON;
+}
+
+
+static void CheckRandomWords(unsigned int* word, unsigned int words) {
+  while (words--) {
+    *word++ = CheckRandom() & 0xFFFF;
+  }
+}
+
+
+static void CheckLockstep(unsigned int depth, unsigned int calls) {
+  /*
+    Random calls with random data, both versions must leave exactly the same state
+    The producer and consumer calls are weighted in phases so that the buffer is full and empty in turn
+  */
+  static CheckState state;
+  static CheckState c_state;
+  static CheckState asm_state;
+  CheckOperation operation;
+  unsigned int call;
+  unsigned int fill_phase;
+  unsigned int n;
+
+  memset(&state, 0, sizeof(state));
+  for (n = 0; n < CHECK_MAX_DEPTH; n++) {
+    CheckRandomWords(state.row[n], 5);
+  }
+  CheckRandomWords(state.rx_sfr, CHECK_SFR_WORDS);
+  CheckRandomWords(state.tx_sfr, CHECK_SFR_WORDS);
+  state.index_mask = depth - 1;
+
+  fill_phase = 0;
+  for (call = 0; call < calls; call++) {
+    if ((call % 64) == 0) {
+      fill_phase = CheckRandom() % 3;
+    }
+    memset(&operation, 0, sizeof(operation));
+    CheckRandomWords(operation.message, 5);
+    n = CheckRandom() % 100;
+    if (n < 4) {
+      operation.code = CHECK_RX_MESSAGE;
+    } else if (n < 8) {
+      operation.code = CHECK_TX_MESSAGE;
+    } else if (n < 9) {
+      operation.code = CHECK_INITIALIZE;
+    } else if (n < 16) {
+      operation.code = CHECK_ROWS_AVAILABLE;
+    } else if (n < 23) {
+      operation.code = CHECK_NOT_EMPTY;
+    } else if (n < 30) {
+      operation.code = CHECK_PEEK;
+    } else if ((n < 65) == (fill_phase != 2)) {
+      // Producer
+      operation.code = (CheckRandom() & 1) ? CHECK_ADD : CHECK_RX_MESSAGE_BUFFER;
+    } else {
+      // Consumer
+      switch (CheckRandom() % 4)
+	{
+	case 0: operation.code = CHECK_READ; break;
+	case 1: operation.code = CHECK_READ_MESSAGES; operation.argument = CheckRandom() % (CHECK_MAX_READ + 1); break;
+	case 2: operation.code = CHECK_COMMIT; operation.argument = CheckRandom() % (((state.write_index - state.read_index) & state.index_mask) + 1); break;
+	case 3: operation.code = CHECK_TX_MESSAGE_BUFFER; break;
+	}
+    }
+    if (fill_phase == 1) {
+      // Keep the producer and consumer roughly even
+      if ((operation.code == CHECK_ADD) && (CheckRandom() & 1)) {
+	operation.code = CHECK_READ;
+      }
+    }
+
+    // The bus: a new frame in the RX buffer and the TX buffer finishing (or not), with random values in the other bits
+    if (CheckRandom() & 1) {
+      CheckRandomWords(state.rx_sfr, CHECK_SFR_WORDS);
+    }
+    if (CheckRandom() & 1) {
+      state.tx_sfr[CHECK_SFR_CON] = CheckRandom() & 0xFFFF;
+    }
+    if ((operation.code == CHECK_RX_MESSAGE_BUFFER) && (CheckRandom() % 4)) {
+      state.rx_sfr[CHECK_SFR_CON] |= BUFFER_FULL_BIT;
+    }
+    if ((operation.code == CHECK_TX_MESSAGE_BUFFER) && (CheckRandom() % 4)) {
+      state.tx_sfr[CHECK_SFR_CON] &= ~TX_REQ_BIT;
+    }
+    if ((CheckRandom() % 32) == 0) {
+      // ETMCanBufferClearHighWater
+      state.high_water_clear = 1;
+    }
+    CheckPoisonOutputs(&state);
+
+    check_c.load(&state);
+    check_c.run(&operation, NULL, 0, NULL);
+    check_c.save(&c_state);
+    check_asm.load(&state);
+    check_asm.run(&operation, NULL, 0, NULL);
+    check_asm.save(&asm_state);
+    if (memcmp(&c_state, &asm_state, sizeof(CheckState)) != 0) {
+      CheckPrintState(check_c.name, &c_state);
+      CheckPrintState(check_asm.name, &asm_state);
+      CheckFail("the C and assembly versions do not match", &operation, &state);
+    }
+    state = c_state;
+    check_calls++;
+  }
+}
+
+
+// ---------- Interleaving ---------------
+
+/*
+  Every frame carries its sequence number in all five words so that a torn row or a repeated or reordered frame is seen
+*/
+
+typedef struct {
+  unsigned int offered;               // Frames given to the producer (16 bit, compared with message_write_count)
+  unsigned int delivered;             // Frames that have come out of the consumer
+  unsigned int next_sequence;
+  unsigned int last_sequence;         // Sequence number of the last frame that came out of the consumer
+  unsigned int peeked;                // Messages returned by the last ETMCanBufferPeek that have not been committed
+} CheckStream;
+
+
+static void CheckFrame(unsigned int* word, unsigned int sequence) {
+  sequence &= 0xFFFF;
+  word[0] = sequence ^ 0x1234;
+  word[1] = sequence;
+  word[2] = sequence ^ 0x5A5A;
+  word[3] = ~sequence & 0xFFFF;
+  word[4] = (sequence * 7 + 1) & 0xFFFF;
+}
+
+
+static unsigned int CheckFrameSequence(const unsigned int* word) {
+  unsigned int expected[5];
+
+  CheckFrame(expected, word[1]);
+  if (memcmp(expected, word, sizeof(expected)) != 0) {
+    return CHECK_NOT_A_FRAME;
+  }
+  return word[1];
+}
+
+
+static void CheckOffer(CheckOperation* operation, CheckStream* stream, unsigned int frames) {
+  // The next frames go to the producer, ETMCanAddMessageToBuffer (one frame) or the RX interrupt
+  CheckFrame(operation->message, stream->next_sequence);
+  operation->sequence = stream->next_sequence;
+  operation->argument = frames;
+  stream->next_sequence = (stream->next_sequence + frames) & 0xFFFF;
+  stream->offered += frames;
+}
+
+
+static void CheckDeliver(const unsigned int* word, CheckStream* stream, const CheckOperation* operation, const CheckState* start) {
+  unsigned int sequence;
+
+  sequence = CheckFrameSequence(word);
+  if (sequence == CHECK_NOT_A_FRAME) {
+    CheckFail("the consumer got a torn or invalid row", operation, start);
+  }
+  if ((stream->delivered != 0) && ((short)(sequence - stream->last_sequence) <= 0)) {
+    CheckFail("the consumer got a frame out of order or twice", operation, start);
+  }
+  stream->last_sequence = sequence;
+  stream->delivered++;
+}
+
+
+static unsigned int CheckContiguous(unsigned int read_index, unsigned int write_index, unsigned int index_mask) {
+  if (write_index >= read_index) {
+    return (write_index - read_index);
+  }
+  return (index_mask + 1 - read_index);
+}
+
+
+static void CheckOutcome(const CheckState* start, const CheckState* outcome, const CheckOperation* operation,
+			 unsigned int rx, const CheckStream* stream_in, CheckStream* stream_out) {
+  /*
+    Checks one state that the interrupt can leave against the FIFO rules and works out what the consumer took out
+    rx = 1: the interrupt is the producer (CHECK_RX_INTERRUPT) and the main loop call is the consumer
+    rx = 0: the main loop call is the producer (ETMCanAddMessageToBuffer) and the interrupt is the consumer (CHECK_TX_INTERRUPT)
+  */
+  CheckStream stream;
+  unsigned int frame[5];
+  unsigned int index_mask;
+  unsigned int rows_in_use;
+  unsigned int before;
+  unsigned int after;
+  unsigned int index;
+  unsigned int sequence;
+  unsigned int previous;
+  unsigned int stored;
+  unsigned int sent;
+  unsigned int n;
+
+  stream = *stream_in;
+  index_mask = start->index_mask;
+  if ((outcome->index_mask != index_mask) || (outcome->write_index > index_mask) || (outcome->read_index > index_mask)) {
+    CheckFail("the buffer indexes are out of range", operation, start);
+  }
+
+  // What came out of the consumer
+  if (rx) {
+    if (outcome->rx_sfr[CHECK_SFR_CON] != (start->rx_sfr[CHECK_SFR_CON] & ~BUFFER_FULL_BIT)) {
+      CheckFail("RXFUL is not cleared or another CxRXxCON bit changed", operation, start);
+    }
+    switch (operation->code)
+      {
+      case CHECK_READ:
+	if (CheckFrameSequence(outcome->out[0]) != CHECK_NOT_A_FRAME) {
+	  CheckDeliver(outcome->out[0], &stream, operation, start);
+	} else if ((outcome->out[0][0] != 0x17F8) || outcome->out[0][1] || outcome->out[0][2] || outcome->out[0][3] ||
+		   outcome->out[0][4] || (outcome->read_index != start->read_index)) {
+	  CheckFail("ETMCanReadMessageFromBuffer returned a torn row", operation, start);
+	}
+	stream.peeked = 0;
+	break;
+
+      case CHECK_READ_MESSAGES:
+	if (outcome->result > operation->argument) {
+	  CheckFail("ETMCanReadMessagesFromBuffer returned too many messages", operation, start);
+	}
+	for (n = 0; n < outcome->result; n++) {
+	  CheckDeliver(outcome->out[n], &stream, operation, start);
+	}
+	stream.peeked = 0;
+	break;
+
+      case CHECK_PEEK:
+	// The span must end at the write index from before or after the interrupt
+	if (outcome->peek_row != start->read_index) {
+	  CheckFail("ETMCanBufferPeek did not return the oldest row", operation, start);
+	}
+	if ((outcome->result != CheckContiguous(start->read_index, start->write_index, index_mask)) &&
+	    (outcome->result != CheckContiguous(start->read_index, outcome->write_index, index_mask))) {
+	  CheckFail("ETMCanBufferPeek returned the wrong number of messages", operation, start);
+	}
+	stream.peeked = outcome->result;
+	break;
+
+      case CHECK_COMMIT:
+	// The consumer has processed the committed rows in place before this call
+	for (n = 0; n < operation->argument; n++) {
+	  CheckDeliver(start->row[(start->read_index + n) & index_mask], &stream, operation, start);
+	}
+	stream.peeked -= operation->argument;
+	break;
+      }
+
+    // The rows from ETMCanBufferPeek that are not committed yet must not be written by the producer
+    if ((operation->code == CHECK_PEEK) || (operation->code == CHECK_COMMIT) ||
+	(operation->code == CHECK_NOT_EMPTY) || (operation->code == CHECK_ROWS_AVAILABLE)) {
+      for (n = (operation->code == CHECK_COMMIT) ? operation->argument : 0; n < stream_in->peeked; n++) {
+	index = (start->read_index + n) & index_mask;
+	if (memcmp(outcome->row[index], start->row[index], sizeof(start->row[index])) != 0) {
+	  CheckFail("the producer wrote a row that the consumer holds", operation, start);
+	}
+      }
+    }
+  } else {
+    // The frames that the interrupt loaded into the TX buffer are in out[]
+    for (sent = 0; sent < CHECK_MAX_READ; sent++) {
+      if (CheckFrameSequence(outcome->out[sent]) == CHECK_NOT_A_FRAME) {
+	break;
+      }
+      CheckDeliver(outcome->out[sent], &stream, operation, start);
+    }
+    for (n = sent; n < CHECK_MAX_READ; n++) {
+      for (index = 0; index < 5; index++) {
+	if (outcome->out[n][index] != CHECK_POISON) {
+	  CheckFail("the TX buffer was loaded with a torn row", operation, start);
+	}
+      }
+    }
+    if (outcome->read_index != ((start->read_index + sent) & index_mask)) {
+      CheckFail("ETMCanTXMessageBuffer released a different number of rows than it sent", operation, start);
+    }
+    if (sent == 0) {
+      if (memcmp(outcome->tx_sfr, start->tx_sfr, sizeof(start->tx_sfr)) != 0) {
+	CheckFail("the TX buffer changed but nothing was sent", operation, start);
+      }
+    } else {
+      frame[0] = outcome->tx_sfr[CHECK_SFR_SID];
+      for (n = 0; n < 4; n++) {
+	frame[n + 1] = outcome->tx_sfr[CHECK_SFR_DATA + n];
+      }
+      // TXREQ is still set unless the interrupt saw the last message sent and found the buffer empty
+      if ((start->tx_sfr[CHECK_SFR_CON] & TX_REQ_BIT) || (memcmp(frame, outcome->out[sent - 1], sizeof(frame)) != 0) ||
+	  ((outcome->tx_sfr[CHECK_SFR_CON] & ~TX_REQ_BIT) != (start->tx_sfr[CHECK_SFR_CON] & ~TX_REQ_BIT))) {
+	CheckFail("the TX buffer does not hold the last message sent", operation, start);
+      }
+    }
+  }
+
+  // What is left in the buffer, frames can be missing (the buffer was full) but must be in order after the last delivered
+  rows_in_use = (outcome->write_index - outcome->read_index) & index_mask;
+  previous = stream.last_sequence;
+  for (n = 0; n < rows_in_use; n++) {
+    index = (outcome->read_index + n) & index_mask;
+    sequence = CheckFrameSequence(outcome->row[index]);
+    if (sequence == CHECK_NOT_A_FRAME) {
+      CheckFail("a row in the buffer is torn", operation, start);
+    }
+    if (((n != 0) || (stream.delivered != 0)) && ((short)(sequence - previous) <= 0)) {
+      CheckFail("the rows in the buffer are out of order", operation, start);
+    }
+    previous = sequence;
+  }
+
+  // Every frame that was offered was either stored or counted as an overwrite
+  if (outcome->write_count != (stream.offered & 0xFFFF)) {
+    CheckFail("message_write_count does not match the frames offered", operation, start);
+  }
+  if (((outcome->write_count - outcome->overwrite_count) & 0xFFFF) != ((stream.delivered + rows_in_use) & 0xFFFF)) {
+    CheckFail("frames were lost or repeated (write_count - overwrite_count != delivered + in the buffer)", operation, start);
+  }
+  if ((outcome->high_water < rows_in_use) || (outcome->high_water > index_mask)) {
+    CheckFail("message_high_water is wrong", operation, start);
+  }
+
+  // A request to clear the high water mark is taken by the next message that is stored, and only then
+  stored = (outcome->write_count - outcome->overwrite_count - start->write_count + start->overwrite_count) & 0xFFFF;
+  if ((stored != 0) && (outcome->high_water_clear != 0)) {
+    CheckFail("a message was stored but the high water clear request is still set", operation, start);
+  }
+  if ((stored == 0) && (outcome->high_water_clear != start->high_water_clear)) {
+    CheckFail("the high water clear request changed but no message was stored", operation, start);
+  }
+
+  // The status calls must return the value from before or after the interrupt
+  if ((operation->code == CHECK_NOT_EMPTY) || (operation->code == CHECK_ROWS_AVAILABLE)) {
+    before = (start->write_index - start->read_index) & index_mask;
+    after = (outcome->write_index - outcome->read_index) & index_mask;
+    if (operation->code == CHECK_ROWS_AVAILABLE) {
+      before = index_mask - before;
+      after = index_mask - after;
+    }
+    if ((outcome->result != before) && (outcome->result != after)) {
+      CheckFail("the returned count is from neither before nor after the interrupt", operation, start);
+    }
+  }
+
+  *stream_out = stream;
+}
+
+
+static unsigned int CheckOutcomes(const CheckImplementation* implementation, const CheckState* start, const CheckOperation* operation,
+				  const CheckOperation* interrupt, CheckState* outcome) {
+  // Runs the call once for every point where the interrupt can happen and returns the distinct states that result
+  static CheckState state;
+  unsigned long steps;
+  unsigned long preempt;
+  unsigned int outcomes;
+  unsigned int n;
+
+  implementation->load(start);
+  implementation->run(operation, NULL, 0, &steps);
+
+  outcomes = 0;
+  for (preempt = 0; preempt <= (steps + 1); preempt++) {
+    implementation->load(start);
+    implementation->run(operation, interrupt, preempt, NULL);
+    implementation->save(&state);
+    check_interleavings++;
+    for (n = 0; n < outcomes; n++) {
+      if (memcmp(&state, &outcome[n], sizeof(CheckState)) == 0) {
+	break;
+      }
+    }
+    if (n == outcomes) {
+      if (outcomes == CHECK_MAX_OUTCOMES) {
+	fprintf(stderr, "FAIL: %s %s can leave more than %u states\n", implementation->name, check_operation_name[operation->code], CHECK_MAX_OUTCOMES);
+	exit(1);
+      }
+      outcome[outcomes++] = state;
+    }
+  }
+  return outcomes;
+}
+
+
+static void CheckInterleave(unsigned int depth, unsigned int steps, unsigned int rx) {
+  static CheckState state;
+  static CheckState c_outcome[CHECK_MAX_OUTCOMES];
+  static CheckState asm_outcome[CHECK_MAX_OUTCOMES];
+  CheckOperation operation;
+  CheckOperation interrupt;
+  CheckStream stream;
+  CheckStream next_stream;
+  unsigned int c_outcomes;
+  unsigned int asm_outcomes;
+  unsigned int step;
+  unsigned int burst;
+  unsigned int pick;
+  unsigned int n;
+  unsigned int m;
+
+  memset(&state, 0, sizeof(state));
+  for (n = 0; n < CHECK_MAX_DEPTH; n++) {
+    CheckRandomWords(state.row[n], 5);
+  }
+  CheckRandomWords(state.rx_sfr, CHECK_SFR_WORDS);
+  CheckRandomWords(state.tx_sfr, CHECK_SFR_WORDS);
+  state.rx_sfr[CHECK_SFR_CON] &= ~BUFFER_FULL_BIT;
+  state.index_mask = depth - 1;
+  memset(&stream, 0, sizeof(stream));
+  stream.next_sequence = CheckRandom() & 0xFFFF;
+
+  for (step = 0; step < steps; step++) {
+    // Now and then fill the buffer without an interleaving so that the full buffer is checked
+    if ((CheckRandom() % 8) == 0) {
+      memset(&operation, 0, sizeof(operation));
+      burst = CheckRandom() % (depth + 2);
+      if (rx) {
+	operation.code = CHECK_RX_INTERRUPT;
+	CheckOffer(&operation, &stream, burst);
+	check_c.load(&state);
+	check_c.run(&operation, NULL, 0, NULL);
+	check_c.save(&state);
+      } else {
+	operation.code = CHECK_ADD;
+	while (burst--) {
+	  CheckOffer(&operation, &stream, 1);
+	  check_c.load(&state);
+	  check_c.run(&operation, NULL, 0, NULL);
+	  check_c.save(&state);
+	}
+      }
+    }
+
+    memset(&operation, 0, sizeof(operation));
+    memset(&interrupt, 0, sizeof(interrupt));
+    if (rx) {
+      // The main loop is the consumer, 0 to 3 frames arrive while it runs
+      switch (CheckRandom() % 6)
+	{
+	case 0: operation.code = CHECK_READ; break;
+	case 1: operation.code = CHECK_READ_MESSAGES; operation.argument = CheckRandom() % (CHECK_MAX_READ + 1); break;
+	case 2: operation.code = CHECK_PEEK; break;
+	case 3: operation.code = CHECK_COMMIT; operation.argument = CheckRandom() % (stream.peeked + 1); break;
+	case 4: operation.code = CHECK_NOT_EMPTY; break;
+	case 5: operation.code = CHECK_ROWS_AVAILABLE; break;
+	}
+      interrupt.code = CHECK_RX_INTERRUPT;
+      CheckOffer(&interrupt, &stream, CheckRandom() % 4);
+    } else {
+      // The main loop is the producer, the TX buffer finishes (or not) and the interrupt sends 1 to 3 messages
+      switch (CheckRandom() % 4)
+	{
+	case 0:
+	case 1:
+	  operation.code = CHECK_ADD;
+	  CheckOffer(&operation, &stream, 1);
+	  break;
+
+	case 2: operation.code = CHECK_NOT_EMPTY; break;
+	case 3: operation.code = CHECK_ROWS_AVAILABLE; break;
+	}
+      interrupt.code = CHECK_TX_INTERRUPT;
+      interrupt.argument = 1 + CheckRandom() % 3;
+      if (CheckRandom() % 4) {
+	state.tx_sfr[CHECK_SFR_CON] &= ~TX_REQ_BIT;
+      }
+    }
+    if ((CheckRandom() % 8) == 0) {
+      // The main loop clears the debug data (ETMCanBufferClearHighWater)
+      state.high_water_clear = 1;
+    }
+    CheckPoisonOutputs(&state);
+
+    c_outcomes = CheckOutcomes(&check_c, &state, &operation, &interrupt, c_outcome);
+    asm_outcomes = CheckOutcomes(&check_asm, &state, &operation, &interrupt, asm_outcome);
+
+    // Both versions must be able to reach exactly the same states
+    for (n = 0; n < asm_outcomes; n++) {
+      for (m = 0; m < c_outcomes; m++) {
+	if (memcmp(&asm_outcome[n], &c_outcome[m], sizeof(CheckState)) == 0) {
+	  break;
+	}
+      }
+      if (m == c_outcomes) {
+	CheckPrintState("assembly only", &asm_outcome[n]);
+	CheckFail("the assembly version can reach a state that the C version can not", &operation, &state);
+      }
+    }
+    if (c_outcomes != asm_outcomes) {
+      CheckFail("the C version can reach a state that the assembly version can not", &operation, &state);
+    }
+
+    for (n = 0; n < c_outcomes; n++) {
+      CheckOutcome(&state, &c_outcome[n], &operation, rx, &stream, &next_stream);
+    }
+
+    pick = CheckRandom() % c_outcomes;
+    CheckOutcome(&state, &c_outcome[pick], &operation, rx, &stream, &next_stream);
+    stream = next_stream;
+    state = c_outcome[pick];
+    check_outcomes += c_outcomes;
+  }
+}
+
+
+// ---------- Throughput ---------------
+
+#define CHECK_BATCH                   8
+#define CHECK_HOST_MESSAGES           4000000
+
+
+static double CheckSeconds(void) {
+  struct timespec now;
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return now.tv_sec + now.tv_nsec * 1.0e-9;
+}
+
+
+static unsigned long CheckAsmCycles(CheckState* state, unsigned int code, unsigned int argument) {
+  CheckOperation operation;
+
+  memset(&operation, 0, sizeof(operation));
+  operation.code = code;
+  operation.argument = argument;
+  CheckFrame(operation.message, 1);
+  state->rx_sfr[CHECK_SFR_CON] |= BUFFER_FULL_BIT;
+  state->tx_sfr[CHECK_SFR_CON] &= ~TX_REQ_BIT;
+  check_asm.load(state);
+  check_asm.run(&operation, NULL, 0, NULL);
+  check_asm.save(state);
+  return asm_model.cycles;
+}
+
+
+static double CheckHostRate(unsigned int path) {
+  ETMCanMessage message;
+  ETMCanMessage* peek;
+  unsigned long messages;
+  unsigned int n;
+  double start;
+
+  memset(&message, 0, sizeof(message));
+  check_c_buffer.message_index_mask = 15;
+  check_c_buffer.message_data = check_c_row;
+  check_c_buffer.message_time_stamp = check_c_time_stamp;
+  ETMCanBufferInitialize(&check_c_buffer);
+
+  start = CheckSeconds();
+  for (messages = 0; messages < CHECK_HOST_MESSAGES; messages += CHECK_BATCH) {
+    switch (path)
+      {
+      case 0:
+	for (n = 0; n < CHECK_BATCH; n++) {
+	  check_c_rx_sfr[CHECK_SFR_CON] |= BUFFER_FULL_BIT;
+	  ETMCanRXMessageBuffer(&check_c_buffer, &check_c_rx_sfr[CHECK_SFR_CON]);
+	  ETMCanReadMessageFromBuffer(&check_c_buffer, &message);
+	}
+	break;
+
+      case 1:
+	for (n = 0; n < CHECK_BATCH; n++) {
+	  check_c_rx_sfr[CHECK_SFR_CON] |= BUFFER_FULL_BIT;
+	  ETMCanRXMessageBuffer(&check_c_buffer, &check_c_rx_sfr[CHECK_SFR_CON]);
+	}
+	ETMCanReadMessagesFromBuffer(&check_c_buffer, check_c_out, CHECK_BATCH);
+	break;
+
+      case 2:
+	for (n = 0; n < CHECK_BATCH; n++) {
+	  check_c_rx_sfr[CHECK_SFR_CON] |= BUFFER_FULL_BIT;
+	  ETMCanRXMessageBuffer(&check_c_buffer, &check_c_rx_sfr[CHECK_SFR_CON]);
+	}
+	while ((n = ETMCanBufferPeek(&check_c_buffer, &peek)) != 0) {
+	  ETMCanBufferCommit(&check_c_buffer, n);
+	}
+	break;
+
+      case 3:
+	for (n = 0; n < CHECK_BATCH; n++) {
+	  ETMCanAddMessageToBuffer(&check_c_buffer, &message);
+	  check_c_tx_sfr[CHECK_SFR_CON] &= ~TX_REQ_BIT;
+	  ETMCanTXMessageBuffer(&check_c_buffer, &check_c_tx_sfr[CHECK_SFR_CON]);
+	}
+	break;
+      }
+  }
+  if (check_c_buffer.message_overwrite_count) {
+    fprintf(stderr, "FAIL: the host throughput loop overran the buffer\n");
+    exit(1);
+  }
+  return messages / (CheckSeconds() - start);
+}
+
+
+static void CheckThroughput(unsigned long fcy) {
+  static CheckState state;
+  static const char* path_name[4] = {
+    "RX  ETMCanRXMessageBuffer + ETMCanReadMessageFromBuffer",
+    "RX  ETMCanRXMessageBuffer + ETMCanReadMessagesFromBuffer (8)",
+    "RX  ETMCanRXMessageBuffer + ETMCanBufferPeek/Commit (8)",
+    "TX  ETMCanAddMessageToBuffer + ETMCanTXMessageBuffer",
+  };
+  unsigned long cycles[CHECK_OPERATIONS];
+  double path_cycles[4];
+  unsigned int n;
+
+  // Assembly cycles, buffer depth 16 with messages in it, every call succeeds
+  memset(&state, 0, sizeof(state));
+  state.index_mask = 15;
+  for (n = 0; n < 8; n++) {
+    cycles[CHECK_ADD] = CheckAsmCycles(&state, CHECK_ADD, 0);
+  }
+  cycles[CHECK_RX_MESSAGE_BUFFER] = CheckAsmCycles(&state, CHECK_RX_MESSAGE_BUFFER, 0);
+  cycles[CHECK_READ] = CheckAsmCycles(&state, CHECK_READ, 0);
+  cycles[CHECK_TX_MESSAGE_BUFFER] = CheckAsmCycles(&state, CHECK_TX_MESSAGE_BUFFER, 0);
+  cycles[CHECK_NOT_EMPTY] = CheckAsmCycles(&state, CHECK_NOT_EMPTY, 0);
+  cycles[CHECK_ROWS_AVAILABLE] = CheckAsmCycles(&state, CHECK_ROWS_AVAILABLE, 0);
+  state.read_index = 0;
+  state.write_index = CHECK_BATCH;
+  cycles[CHECK_READ_MESSAGES] = CheckAsmCycles(&state, CHECK_READ_MESSAGES, CHECK_BATCH);
+  state.read_index = 0;
+  cycles[CHECK_PEEK] = CheckAsmCycles(&state, CHECK_PEEK, 0);
+  cycles[CHECK_COMMIT] = CheckAsmCycles(&state, CHECK_COMMIT, CHECK_BATCH);
+
+  printf("\nAssembly, dsPIC30F instruction cycles per call including CALL and RETURN (depth 16, the call succeeds)\n");
+  printf("  %-34s %3lu\n", "ETMCanRXMessageBuffer", cycles[CHECK_RX_MESSAGE_BUFFER]);
+  printf("  %-34s %3lu\n", "ETMCanAddMessageToBuffer", cycles[CHECK_ADD]);
+  printf("  %-34s %3lu\n", "ETMCanReadMessageFromBuffer", cycles[CHECK_READ]);
+  printf("  %-34s %3lu\n", "ETMCanReadMessagesFromBuffer (8)", cycles[CHECK_READ_MESSAGES]);
+  printf("  %-34s %3lu\n", "ETMCanBufferPeek", cycles[CHECK_PEEK]);
+  printf("  %-34s %3lu\n", "ETMCanBufferCommit", cycles[CHECK_COMMIT]);
+  printf("  %-34s %3lu\n", "ETMCanTXMessageBuffer", cycles[CHECK_TX_MESSAGE_BUFFER]);
+  printf("  %-34s %3lu\n", "ETMCanBufferNotEmpty", cycles[CHECK_NOT_EMPTY]);
+  printf("  %-34s %3lu\n", "ETMCanBufferRowsAvailable", cycles[CHECK_ROWS_AVAILABLE]);
+
+  path_cycles[0] = cycles[CHECK_RX_MESSAGE_BUFFER] + cycles[CHECK_READ];
+  path_cycles[1] = cycles[CHECK_RX_MESSAGE_BUFFER] + (double)cycles[CHECK_READ_MESSAGES] / CHECK_BATCH;
+  path_cycles[2] = cycles[CHECK_RX_MESSAGE_BUFFER] + (double)(cycles[CHECK_PEEK] + cycles[CHECK_COMMIT]) / CHECK_BATCH;
+  path_cycles[3] = cycles[CHECK_ADD] + cycles[CHECK_TX_MESSAGE_BUFFER];
+
+  printf("\nMessages/second through both sides of a buffer, assembly at Fcy = %lu and C version on this host\n", fcy);
+  printf("  %-62s %7s %12s %12s\n", "", "cycles", "dsPIC asm", "host C");
+  for (n = 0; n < 4; n++) {
+    printf("  %-62s %7.1f %12.0f %12.0f\n", path_name[n], path_cycles[n], fcy / path_cycles[n], CheckHostRate(n));
+  }
+}
+
+
+static void CheckUsage(const char* program) {
+  fprintf(stderr, "usage: %s [-a file] [-n calls] [-i steps] [-s seed] [-f fcy]\n", program);
+  exit(2);
+}
+
+
+int main(int argc, char** argv) {
+  const char* file = "../ETM_LINAC_CAN.X/P1395_CAN_CORE.s";
+  unsigned int calls = 20000;
+  unsigned int steps = 100;
+  unsigned long fcy = 10000000;
+  struct sigaction action;
+  unsigned int depth;
+  int option;
+
+  while ((option = getopt(argc, argv, "a:n:i:s:f:")) != -1) {
+    switch (option)
+      {
+      case 'a': file = optarg; break;
+      case 'n': calls = strtoul(optarg, NULL, 0); break;
+      case 'i': steps = strtoul(optarg, NULL, 0); break;
+      case 's': check_random_state = strtoull(optarg, NULL, 0) | 1; break;
+      case 'f': fcy = strtoul(optarg, NULL, 0); break;
+      default: CheckUsage(argv[0]);
+      }
+  }
+  if ((optind != argc) || (fcy == 0)) {
+    CheckUsage(argv[0]);
+  }
+
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = CheckTrap;
+  action.sa_flags = SA_SIGINFO;
+  sigaction(SIGTRAP, &action, NULL);
+
+  AsmLoad(file);
+  CheckModelInitialize();
+  printf("Checking P1395_CAN_CORE.c against %s (%u instructions in the model)\n\n", file, asm_model.instructions);
+  printf("  %5s %14s %36s %36s\n", "depth", "lockstep calls", "RX interrupt points / states", "TX interrupt points / states");
+
+  for (depth = 4; depth <= CHECK_MAX_DEPTH; depth <<= 1) {
+    check_calls = 0;
+    CheckLockstep(depth, calls);
+    printf("  %5u %14lu", depth, check_calls);
+
+    check_interleavings = 0;
+    check_outcomes = 0;
+    CheckInterleave(depth, steps, 1);
+    printf(" %27lu / %6lu", check_interleavings, check_outcomes);
+
+    check_interleavings = 0;
+    check_outcomes = 0;
+    CheckInterleave(depth, steps, 0);
+    printf(" %27lu / %6lu\n", check_interleavings, check_outcomes);
+    fflush(stdout);
+  }
+
+  CheckThroughput(fcy);
+  printf("\nPASS\n");
+  return 0;
+}
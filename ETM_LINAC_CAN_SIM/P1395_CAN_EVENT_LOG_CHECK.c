@@ -0,0 +1,612 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "P1395_CAN_SIM.h"
+
+/*
+  The master is compiled into this check so that time_seconds_now (in TYPE_GLOBAL_DATA_CAN_MASTER) and the static
+  event log decoder can be reached.  The EEPROM model comes from P1395_CAN_SIM_NODE.c.
+*/
+#include "P1395_CAN_MASTER.c"
+
+/*
+  P1395 CAN event log check
+
+  Usage: p1395_can_event_log_check [options]
+    -n events       events logged in each random phase                       (default 10000)
+    -s seed         random seed                                              (default 1)
+
+  Every event is logged with SendToEventLog() and kept in a model, indexed by event number.  After every event the
+  whole log (event_words from the oldest event to the write position) is decoded and compared with the model, and the
+  decoded entry sizes must add up to words_used.
+   - Capacity: the log is filled with 1 word, 2 word extended and 5 word keyframe entries and the number of events that
+     it holds is checked against the sizes given in P1395_CAN_MASTER.h.
+   - Readers: time deltas from 0 to more than 0x7FFFF seconds (and backwards), ids inside and outside the 3 id classes
+     and the word ring wrapping many times.  The GUI reader takes its events with ETMCanMasterEventLogPeek() /
+     ETMCanMasterEventLogCommit(), the diagnostics reader walks them with ETMCanMasterEventLogRead() /
+     ETMCanMasterEventLogNext() / ETMCanMasterEventLogCommitIterator().  Both are lapped on purpose, during a span and in
+     the middle of a walk.  Every event a reader gets must match the model, a handed out span must not change until it
+     is committed, and dropped_count must be exactly the number of events that were removed before the reader got them.
+   - EEPROM: the same with the log stored in 1, 2, 5 and 16 EEPROM pages.  Every page written by
+     ETMCanMasterEventLogStore() is read back and compared with the model.  The ECB is reset at random points (the RAM
+     log is overwritten and ETMCanMasterEventLogInitialize() is called again), sometimes with the newest page torn.  The
+     newest pages must be found and loaded back and numbering must continue from the newest stored event.
+
+  On the ECB time_seconds_now is 16 bits, so a gap of more than 0x7FFFF seconds only comes from events loaded from the
+  EEPROM.  It is 32 bits on this host, so SendToEventLog() is used for those too.
+  Event numbers and EEPROM sequence numbers are 16 bits on the ECB, each phase stays below 0x10000 of them.
+
+  Returns 0 if every check passes.
+*/
+
+#define CHECK_EVENTS              0x10000
+#define CHECK_MAX_PAGES           16
+#define CHECK_REGION_PAGE         0x20    // EEPROM page of the first region, each region gets CHECK_MAX_PAGES pages
+
+#define CHECK_MIXED               0
+#define CHECK_SHORT               1       // 0 -> 63 seconds apart, in the 3 id classes
+#define CHECK_EXTENDED            2       // 64 -> 0x7FFFF seconds apart, in the 3 id classes
+#define CHECK_KEYFRAME            3       // 0 -> 63 seconds apart, ids outside the 3 id classes
+
+#define GUI                       ETM_CAN_MASTER_EVENT_LOG_READER_GUI
+#define EEPROM                    ETM_CAN_MASTER_EVENT_LOG_READER_EEPROM
+#define DIAG                      ETM_CAN_MASTER_EVENT_LOG_READER_DIAG
+
+
+static unsigned long long check_random_state = 1;
+
+static unsigned long  check_time[CHECK_EVENTS];
+static unsigned int   check_id[CHECK_EVENTS];
+static unsigned int   check_now;
+static unsigned int   check_mode;
+static unsigned int   check_events_logged;
+
+static unsigned int   check_next[ETM_CAN_MASTER_EVENT_LOG_READERS];      // Next event each reader should get
+static unsigned int   check_dropped[ETM_CAN_MASTER_EVENT_LOG_READERS];   // dropped_count each reader should have
+static unsigned int   check_read[ETM_CAN_MASTER_EVENT_LOG_READERS];      // Events each reader got
+static unsigned int   check_laps[ETM_CAN_MASTER_EVENT_LOG_READERS];      // Times each reader was lapped
+
+// The EEPROM pages that have been written (valid, sequence number, first event and number of events in each page)
+static unsigned int   check_page_valid[CHECK_MAX_PAGES];
+static unsigned int   check_page_sequence[CHECK_MAX_PAGES];
+static unsigned int   check_page_first[CHECK_MAX_PAGES];
+static unsigned int   check_page_events[CHECK_MAX_PAGES];
+static unsigned int   check_first_page;
+static unsigned int   check_pages;
+static unsigned int   check_sequence;                                   // Sequence number of the next page
+static unsigned int   check_page_writes;
+static unsigned int   check_resets;
+static unsigned int   check_torn;
+static unsigned int   check_loaded;
+
+
+static unsigned int CheckRandom(void) {
+  // xorshift64*
+  check_random_state ^= check_random_state >> 12;
+  check_random_state ^= check_random_state << 25;
+  check_random_state ^= check_random_state >> 27;
+  return (unsigned int)((check_random_state * 2685821657736338717ULL) >> 32);
+}
+
+
+static void CheckFail(const char* format, ...) {
+  va_list args;
+
+  fprintf(stderr, "FAIL: ");
+  va_start(args, format);
+  vfprintf(stderr, format, args);
+  va_end(args);
+  fprintf(stderr, "\n  after %u events, write event %u index %u, oldest event %u index %u, %u words used\n",
+	  check_events_logged, event_log.write.event_number, event_log.write.index, event_log.oldest.event_number,
+	  event_log.oldest.index, event_log.words_used);
+  exit(1);
+}
+
+
+static void CheckEvent(const char* where, const TYPE_EVENT* event_ptr, unsigned int event_number) {
+  if (event_ptr->event_number != event_number) {
+    CheckFail("%s: got event %u, expected event %u", where, event_ptr->event_number, event_number);
+  }
+  if ((event_ptr->event_time != check_time[event_number]) || (event_ptr->event_id != check_id[event_number])) {
+    CheckFail("%s: event %u is time 0x%08lX id 0x%04X, it was logged as time 0x%08lX id 0x%04X", where, event_number,
+	      event_ptr->event_time, event_ptr->event_id, check_time[event_number], check_id[event_number]);
+  }
+}
+
+
+static void CheckLog(void) {
+  // Decode every event in event_words and compare it with the model
+  TYPE_EVENT_LOG_POSITION position;
+  TYPE_EVENT event;
+  unsigned int words;
+  unsigned int event_number;
+
+  if (event_log.words_used > ETM_CAN_MASTER_EVENT_LOG_WORDS) {
+    CheckFail("%u words used", event_log.words_used);
+  }
+  position = event_log.oldest;
+  words = 0;
+  for (event_number = event_log.oldest.event_number; event_number != event_log.write.event_number; event_number++) {
+    if (words >= event_log.words_used) {
+      CheckFail("event %u is past the %u words used", event_number, event_log.words_used);
+    }
+    words += ETMCanMasterEventLogDecode(&position, &event);
+    CheckEvent("log", &event, event_number);
+  }
+  if ((words != event_log.words_used) || (position.index != event_log.write.index)) {
+    CheckFail("the entries add up to %u words ending at index %u", words, position.index);
+  }
+}
+
+
+static unsigned int CheckCatchUp(unsigned int reader, unsigned int event_number) {
+  // A reader that is behind the oldest event is moved to it and the events it missed are dropped
+  if ((int)(event_number - event_log.oldest.event_number) < 0) {
+    check_dropped[reader] += event_log.oldest.event_number - event_number;
+    check_laps[reader]++;
+    return event_log.oldest.event_number;
+  }
+  return event_number;
+}
+
+
+static void CheckReader(const char* where, unsigned int reader) {
+  if (event_log.reader[reader].position.event_number != check_next[reader]) {
+    CheckFail("%s: reader %u is at event %u, expected %u", where, reader, event_log.reader[reader].position.event_number,
+	      check_next[reader]);
+  }
+  if (event_log.reader[reader].dropped_count != check_dropped[reader]) {
+    CheckFail("%s: reader %u dropped_count is %u, expected %u", where, reader, event_log.reader[reader].dropped_count,
+	      check_dropped[reader]);
+  }
+}
+
+
+static void CheckStore(void) {
+  // One pass of the main loop, ETMCanMasterEventLogStore() writes at most one page
+  unsigned int page_data[EVENT_LOG_PAGE_WORDS];
+  unsigned int page;
+  unsigned int writes;
+  unsigned int unread;
+  unsigned int n;
+  unsigned int* data_ptr;
+  TYPE_EVENT event;
+
+  if (check_pages == 0) {
+    return;
+  }
+  etm_can_master_tick += CheckRandom() % 24;
+  page = event_log.eeprom_next_page;
+  writes = event_log.eeprom_page_writes;
+  check_next[EEPROM] = CheckCatchUp(EEPROM, check_next[EEPROM]);
+  unread = event_log.write.event_number - check_next[EEPROM];
+  ETMCanMasterEventLogStore();
+
+  if (event_log.eeprom_page_writes == writes) {
+    if ((unread >= ETM_CAN_MASTER_EVENT_LOG_EVENTS_PER_PAGE) ||
+	(unread && ((unsigned int)(etm_can_master_tick - event_log.eeprom_flush_tick) >= ETM_CAN_MASTER_EVENT_LOG_FLUSH))) {
+      CheckFail("%u events were not stored", unread);
+    }
+    CheckReader("store", EEPROM);
+    return;
+  }
+
+  ETMEEPromReadPage(check_first_page + page, EVENT_LOG_PAGE_WORDS, page_data);
+  if ((page_data[EVENT_LOG_PAGE_CHECK] != ETMCanMasterEventLogCheckWord(page_data)) ||
+      (page_data[EVENT_LOG_PAGE_SEQUENCE] != (check_sequence & 0xFFFF)) || (page_data[EVENT_LOG_PAGE_EVENTS] == 0) ||
+      (page_data[EVENT_LOG_PAGE_EVENTS] > ETM_CAN_MASTER_EVENT_LOG_EVENTS_PER_PAGE) ||
+      (page_data[EVENT_LOG_PAGE_FIRST_EVENT] != check_next[EEPROM])) {
+    CheckFail("page %u: sequence %u, first event %u, %u events, expected sequence %u first event %u", page,
+	      page_data[EVENT_LOG_PAGE_SEQUENCE], page_data[EVENT_LOG_PAGE_FIRST_EVENT], page_data[EVENT_LOG_PAGE_EVENTS],
+	      check_sequence, check_next[EEPROM]);
+  }
+  if ((unread < ETM_CAN_MASTER_EVENT_LOG_EVENTS_PER_PAGE) ? (page_data[EVENT_LOG_PAGE_EVENTS] != unread) :
+      (page_data[EVENT_LOG_PAGE_EVENTS] != ETM_CAN_MASTER_EVENT_LOG_EVENTS_PER_PAGE)) {
+    CheckFail("page %u holds %u of %u unread events", page, page_data[EVENT_LOG_PAGE_EVENTS], unread);
+  }
+  data_ptr = &page_data[EVENT_LOG_PAGE_DATA];
+  for (n = 0; n < page_data[EVENT_LOG_PAGE_EVENTS]; n++) {
+    event.event_number = check_next[EEPROM] + n;
+    event.event_time = data_ptr[1];
+    event.event_time <<= 16;
+    event.event_time += data_ptr[0];
+    event.event_id = data_ptr[2];
+    CheckEvent("EEPROM page", &event, check_next[EEPROM] + n);
+    data_ptr += EVENT_LOG_WORDS_PER_EVENT;
+  }
+
+  check_page_valid[page] = 1;
+  check_page_sequence[page] = check_sequence;
+  check_page_first[page] = check_next[EEPROM];
+  check_page_events[page] = page_data[EVENT_LOG_PAGE_EVENTS];
+  check_sequence++;
+  check_page_writes++;
+  check_next[EEPROM] += page_data[EVENT_LOG_PAGE_EVENTS];
+  check_read[EEPROM] += page_data[EVENT_LOG_PAGE_EVENTS];
+  CheckReader("store", EEPROM);
+}
+
+
+static void CheckPush(void) {
+  // Log one event with SendToEventLog() and record it in the model
+  unsigned int event_number;
+  unsigned int select;
+  unsigned int event_id;
+  static const unsigned int boundary[] = {0, 1, 63, 64, 0x3FF, 0xFFFF, 0x10000, 0x7FFFE, 0x7FFFF, 0x80000, 0x80001};
+
+  select = CheckRandom() % 100;
+  switch (check_mode)
+    {
+    case CHECK_SHORT:
+    case CHECK_KEYFRAME:
+      check_now += CheckRandom() % 64;
+      break;
+
+    case CHECK_EXTENDED:
+      check_now += 64 + (CheckRandom() % (0x80000 - 64));
+      break;
+
+    default:
+      if (select < 55) {
+	check_now += CheckRandom() % 64;
+      } else if (select < 78) {
+	check_now += 64 + (CheckRandom() % (0x80000 - 64));
+      } else if (select < 86) {
+	check_now += 0x80000 + (CheckRandom() % 0x1000000);
+      } else if (select < 92) {
+	check_now -= CheckRandom() % (check_now + 1);
+      } else {
+	check_now += boundary[CheckRandom() % (sizeof(boundary) / sizeof(boundary[0]))];
+      }
+      break;
+    }
+  if (check_now > 0xF0000000) {
+    // Keep the time inside 32 bits (the time moves backwards)
+    check_now = CheckRandom() % 1000;
+  }
+
+  if ((check_mode == CHECK_KEYFRAME) || ((check_mode == CHECK_MIXED) && ((CheckRandom() % 100) < 15))) {
+    do {
+      event_id = CheckRandom() & 0xFFFF;
+    } while ((check_mode == CHECK_KEYFRAME) &&
+	     (((event_id & 0xFF00) == 0x0000) || ((event_id & 0xFF00) == 0x1000) || ((event_id & 0xFF00) == 0x1100)));
+  } else {
+    event_id = event_log_id_high_byte[CheckRandom() % 3] + (CheckRandom() & 0xFF);
+  }
+
+  event_number = event_log.write.event_number;
+  if (event_number >= CHECK_EVENTS) {
+    CheckFail("the phase has used up the 16 bit event numbers");
+  }
+  check_time[event_number] = check_now;
+  check_id[event_number] = event_id;
+  global_data_can_master.time_seconds_now = check_now;
+  SendToEventLog(event_id);
+  check_events_logged++;
+  if (event_log.write.event_number != (event_number + 1)) {
+    CheckFail("event %u was logged as %u", event_number, event_log.write.event_number - 1);
+  }
+  CheckLog();
+  CheckStore();
+}
+
+
+static void CheckPushMany(unsigned int events) {
+  for (; events; events--) {
+    CheckPush();
+  }
+}
+
+
+static unsigned int CheckLapEvents(void) {
+  // Usually a few events, sometimes enough to lap any reader
+  if ((CheckRandom() % 40) == 0) {
+    return 520 + (CheckRandom() % 600);
+  }
+  return CheckRandom() % 3;
+}
+
+
+static void CheckGuiReader(void) {
+  // ETMCanMasterEventLogPeek / ETMCanMasterEventLogCommit
+  TYPE_EVENT* window;
+  TYPE_EVENT saved[ETM_CAN_MASTER_EVENT_LOG_WINDOW];
+  unsigned int events;
+  unsigned int expected;
+  unsigned int commit;
+  unsigned int n;
+
+  check_next[GUI] = CheckCatchUp(GUI, check_next[GUI]);
+  expected = event_log.write.event_number - check_next[GUI];
+  if (expected > ETM_CAN_MASTER_EVENT_LOG_WINDOW) {
+    expected = ETM_CAN_MASTER_EVENT_LOG_WINDOW;
+  }
+  events = ETMCanMasterEventLogPeek(GUI, &window);
+  if ((events != expected) || (window != event_log.reader[GUI].window)) {
+    CheckFail("peek: %u events, expected %u", events, expected);
+  }
+  CheckReader("peek", GUI);
+  for (n = 0; n < events; n++) {
+    CheckEvent("peek", &window[n], check_next[GUI] + n);
+  }
+  memcpy(saved, window, sizeof(saved));
+
+  // The span must stay valid until it is committed, even if its events are removed from event_words
+  CheckPushMany(CheckLapEvents());
+  if (memcmp(saved, window, events * sizeof(TYPE_EVENT))) {
+    CheckFail("peek: the span changed before it was committed");
+  }
+
+  commit = CheckRandom() % (events + 1);
+  if ((CheckRandom() % 4) != 0) {
+    commit = events;
+  }
+  ETMCanMasterEventLogCommit(GUI, commit);
+  check_read[GUI] += commit;
+  check_next[GUI] = CheckCatchUp(GUI, check_next[GUI] + commit);
+  CheckReader("commit", GUI);
+}
+
+
+static void CheckDiagReader(void) {
+  // ETMCanMasterEventLogRead / ETMCanMasterEventLogNext / ETMCanMasterEventLogCommitIterator
+  TYPE_EVENT_LOG_POSITION iterator;
+  TYPE_EVENT event;
+  unsigned int events;
+  unsigned int steps;
+  unsigned int expected;
+  unsigned int got;
+
+  check_next[DIAG] = CheckCatchUp(DIAG, check_next[DIAG]);
+  events = ETMCanMasterEventLogRead(DIAG, &iterator);
+  if ((events != (event_log.write.event_number - check_next[DIAG])) || (iterator.event_number != check_next[DIAG])) {
+    CheckFail("read: %u events from event %u, expected %u from event %u", events, iterator.event_number,
+	      event_log.write.event_number - check_next[DIAG], check_next[DIAG]);
+  }
+  CheckReader("read", DIAG);
+
+  for (steps = CheckRandom() % 40; steps; steps--) {
+    if ((CheckRandom() % 8) == 0) {
+      // The iterator can be lapped in the middle of the walk
+      CheckPushMany(CheckLapEvents());
+    }
+    expected = (iterator.event_number != event_log.write.event_number) &&
+      ((int)(iterator.event_number - event_log.oldest.event_number) >= 0);
+    event.event_number = iterator.event_number;
+    got = ETMCanMasterEventLogNext(&iterator, &event);
+    if (got != expected) {
+      CheckFail("next: returned %u at event %u, expected %u", got, event.event_number, expected);
+    }
+    if (!got) {
+      break;
+    }
+    CheckEvent("next", &event, iterator.event_number - 1);
+    check_read[DIAG]++;
+  }
+
+  ETMCanMasterEventLogCommitIterator(DIAG, &iterator);
+  check_next[DIAG] = CheckCatchUp(DIAG, iterator.event_number);
+  CheckReader("commit iterator", DIAG);
+}
+
+
+static void CheckStart(unsigned int first_page, unsigned int pages) {
+  // Power up with an erased event log region
+  unsigned int page_data[EVENT_LOG_PAGE_WORDS];
+  unsigned int n;
+
+  memset(page_data, 0xFF, sizeof(page_data));
+  for (n = 0; n < pages; n++) {
+    ETMEEPromWritePage(first_page + n, EVENT_LOG_PAGE_WORDS, page_data);
+  }
+  memset(&event_log, 0xA5, sizeof(event_log));
+  ETMCanMasterEventLogInitialize(first_page, pages);
+  if (event_log.write.event_number || event_log.words_used) {
+    CheckFail("an erased region loaded %u events", event_log.write.event_number);
+  }
+
+  check_first_page = first_page;
+  check_pages = pages;
+  check_sequence = 0;
+  for (n = 0; n < CHECK_MAX_PAGES; n++) {
+    check_page_valid[n] = 0;
+  }
+  for (n = 0; n < ETM_CAN_MASTER_EVENT_LOG_READERS; n++) {
+    check_next[n] = 0;
+    check_dropped[n] = 0;
+    check_read[n] = 0;
+    check_laps[n] = 0;
+  }
+  check_events_logged = 0;
+  check_page_writes = 0;
+  check_resets = 0;
+  check_torn = 0;
+  check_loaded = 0;
+}
+
+
+static void CheckReset(void) {
+  // The ECB is reset, the page that was being written may be torn.  The RAM log is lost.
+  unsigned int page_data[EVENT_LOG_PAGE_WORDS];
+  unsigned int newest;
+  unsigned int page;
+  unsigned int pages_loaded;
+  unsigned int first_event;
+  unsigned int write_event;
+  unsigned int n;
+
+  if (check_page_writes && ((CheckRandom() % 3) == 0)) {
+    // Only part of the newest page was written
+    page = (event_log.eeprom_next_page + check_pages - 1) % check_pages;
+    ETMEEPromReadPage(check_first_page + page, EVENT_LOG_PAGE_WORDS, page_data);
+    page_data[EVENT_LOG_PAGE_DATA + (CheckRandom() % (EVENT_LOG_PAGE_CHECK - EVENT_LOG_PAGE_DATA))] ^= 1 << (CheckRandom() % 16);
+    ETMEEPromWritePage(check_first_page + page, EVENT_LOG_PAGE_WORDS, page_data);
+    check_page_valid[page] = 0;
+    check_sequence--;
+    check_torn++;
+  }
+
+  // The newest pages that the log can be loaded from, newest first
+  pages_loaded = 0;
+  first_event = 0;
+  write_event = 0;
+  newest = check_pages;
+  if (check_sequence) {
+    newest = (check_sequence - 1) % check_pages;
+    page = newest;
+    while ((pages_loaded < check_pages) && check_page_valid[page] && (check_page_sequence[page] == (check_sequence - 1 - pages_loaded))) {
+      first_event = check_page_first[page];
+      pages_loaded++;
+      page = (page + check_pages - 1) % check_pages;
+    }
+    if (pages_loaded) {
+      write_event = check_page_first[newest] + check_page_events[newest];
+    }
+  }
+  if (pages_loaded == 0) {
+    // Nothing can be loaded (the only page that was written is torn), a new log is started at the first page
+    check_sequence = 0;
+  }
+
+  memset(&event_log, 0x5A, sizeof(event_log));
+  ETMCanMasterEventLogInitialize(check_first_page, check_pages);
+  check_resets++;
+
+  if (event_log.write.event_number != write_event) {
+    CheckFail("reset: numbering continues from %u, expected %u", event_log.write.event_number, write_event);
+  }
+  if (pages_loaded && (event_log.oldest.event_number != first_event)) {
+    CheckFail("reset: the oldest loaded event is %u, expected %u", event_log.oldest.event_number, first_event);
+  }
+  if (!pages_loaded && event_log.words_used) {
+    CheckFail("reset: %u words were loaded from an empty region", event_log.words_used);
+  }
+  if ((event_log.eeprom_sequence != check_sequence) ||
+      (event_log.eeprom_next_page != (pages_loaded ? ((newest + 1) % check_pages) : 0))) {
+    CheckFail("reset: the next page is %u sequence %u, expected sequence %u after page %u", event_log.eeprom_next_page,
+	      event_log.eeprom_sequence, check_sequence, newest);
+  }
+  CheckLog();
+  check_loaded += event_log.write.event_number - event_log.oldest.event_number;
+
+  // The loaded events are unread except by the EEPROM reader
+  for (n = 0; n < ETM_CAN_MASTER_EVENT_LOG_READERS; n++) {
+    check_next[n] = event_log.oldest.event_number;
+    check_dropped[n] = 0;
+  }
+  check_next[EEPROM] = event_log.write.event_number;
+  for (n = 0; n < ETM_CAN_MASTER_EVENT_LOG_READERS; n++) {
+    CheckReader("reset", n);
+  }
+}
+
+
+static void CheckCapacity(const char* name, unsigned int mode, unsigned int expected) {
+  // Fill the log three times over and keep the fewest events it held once it was full
+  unsigned int held;
+  unsigned int fewest;
+  unsigned int n;
+
+  CheckStart(0, 0);
+  check_mode = mode;
+  fewest = 0xFFFF;
+  for (n = 0; n < 3 * ETM_CAN_MASTER_EVENT_LOG_WORDS; n++) {
+    CheckPush();
+    held = event_log.write.event_number - event_log.oldest.event_number;
+    if ((n >= ETM_CAN_MASTER_EVENT_LOG_WORDS) && (held < fewest)) {
+      fewest = held;
+    }
+  }
+  printf("  %-44s %5u events, at least %u\n", name, fewest, expected);
+  if (fewest < expected) {
+    CheckFail("%s: the log held %u events, P1395_CAN_MASTER.h gives %u", name, fewest, expected);
+  }
+}
+
+
+static void CheckReaders(unsigned int first_page, unsigned int pages, unsigned int events) {
+  unsigned int select;
+
+  CheckStart(first_page, pages);
+  check_mode = CHECK_MIXED;
+  check_now = CheckRandom() % 1000;
+  while (check_events_logged < events) {
+    select = CheckRandom() % 100;
+    if (select < 50) {
+      CheckPushMany(1 + (CheckRandom() % 6));
+    } else if (select < 70) {
+      CheckGuiReader();
+    } else if (select < 90) {
+      CheckDiagReader();
+    } else if ((select == 90) && pages) {
+      CheckReset();
+    } else {
+      CheckStore();
+    }
+  }
+  printf("  %5u %8u %8u %5u %6u %9u %5u %6u %8u %6u %5u %7u\n", pages, check_events_logged, check_read[GUI],
+	 check_laps[GUI], check_dropped[GUI], check_read[DIAG], check_laps[DIAG], check_dropped[DIAG], check_page_writes,
+	 check_resets, check_torn, check_loaded);
+}
+
+
+static void CheckUsage(const char* program) {
+  fprintf(stderr, "usage: %s [-n events] [-s seed]\n", program);
+  exit(2);
+}
+
+
+int main(int argc, char** argv) {
+  unsigned int events = 10000;
+  int option;
+
+  while ((option = getopt(argc, argv, "n:s:")) != -1) {
+    switch (option)
+      {
+      case 'n': events = strtoul(optarg, NULL, 0); break;
+      case 's': check_random_state = strtoull(optarg, NULL, 0) | 1; break;
+      default: CheckUsage(argv[0]);
+      }
+  }
+  if ((optind != argc) || (events == 0) || (events > (CHECK_EVENTS - 0x1000))) {
+    CheckUsage(argv[0]);
+  }
+
+  printf("Event log capacity (%u words)\n", ETM_CAN_MASTER_EVENT_LOG_WORDS);
+  CheckCapacity("less than 64 seconds apart", CHECK_SHORT, 512);
+  CheckCapacity("more than 63 seconds apart", CHECK_EXTENDED, 259);
+  CheckCapacity("every event a keyframe", CHECK_KEYFRAME, 105);
+
+  printf("\nReaders (GUI peek / commit, DIAG read / next / commit iterator, EEPROM store)\n");
+  printf("  %5s %8s %8s %5s %6s %9s %5s %6s %8s %6s %5s %7s\n", "pages", "logged", "GUI read", "laps", "drop",
+	 "DIAG read", "laps", "drop", "written", "resets", "torn", "loaded");
+  CheckReaders(0, 0, events);
+  CheckReaders(CHECK_REGION_PAGE, 1, events);
+  CheckReaders(CHECK_REGION_PAGE + CHECK_MAX_PAGES, 2, events);
+  CheckReaders(CHECK_REGION_PAGE + 2 * CHECK_MAX_PAGES, 5, events);
+  CheckReaders(CHECK_REGION_PAGE + 3 * CHECK_MAX_PAGES, CHECK_MAX_PAGES, events);
+
+  printf("\nPASS\n");
+  return 0;
+}
+
+
+// The node start up and main loop are not used, the check calls the event log directly
+void SimAppInitialize(const SimNodeConfig* config) {
+}
+
+void SimAppMainLoop(unsigned long long time_ns) {
+}
+
+void SimAppReport(SimNodeReportData* report) {
+}
+
+
+// These are normally provided by the ECB application
+ETMCanSyncMessage etm_can_master_sync_message;
+
+unsigned int SendCalibrationData(unsigned int index, unsigned int scale, unsigned int offset) {
+  return 0;
+}
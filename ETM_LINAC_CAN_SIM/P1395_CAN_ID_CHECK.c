@@ -0,0 +1,242 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <xc.h>
+#include "P1395_CAN_CORE.h"
+
+/*
+  P1395 CAN identifier check
+
+  Usage: p1395_can_id_check
+
+  Checks the identifier macros in P1395_CAN_CORE.h for every one of the 2^11 standard identifiers.
+   - ETM_CAN_ID_TO_TX_SID / ETM_CAN_TX_SID_TO_ID and ETM_CAN_ID_TO_RX_SID / ETM_CAN_RX_SID_TO_ID round trip, and the SID
+     values match the CxTXxSID and CxRXxSID register layouts (built here bit by bit from the data sheet, not from the
+     macros).  A frame sent with the TX SID is received with the RX SID of the same identifier.
+   - ETM_CAN_ID, ETM_CAN_ID_CLASS, ETM_CAN_ID_ADDRESS and ETM_CAN_ID_LOG_REGISTER split and rebuild every identifier, and
+     ETM_CAN_TX_SID / ETM_CAN_LOG_TX_SID give the same SID as converting the identifier.
+   - The ETM_CAN_MSG_xxx constants have the values written next to them.
+   - The masks and filters that ETMCanMasterInitialize() / ETMCanSlaveInitialize() load (RXF0 -> RXF2) route each
+     message class to the RX buffer and filter that DoCanInterrupt() expects, on every slave address.
+
+  Returns 0 if every check passes.
+*/
+
+
+static unsigned int id_check_failures;
+
+
+static void IdCheckFail(const char* message, unsigned int id, unsigned int got, unsigned int expected) {
+  if (id_check_failures < 20) {
+    printf("FAIL: id 0x%03X %s (0x%04X, expected 0x%04X)\n", id, message, got, expected);
+  }
+  id_check_failures++;
+}
+
+
+static unsigned int IdCheckTXSID(unsigned int id) {
+  /*
+    CxTXxSID: SID<10:6> in bits 15:11, bits 10:8 unimplemented, SID<5:0> in bits 7:2, SRR in bit 1 and TXIDE in bit 0
+  */
+  unsigned int sid;
+  unsigned int bit;
+
+  sid = 0;
+  for (bit = 0; bit < 11; bit++) {
+    if (id & (1 << bit)) {
+      sid |= (bit >= 6) ? (1 << (bit - 6 + 11)) : (1 << (bit + 2));
+    }
+  }
+  return sid;
+}
+
+
+static unsigned int IdCheckRXSID(unsigned int id) {
+  /*
+    CxRXxSID and CxRXFnSID: SID<10:0> in bits 12:2, bit 0 is RXIDE / EXIDE
+  */
+  unsigned int sid;
+  unsigned int bit;
+
+  sid = 0;
+  for (bit = 0; bit < 11; bit++) {
+    if (id & (1 << bit)) {
+      sid |= (1 << (bit + 2));
+    }
+  }
+  return sid;
+}
+
+
+static unsigned int IdCheckAccept(unsigned int rx_sid, unsigned int mask, unsigned int filter) {
+  return (((rx_sid ^ filter) & mask & 0x1FFC) == 0);
+}
+
+
+/*
+  Where a frame ends up: 0 = not received, otherwise (buffer * 4 + filter + 1).  A frame that matches a buffer 0 filter
+  goes to buffer 0 even if it also matches buffer 1.  RXF3 -> RXF5 are not loaded by the library and are not modeled.
+*/
+#define ID_CHECK_NOT_RECEIVED   0
+#define ID_CHECK_RX0_RF0        1
+#define ID_CHECK_RX0_RF1        2
+#define ID_CHECK_RX1_RF2        7
+
+static unsigned int IdCheckRoute(unsigned int id, unsigned int mask0, unsigned int mask1, unsigned int rf0, unsigned int rf1, unsigned int rf2) {
+  unsigned int rx_sid;
+
+  rx_sid = IdCheckRXSID(id);
+  if (IdCheckAccept(rx_sid, mask0, rf0)) {
+    return ID_CHECK_RX0_RF0;
+  }
+  if (IdCheckAccept(rx_sid, mask0, rf1)) {
+    return ID_CHECK_RX0_RF1;
+  }
+  if (IdCheckAccept(rx_sid, mask1, rf2)) {
+    return ID_CHECK_RX1_RF2;
+  }
+  return ID_CHECK_NOT_RECEIVED;
+}
+
+
+static void IdCheckConstant(const char* name, unsigned int value, unsigned int expected) {
+  if (value != expected) {
+    printf("FAIL: %s is 0x%04X, expected 0x%04X\n", name, value, expected);
+    id_check_failures++;
+  }
+}
+
+
+int main(int argc, char** argv) {
+  unsigned int id;
+  unsigned int tx_sid;
+  unsigned int rx_sid;
+  unsigned int id_class;
+  unsigned int address;
+  unsigned int slave;
+  unsigned int expected;
+  unsigned int route;
+  unsigned int seen[0x10000 / 32];
+
+  if (argc > 1) {
+    fprintf(stderr, "usage: %s\n", argv[0]);
+    return 1;
+  }
+
+  // Every identifier through the SID conversions
+  for (id = 0; id < 0x10000 / 32; id++) {
+    seen[id] = 0;
+  }
+  for (id = 0; id <= ETM_CAN_ID_MASK; id++) {
+    tx_sid = ETM_CAN_ID_TO_TX_SID(id);
+    rx_sid = ETM_CAN_ID_TO_RX_SID(id);
+    if (tx_sid != IdCheckTXSID(id)) {
+      IdCheckFail("ETM_CAN_ID_TO_TX_SID does not match the CxTXxSID layout", id, tx_sid, IdCheckTXSID(id));
+    }
+    if (rx_sid != IdCheckRXSID(id)) {
+      IdCheckFail("ETM_CAN_ID_TO_RX_SID does not match the CxRXxSID layout", id, rx_sid, IdCheckRXSID(id));
+    }
+    if (ETM_CAN_TX_SID_TO_ID(tx_sid) != id) {
+      IdCheckFail("ETM_CAN_TX_SID_TO_ID(ETM_CAN_ID_TO_TX_SID) does not round trip", id, ETM_CAN_TX_SID_TO_ID(tx_sid), id);
+    }
+    if (ETM_CAN_RX_SID_TO_ID(rx_sid) != id) {
+      IdCheckFail("ETM_CAN_RX_SID_TO_ID(ETM_CAN_ID_TO_RX_SID) does not round trip", id, ETM_CAN_RX_SID_TO_ID(rx_sid), id);
+    }
+    // The SRR / TXIDE and RXIDE bits are set by the hardware when a SID is read back, they must not change the identifier
+    if (ETM_CAN_TX_SID_TO_ID(tx_sid | 0x0703) != id) {
+      IdCheckFail("ETM_CAN_TX_SID_TO_ID uses bits outside the SID", id, ETM_CAN_TX_SID_TO_ID(tx_sid | 0x0703), id);
+    }
+    if (ETM_CAN_RX_SID_TO_ID(rx_sid | 0xE003) != id) {
+      IdCheckFail("ETM_CAN_RX_SID_TO_ID uses bits outside the SID", id, ETM_CAN_RX_SID_TO_ID(rx_sid | 0xE003), id);
+    }
+    if (ETM_CAN_ID_TO_RX_SID(ETM_CAN_TX_SID_TO_ID(tx_sid)) != rx_sid) {
+      IdCheckFail("a frame sent with ETM_CAN_ID_TO_TX_SID is not received with ETM_CAN_ID_TO_RX_SID", id,
+		  ETM_CAN_ID_TO_RX_SID(ETM_CAN_TX_SID_TO_ID(tx_sid)), rx_sid);
+    }
+    if (seen[tx_sid >> 5] & (1 << (tx_sid & 31))) {
+      IdCheckFail("two identifiers have the same TX SID", id, tx_sid, tx_sid);
+    }
+    seen[tx_sid >> 5] |= (1 << (tx_sid & 31));
+
+    // Split the identifier and build it again
+    id_class = ETM_CAN_ID_CLASS(id);
+    address = ETM_CAN_ID_ADDRESS(id);
+    if ((ETM_CAN_ID(id_class, address) != id) || ((id_class | address) != id) || (id_class & address)) {
+      IdCheckFail("ETM_CAN_ID(ETM_CAN_ID_CLASS, ETM_CAN_ID_ADDRESS) does not rebuild the identifier", id,
+		  ETM_CAN_ID(id_class, address), id);
+    }
+    if (ETM_CAN_ID(id_class, address + 0x10) != id) {
+      IdCheckFail("ETM_CAN_ID does not mask the address", id, ETM_CAN_ID(id_class, address + 0x10), id);
+    }
+    if (ETM_CAN_TX_SID(id_class, address) != tx_sid) {
+      IdCheckFail("ETM_CAN_TX_SID does not match ETM_CAN_ID_TO_TX_SID", id, ETM_CAN_TX_SID(id_class, address), tx_sid);
+    }
+    if (id & ETM_CAN_ID_LOG) {
+      if (ETM_CAN_ID_LOG_REGISTER(id) != (id_class & ~ETM_CAN_ID_LOG)) {
+	IdCheckFail("ETM_CAN_ID_LOG_REGISTER is not the class without ETM_CAN_ID_LOG", id, ETM_CAN_ID_LOG_REGISTER(id),
+		    id_class & ~ETM_CAN_ID_LOG);
+      }
+      if (ETM_CAN_LOG_TX_SID(ETM_CAN_ID_LOG_REGISTER(id), address) != tx_sid) {
+	IdCheckFail("ETM_CAN_LOG_TX_SID does not match ETM_CAN_ID_TO_TX_SID", id,
+		    ETM_CAN_LOG_TX_SID(ETM_CAN_ID_LOG_REGISTER(id), address), tx_sid);
+      }
+    }
+  }
+
+  // The constants and the binary values in their comments
+  IdCheckConstant("ETM_CAN_MSG_RTN_RX", ETM_CAN_MSG_RTN_RX, 0b0000001000000000);
+  IdCheckConstant("ETM_CAN_MSG_STATUS_RX", ETM_CAN_MSG_STATUS_RX, 0b0000001001000000);
+  IdCheckConstant("ETM_CAN_MSG_LVL_TX", ETM_CAN_MSG_LVL_TX, 0b0000000000000000);
+  IdCheckConstant("ETM_CAN_MSG_SYNC_TX", ETM_CAN_MSG_SYNC_TX, 0b0000100000000000);
+  IdCheckConstant("ETM_CAN_MSG_RTN_TX", ETM_CAN_MSG_RTN_TX, 0b0001000000000000);
+  IdCheckConstant("ETM_CAN_MSG_STATUS_TX", ETM_CAN_MSG_STATUS_TX, 0b0001000001000000);
+  IdCheckConstant("ETM_CAN_MSG_CMD_TX", ETM_CAN_MSG_CMD_TX, 0b0110000000000000);
+  IdCheckConstant("ETM_CAN_MSG_LOG_TX", ETM_CAN_MSG_LOG_TX, 0b1000000000000000);
+  IdCheckConstant("ETM_CAN_MASTER_MSG_TYPE_MASK & ETM_CAN_MSG_RTN_RX", ETM_CAN_MASTER_MSG_TYPE_MASK & ETM_CAN_MSG_RTN_RX, ETM_CAN_MSG_RTN_RX);
+  IdCheckConstant("ETM_CAN_MASTER_MSG_TYPE_MASK & ETM_CAN_MSG_STATUS_RX", ETM_CAN_MASTER_MSG_TYPE_MASK & ETM_CAN_MSG_STATUS_RX, ETM_CAN_MSG_STATUS_RX);
+  IdCheckConstant("ETM_CAN_MASTER_MSG_TYPE_MASK address bits", ETM_CAN_MASTER_MSG_TYPE_MASK & ETM_CAN_ID_TO_RX_SID(ETM_CAN_ID_ADDRESS_MASK), 0);
+
+  // Every class and address through the master and slave acceptance filters
+  for (id = 0; id <= ETM_CAN_ID_MASK; id++) {
+    id_class = ETM_CAN_ID_CLASS(id);
+
+    expected = ID_CHECK_NOT_RECEIVED;
+    if (id_class == ETM_CAN_ID_LVL) {
+      expected = ID_CHECK_RX0_RF0;
+    } else if ((id_class == ETM_CAN_ID_RTN) || (id_class == ETM_CAN_ID_STATUS)) {
+      expected = ID_CHECK_RX0_RF1;
+    } else if (id & ETM_CAN_ID_LOG) {
+      expected = ID_CHECK_RX1_RF2;
+    }
+    route = IdCheckRoute(id, ETM_CAN_MASTER_RX0_MASK, ETM_CAN_MASTER_RX1_MASK, ETM_CAN_MASTER_MSG_FILTER_RF0,
+			 ETM_CAN_MASTER_MSG_FILTER_RF1, ETM_CAN_MASTER_MSG_FILTER_RF2);
+    // The master filters are wider than the classes it uses, only check the classes that are sent on the bus
+    if (((id_class == ETM_CAN_ID_LVL) || (id_class == ETM_CAN_ID_SYNC) || (id_class == ETM_CAN_ID_RTN) ||
+	 (id_class == ETM_CAN_ID_STATUS) || (id_class == ETM_CAN_ID_CMD) || (id & ETM_CAN_ID_LOG)) && (route != expected)) {
+      IdCheckFail("the master receives this identifier in the wrong place", id, route, expected);
+    }
+
+    for (slave = 0; slave <= ETM_CAN_ID_ADDRESS_MASK; slave++) {
+      expected = ID_CHECK_NOT_RECEIVED;
+      if (id_class == ETM_CAN_ID_LVL) {
+	expected = ID_CHECK_RX0_RF0;
+      } else if (id_class == ETM_CAN_ID_SYNC) {
+	expected = ID_CHECK_RX0_RF1;
+      } else if (id == ETM_CAN_ID(ETM_CAN_ID_CMD, slave)) {
+	expected = ID_CHECK_RX1_RF2;
+      }
+      route = IdCheckRoute(id, ETM_CAN_SLAVE_RX0_MASK, ETM_CAN_SLAVE_RX1_MASK, ETM_CAN_SLAVE_MSG_FILTER_RF0,
+			   ETM_CAN_SLAVE_MSG_FILTER_RF1, (ETM_CAN_SLAVE_MSG_FILTER_RF2 | ETM_CAN_ID_TO_RX_SID(slave)));
+      if (((id_class == ETM_CAN_ID_LVL) || (id_class == ETM_CAN_ID_SYNC) || (id_class == ETM_CAN_ID_RTN) ||
+	   (id_class == ETM_CAN_ID_STATUS) || (id_class == ETM_CAN_ID_CMD) || (id & ETM_CAN_ID_LOG)) && (route != expected)) {
+	IdCheckFail("a slave receives this identifier in the wrong place", id, route, expected);
+      }
+    }
+  }
+
+  if (id_check_failures) {
+    printf("%u checks FAILED\n", id_check_failures);
+    return 1;
+  }
+  printf("%u identifiers, TX / RX SID round trip, fields, constants and filters PASS\n", ETM_CAN_ID_MASK + 1);
+  return 0;
+}
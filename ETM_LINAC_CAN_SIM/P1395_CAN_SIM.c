@@ -0,0 +1,828 @@
+#define _GNU_SOURCE
+#include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "P1395_CAN_SIM.h"
+
+/*
+  P1395 CAN network simulator - virtual bus
+
+  Usage: p1395_can_sim [options]
+    -t seconds      simulated run time                         (default 10)
+    -f fcy          instruction clock of every board in Hz     (default 10000000)
+    -p deci_hertz   pulse repetition rate x10, 0 = no pulses   (default 4000 = 400Hz)
+    -l              enable high speed (pulse by pulse) logging on the ECB
+    -c              ECB writes a full calibration set to every slave with block transfers and reads it back
+    -b list         comma separated slave addresses            (default 1,2,3,4,5,6,7,8)
+    -g list         comma separated slave addresses that the ECB debugs, the first is the GUI selection (default none)
+    -m microseconds main loop period of every board            (default 50)
+    -d directory    location of the node shared objects        (default directory of the executable)
+
+  One ECB (P1395_CAN_SIM_ECB.so) and one instance of P1395_CAN_SIM_SLAVE.so per slave address are loaded, each into a
+  private dlmopen() namespace.  Each board runs its main loop every -m microseconds (the boards are staggered) and the
+  CAN interrupt is serviced whenever the bus changes one of the board's CAN registers.
+
+  The bus arbitrates between all pending TX buffers by identifier, applies the masks and filters of every receiver,
+  and holds the bus for the length of the bit stuffed frame.  The bit time is taken from the CxCFG1/CxCFG2 registers
+  of the ECB (Fcan = 4xFcy).
+
+  Reported
+    - Bus utilization (average and worst 100ms window)
+    - Latency per message class, measured from the time a message is added to its transmit queue until the
+      end of its frame on the bus
+    - TX buffers that were overwritten by the firmware before the frame made it onto the bus (clobbered)
+    - RX buffer overruns per board and the write/overwrite counts of the library message buffers
+*/
+
+
+#define SIM_MAX_NODES                 16
+#define SIM_STAMP_FIFO_SIZE           256
+#define SIM_WINDOW_NS                 100000000ULL
+#define SIM_MAX_WINDOWS               100000
+
+#define SIM_CLASS_LVL                 0
+#define SIM_CLASS_SYNC                1
+#define SIM_CLASS_RTN                 2
+#define SIM_CLASS_STATUS              3
+#define SIM_CLASS_CMD                 4
+#define SIM_CLASS_FAST_LOG            5
+#define SIM_CLASS_LOG                 6
+#define SIM_CLASS_UNKNOWN             7
+#define SIM_CLASS_COUNT               8
+
+static const char* sim_class_name[SIM_CLASS_COUNT] = {
+  "LVL", "SYNC", "RTN", "STATUS", "CMD", "FAST_LOG", "LOG", "UNKNOWN"
+};
+
+// The transmit queues (transmit scheduler classes) followed by the RX latency
+static const char* sim_timing_name[SIM_TX_QUEUES + 1] = {
+  "tx level", "tx sts/syn", "tx cmd/rtn", "tx log", "rx"
+};
+
+
+typedef struct {
+  unsigned int       loaded;          // TXREQ has been seen for the current contents
+  unsigned int       on_bus;          // The frame is being transmitted
+  unsigned long long stamp_ns;        // Time the frame was queued by the firmware
+  unsigned int       sid;
+  unsigned int       data[4];
+} SimMailbox;
+
+
+typedef struct {
+  SimNodeConfig             config;
+  char                      name[16];
+  void*                     handle;
+  SimNodeMainLoopFunction   main_loop;
+  SimNodeInterruptFunction  interrupt;
+  SimNodeReportFunction     report;
+  SimCanPort*               port;
+  unsigned long long        next_step_ns;
+
+  SimMailbox                mailbox[3];
+  unsigned long long        stamp_fifo[SIM_TX_QUEUES][SIM_STAMP_FIFO_SIZE];
+  unsigned int              stamp_read[SIM_TX_QUEUES];
+  unsigned int              stamp_write[SIM_TX_QUEUES];
+  unsigned int              tx_queue_writes[SIM_TX_QUEUES];
+
+  unsigned long             rx_overrun[2];
+  unsigned long             frames_sent;
+  unsigned long             frames_received;
+  SimNodeReportData         report_data;
+} SimNode;
+
+
+typedef struct {
+  unsigned long       frames;
+  unsigned long long  busy_ns;
+  unsigned long long  latency_total_ns;
+  unsigned long long  latency_min_ns;
+  unsigned long long  latency_max_ns;
+  unsigned long       clobbered_pending;
+  unsigned long       clobbered_on_bus;
+} SimClassStats;
+
+
+static SimNode        sim_node[SIM_MAX_NODES];
+static unsigned int   sim_node_count;
+static SimClassStats  sim_class_stats[SIM_CLASS_COUNT];
+static unsigned long long sim_window_busy_ns[SIM_MAX_WINDOWS];
+static unsigned long  sim_id_collisions;
+
+
+// ------------------ FRAME HELPERS ------------------- //
+
+static unsigned int SimTXSidToIdentifier(unsigned int sid) {
+  // TRANSMIT MODE 0bCCCCCXXXCCAAAA00
+  return (((sid >> 11) & 0x1F) << 6) | ((sid >> 2) & 0x3F);
+}
+
+
+static unsigned int SimClassify(unsigned int identifier) {
+  if (identifier < 0x040) {
+    return SIM_CLASS_LVL;
+  }
+  if (identifier < 0x080) {
+    return SIM_CLASS_SYNC;
+  }
+  if (identifier < 0x090) {
+    return SIM_CLASS_RTN;
+  }
+  if (identifier < 0x0A0) {
+    return SIM_CLASS_STATUS;
+  }
+  if ((identifier >= 0x100) && (identifier < 0x400)) {
+    return SIM_CLASS_CMD;
+  }
+  if (identifier >= 0x400) {
+    if ((identifier & 0x3F0) < 0x040) {
+      return SIM_CLASS_FAST_LOG;
+    }
+    return SIM_CLASS_LOG;
+  }
+  return SIM_CLASS_UNKNOWN;
+}
+
+
+static unsigned int SimFrameDataLength(unsigned int dlc_register) {
+  unsigned int length;
+  // TX DLC bits 6:3
+  length = (dlc_register >> 3) & 0x0F;
+  if (length > 8) {
+    length = 8;
+  }
+  return length;
+}
+
+
+/*
+  Returns the number of bits the frame occupies on the bus, including stuff bits and interframe space.
+  Stuffing applies from SOF to the end of the CRC.
+*/
+static unsigned int SimFrameBits(unsigned int identifier, unsigned int data_length, const unsigned int* data) {
+  unsigned char bits[128];
+  unsigned int count = 0;
+  unsigned int n;
+  unsigned int crc = 0;
+  unsigned int crc_next;
+  unsigned int stuffed;
+  unsigned int run;
+  unsigned int byte;
+  unsigned int last;
+
+  bits[count++] = 0;                                   // SOF
+  for (n = 0; n < 11; n++) {
+    bits[count++] = (identifier >> (10 - n)) & 1;      // Identifier
+  }
+  bits[count++] = 0;                                   // RTR
+  bits[count++] = 0;                                   // IDE
+  bits[count++] = 0;                                   // r0
+  for (n = 0; n < 4; n++) {
+    bits[count++] = (data_length >> (3 - n)) & 1;      // DLC
+  }
+  for (n = 0; n < data_length; n++) {
+    byte = (data[n >> 1] >> ((n & 1) * 8)) & 0xFF;     // B1 low byte is the first data byte
+    for (run = 0; run < 8; run++) {
+      bits[count++] = (byte >> (7 - run)) & 1;
+    }
+  }
+
+  for (n = 0; n < count; n++) {
+    crc_next = bits[n] ^ ((crc >> 14) & 1);
+    crc = (crc << 1) & 0x7FFF;
+    if (crc_next) {
+      crc ^= 0x4599;
+    }
+  }
+  for (n = 0; n < 15; n++) {
+    bits[count++] = (crc >> (14 - n)) & 1;
+  }
+
+  // After 5 equal bits a complementary stuff bit is inserted, the stuff bit starts the next run
+  stuffed = 0;
+  run = 1;
+  last = bits[0];
+  for (n = 1; n < count; n++) {
+    if (bits[n] == last) {
+      run++;
+    } else {
+      run = 1;
+      last = bits[n];
+    }
+    if (run == 5) {
+      stuffed++;
+      last = !last;
+      run = 1;
+    }
+  }
+
+  // CRC delimiter, ACK slot, ACK delimiter, EOF, IFS
+  return count + stuffed + 1 + 2 + 7 + 3;
+}
+
+
+/*
+  Bit time in nanoseconds from the CAN configuration registers
+  TQ = 2 x (BRP + 1) / Fcan with Fcan = 4 x Fcy
+*/
+static double SimBitTimeNs(unsigned int cfg1, unsigned int cfg2, unsigned long fcy) {
+  unsigned int brp;
+  unsigned int prseg;
+  unsigned int seg1ph;
+  unsigned int seg2ph;
+  double tq_ns;
+
+  brp = cfg1 & 0x3F;
+  prseg = (cfg2 & 0x07) + 1;
+  seg1ph = ((cfg2 >> 3) & 0x07) + 1;
+  if (cfg2 & 0x0080) {
+    seg2ph = ((cfg2 >> 8) & 0x07) + 1;
+  } else {
+    seg2ph = seg1ph;
+  }
+  tq_ns = (2.0 * (brp + 1) * 1.0e9) / (4.0 * (double)fcy);
+  return tq_ns * (1 + prseg + seg1ph + seg2ph);
+}
+
+
+// ------------------ NODE BOOKKEEPING ------------------- //
+
+// The transmit queue that messages of each class are sent from
+static unsigned int SimClassToTXQueue(unsigned int sim_class) {
+  switch (sim_class)
+    {
+    case SIM_CLASS_LVL:
+      return SIM_TX_QUEUE_PULSE_LEVEL;
+    case SIM_CLASS_SYNC:
+    case SIM_CLASS_STATUS:
+      return SIM_TX_QUEUE_STATUS_SYNC;
+    case SIM_CLASS_RTN:
+    case SIM_CLASS_CMD:
+      return SIM_TX_QUEUE_CMD;
+    }
+  return SIM_TX_QUEUE_LOG;
+}
+
+
+static void SimStampPush(SimNode* node, unsigned int queue, unsigned long long stamp_ns) {
+  node->stamp_fifo[queue][node->stamp_write[queue] % SIM_STAMP_FIFO_SIZE] = stamp_ns;
+  node->stamp_write[queue]++;
+}
+
+
+static unsigned long long SimStampPop(SimNode* node, unsigned int queue, unsigned long long now_ns) {
+  if (node->stamp_read[queue] == node->stamp_write[queue]) {
+    return now_ns;
+  }
+  return node->stamp_fifo[queue][node->stamp_read[queue]++ % SIM_STAMP_FIFO_SIZE];
+}
+
+
+static double SimTimingCountsToMicroseconds(SimNode* node, unsigned int counts) {
+  return (double)counts * node->report_data.can_timing[SIM_CAN_TIMING_COUNT_NS] / 1000.0;
+}
+
+
+static void SimRecordClobber(SimMailbox* mailbox) {
+  SimClassStats* stats;
+  stats = &sim_class_stats[SimClassify(SimTXSidToIdentifier(mailbox->sid))];
+  if (mailbox->on_bus) {
+    stats->clobbered_on_bus++;
+  } else {
+    stats->clobbered_pending++;
+  }
+}
+
+
+/*
+  Called every time the node firmware has run.
+  Time stamps newly queued messages and finds TX buffers that the firmware has loaded or overwritten.
+*/
+static void SimNodeScan(SimNode* node, unsigned long long now_ns) {
+  unsigned int n;
+  unsigned int writes;
+  unsigned int changed;
+  SimMailbox* mailbox;
+  volatile SimCanBufferRegisters* tx;
+
+  node->report(&node->report_data);
+  for (n = 0; n < SIM_TX_QUEUES; n++) {
+    writes = node->report_data.tx_queue_write_count[n];
+    while (node->tx_queue_writes[n] != writes) {
+      SimStampPush(node, n, now_ns);
+      node->tx_queue_writes[n]++;
+    }
+  }
+
+  for (n = 0; n < 3; n++) {
+    mailbox = &node->mailbox[n];
+    tx = &node->port->tx[n];
+    changed = (tx->sid != mailbox->sid) || ((tx->b1 & 0xFFFF) != mailbox->data[0]) || ((tx->b2 & 0xFFFF) != mailbox->data[1]) ||
+      ((tx->b3 & 0xFFFF) != mailbox->data[2]) || ((tx->b4 & 0xFFFF) != mailbox->data[3]);
+
+    if (mailbox->loaded && changed) {
+      // The firmware replaced a frame that had not been sent (or was being sent)
+      SimRecordClobber(mailbox);
+      mailbox->loaded = 0;
+      mailbox->on_bus = 0;
+    }
+
+    if ((tx->con & SIM_CAN_TXCON_TXREQ) && (!mailbox->loaded)) {
+      mailbox->loaded = 1;
+      mailbox->sid = tx->sid;
+      mailbox->data[0] = tx->b1 & 0xFFFF;
+      mailbox->data[1] = tx->b2 & 0xFFFF;
+      mailbox->data[2] = tx->b3 & 0xFFFF;
+      mailbox->data[3] = tx->b4 & 0xFFFF;
+      // Every TX buffer is loaded by the transmit scheduler, in order, from the queue for the message class
+      mailbox->stamp_ns = SimStampPop(node, SimClassToTXQueue(SimClassify(SimTXSidToIdentifier(tx->sid))), now_ns);
+    }
+  }
+}
+
+
+static void SimNodeRun(SimNode* node, unsigned long long now_ns) {
+  node->main_loop(now_ns);
+  SimNodeScan(node, now_ns);
+}
+
+
+static void SimNodeRunInterrupt(SimNode* node, unsigned long long now_ns) {
+  node->interrupt(now_ns);
+  SimNodeScan(node, now_ns);
+}
+
+
+static void SimRaiseFlag(SimNode* node, unsigned int intf_bit) {
+  node->port->intf |= intf_bit;
+  if (node->port->inte & intf_bit) {
+    node->port->flag = 1;
+  }
+}
+
+
+// ------------------ BUS ------------------- //
+
+static int SimSelectMailbox(SimNode* node) {
+  int n;
+  int selected = -1;
+  unsigned int priority = 0;
+  volatile SimCanBufferRegisters* tx;
+
+  if (node->port->ctrl & 0x0700) {
+    // Not in normal operating mode
+    return -1;
+  }
+  // Highest TXPRI wins, the higher buffer number wins a tie
+  for (n = 0; n < 3; n++) {
+    tx = &node->port->tx[n];
+    if ((tx->con & SIM_CAN_TXCON_TXREQ) && ((selected < 0) || ((tx->con & SIM_CAN_TXCON_TXPRI) >= priority))) {
+      selected = n;
+      priority = tx->con & SIM_CAN_TXCON_TXPRI;
+    }
+  }
+  return selected;
+}
+
+
+static unsigned int SimAccept(SimNode* node, unsigned int rx_sid, unsigned int filter, unsigned int mask) {
+  return (((rx_sid ^ node->port->rxf_sid[filter]) & node->port->rxm_sid[mask] & 0x1FFC) == 0);
+}
+
+
+static void SimDeliver(SimNode* node, unsigned int identifier, unsigned int dlc, const unsigned int* data) {
+  unsigned int rx_sid;
+  unsigned int buffer;
+  unsigned int filter_hit;
+  volatile SimCanBufferRegisters* rx;
+
+  if (node->port->ctrl & 0x0700) {
+    return;
+  }
+  rx_sid = identifier << 2;
+
+  // RXB0 is checked first (filters 0,1), then RXB1 (filters 2-5)
+  if (SimAccept(node, rx_sid, 0, 0)) {
+    buffer = 0;
+    filter_hit = 0;
+  } else if (SimAccept(node, rx_sid, 1, 0)) {
+    buffer = 0;
+    filter_hit = 1;
+  } else {
+    buffer = 1;
+    for (filter_hit = 2; filter_hit < 6; filter_hit++) {
+      if (SimAccept(node, rx_sid, filter_hit, 1)) {
+	break;
+      }
+    }
+    if (filter_hit == 6) {
+      return;
+    }
+  }
+
+  rx = &node->port->rx[buffer];
+  if (rx->con & SIM_CAN_RXCON_RXFUL) {
+    node->rx_overrun[buffer]++;
+    node->port->intf |= (buffer == 0) ? SIM_CAN_INTF_RX0OVR : SIM_CAN_INTF_RX1OVR;
+    return;
+  }
+
+  rx->sid = rx_sid;
+  rx->dlc = dlc;
+  rx->b1 = data[0];
+  rx->b2 = data[1];
+  rx->b3 = data[2];
+  rx->b4 = data[3];
+  if (buffer == 0) {
+    rx->con = (rx->con & ~0x0001) | filter_hit;
+  } else {
+    rx->con = (rx->con & ~0x0007) | filter_hit;
+  }
+  rx->con |= SIM_CAN_RXCON_RXFUL;
+  node->frames_received++;
+  SimRaiseFlag(node, (buffer == 0) ? SIM_CAN_INTF_RX0IF : SIM_CAN_INTF_RX1IF);
+}
+
+
+static void SimAddBusy(unsigned long long start_ns, unsigned long long end_ns) {
+  unsigned long long window;
+  unsigned long long window_end;
+  while (start_ns < end_ns) {
+    window = start_ns / SIM_WINDOW_NS;
+    window_end = (window + 1) * SIM_WINDOW_NS;
+    if (window_end > end_ns) {
+      window_end = end_ns;
+    }
+    if (window < SIM_MAX_WINDOWS) {
+      sim_window_busy_ns[window] += window_end - start_ns;
+    }
+    start_ns = window_end;
+  }
+}
+
+
+// ------------------ SETUP ------------------- //
+
+static void SimLoadNode(SimNode* node, const char* path) {
+  SimNodeStartFunction start;
+  SimNodeCanPortFunction can_port;
+
+  node->handle = dlmopen(LM_ID_NEWLM, path, RTLD_NOW | RTLD_LOCAL);
+  if (node->handle == NULL) {
+    fprintf(stderr, "Unable to load %s: %s\n", path, dlerror());
+    exit(1);
+  }
+  start = (SimNodeStartFunction)dlsym(node->handle, SIM_NODE_START_SYMBOL);
+  node->main_loop = (SimNodeMainLoopFunction)dlsym(node->handle, SIM_NODE_MAIN_LOOP_SYMBOL);
+  node->interrupt = (SimNodeInterruptFunction)dlsym(node->handle, SIM_NODE_INTERRUPT_SYMBOL);
+  node->report = (SimNodeReportFunction)dlsym(node->handle, SIM_NODE_REPORT_SYMBOL);
+  can_port = (SimNodeCanPortFunction)dlsym(node->handle, SIM_NODE_CAN_PORT_SYMBOL);
+  if (!start || !node->main_loop || !node->interrupt || !node->report || !can_port) {
+    fprintf(stderr, "%s is not a simulator node\n", path);
+    exit(1);
+  }
+  node->port = can_port();
+  start(&node->config);
+  SimNodeScan(node, 0);
+}
+
+
+static void SimUsage(const char* program) {
+  fprintf(stderr, "usage: %s [-t seconds] [-f fcy] [-p prf_deci_hertz] [-l] [-c] [-b addr,addr,...] [-g addr,addr,...] [-m main_loop_us] [-d so_directory]\n", program);
+  exit(1);
+}
+
+
+int main(int argc, char** argv) {
+  double run_seconds = 10.0;
+  unsigned long fcy = 10000000;
+  unsigned int prf_deci_hertz = 4000;
+  unsigned int high_speed_logging = 0;
+  unsigned int calibration_test = 0;
+  unsigned int main_loop_us = 50;
+  const char* board_list = "1,2,3,4,5,6,7,8";
+  const char* debug_list = "";
+  unsigned int debug_board_count = 0;
+  unsigned int debug_board[SIM_DEBUG_BOARDS];
+  char so_directory[512];
+  char path[600];
+  char list_copy[256];
+  char* token;
+  int option;
+  unsigned int n;
+  unsigned int m;
+  unsigned long long now_ns;
+  unsigned long long end_ns;
+  unsigned long long next_ns;
+  unsigned long long main_loop_ns;
+  unsigned long long busy_until_ns = 0;
+  unsigned long long bus_busy_total_ns = 0;
+  unsigned long long latency_ns;
+  unsigned long long peak_window_ns;
+  double bit_ns;
+  double slave_bit_ns;
+  int bus_busy = 0;
+  int tx_node = -1;
+  int tx_mailbox = -1;
+  int selected;
+  unsigned int identifier;
+  unsigned int best_identifier;
+  unsigned int tx_identifier = 0;
+  unsigned int tx_dlc = 0;
+  unsigned int tx_data[4];
+  unsigned int frame_bits;
+  SimNode* node;
+  SimClassStats* stats;
+  unsigned int* timing_ptr;
+  char* slash;
+
+  strncpy(so_directory, argv[0], sizeof(so_directory) - 1);
+  so_directory[sizeof(so_directory) - 1] = 0;
+  slash = strrchr(so_directory, '/');
+  if (slash) {
+    *slash = 0;
+  } else {
+    strcpy(so_directory, ".");
+  }
+
+  while ((option = getopt(argc, argv, "t:f:p:lcb:g:m:d:")) != -1) {
+    switch (option)
+      {
+      case 't': run_seconds = atof(optarg); break;
+      case 'f': fcy = strtoul(optarg, NULL, 0); break;
+      case 'p': prf_deci_hertz = strtoul(optarg, NULL, 0); break;
+      case 'l': high_speed_logging = 1; break;
+      case 'c': calibration_test = 1; break;
+      case 'b': board_list = optarg; break;
+      case 'g': debug_list = optarg; break;
+      case 'm': main_loop_us = strtoul(optarg, NULL, 0); break;
+      case 'd': strncpy(so_directory, optarg, sizeof(so_directory) - 1); break;
+      default: SimUsage(argv[0]);
+      }
+  }
+  if ((main_loop_us == 0) || (run_seconds <= 0)) {
+    SimUsage(argv[0]);
+  }
+
+  // The ECB is always node 0
+  node = &sim_node[sim_node_count++];
+  node->config.role = SIM_NODE_ROLE_ECB;
+  node->config.address = 14;
+  strcpy(node->name, "ECB");
+
+  strncpy(list_copy, board_list, sizeof(list_copy) - 1);
+  for (token = strtok(list_copy, ","); token; token = strtok(NULL, ",")) {
+    if (sim_node_count >= SIM_MAX_NODES) {
+      fprintf(stderr, "Too many boards\n");
+      return 1;
+    }
+    node = &sim_node[sim_node_count++];
+    node->config.role = SIM_NODE_ROLE_SLAVE;
+    node->config.address = strtoul(token, NULL, 0) & 0x0F;
+    snprintf(node->name, sizeof(node->name), "SLAVE_%u", node->config.address);
+  }
+
+  strncpy(list_copy, debug_list, sizeof(list_copy) - 1);
+  for (token = strtok(list_copy, ","); token; token = strtok(NULL, ",")) {
+    if (debug_board_count >= SIM_DEBUG_BOARDS) {
+      fprintf(stderr, "Too many debug boards\n");
+      return 1;
+    }
+    debug_board[debug_board_count++] = strtoul(token, NULL, 0) & 0x0F;
+  }
+
+  main_loop_ns = (unsigned long long)main_loop_us * 1000ULL;
+  for (n = 0; n < sim_node_count; n++) {
+    node = &sim_node[n];
+    node->config.fcy = fcy;
+    node->config.prf_deci_hertz = prf_deci_hertz;
+    node->config.high_speed_logging = high_speed_logging;
+    node->config.calibration_test = calibration_test;
+    node->config.debug_board_count = debug_board_count;
+    memcpy(node->config.debug_board, debug_board, sizeof(debug_board));
+    node->config.seed = 1000 + n;
+    node->next_step_ns = (main_loop_ns * n) / sim_node_count;
+    snprintf(path, sizeof(path), "%s/%s", so_directory, (node->config.role == SIM_NODE_ROLE_ECB) ? "P1395_CAN_SIM_ECB.so" : "P1395_CAN_SIM_SLAVE.so");
+    SimLoadNode(node, path);
+  }
+
+  for (n = 0; n < sim_node_count; n++) {
+    if (sim_node[n].port->ctrl & 0x0700) {
+      fprintf(stderr, "Warning: %s has no bit timing for Fcy %lu Hz and stayed off the bus\n", sim_node[n].name, fcy);
+    }
+  }
+  bit_ns = SimBitTimeNs(sim_node[0].port->cfg1, sim_node[0].port->cfg2, fcy);
+  for (n = 1; n < sim_node_count; n++) {
+    slave_bit_ns = SimBitTimeNs(sim_node[n].port->cfg1, sim_node[n].port->cfg2, fcy);
+    if (slave_bit_ns != bit_ns) {
+      fprintf(stderr, "Warning: %s bit time %.1fns does not match the ECB (%.1fns)\n", sim_node[n].name, slave_bit_ns, bit_ns);
+    }
+  }
+
+  for (n = 0; n < SIM_CLASS_COUNT; n++) {
+    sim_class_stats[n].latency_min_ns = ~0ULL;
+  }
+
+
+  // ------------------ MAIN SIMULATION LOOP ------------------- //
+  end_ns = (unsigned long long)(run_seconds * 1.0e9);
+  now_ns = 0;
+  while (now_ns < end_ns) {
+    // Find the next event
+    next_ns = end_ns;
+    for (n = 0; n < sim_node_count; n++) {
+      if (sim_node[n].next_step_ns < next_ns) {
+	next_ns = sim_node[n].next_step_ns;
+      }
+    }
+    if (bus_busy && (busy_until_ns <= next_ns)) {
+      next_ns = busy_until_ns;
+    }
+    now_ns = next_ns;
+    if (now_ns >= end_ns) {
+      break;
+    }
+
+    if (bus_busy && (now_ns >= busy_until_ns)) {
+      // End of frame
+      bus_busy = 0;
+      node = &sim_node[tx_node];
+      stats = &sim_class_stats[SimClassify(tx_identifier)];
+      if (node->mailbox[tx_mailbox].on_bus) {
+	latency_ns = now_ns - node->mailbox[tx_mailbox].stamp_ns;
+	stats->latency_total_ns += latency_ns;
+	if (latency_ns < stats->latency_min_ns) {
+	  stats->latency_min_ns = latency_ns;
+	}
+	if (latency_ns > stats->latency_max_ns) {
+	  stats->latency_max_ns = latency_ns;
+	}
+	node->mailbox[tx_mailbox].on_bus = 0;
+	node->mailbox[tx_mailbox].loaded = 0;
+	node->port->tx[tx_mailbox].con &= ~SIM_CAN_TXCON_TXREQ;
+      }
+      // A frame that was replaced while on the bus still completes, but the replacement stays queued
+      node->frames_sent++;
+      stats->frames++;
+      SimRaiseFlag(node, SIM_CAN_INTF_TX0IF << tx_mailbox);
+
+      for (n = 0; n < sim_node_count; n++) {
+	if (n != (unsigned int)tx_node) {
+	  SimDeliver(&sim_node[n], tx_identifier, tx_dlc, tx_data);
+	}
+      }
+      for (n = 0; n < sim_node_count; n++) {
+	if (sim_node[n].port->flag && sim_node[n].port->ie) {
+	  SimNodeRunInterrupt(&sim_node[n], now_ns);
+	}
+      }
+    }
+
+    for (n = 0; n < sim_node_count; n++) {
+      if (sim_node[n].next_step_ns <= now_ns) {
+	SimNodeRun(&sim_node[n], now_ns);
+	sim_node[n].next_step_ns += main_loop_ns;
+      }
+    }
+
+    if (!bus_busy) {
+      // Arbitration - the lowest identifier wins
+      tx_node = -1;
+      best_identifier = 0xFFFF;
+      for (n = 0; n < sim_node_count; n++) {
+	selected = SimSelectMailbox(&sim_node[n]);
+	if (selected < 0) {
+	  continue;
+	}
+	identifier = SimTXSidToIdentifier(sim_node[n].port->tx[selected].sid);
+	if (identifier == best_identifier) {
+	  sim_id_collisions++;
+	}
+	if (identifier < best_identifier) {
+	  best_identifier = identifier;
+	  tx_node = n;
+	  tx_mailbox = selected;
+	}
+      }
+      if (tx_node >= 0) {
+	node = &sim_node[tx_node];
+	tx_identifier = best_identifier;
+	tx_dlc = SimFrameDataLength(node->port->tx[tx_mailbox].dlc);
+	tx_data[0] = node->port->tx[tx_mailbox].b1 & 0xFFFF;
+	tx_data[1] = node->port->tx[tx_mailbox].b2 & 0xFFFF;
+	tx_data[2] = node->port->tx[tx_mailbox].b3 & 0xFFFF;
+	tx_data[3] = node->port->tx[tx_mailbox].b4 & 0xFFFF;
+	node->mailbox[tx_mailbox].on_bus = 1;
+	frame_bits = SimFrameBits(tx_identifier, tx_dlc, tx_data);
+	busy_until_ns = now_ns + (unsigned long long)(frame_bits * bit_ns + 0.5);
+	bus_busy = 1;
+	bus_busy_total_ns += busy_until_ns - now_ns;
+	sim_class_stats[SimClassify(tx_identifier)].busy_ns += busy_until_ns - now_ns;
+	SimAddBusy(now_ns, busy_until_ns);
+      }
+    }
+  }
+
+
+  // ------------------ REPORT ------------------- //
+  peak_window_ns = 0;
+  for (n = 0; (n < SIM_MAX_WINDOWS) && ((unsigned long long)n * SIM_WINDOW_NS < end_ns); n++) {
+    if (sim_window_busy_ns[n] > peak_window_ns) {
+      peak_window_ns = sim_window_busy_ns[n];
+    }
+  }
+
+  printf("P1395 CAN simulation: ECB + %u slaves, %.3f s, Fcy %lu Hz, PRF %.1f Hz, high speed logging %s\n",
+	 sim_node_count - 1, run_seconds, fcy, prf_deci_hertz / 10.0, high_speed_logging ? "on" : "off");
+  printf("Bit time %.1f ns (%.1f kbit/s)\n", bit_ns, 1.0e6 / bit_ns);
+  printf("Bus utilization %.2f %% average, %.2f %% peak (100 ms window)\n",
+	 100.0 * (double)bus_busy_total_ns / (double)end_ns, 100.0 * (double)peak_window_ns / (double)SIM_WINDOW_NS);
+  if (sim_id_collisions) {
+    printf("Identifier collisions: %lu\n", sim_id_collisions);
+  }
+
+  printf("\n%-10s %10s %8s %12s %12s %12s %10s %10s\n", "class", "frames", "busy %", "lat min us", "lat avg us", "lat max us", "clobbered", "on bus");
+  for (n = 0; n < SIM_CLASS_COUNT; n++) {
+    stats = &sim_class_stats[n];
+    if ((stats->frames == 0) && (stats->clobbered_pending == 0) && (stats->clobbered_on_bus == 0)) {
+      continue;
+    }
+    printf("%-10s %10lu %8.2f %12.1f %12.1f %12.1f %10lu %10lu\n", sim_class_name[n], stats->frames,
+	   100.0 * (double)stats->busy_ns / (double)end_ns,
+	   stats->frames ? stats->latency_min_ns / 1000.0 : 0.0,
+	   stats->frames ? (double)stats->latency_total_ns / stats->frames / 1000.0 : 0.0,
+	   stats->latency_max_ns / 1000.0,
+	   stats->clobbered_pending, stats->clobbered_on_bus);
+  }
+
+  printf("\n%-10s %8s %8s %8s %8s %8s %12s %10s %10s %8s %8s %8s\n", "board", "sent", "received", "rx0 ovr", "rx1 ovr", "timeouts",
+	 "buffer", "writes", "overwrite", "in use", "max use", "depth");
+  for (n = 0; n < sim_node_count; n++) {
+    node = &sim_node[n];
+    node->report(&node->report_data);
+    for (m = 0; m < node->report_data.buffer_count; m++) {
+      if (m == 0) {
+	printf("%-10s %8lu %8lu %8lu %8lu %8u ", node->name, node->frames_sent, node->frames_received,
+	       node->rx_overrun[0], node->rx_overrun[1], node->report_data.can_timeout);
+      } else {
+	printf("%-10s %8s %8s %8s %8s %8s ", "", "", "", "", "", "");
+      }
+      printf("%12s %10u %10u %8u %8u %8u\n", node->report_data.buffer[m].name, node->report_data.buffer[m].write_count,
+	     node->report_data.buffer[m].overwrite_count, node->report_data.buffer[m].rows_in_use,
+	     node->report_data.buffer[m].high_water, node->report_data.buffer[m].depth);
+    }
+  }
+
+  printf("\nLatency measured by the nodes (CAN_TIMING registers, queued -> sent for TX, RX interrupt -> processed for RX)\n");
+  printf("(buf/isr max us is loaded -> sent for TX and the longest frame handled in the interrupt for RX)\n");
+  printf("%-10s %-10s %8s %8s %8s %8s %12s %12s\n", "board", "queue", "<250us", "<1ms", "<10ms", ">10ms", "max us", "buf/isr max us");
+  for (n = 0; n < sim_node_count; n++) {
+    node = &sim_node[n];
+    for (m = 0; m <= SIM_TX_QUEUES; m++) {
+      timing_ptr = &node->report_data.can_timing[(m < SIM_TX_QUEUES) ? (m * 4) : SIM_CAN_TIMING_RX_HISTOGRAM];
+      if (((timing_ptr[0] + timing_ptr[1] + timing_ptr[2] + timing_ptr[3]) == 0) &&
+	  ((m < SIM_TX_QUEUES) || (node->report_data.can_timing[SIM_CAN_TIMING_RX_ISR_MAX] == 0))) {
+	continue;
+      }
+      printf("%-10s %-10s %8u %8u %8u %8u ", node->name, sim_timing_name[m], timing_ptr[0], timing_ptr[1], timing_ptr[2], timing_ptr[3]);
+      if (m < SIM_TX_QUEUES) {
+	printf("%12.1f %12.1f\n", SimTimingCountsToMicroseconds(node, node->report_data.can_timing[SIM_CAN_TIMING_TX_MAX + m]),
+	       SimTimingCountsToMicroseconds(node, node->report_data.can_timing[SIM_CAN_TIMING_TX_BUFFER_MAX + m]));
+      } else {
+	printf("%12.1f %12.1f\n", SimTimingCountsToMicroseconds(node, node->report_data.can_timing[SIM_CAN_TIMING_RX_MAX]),
+	       SimTimingCountsToMicroseconds(node, node->report_data.can_timing[SIM_CAN_TIMING_RX_ISR_MAX]));
+      }
+    }
+  }
+
+  printf("\n%-10s %12s %12s %12s %12s %12s\n", "board", "unknown id", "inv index", "addr error", "eeprom word", "eeprom page");
+  for (n = 0; n < sim_node_count; n++) {
+    node = &sim_node[n];
+    printf("%-10s %12u %12u %12u %12u %12u\n", node->name, node->report_data.can_unknown_msg_id, node->report_data.can_invalid_index,
+	   node->report_data.can_address_error, node->report_data.eeprom_word_writes, node->report_data.eeprom_page_writes);
+  }
+
+  // The ECB is always node 0
+  node = &sim_node[0];
+  if (node->report_data.pulse_records_exported || node->report_data.pulse_records_overrun || node->report_data.pulse_records_late) {
+    printf("\nHigh speed data records: %u exported, %u incomplete, %u bad, %u overrun, %u late fast log messages\n",
+	   node->report_data.pulse_records_exported, node->report_data.pulse_records_incomplete, node->report_data.pulse_records_bad,
+	   node->report_data.pulse_records_overrun, node->report_data.pulse_records_late);
+  }
+  if (node->report_data.event_log_read || node->report_data.event_log_dropped) {
+    printf("Event log: %u events read by the GUI reader, %u dropped\n", node->report_data.event_log_read, node->report_data.event_log_dropped);
+  }
+  if (calibration_test) {
+    printf("Calibration blocks: %u pages transferred, %u retries, %u failed, %u pairs read back, %u mismatched\n",
+	   node->report_data.calibration_pages, node->report_data.calibration_retries, node->report_data.calibration_failed,
+	   node->report_data.calibration_pairs, node->report_data.calibration_mismatched);
+  }
+  for (n = 0; n < node->report_data.debug_mirror_count; n++) {
+    printf("Debug mirror of board %u: reset count %u, rx max %u\n", node->report_data.debug_mirror_board[n],
+	   node->report_data.debug_mirror_reset_count[n], node->report_data.debug_mirror_rx_max[n]);
+  }
+
+  return 0;
+}
@@ -0,0 +1,164 @@
+#ifndef __P1395_CAN_SIM_H
+#define __P1395_CAN_SIM_H
+
+/*
+  Host (Linux) simulator for the P1395 CAN network.
+
+  The real P1395_CAN_MASTER.c and P1395_CAN_SLAVE.c are compiled against a model of the dsPIC30F CAN and timer SFRs.
+  Every board is built into a shared object and loaded into its own dlmopen() namespace so that each instance
+  gets a private copy of all the library globals.  P1395_CAN_SIM.c owns the virtual bus and moves frames between
+  the register files of the loaded nodes.
+
+  This file is shared between the bus (P1395_CAN_SIM.c) and the node side (P1395_CAN_SIM_NODE.c and the SFR shims).
+*/
+
+
+// --------------------- CAN SFR MODEL ----------------------- //
+
+/*
+  One TX or RX buffer in the same word order as the dsPIC30F SFR map.
+  The CON register is 7 words after the SID register, this is what the P1395_CAN_CORE routines rely on.
+*/
+typedef struct {
+  volatile unsigned int sid;
+  volatile unsigned int eid;
+  volatile unsigned int dlc;
+  volatile unsigned int b1;
+  volatile unsigned int b2;
+  volatile unsigned int b3;
+  volatile unsigned int b4;
+  volatile unsigned int con;
+} SimCanBufferRegisters;
+
+
+typedef struct {
+  SimCanBufferRegisters tx[3];        // CxTX0 - CxTX2
+  SimCanBufferRegisters rx[2];        // CxRX0 - CxRX1
+  volatile unsigned int rxf_sid[6];   // CxRXF0SID - CxRXF5SID
+  volatile unsigned int rxm_sid[2];   // CxRXM0SID - CxRXM1SID
+  volatile unsigned int ctrl;         // CxCTRL
+  volatile unsigned int cfg1;         // CxCFG1
+  volatile unsigned int cfg2;         // CxCFG2
+  volatile unsigned int intf;         // CxINTF
+  volatile unsigned int inte;         // CxINTE
+  volatile unsigned int ec;           // CxEC
+  volatile unsigned int ie;           // _CxIE
+  volatile unsigned int flag;         // _CxIF
+  volatile unsigned int ip;           // _CxIP
+} SimCanPort;
+
+
+// CxINTF bits
+#define SIM_CAN_INTF_RX0IF                0x0001
+#define SIM_CAN_INTF_RX1IF                0x0002
+#define SIM_CAN_INTF_TX0IF                0x0004
+#define SIM_CAN_INTF_ERRIF                0x0020
+#define SIM_CAN_INTF_RX1OVR               0x4000
+#define SIM_CAN_INTF_RX0OVR               0x8000
+
+// CxTXxCON / CxRXxCON bits
+#define SIM_CAN_TXCON_TXREQ               0x0008
+#define SIM_CAN_TXCON_TXPRI               0x0003
+#define SIM_CAN_RXCON_RXFUL               0x0080
+
+
+// --------------------- NODE INTERFACE ----------------------- //
+
+#define SIM_NODE_ROLE_ECB                 0
+#define SIM_NODE_ROLE_SLAVE               1
+
+#define SIM_DEBUG_BOARDS                  4
+
+typedef struct {
+  unsigned int  role;
+  unsigned int  address;                // ETM_CAN_ADDR_xxx
+  unsigned long fcy;
+  unsigned int  prf_deci_hertz;         // Only used by the pulse sync board
+  unsigned int  high_speed_logging;     // Only used by the ECB
+  unsigned int  calibration_test;       // Only used by the ECB
+  unsigned int  debug_board_count;      // Only used by the ECB
+  unsigned int  debug_board[SIM_DEBUG_BOARDS]; // Only used by the ECB - the first is selected on the GUI, the rest are subscribed
+  unsigned int  seed;
+} SimNodeConfig;
+
+
+#define SIM_NODE_MAX_BUFFERS              6
+
+// One transmit queue per transmit scheduler class (ETM_CAN_TX_CLASS_PULSE_LEVEL -> ETM_CAN_TX_CLASS_LOG)
+#define SIM_TX_QUEUES                     4
+#define SIM_TX_QUEUE_PULSE_LEVEL          0
+#define SIM_TX_QUEUE_STATUS_SYNC          1
+#define SIM_TX_QUEUE_CMD                  2
+#define SIM_TX_QUEUE_LOG                  3
+
+// The CAN_TIMING data in ETMCanLatencyData word order
+#define SIM_CAN_TIMING_WORDS              32
+#define SIM_CAN_TIMING_TX_MAX             16
+#define SIM_CAN_TIMING_TX_BUFFER_MAX      20
+#define SIM_CAN_TIMING_RX_HISTOGRAM       24
+#define SIM_CAN_TIMING_RX_MAX             28
+#define SIM_CAN_TIMING_COUNT_NS           29
+#define SIM_CAN_TIMING_RX_ISR_MAX         31
+
+typedef struct {
+  const char*  name;
+  unsigned int write_count;             // message_write_count
+  unsigned int overwrite_count;         // message_overwrite_count
+  unsigned int rows_in_use;             // ETMCanBufferNotEmpty()
+  unsigned int high_water;              // message_high_water
+  unsigned int depth;                   // message_index_mask + 1
+} SimNodeBufferReport;
+
+typedef struct {
+  unsigned int        buffer_count;
+  SimNodeBufferReport buffer[SIM_NODE_MAX_BUFFERS];
+  unsigned int        tx_queue_write_count[SIM_TX_QUEUES]; // accepted writes into each transmit queue (used to time stamp queued frames)
+  unsigned int        can_timing[SIM_CAN_TIMING_WORDS];    // ETMCanLatencyData as measured by the node (the CAN_TIMING_0 -> CAN_TIMING_7 registers)
+  unsigned int        can_timeout;
+  unsigned int        can_unknown_msg_id;
+  unsigned int        can_invalid_index;
+  unsigned int        can_address_error;
+  unsigned int        eeprom_word_writes;
+  unsigned int        eeprom_page_writes;
+  unsigned int        pulse_records_exported;   // ECB only - high speed data records read from the ring
+  unsigned int        pulse_records_incomplete; // ECB only - records released by timeout with fast logging data missing
+  unsigned int        pulse_records_bad;        // ECB only - records released as complete that do not hold the logged values
+  unsigned int        pulse_records_overrun;    // ECB only - records overwritten before they were exported
+  unsigned int        pulse_records_late;       // ECB only - fast logging messages that arrived after the record was reused
+  unsigned int        event_log_read;           // ECB only - events read from the event log by the GUI reader
+  unsigned int        event_log_dropped;        // ECB only - events the GUI reader missed because it was lapped
+  unsigned int        calibration_pages;        // ECB only - calibration pages transferred with block transfers
+  unsigned int        calibration_retries;      // ECB only - calibration pages that had to be sent again
+  unsigned int        calibration_failed;       // ECB only - calibration block transfers that were abandoned
+  unsigned int        calibration_pairs;        // ECB only - calibration pairs read back from the slaves
+  unsigned int        calibration_mismatched;   // ECB only - calibration pairs read back that do not match what was written
+  unsigned int        debug_mirror_count;       // ECB only - debug mirrors in use
+  unsigned int        debug_mirror_board[SIM_DEBUG_BOARDS];  // ECB only - board address of each debug mirror
+  unsigned int        debug_mirror_reset_count[SIM_DEBUG_BOARDS]; // ECB only - SYSTEM_ERROR_0 reset count in each debug mirror
+  unsigned int        debug_mirror_rx_max[SIM_DEBUG_BOARDS];      // ECB only - CAN_TIMING_7 rx max in each debug mirror
+} SimNodeReportData;
+
+
+/*
+  Functions exported by every node shared object.
+  The bus looks them up with dlsym() in each namespace.
+*/
+typedef void         (*SimNodeStartFunction)(const SimNodeConfig* config);
+typedef void         (*SimNodeMainLoopFunction)(unsigned long long time_ns);
+typedef void         (*SimNodeInterruptFunction)(unsigned long long time_ns);
+typedef SimCanPort*  (*SimNodeCanPortFunction)(void);
+typedef void         (*SimNodeReportFunction)(SimNodeReportData* report);
+
+#define SIM_NODE_START_SYMBOL             "SimNodeStart"
+#define SIM_NODE_MAIN_LOOP_SYMBOL         "SimNodeMainLoop"
+#define SIM_NODE_INTERRUPT_SYMBOL         "SimNodeInterrupt"
+#define SIM_NODE_CAN_PORT_SYMBOL          "SimNodeCanPort"
+#define SIM_NODE_REPORT_SYMBOL            "SimNodeReport"
+
+
+// Node side only - implemented by the board application files (P1395_CAN_SIM_ECB.c, P1395_CAN_SIM_SLAVE.c)
+void SimAppInitialize(const SimNodeConfig* config);
+void SimAppMainLoop(unsigned long long time_ns);
+void SimAppReport(SimNodeReportData* report);
+
+#endif
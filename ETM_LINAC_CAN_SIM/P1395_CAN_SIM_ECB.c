@@ -0,0 +1,232 @@
+#include <xc.h>
+#include "P1395_CAN_SIM.h"
+#include "P1395_CAN_MASTER.h"
+
+/*
+  Board application for the simulated Ethernet Control Board.
+  This plays the part of the ECB main program (A36507) - it initializes the CAN master and calls ETMCanMasterDoCan() from the
+  main loop.  Only what the CAN master needs from the application is provided here.
+*/
+
+#define SIM_ECB_CAN_LED                   0x0001UL
+#define SIM_ECB_AGILE_ID                  36507
+#define SIM_ECB_INTERRUPT_PRIORITY        4
+#define SIM_ECB_SETPOINT_STEP_NS          500000000ULL  // The lambda set point is changed every 500ms
+#define SIM_ECB_EVENT_LOG_PAGE            0x80          // Event log region in the simulated EEPROM
+#define SIM_ECB_EVENT_LOG_PAGES           32
+#define SIM_ECB_CALIBRATION_START_NS      500000000ULL  // The calibration test starts once the missing boards have timed out
+#define SIM_ECB_CALIBRATION_WORDS         (ETM_CAN_CALIBRATION_BLOCK_PAGES * ETM_CAN_CALIBRATION_BLOCK_PAGE_WORDS)
+
+#define SIM_ECB_CALIBRATION_IDLE          0
+#define SIM_ECB_CALIBRATION_WRITE         1
+#define SIM_ECB_CALIBRATION_READ          2
+#define SIM_ECB_CALIBRATION_DONE          3
+
+
+// These are normally provided by the ECB application
+ETMCanSyncMessage etm_can_master_sync_message;
+
+extern ETMCanBuffer etm_can_master_rx_data_log_buffer;
+extern ETMCanBuffer etm_can_master_rx_message_buffer;
+extern ETMCanBuffer etm_can_master_tx_message_buffer;
+extern ETMCanBuffer etm_can_master_tx_sync_buffer;
+extern unsigned int board_com_fault;
+
+static unsigned int sim_ecb_calibration_returns;
+static unsigned int sim_ecb_pulse_records_bad;
+static unsigned int sim_ecb_events_read;
+static unsigned int sim_ecb_calibration_test;
+static unsigned int sim_ecb_calibration_state[ETM_CAN_MASTER_BOARDS];
+static unsigned int sim_ecb_calibration_data[ETM_CAN_MASTER_BOARDS][SIM_ECB_CALIBRATION_WORDS];
+static unsigned int sim_ecb_calibration_mismatched;
+
+
+unsigned int SendCalibrationData(unsigned int index, unsigned int scale, unsigned int offset) {
+  // On the ECB this is forwarded to the GUI over TCP/IP
+  unsigned int* data_ptr;
+
+  sim_ecb_calibration_returns++;
+  if (sim_ecb_calibration_test) {
+    // index is 0xZrrr, r = calibration register 0x100 -> 0x1FF
+    data_ptr = &sim_ecb_calibration_data[(index >> 12) & 0x000F][(index & 0x0FFF) - 0x0100];
+    if ((data_ptr[0] != offset) || (data_ptr[1] != scale)) {
+      sim_ecb_calibration_mismatched++;
+    }
+  }
+  return 0;
+}
+
+
+void SimAppInitialize(const SimNodeConfig* config) {
+  unsigned int n;
+
+  ETMCanMasterInitialize(CAN_PORT_1, config->fcy, ETM_CAN_ADDR_ETHERNET_BOARD, SIM_ECB_CAN_LED, SIM_ECB_INTERRUPT_PRIORITY);
+  ETMCanMasterLoadConfiguration(SIM_ECB_AGILE_ID, 0, 'A', 0, 0, 0, config->seed);
+  ETMCanMasterEventLogInitialize(SIM_ECB_EVENT_LOG_PAGE, SIM_ECB_EVENT_LOG_PAGES);
+
+  // The ECB sets this once the personality has been read from the pulse sync board.
+  // Until then only the sync message is sent.
+  _CONTROL_NOT_CONFIGURED = 1;
+
+  _SYNC_CONTROL_HIGH_SPEED_LOGGING = config->high_speed_logging ? 1 : 0;
+
+  sim_ecb_calibration_test = config->calibration_test;
+
+  // The first debug board is the one selected on the GUI
+  if (config->debug_board_count) {
+    etm_can_active_debugging_board_id = config->debug_board[0];
+  }
+  for (n = 1; n < config->debug_board_count; n++) {
+    ETMCanMasterDebugSubscribe(config->debug_board[n]);
+  }
+}
+
+
+static unsigned int SimAppPulseRecordComplete(const ETMCanHighSpeedData* record) {
+  // The values logged by P1395_CAN_SIM_SLAVE.c for every pulse
+  return ((record->psync_readback_trigger_width_and_filtered_trigger_width == 0x1010) &&
+	  (record->hvlambda_readback_high_energy_lambda_program_voltage == 18000) &&
+	  (record->magmon_readback_magnetron_high_energy_current == 1100) &&
+	  (record->afc_readback_current_position == 20000) &&
+	  (record->afc_readback_a_input == 512));
+}
+
+
+static void SimAppExportPulseRecords(void) {
+  // On the ECB the records are sent to the GUI over TCP/IP
+  ETMCanHighSpeedData* record;
+  unsigned int records;
+  unsigned int n;
+
+  while ((records = ETMCanHighSpeedDataPeek(&record)) != 0) {
+    for (n = 0; n < records; n++) {
+      if (!record[n].status_bits.data_incomplete && !SimAppPulseRecordComplete(&record[n])) {
+	sim_ecb_pulse_records_bad++;
+      }
+    }
+    ETMCanHighSpeedDataCommit(records);
+  }
+}
+
+
+static void SimAppSendEventLog(void) {
+  // On the ECB the events are sent to the GUI over TCP/IP
+  TYPE_EVENT* event;
+  unsigned int events;
+
+  while ((events = ETMCanMasterEventLogPeek(ETM_CAN_MASTER_EVENT_LOG_READER_GUI, &event)) != 0) {
+    sim_ecb_events_read += events;
+    ETMCanMasterEventLogCommit(ETM_CAN_MASTER_EVENT_LOG_READER_GUI, events);
+  }
+}
+
+
+static void SimAppCalibrationTest(void) {
+  // Write a full calibration set to every board that is connected, then read it back
+  unsigned int board;
+  unsigned int n;
+
+  for (board = 1; board < ETM_CAN_MASTER_BOARDS; board++) {
+    if (!((ETMCanMasterGetExpectedBoards() & ~board_com_fault) & (1 << board)) || ETMCanMasterCalibrationBlockBusy(board)) {
+      continue;
+    }
+    switch (sim_ecb_calibration_state[board])
+      {
+      case SIM_ECB_CALIBRATION_IDLE:
+	for (n = 0; n < SIM_ECB_CALIBRATION_WORDS; n++) {
+	  sim_ecb_calibration_data[board][n] = ((board << 12) | n) ^ 0x0A5A;
+	}
+	if (ETMCanMasterCalibrationBlockWrite(board, 0, ETM_CAN_CALIBRATION_BLOCK_PAGES, sim_ecb_calibration_data[board]) == 0) {
+	  sim_ecb_calibration_state[board] = SIM_ECB_CALIBRATION_WRITE;
+	}
+	break;
+
+      case SIM_ECB_CALIBRATION_WRITE:
+	if (ETMCanMasterCalibrationBlockRead(board, 0, ETM_CAN_CALIBRATION_BLOCK_PAGES) == 0) {
+	  sim_ecb_calibration_state[board] = SIM_ECB_CALIBRATION_READ;
+	}
+	break;
+
+      case SIM_ECB_CALIBRATION_READ:
+	sim_ecb_calibration_state[board] = SIM_ECB_CALIBRATION_DONE;
+	break;
+      }
+  }
+}
+
+
+void SimAppMainLoop(unsigned long long time_ns) {
+  // Step the lambda set point like an operator would so that the send on change commands are exercised
+  local_hv_lambda_high_en_set_point = (unsigned int)(time_ns / SIM_ECB_SETPOINT_STEP_NS);
+  ETMCanMasterDoCan();
+  SimAppExportPulseRecords();
+  SimAppSendEventLog();
+  if (sim_ecb_calibration_test && (time_ns >= SIM_ECB_CALIBRATION_START_NS)) {
+    SimAppCalibrationTest();
+  }
+}
+
+
+static void SimAppReportBuffer(SimNodeBufferReport* report, const char* name, ETMCanBuffer* buffer_ptr) {
+  report->name = name;
+  report->write_count = buffer_ptr->message_write_count;
+  report->overwrite_count = buffer_ptr->message_overwrite_count;
+  report->rows_in_use = ETMCanBufferNotEmpty(buffer_ptr);
+  report->high_water = buffer_ptr->message_high_water;
+  report->depth = buffer_ptr->message_index_mask + 1;
+}
+
+
+static unsigned int SimAppAcceptedWrites(ETMCanBuffer* buffer_ptr) {
+  return buffer_ptr->message_write_count - buffer_ptr->message_overwrite_count;
+}
+
+
+void SimAppReport(SimNodeReportData* report) {
+  unsigned int n;
+  unsigned int board;
+
+  report->buffer_count = 4;
+  SimAppReportBuffer(&report->buffer[0], "rx_message", &etm_can_master_rx_message_buffer);
+  SimAppReportBuffer(&report->buffer[1], "rx_data_log", &etm_can_master_rx_data_log_buffer);
+  SimAppReportBuffer(&report->buffer[2], "tx_sync", &etm_can_master_tx_sync_buffer);
+  SimAppReportBuffer(&report->buffer[3], "tx_message", &etm_can_master_tx_message_buffer);
+
+  report->tx_queue_write_count[SIM_TX_QUEUE_PULSE_LEVEL] = 0;
+  report->tx_queue_write_count[SIM_TX_QUEUE_STATUS_SYNC] = SimAppAcceptedWrites(&etm_can_master_tx_sync_buffer);
+  report->tx_queue_write_count[SIM_TX_QUEUE_CMD] = SimAppAcceptedWrites(&etm_can_master_tx_message_buffer);
+  report->tx_queue_write_count[SIM_TX_QUEUE_LOG] = 0;
+
+  for (n = 0; n < SIM_CAN_TIMING_WORDS; n++) {
+    report->can_timing[n] = ((unsigned int*)&timing_data_ecb.data)[n];
+  }
+
+  report->can_timeout = debug_data_ecb.can_timeout;
+  report->can_unknown_msg_id = debug_data_ecb.can_unknown_msg_id;
+  report->can_invalid_index = debug_data_ecb.can_invalid_index;
+  report->can_address_error = debug_data_ecb.can_address_error;
+
+  report->pulse_records_exported = etm_can_high_speed_data_ring.export_count;
+  report->pulse_records_incomplete = etm_can_high_speed_data_ring.incomplete_count;
+  report->pulse_records_bad = sim_ecb_pulse_records_bad;
+  report->pulse_records_overrun = etm_can_high_speed_data_ring.overrun_count;
+  report->pulse_records_late = etm_can_high_speed_data_ring.late_count;
+  report->event_log_read = sim_ecb_events_read;
+  report->event_log_dropped = event_log.reader[ETM_CAN_MASTER_EVENT_LOG_READER_GUI].dropped_count;
+  report->calibration_pages = etm_can_master_calibration.page_count;
+  report->calibration_retries = etm_can_master_calibration.retry_count;
+  report->calibration_failed = etm_can_master_calibration.failed_count;
+  report->calibration_pairs = sim_ecb_calibration_returns;
+  report->calibration_mismatched = sim_ecb_calibration_mismatched;
+
+  report->debug_mirror_count = 0;
+  for (n = 0; (n < ETM_CAN_MASTER_DEBUG_MIRRORS) && (report->debug_mirror_count < SIM_DEBUG_BOARDS); n++) {
+    board = etm_can_master_debug_mirror[n].board;
+    if ((board < ETM_CAN_MASTER_BOARDS) && ((1 << board) & ETMCanMasterGetDebugBoards())) {
+      report->debug_mirror_board[report->debug_mirror_count] = board;
+      report->debug_mirror_reset_count[report->debug_mirror_count] = etm_can_master_debug_mirror[n].debug_data.reset_count;
+      report->debug_mirror_rx_max[report->debug_mirror_count] = etm_can_master_debug_mirror[n].timing_data.rx_max;
+      report->debug_mirror_count++;
+    }
+  }
+}
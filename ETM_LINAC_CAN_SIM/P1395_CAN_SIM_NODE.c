@@ -0,0 +1,240 @@
+#include <xc.h>
+#include "P1395_CAN_SIM.h"
+#include "ETM_IO_PORTS.h"
+#include "ETM_SCALE.h"
+#include "ETM_EEPROM.h"
+#include "ETM_ANALOG.h"
+
+/*
+  Node side of the simulator.
+  This is linked into every node shared object together with the CAN library and the board application.
+  It provides the storage for the modeled SFRs, host versions of the ETM_CORE functions used by the CAN library
+  and the entry points that the bus calls through dlsym().
+*/
+
+extern void _C1Interrupt(void);
+extern void _C2Interrupt(void);
+
+
+// ------------------- SFR STORAGE ------------------------ //
+SimCanPort          sim_can_port[2];
+SimTimer            sim_timer[6];
+SimSystemRegisters  sim_system;
+
+
+// ------------------- LOCAL DATA ------------------------ //
+#define SIM_NODE_EEPROM_WORDS      0x1000
+#define SIM_NODE_PIN_SLOTS         16
+#define SIM_NODE_MAX_NESTED_ISR    16
+
+static SimNodeConfig       sim_node_config;
+static unsigned int        sim_node_eeprom[SIM_NODE_EEPROM_WORDS];
+static unsigned int        sim_node_eeprom_word_writes;
+static unsigned int        sim_node_eeprom_page_writes;
+static unsigned long       sim_node_pin[SIM_NODE_PIN_SLOTS];
+static unsigned int        sim_node_pin_latch[SIM_NODE_PIN_SLOTS];
+static unsigned int        sim_node_reset_requested;
+
+unsigned int etm_scale_saturation_etmscalefactor2_count;
+unsigned int etm_scale_saturation_etmscalefactor16_count;
+
+
+
+volatile SimCanCTRLBits* SimCanCTRLBitsSync(unsigned int port) {
+  volatile SimCanCTRLBits* bits_ptr;
+  bits_ptr = (volatile SimCanCTRLBits*)&sim_can_port[port].ctrl;
+  bits_ptr->OPMODE = bits_ptr->REQOP;
+  return bits_ptr;
+}
+
+void SimNodeClrWdt(void) {
+}
+
+void SimNodeReset(void) {
+  // The reset is executed once the library code that requested it has returned
+  sim_node_reset_requested = 1;
+}
+
+
+static void SimNodeAdvanceTimers(unsigned long long time_ns) {
+  static const unsigned int prescale[4] = {1, 8, 64, 256};
+  unsigned int n;
+  unsigned long long elapsed_counts;
+  unsigned long long count;
+  unsigned long long period;
+  SimTimer* timer_ptr;
+
+  for (n = 1; n < 6; n++) {
+    timer_ptr = &sim_timer[n];
+    if ((time_ns > timer_ptr->last_update_ns) && ((SimTimerCONBits*)&timer_ptr->con)->TON) {
+      // counts = elapsed_time * fcy / prescale, the remainder is carried to the next update
+      timer_ptr->residue += (time_ns - timer_ptr->last_update_ns) * (unsigned long long)sim_node_config.fcy;
+      elapsed_counts = timer_ptr->residue / (1000000000ULL * prescale[((SimTimerCONBits*)&timer_ptr->con)->TCKPS]);
+      timer_ptr->residue -= elapsed_counts * 1000000000ULL * prescale[((SimTimerCONBits*)&timer_ptr->con)->TCKPS];
+
+      count = (unsigned long long)timer_ptr->tmr + elapsed_counts;
+      period = (unsigned long long)timer_ptr->pr + 1;
+      if ((timer_ptr->pr != 0) && (count >= period)) {
+	// Period match - TMR resets to zero and the interrupt flag is set
+	timer_ptr->flag = 1;
+	count %= period;
+      }
+      timer_ptr->tmr = (unsigned int)(count & 0xFFFF);
+    }
+    timer_ptr->last_update_ns = time_ns;
+  }
+}
+
+
+static void SimNodeServiceInterrupt(void) {
+  unsigned int nested;
+  for (nested = 0; nested < SIM_NODE_MAX_NESTED_ISR; nested++) {
+    if (sim_can_port[0].flag && sim_can_port[0].ie) {
+      _C1Interrupt();
+    } else if (sim_can_port[1].flag && sim_can_port[1].ie) {
+      _C2Interrupt();
+    } else {
+      break;
+    }
+  }
+}
+
+
+static void SimNodeCheckReset(unsigned long long time_ns) {
+  if (sim_node_reset_requested) {
+    sim_node_reset_requested = 0;
+    SimAppInitialize(&sim_node_config);
+    SimNodeAdvanceTimers(time_ns);
+  }
+}
+
+
+// ------------------- EXPORTED NODE INTERFACE ------------------------ //
+
+void SimNodeStart(const SimNodeConfig* config) {
+  sim_node_config = *config;
+  SimAppInitialize(&sim_node_config);
+}
+
+void SimNodeMainLoop(unsigned long long time_ns) {
+  SimNodeAdvanceTimers(time_ns);
+  SimAppMainLoop(time_ns);
+  SimNodeServiceInterrupt();
+  SimNodeCheckReset(time_ns);
+}
+
+void SimNodeInterrupt(unsigned long long time_ns) {
+  SimNodeAdvanceTimers(time_ns);
+  SimNodeServiceInterrupt();
+  SimNodeCheckReset(time_ns);
+}
+
+SimCanPort* SimNodeCanPort(void) {
+  return &sim_can_port[0];
+}
+
+void SimNodeReport(SimNodeReportData* report) {
+  SimAppReport(report);
+  report->eeprom_word_writes = sim_node_eeprom_word_writes;
+  report->eeprom_page_writes = sim_node_eeprom_page_writes;
+}
+
+
+// ------------------- ETM_CORE HOST VERSIONS ------------------------ //
+
+static unsigned int SimNodePinSlot(unsigned long pin) {
+  unsigned int n;
+  for (n = 0; n < SIM_NODE_PIN_SLOTS; n++) {
+    if ((sim_node_pin[n] == pin) || (sim_node_pin[n] == 0)) {
+      sim_node_pin[n] = pin;
+      return n;
+    }
+  }
+  return 0;
+}
+
+void ETMSetPin(unsigned long pin) {
+  sim_node_pin_latch[SimNodePinSlot(pin)] = 1;
+}
+
+void ETMClearPin(unsigned long pin) {
+  sim_node_pin_latch[SimNodePinSlot(pin)] = 0;
+}
+
+void ETMPinTrisInput(unsigned long pin) {
+}
+
+void ETMPinTrisOutput(unsigned long pin) {
+}
+
+unsigned int ETMReadPinLatch(unsigned long pin) {
+  return sim_node_pin_latch[SimNodePinSlot(pin)];
+}
+
+
+void ETMEEPromWriteWord(unsigned int register_location, unsigned int data) {
+  sim_node_eeprom_word_writes++;
+  sim_node_eeprom[register_location & (SIM_NODE_EEPROM_WORDS - 1)] = data & 0xFFFF;
+}
+
+unsigned int ETMEEPromReadWord(unsigned int register_location) {
+  return sim_node_eeprom[register_location & (SIM_NODE_EEPROM_WORDS - 1)];
+}
+
+void ETMEEPromWritePage(unsigned int page_number, unsigned int words_to_write, unsigned int *data) {
+  unsigned int n;
+  if (words_to_write > 16) {
+    words_to_write = 16;
+  }
+  sim_node_eeprom_page_writes++;
+  for (n = 0; n < words_to_write; n++) {
+    sim_node_eeprom[((page_number << 4) + n) & (SIM_NODE_EEPROM_WORDS - 1)] = data[n] & 0xFFFF;
+  }
+}
+
+void ETMEEPromReadPage(unsigned int page_number, unsigned int words_to_read, unsigned int *data) {
+  unsigned int n;
+  if (words_to_read > 16) {
+    words_to_read = 16;
+  }
+  for (n = 0; n < words_to_read; n++) {
+    data[n] = sim_node_eeprom[((page_number << 4) + n) & (SIM_NODE_EEPROM_WORDS - 1)];
+  }
+}
+
+
+unsigned int ETMAnalogCheckEEPromInitialized() {
+  return 1;
+}
+
+void ETMAnalogLoadDefaultCalibration(void) {
+}
+
+
+unsigned int ETMScaleFactor2(unsigned int value, unsigned int scale_factor_0_2, signed int offset) {
+  long result;
+  result = ((long)(value & 0xFFFF) + offset);
+  if (result < 0) {
+    result = 0;
+  }
+  result = (result * (long)(scale_factor_0_2 & 0xFFFF)) >> 15;
+  if (result > 0xFFFF) {
+    etm_scale_saturation_etmscalefactor2_count++;
+    result = 0xFFFF;
+  }
+  return (unsigned int)result;
+}
+
+unsigned int ETMScaleFactor16(unsigned int value, unsigned int scale_factor_0_16, signed int offset) {
+  long result;
+  result = ((long)(value & 0xFFFF) + offset);
+  if (result < 0) {
+    result = 0;
+  }
+  result = (result * (long)(scale_factor_0_16 & 0xFFFF)) >> 12;
+  if (result > 0xFFFF) {
+    etm_scale_saturation_etmscalefactor16_count++;
+    result = 0xFFFF;
+  }
+  return (unsigned int)result;
+}
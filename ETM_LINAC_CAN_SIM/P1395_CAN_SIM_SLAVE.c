@@ -0,0 +1,177 @@
+#include <xc.h>
+#include "P1395_CAN_SIM.h"
+#include "P1395_CAN_SLAVE.h"
+
+/*
+  Board application for a simulated slave board.
+  The same object is loaded once for every slave address on the bus.
+  It produces the CAN traffic that the real board firmware generates
+    - Status and slow logging through ETMCanSlaveDoCan()
+    - The next pulse level broadcast (Pulse Sync Board only)
+    - Pulse by pulse logging while high speed logging is enabled (Magnetron Current, Pulse Sync, HV Lambda and AFC boards)
+*/
+
+#define SIM_SLAVE_CAN_LED                 0x0001UL
+#define SIM_SLAVE_FLASH_LED               0x0002UL
+#define SIM_SLAVE_NOT_READY_LED           0x0003UL
+#define SIM_SLAVE_AGILE_ID                36000
+#define SIM_SLAVE_INTERRUPT_PRIORITY      4
+
+// The pulse data is logged this long after the next pulse level message (the pulse happens in between)
+#define SIM_SLAVE_PULSE_LOG_DELAY_NS      500000ULL
+
+extern ETMCanBuffer etm_can_slave_rx_message_buffer;
+extern ETMCanBuffer etm_can_slave_tx_message_buffer;
+extern ETMCanBuffer etm_can_slave_tx_log_buffer;
+extern ETMCanBuffer etm_can_slave_tx_status_buffer;
+extern ETMCanBuffer etm_can_slave_tx_pulse_level_buffer;
+extern ETMCanBoardDebuggingData etm_can_slave_debug_data;
+extern ETMCanTiming etm_can_slave_timing;
+
+static SimNodeConfig       sim_slave_config;
+static unsigned long long  sim_slave_next_pulse_ns;
+static unsigned long long  sim_slave_pulse_log_ns;
+static unsigned int        sim_slave_pulse_count;
+static unsigned int        sim_slave_last_pulse_count;
+static unsigned int        sim_slave_pulse_log_pending;
+static unsigned int        sim_slave_set_point[16][3];
+
+
+// Every board specific command is a plain set point with 3 data words
+#define SIM_SLAVE_SET_POINT(n)    {0x0200 + (n), 0, 0x0000, 0xFFFF, sim_slave_set_point[n], 3}
+
+static const ETMCanSlaveCommand sim_slave_commands[16] = {
+  SIM_SLAVE_SET_POINT(0),  SIM_SLAVE_SET_POINT(1),  SIM_SLAVE_SET_POINT(2),  SIM_SLAVE_SET_POINT(3),
+  SIM_SLAVE_SET_POINT(4),  SIM_SLAVE_SET_POINT(5),  SIM_SLAVE_SET_POINT(6),  SIM_SLAVE_SET_POINT(7),
+  SIM_SLAVE_SET_POINT(8),  SIM_SLAVE_SET_POINT(9),  SIM_SLAVE_SET_POINT(10), SIM_SLAVE_SET_POINT(11),
+  SIM_SLAVE_SET_POINT(12), SIM_SLAVE_SET_POINT(13), SIM_SLAVE_SET_POINT(14), SIM_SLAVE_SET_POINT(15),
+};
+
+
+void SimAppInitialize(const SimNodeConfig* config) {
+  sim_slave_config = *config;
+
+  ETMCanSlaveInitialize(CAN_PORT_1, config->fcy, config->address, SIM_SLAVE_CAN_LED, SIM_SLAVE_INTERRUPT_PRIORITY,
+			SIM_SLAVE_FLASH_LED, SIM_SLAVE_NOT_READY_LED);
+  ETMCanSlaveLoadConfiguration(SIM_SLAVE_AGILE_ID + config->address, 0, 0, 0, 0);
+  ETMCanSlaveRegisterCommands(sim_slave_commands, 16);
+
+  _CONTROL_NOT_CONFIGURED = 0;
+  _CONTROL_NOT_READY = 0;
+
+  sim_slave_next_pulse_ns = 0;
+  sim_slave_pulse_log_pending = 0;
+  sim_slave_last_pulse_count = ETMCanSlaveGetPulseCount();
+}
+
+
+static unsigned int SimSlaveIsFastLogBoard(void) {
+  switch (sim_slave_config.address)
+    {
+    case ETM_CAN_ADDR_MAGNETRON_CURRENT_BOARD:
+    case ETM_CAN_ADDR_PULSE_SYNC_BOARD:
+    case ETM_CAN_ADDR_HV_LAMBDA_BOARD:
+    case ETM_CAN_ADDR_AFC_CONTROL_BOARD:
+      return 1;
+    }
+  return 0;
+}
+
+
+static void SimSlaveLogPulse(unsigned int pulse_count) {
+  switch (sim_slave_config.address)
+    {
+    case ETM_CAN_ADDR_MAGNETRON_CURRENT_BOARD:
+      ETMCanSlaveLogPulseData(ETM_CAN_DATA_LOG_REGISTER_MAGNETRON_MON_FAST_LOG_0, pulse_count, 1200, 1100, 0);
+      break;
+
+    case ETM_CAN_ADDR_PULSE_SYNC_BOARD:
+      ETMCanSlaveLogPulseData(ETM_CAN_DATA_LOG_REGISTER_PULSE_SYNC_FAST_LOG_0, pulse_count, 0x1010, 0x2020, 0x3030);
+      break;
+
+    case ETM_CAN_ADDR_HV_LAMBDA_BOARD:
+      ETMCanSlaveLogPulseData(ETM_CAN_DATA_LOG_REGISTER_HV_LAMBDA_FAST_LOG_0, pulse_count, 18000, 15000, 17950);
+      break;
+
+    case ETM_CAN_ADDR_AFC_CONTROL_BOARD:
+      ETMCanSlaveLogPulseData(ETM_CAN_DATA_LOG_REGISTER_AFC_FAST_LOG_0, pulse_count, 20000, 20010, 0);
+      ETMCanSlaveLogPulseData(ETM_CAN_DATA_LOG_REGISTER_AFC_FAST_LOG_1, pulse_count, 512, 498, 14);
+      break;
+    }
+}
+
+
+void SimAppMainLoop(unsigned long long time_ns) {
+  unsigned int n;
+
+  // Keep the logged values moving so that every log message carries new data
+  for (n = 0; n < 24; n++) {
+    slave_board_data.log_data[n] = (unsigned int)((time_ns >> 20) + n + sim_slave_config.seed) & 0xFFFF;
+  }
+
+  ETMCanSlaveDoCan();
+
+  if ((sim_slave_config.address == ETM_CAN_ADDR_PULSE_SYNC_BOARD) && sim_slave_config.prf_deci_hertz) {
+    if (time_ns >= sim_slave_next_pulse_ns) {
+      sim_slave_next_pulse_ns = time_ns + 10000000000ULL / sim_slave_config.prf_deci_hertz;
+      sim_slave_pulse_count++;
+      ETMCanSlavePulseSyncSendNextPulseLevel(sim_slave_pulse_count & 0x0001, sim_slave_pulse_count, sim_slave_config.prf_deci_hertz);
+      // The pulse sync board does not receive its own level message
+      sim_slave_pulse_log_pending = 1;
+      sim_slave_pulse_log_ns = time_ns + SIM_SLAVE_PULSE_LOG_DELAY_NS;
+      sim_slave_last_pulse_count = sim_slave_pulse_count;
+    }
+  } else if (ETMCanSlaveGetPulseCount() != sim_slave_last_pulse_count) {
+    sim_slave_last_pulse_count = ETMCanSlaveGetPulseCount();
+    sim_slave_pulse_log_pending = 1;
+    sim_slave_pulse_log_ns = time_ns + SIM_SLAVE_PULSE_LOG_DELAY_NS;
+  }
+
+  if (sim_slave_pulse_log_pending && (time_ns >= sim_slave_pulse_log_ns)) {
+    sim_slave_pulse_log_pending = 0;
+    if (SimSlaveIsFastLogBoard() && ETMCanSlaveGetSyncMsgHighSpeedLogging()) {
+      SimSlaveLogPulse(sim_slave_last_pulse_count);
+    }
+  }
+}
+
+
+static void SimAppReportBuffer(SimNodeBufferReport* report, const char* name, ETMCanBuffer* buffer_ptr) {
+  report->name = name;
+  report->write_count = buffer_ptr->message_write_count;
+  report->overwrite_count = buffer_ptr->message_overwrite_count;
+  report->rows_in_use = ETMCanBufferNotEmpty(buffer_ptr);
+  report->high_water = buffer_ptr->message_high_water;
+  report->depth = buffer_ptr->message_index_mask + 1;
+}
+
+
+static unsigned int SimAppAcceptedWrites(ETMCanBuffer* buffer_ptr) {
+  return buffer_ptr->message_write_count - buffer_ptr->message_overwrite_count;
+}
+
+
+void SimAppReport(SimNodeReportData* report) {
+  unsigned int n;
+
+  report->buffer_count = 5;
+  SimAppReportBuffer(&report->buffer[0], "rx_message", &etm_can_slave_rx_message_buffer);
+  SimAppReportBuffer(&report->buffer[1], "tx_level", &etm_can_slave_tx_pulse_level_buffer);
+  SimAppReportBuffer(&report->buffer[2], "tx_status", &etm_can_slave_tx_status_buffer);
+  SimAppReportBuffer(&report->buffer[3], "tx_message", &etm_can_slave_tx_message_buffer);
+  SimAppReportBuffer(&report->buffer[4], "tx_log", &etm_can_slave_tx_log_buffer);
+
+  report->tx_queue_write_count[SIM_TX_QUEUE_PULSE_LEVEL] = SimAppAcceptedWrites(&etm_can_slave_tx_pulse_level_buffer);
+  report->tx_queue_write_count[SIM_TX_QUEUE_STATUS_SYNC] = SimAppAcceptedWrites(&etm_can_slave_tx_status_buffer);
+  report->tx_queue_write_count[SIM_TX_QUEUE_CMD] = SimAppAcceptedWrites(&etm_can_slave_tx_message_buffer);
+  report->tx_queue_write_count[SIM_TX_QUEUE_LOG] = SimAppAcceptedWrites(&etm_can_slave_tx_log_buffer);
+
+  for (n = 0; n < SIM_CAN_TIMING_WORDS; n++) {
+    report->can_timing[n] = ((unsigned int*)&etm_can_slave_timing.data)[n];
+  }
+
+  report->can_timeout = etm_can_slave_debug_data.can_timeout;
+  report->can_unknown_msg_id = etm_can_slave_debug_data.can_unknown_msg_id;
+  report->can_invalid_index = etm_can_slave_debug_data.can_invalid_index;
+  report->can_address_error = etm_can_slave_debug_data.can_address_error;
+}
@@ -0,0 +1,37 @@
+#ifndef __P1395_CAN_SIM_TIMER_H
+#define __P1395_CAN_SIM_TIMER_H
+
+/*
+  Stand in for the XC16 peripheral library <timer.h> when building the host simulator.
+  Same AND-mask convention as the peripheral library, only the values used by the CAN library are defined.
+*/
+
+#define T4_ON                 0xFFFF
+#define T4_OFF                0x7FFF
+#define T4_IDLE_CON           0xDFFF
+#define T4_IDLE_STOP          0xFFFF
+#define T4_GATE_ON            0xFFFF
+#define T4_GATE_OFF           0xFFBF
+#define T4_PS_1_1             0xFFCF
+#define T4_PS_1_8             0xFFDF
+#define T4_PS_1_64            0xFFEF
+#define T4_PS_1_256           0xFFFF
+#define T4_32BIT_MODE_ON      0xFFFF
+#define T4_32BIT_MODE_OFF     0xFFF7
+#define T4_SOURCE_EXT         0xFFFF
+#define T4_SOURCE_INT         0xFFFD
+
+#define T5_ON                 0xFFFF
+#define T5_OFF                0x7FFF
+#define T5_IDLE_CON           0xDFFF
+#define T5_IDLE_STOP          0xFFFF
+#define T5_GATE_ON            0xFFFF
+#define T5_GATE_OFF           0xFFBF
+#define T5_PS_1_1             0xFFCF
+#define T5_PS_1_8             0xFFDF
+#define T5_PS_1_64            0xFFEF
+#define T5_PS_1_256           0xFFFF
+#define T5_SOURCE_EXT         0xFFFF
+#define T5_SOURCE_INT         0xFFFD
+
+#endif
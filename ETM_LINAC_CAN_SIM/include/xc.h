@@ -0,0 +1,213 @@
+#ifndef __P1395_CAN_SIM_XC_H
+#define __P1395_CAN_SIM_XC_H
+
+/*
+  Stand in for the XC16 <xc.h> when the CAN library is compiled for the host simulator.
+  Only the SFRs used by P1395_CAN_MASTER.c and P1395_CAN_SLAVE.c are modeled.
+  Every SFR is backed by a plain variable in P1395_CAN_SIM_NODE.c
+*/
+
+#include "P1395_CAN_SIM.h"
+
+
+// ------------------- CAN ------------------------ //
+
+extern SimCanPort sim_can_port[2];
+
+typedef struct {
+  unsigned RX0IE:1;
+  unsigned RX1IE:1;
+  unsigned TX0IE:1;
+  unsigned TX1IE:1;
+  unsigned TX2IE:1;
+  unsigned ERRIE:1;
+  unsigned WAKIE:1;
+  unsigned IVRIE:1;
+  unsigned :8;
+} SimCanINTEBits;
+
+typedef struct {
+  unsigned :5;
+  unsigned OPMODE:3;
+  unsigned REQOP:3;
+  unsigned CANCKS:1;
+  unsigned ABAT:1;
+  unsigned CANCAP:1;
+  unsigned CSIDL:1;
+  unsigned :1;
+} SimCanCTRLBits;
+
+volatile SimCanCTRLBits* SimCanCTRLBitsSync(unsigned int port);
+// The mode change is immediate in the model, OPMODE follows REQOP every time it is read
+
+
+#define C1TX0SID    sim_can_port[0].tx[0].sid
+#define C1TX0DLC    sim_can_port[0].tx[0].dlc
+#define C1TX0CON    sim_can_port[0].tx[0].con
+#define C1TX1SID    sim_can_port[0].tx[1].sid
+#define C1TX1DLC    sim_can_port[0].tx[1].dlc
+#define C1TX1CON    sim_can_port[0].tx[1].con
+#define C1TX2SID    sim_can_port[0].tx[2].sid
+#define C1TX2DLC    sim_can_port[0].tx[2].dlc
+#define C1TX2CON    sim_can_port[0].tx[2].con
+#define C1RX0CON    sim_can_port[0].rx[0].con
+#define C1RX1CON    sim_can_port[0].rx[1].con
+#define C1RXF0SID   sim_can_port[0].rxf_sid[0]
+#define C1RXF1SID   sim_can_port[0].rxf_sid[1]
+#define C1RXF2SID   sim_can_port[0].rxf_sid[2]
+#define C1RXF3SID   sim_can_port[0].rxf_sid[3]
+#define C1RXF4SID   sim_can_port[0].rxf_sid[4]
+#define C1RXF5SID   sim_can_port[0].rxf_sid[5]
+#define C1RXM0SID   sim_can_port[0].rxm_sid[0]
+#define C1RXM1SID   sim_can_port[0].rxm_sid[1]
+#define C1CTRL      sim_can_port[0].ctrl
+#define C1CFG1      sim_can_port[0].cfg1
+#define C1CFG2      sim_can_port[0].cfg2
+#define C1INTF      sim_can_port[0].intf
+#define C1INTE      sim_can_port[0].inte
+#define C1EC        sim_can_port[0].ec
+#define C1INTEbits  (*(volatile SimCanINTEBits*)&sim_can_port[0].inte)
+#define C1CTRLbits  (*SimCanCTRLBitsSync(0))
+#define _C1IE       sim_can_port[0].ie
+#define _C1IF       sim_can_port[0].flag
+#define _C1IP       sim_can_port[0].ip
+
+#define C2TX0SID    sim_can_port[1].tx[0].sid
+#define C2TX0DLC    sim_can_port[1].tx[0].dlc
+#define C2TX0CON    sim_can_port[1].tx[0].con
+#define C2TX1SID    sim_can_port[1].tx[1].sid
+#define C2TX1DLC    sim_can_port[1].tx[1].dlc
+#define C2TX1CON    sim_can_port[1].tx[1].con
+#define C2TX2SID    sim_can_port[1].tx[2].sid
+#define C2TX2DLC    sim_can_port[1].tx[2].dlc
+#define C2TX2CON    sim_can_port[1].tx[2].con
+#define C2RX0CON    sim_can_port[1].rx[0].con
+#define C2RX1CON    sim_can_port[1].rx[1].con
+#define C2RXF0SID   sim_can_port[1].rxf_sid[0]
+#define C2RXF1SID   sim_can_port[1].rxf_sid[1]
+#define C2RXF2SID   sim_can_port[1].rxf_sid[2]
+#define C2RXF3SID   sim_can_port[1].rxf_sid[3]
+#define C2RXF4SID   sim_can_port[1].rxf_sid[4]
+#define C2RXF5SID   sim_can_port[1].rxf_sid[5]
+#define C2RXM0SID   sim_can_port[1].rxm_sid[0]
+#define C2RXM1SID   sim_can_port[1].rxm_sid[1]
+#define C2CTRL      sim_can_port[1].ctrl
+#define C2CFG1      sim_can_port[1].cfg1
+#define C2CFG2      sim_can_port[1].cfg2
+#define C2INTF      sim_can_port[1].intf
+#define C2INTE      sim_can_port[1].inte
+#define C2EC        sim_can_port[1].ec
+#define C2INTEbits  (*(volatile SimCanINTEBits*)&sim_can_port[1].inte)
+#define C2CTRLbits  (*SimCanCTRLBitsSync(1))
+#define _C2IE       sim_can_port[1].ie
+#define _C2IF       sim_can_port[1].flag
+#define _C2IP       sim_can_port[1].ip
+
+
+// ------------------- TIMERS ------------------------ //
+
+typedef struct {
+  volatile unsigned int tmr;
+  volatile unsigned int pr;
+  volatile unsigned int con;
+  volatile unsigned int flag;
+  volatile unsigned int ie;
+  unsigned long long    last_update_ns;
+  unsigned long long    residue;
+} SimTimer;
+
+extern SimTimer sim_timer[6];
+
+typedef struct {
+  unsigned :1;
+  unsigned TCS:1;
+  unsigned TSYNC:1;
+  unsigned T32:1;
+  unsigned TCKPS:2;
+  unsigned TGATE:1;
+  unsigned :6;
+  unsigned TSIDL:1;
+  unsigned :1;
+  unsigned TON:1;
+} SimTimerCONBits;
+
+#define TMR1        sim_timer[1].tmr
+#define PR1         sim_timer[1].pr
+#define T1CON       sim_timer[1].con
+#define T1CONbits   (*(volatile SimTimerCONBits*)&sim_timer[1].con)
+#define _T1IF       sim_timer[1].flag
+#define _T1IE       sim_timer[1].ie
+
+#define TMR2        sim_timer[2].tmr
+#define PR2         sim_timer[2].pr
+#define T2CON       sim_timer[2].con
+#define T2CONbits   (*(volatile SimTimerCONBits*)&sim_timer[2].con)
+#define _T2IF       sim_timer[2].flag
+#define _T2IE       sim_timer[2].ie
+
+#define TMR3        sim_timer[3].tmr
+#define PR3         sim_timer[3].pr
+#define T3CON       sim_timer[3].con
+#define T3CONbits   (*(volatile SimTimerCONBits*)&sim_timer[3].con)
+#define _T3IF       sim_timer[3].flag
+#define _T3IE       sim_timer[3].ie
+
+#define TMR4        sim_timer[4].tmr
+#define PR4         sim_timer[4].pr
+#define T4CON       sim_timer[4].con
+#define T4CONbits   (*(volatile SimTimerCONBits*)&sim_timer[4].con)
+#define _T4IF       sim_timer[4].flag
+#define _T4IE       sim_timer[4].ie
+
+#define TMR5        sim_timer[5].tmr
+#define PR5         sim_timer[5].pr
+#define T5CON       sim_timer[5].con
+#define T5CONbits   (*(volatile SimTimerCONBits*)&sim_timer[5].con)
+#define _T5IF       sim_timer[5].flag
+#define _T5IE       sim_timer[5].ie
+
+
+// ------------------- RESET / SYSTEM ------------------------ //
+
+typedef struct {
+  volatile unsigned int rcon;
+  volatile unsigned int trapr;
+  volatile unsigned int iopuwr;
+  volatile unsigned int extr;
+  volatile unsigned int wdto;
+  volatile unsigned int sleep;
+  volatile unsigned int idle;
+  volatile unsigned int bor;
+  volatile unsigned int por;
+  volatile unsigned int swr;
+} SimSystemRegisters;
+
+extern SimSystemRegisters sim_system;
+
+#define RCON        sim_system.rcon
+#define _TRAPR      sim_system.trapr
+#define _IOPUWR     sim_system.iopuwr
+#define _EXTR       sim_system.extr
+#define _WDTO       sim_system.wdto
+#define _SLEEP      sim_system.sleep
+#define _IDLE       sim_system.idle
+#define _BOR        sim_system.bor
+#define _POR        sim_system.por
+#define _SWR        sim_system.swr
+
+void SimNodeClrWdt(void);
+void SimNodeReset(void);
+
+#define ClrWdt()    SimNodeClrWdt()
+#define Nop()
+
+
+/*
+  XC16 specific attributes (interrupt, persistent, space, ...) have no meaning on the host.
+  The only inline assembly used by the library is the "Reset" instruction.
+  These must be the last definitions in this file so they do not affect any system header.
+*/
+#define __attribute__(X)
+#define __asm__(X)  SimNodeReset()
+
+#endif